@@ -0,0 +1,363 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "libssh_cpp_wrap/command_execution_channel.hpp"
+#include "libssh_cpp_wrap/connection.hpp"
+#include "libssh_cpp_wrap/ip.hpp"
+#include "libssh_cpp_wrap/scp.hpp"
+#include "libssh_cpp_wrap/session.hpp"
+#include "libssh_cpp_wrap/session_options.hpp"
+#include "libssh_cpp_wrap/sftp_channel.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+#include "libssh_cpp_wrap_testing/wan_proxy.hpp"
+
+namespace
+{
+
+using namespace libssh_wrap;
+
+/**
+ * \brief the benchmark target; read from the environment, defaulting to an in-process test server
+ */
+struct BenchmarkTarget
+{
+    IpV4 m_ip{ 127, 0, 0, 1 };
+    int m_port{ 22 };
+    std::string m_user;
+    std::string m_password;
+    std::string m_remoteDirectory{ "/tmp" };
+};
+
+char const* GetEnvironment(char const* name, char const* defaultValue)
+{
+    char const* value = std::getenv(name);
+    return (value == nullptr) ? defaultValue : value;
+}
+
+testing::TestServerOptions InProcessServerOptions()
+{
+    testing::TestServerOptions options;
+    options.m_requestDelay = std::chrono::microseconds(std::atoll(GetEnvironment("LIBSSH_CPP_WRAP_BENCH_SERVER_DELAY_US", "0")));
+    options.m_bytesPerSecond = static_cast<size_t>(std::atoll(GetEnvironment("LIBSSH_CPP_WRAP_BENCH_SERVER_BYTES_PER_SECOND", "0")));
+    return options;
+}
+
+testing::TestServer& InProcessServer()
+{
+    static testing::TestServer server(InProcessServerOptions());
+    return server;
+}
+
+BenchmarkTarget const& Target()
+{
+    static BenchmarkTarget const target = []
+        {
+            BenchmarkTarget result;
+            if (std::getenv("LIBSSH_CPP_WRAP_BENCH_HOST") == nullptr)
+            {
+                auto& server = InProcessServer();
+                result.m_ip = server.Address();
+                result.m_port = server.Port();
+                result.m_user = server.Options().m_user;
+                result.m_password = server.Options().m_password;
+
+                auto const directory = std::filesystem::temp_directory_path() / "libssh_cpp_wrap_benchmark";
+                std::filesystem::create_directories(directory);
+                result.m_remoteDirectory = directory.string();
+                return result;
+            }
+            result.m_ip = IpV4(GetEnvironment("LIBSSH_CPP_WRAP_BENCH_HOST", "127.0.0.1"));
+            result.m_port = std::atoi(GetEnvironment("LIBSSH_CPP_WRAP_BENCH_PORT", "22"));
+            result.m_user = GetEnvironment("LIBSSH_CPP_WRAP_BENCH_USER", "");
+            result.m_password = GetEnvironment("LIBSSH_CPP_WRAP_BENCH_PASSWORD", "");
+            result.m_remoteDirectory = GetEnvironment("LIBSSH_CPP_WRAP_BENCH_DIR", "/tmp");
+            return result;
+        }();
+    return target;
+}
+
+/**
+ * \brief a way of reaching the target: directly or through a WanProxy emulating a link profile
+ */
+class Endpoint
+{
+public:
+    Endpoint(std::string name, IpV4 ip, int port)
+        : m_name(std::move(name)),
+        m_ip(ip),
+        m_port(port)
+    {
+    }
+
+    std::string const& Name() const noexcept
+    {
+        return m_name;
+    }
+
+    std::shared_ptr<AuthenticatedConnection> Connect() const
+    {
+        auto const& target = Target();
+
+        Session session = Session::Create();
+        session.SetOption(m_ip);
+        session.SetOption(Port{ m_port });
+        session.SetOption(UserName(target.m_user.c_str()));
+        return Connection(std::move(session)).Authenticate(target.m_password.c_str());
+    }
+
+    /**
+     * \brief the connection shared by all benchmarks not measuring the connection setup
+     */
+    std::shared_ptr<AuthenticatedConnection> const& SharedConnection()
+    {
+        if (!m_sharedConnection)
+        {
+            m_sharedConnection = Connect();
+        }
+        return m_sharedConnection;
+    }
+
+private:
+    std::string m_name;
+    IpV4 m_ip;
+    int m_port;
+    std::shared_ptr<AuthenticatedConnection> m_sharedConnection;
+};
+
+std::string RemotePath(char const* fileName)
+{
+    return Target().m_remoteDirectory + '/' + fileName;
+}
+
+std::string MakePayload(size_t size)
+{
+    std::string result(size, '\0');
+    for (size_t i = 0; i != size; ++i)
+    {
+        result[i] = static_cast<char>('a' + (i % 26));
+    }
+    return result;
+}
+
+void BM_ConnectAuthenticate(benchmark::State& state, Endpoint* endpoint)
+{
+    for (auto _ : state)
+    {
+        auto connection = endpoint->Connect();
+        benchmark::DoNotOptimize(connection);
+    }
+}
+
+void BM_ExecuteRoundTrip(benchmark::State& state, Endpoint* endpoint)
+{
+    auto const& connection = endpoint->SharedConnection();
+    for (auto _ : state)
+    {
+        std::ostringstream out;
+        std::ostringstream err;
+        ExecutionChannel(connection).Execute("true", out, err);
+    }
+}
+
+void BM_ExecuteOutput(benchmark::State& state, Endpoint* endpoint)
+{
+    auto const& connection = endpoint->SharedConnection();
+    std::string const command = "head -c " + std::to_string(state.range(0)) + " /dev/zero";
+    for (auto _ : state)
+    {
+        std::ostringstream out;
+        std::ostringstream err;
+        ExecutionChannel(connection).Execute<16384>(command.c_str(), out, err);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template<size_t bufferSize>
+void BM_SftpWrite(benchmark::State& state, Endpoint* endpoint)
+{
+    SftpChannel channel(endpoint->SharedConnection());
+    std::string const payload = MakePayload(static_cast<size_t>(state.range(0)));
+    std::string const path = RemotePath("libssh_cpp_wrap_bench_sftp");
+    for (auto _ : state)
+    {
+        std::istringstream in(payload);
+        channel.OpenFile(path.c_str(), 0644, FileAccessMode::WriteOnly).Write<bufferSize>(in);
+    }
+    channel.DeleteFile(path.c_str());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template<size_t bufferSize>
+void BM_SftpRead(benchmark::State& state, Endpoint* endpoint)
+{
+    SftpChannel channel(endpoint->SharedConnection());
+    std::string const path = RemotePath("libssh_cpp_wrap_bench_sftp");
+    {
+        std::istringstream in(MakePayload(static_cast<size_t>(state.range(0))));
+        channel.OpenFile(path.c_str(), 0644, FileAccessMode::WriteOnly).Write<65536>(in);
+    }
+    for (auto _ : state)
+    {
+        std::ostringstream out;
+        channel.OpenFile(path.c_str(), 0644, FileAccessMode::ReadOnly).Read<bufferSize>(out);
+    }
+    channel.DeleteFile(path.c_str());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template<size_t bufferSize>
+void BM_ScpWrite(benchmark::State& state, Endpoint* endpoint)
+{
+    auto const& connection = endpoint->SharedConnection();
+    std::string const payload = MakePayload(static_cast<size_t>(state.range(0)));
+    for (auto _ : state)
+    {
+        std::istringstream in(payload);
+        ScpSession scp(connection, Target().m_remoteDirectory.c_str(), ScpAccessMode::Write);
+        scp.WriteFile<bufferSize>("libssh_cpp_wrap_bench_scp", in, payload.size(), 0644);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template<size_t bufferSize>
+void BM_ScpRead(benchmark::State& state, Endpoint* endpoint)
+{
+    auto const& connection = endpoint->SharedConnection();
+    {
+        std::string const payload = MakePayload(static_cast<size_t>(state.range(0)));
+        std::istringstream in(payload);
+        ScpSession scp(connection, Target().m_remoteDirectory.c_str(), ScpAccessMode::Write);
+        scp.WriteFile<65536>("libssh_cpp_wrap_bench_scp", in, payload.size(), 0644);
+    }
+    std::string const path = RemotePath("libssh_cpp_wrap_bench_scp");
+    for (auto _ : state)
+    {
+        std::ostringstream out;
+        ScpSession scp(connection, path.c_str(), ScpAccessMode::Read);
+        scp.ReadFile<bufferSize>(out);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+/**
+ * \brief registers all benchmarks for \p endpoint; the benchmark names are suffixed with the endpoint name
+ */
+void RegisterBenchmarks(Endpoint& endpoint, int64_t maxSize)
+{
+    auto const name = [&endpoint](std::string_view benchmarkName)
+        {
+            return std::string(benchmarkName) + '/' + endpoint.Name();
+        };
+    auto const configure = [maxSize](benchmark::internal::Benchmark* benchmark, bool sized)
+        {
+            if (sized)
+            {
+                benchmark->RangeMultiplier(16)->Range(1 << 10, maxSize);
+            }
+            benchmark->Unit(benchmark::kMillisecond)->UseRealTime();
+        };
+
+    configure(benchmark::RegisterBenchmark(name("BM_ConnectAuthenticate").c_str(), &BM_ConnectAuthenticate, &endpoint), false);
+    configure(benchmark::RegisterBenchmark(name("BM_ExecuteRoundTrip").c_str(), &BM_ExecuteRoundTrip, &endpoint), false);
+    configure(benchmark::RegisterBenchmark(name("BM_ExecuteOutput").c_str(), &BM_ExecuteOutput, &endpoint), true);
+
+    configure(benchmark::RegisterBenchmark(name("BM_SftpWrite<1024>").c_str(), &BM_SftpWrite<1024>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_SftpWrite<16384>").c_str(), &BM_SftpWrite<16384>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_SftpWrite<65536>").c_str(), &BM_SftpWrite<65536>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_SftpRead<1024>").c_str(), &BM_SftpRead<1024>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_SftpRead<16384>").c_str(), &BM_SftpRead<16384>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_SftpRead<65536>").c_str(), &BM_SftpRead<65536>, &endpoint), true);
+
+    configure(benchmark::RegisterBenchmark(name("BM_ScpWrite<1024>").c_str(), &BM_ScpWrite<1024>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_ScpWrite<16384>").c_str(), &BM_ScpWrite<16384>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_ScpWrite<65536>").c_str(), &BM_ScpWrite<65536>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_ScpRead<1024>").c_str(), &BM_ScpRead<1024>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_ScpRead<16384>").c_str(), &BM_ScpRead<16384>, &endpoint), true);
+    configure(benchmark::RegisterBenchmark(name("BM_ScpRead<65536>").c_str(), &BM_ScpRead<65536>, &endpoint), true);
+}
+
+/**
+ * \return the link profiles selected via LIBSSH_CPP_WRAP_BENCH_PROFILES: "all" (default), "none" or a comma separated list of names
+ */
+std::vector<testing::LinkProfile> SelectedProfiles()
+{
+    std::string_view const selection = GetEnvironment("LIBSSH_CPP_WRAP_BENCH_PROFILES", "all");
+    if (selection == "all")
+    {
+        return testing::StandardLinkProfiles();
+    }
+
+    std::vector<testing::LinkProfile> result;
+    for (auto const& profile : testing::StandardLinkProfiles())
+    {
+        size_t pos = 0;
+        while (pos <= selection.size())
+        {
+            size_t const end = (std::min)(selection.find(',', pos), selection.size());
+            if (selection.substr(pos, end - pos) == profile.m_name)
+            {
+                result.push_back(profile);
+                break;
+            }
+            pos = end + 1;
+        }
+    }
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    auto const& target = Target();
+
+    Endpoint direct("direct", target.m_ip, target.m_port);
+    RegisterBenchmarks(direct, 1 << 24);
+
+    // proxies declared before the endpoints to outlive their connections
+    std::vector<std::unique_ptr<testing::WanProxy>> proxies;
+    std::vector<std::unique_ptr<Endpoint>> endpoints;
+    for (auto const& profile : SelectedProfiles())
+    {
+        auto& proxy = *proxies.emplace_back(std::make_unique<testing::WanProxy>(target.m_ip, target.m_port, profile));
+        auto& endpoint = *endpoints.emplace_back(std::make_unique<Endpoint>(profile.m_name, proxy.Address(), proxy.Port()));
+        RegisterBenchmarks(endpoint, 1 << 20);
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+}
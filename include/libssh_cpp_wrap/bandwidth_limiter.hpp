@@ -0,0 +1,409 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_BANDWIDTH_LIMITER
+#define LIBSSH_CPP_WRAP_BANDWIDTH_LIMITER
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <stop_token>
+#include <string>
+
+#include "libssh/libssh.h"
+
+#include "cancellation.hpp"
+#include "transfer_options.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief the figures of a single transfer
+     */
+    struct TransferStatistics
+    {
+        uint64_t m_bytes{ 0 };
+
+        /**
+         * \brief the time from the start to the end of the transfer
+         */
+        std::chrono::nanoseconds m_duration{ 0 };
+
+        /**
+         * \brief the part of m_duration spent waiting for the bandwidth limiter
+         */
+        std::chrono::nanoseconds m_throttled{ 0 };
+
+        /**
+         * \return the achieved rate in bytes per second
+         */
+        [[nodiscard]] double Rate() const noexcept
+        {
+            auto const seconds = std::chrono::duration<double>(m_duration).count();
+            return seconds > 0 ? static_cast<double>(m_bytes) / seconds : 0.0;
+        }
+    };
+
+    /**
+     * \brief Limits the rate of transfers globally, per site and per host
+     *
+     * Every limit is a token bucket; a transfer may send a chunk once all buckets that apply to its host have room for
+     * it. Chunks are granted in pieces of at most Quantum() bytes in the order they are requested, so transfers
+     * waiting for the same bucket take turns and share it evenly, regardless of their buffer sizes.
+     *
+     * Limits can be changed at any time and apply to the next chunk of running transfers.
+     */
+    class BandwidthLimiter
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * \brief a rate of 0 bytes per second disables a limit
+         */
+        static constexpr uint64_t Unlimited = 0;
+
+        /**
+         * \param quantum the maximum number of bytes granted at once; also the burst allowed by each bucket
+         */
+        explicit BandwidthLimiter(size_t quantum = 64 * 1024)
+            : m_quantum((std::max)(quantum, size_t(1)))
+        {
+        }
+
+        BandwidthLimiter(BandwidthLimiter const&) = delete;
+        BandwidthLimiter& operator=(BandwidthLimiter const&) = delete;
+
+        [[nodiscard]] size_t Quantum() const noexcept
+        {
+            return m_quantum;
+        }
+
+        void SetGlobalLimit(uint64_t bytesPerSecond)
+        {
+            std::lock_guard lock(m_mutex);
+            m_global.SetRate(bytesPerSecond);
+        }
+
+        void SetSiteLimit(std::string const& site, uint64_t bytesPerSecond)
+        {
+            std::lock_guard lock(m_mutex);
+            m_sites[site].SetRate(bytesPerSecond);
+        }
+
+        /**
+         * \param host the host name as passed to the connection
+         */
+        void SetHostLimit(std::string const& host, uint64_t bytesPerSecond)
+        {
+            std::lock_guard lock(m_mutex);
+            m_hosts[host].SetRate(bytesPerSecond);
+        }
+
+        /**
+         * \brief makes transfers to \p host count towards the limit of \p site; an empty site removes the assignment
+         */
+        void AssignSite(std::string const& host, std::string const& site)
+        {
+            std::lock_guard lock(m_mutex);
+            if (site.empty())
+            {
+                m_siteOfHost.erase(host);
+            }
+            else
+            {
+                m_siteOfHost[host] = site;
+            }
+        }
+
+        /**
+         * \brief the permission to transfer a number of bytes
+         */
+        struct Grant
+        {
+            size_t m_bytes;
+
+            /**
+             * \brief the time Acquire() blocked
+             */
+            Clock::duration m_throttled;
+        };
+
+        /**
+         * \brief blocks until up to \p wanted bytes may be transferred to or from \p host
+         *
+         * The wait ends early, once \p deadline passes or a stop is requested via \p stopToken; the bytes are
+         * returned to the buckets in that case.
+         *
+         * \return the granted amount, at least 1 byte and at most Quantum() bytes, unless no limit applies
+         *
+         * \exception OperationCancelled If the wait was ended by \p deadline or \p stopToken
+         */
+        Grant Acquire(std::string const& host, size_t wanted, Deadline deadline = NoDeadline, std::stop_token const& stopToken = {})
+        {
+            if (wanted == 0)
+            {
+                return { 0, Clock::duration::zero() };
+            }
+
+            std::unique_lock lock(m_mutex);
+            auto const buckets = BucketsOf(host);
+            if (std::none_of(buckets.begin(), buckets.end(), [](Bucket const* bucket) { return bucket != nullptr; }))
+            {
+                return { wanted, Clock::duration::zero() };
+            }
+            detail::CancellationGuard::ThrowCancelled(detail::CancellationGuard::Due(deadline, stopToken));
+            size_t const granted = (std::min)(wanted, m_quantum);
+
+            auto const now = Clock::now();
+            auto start = now;
+            for (auto bucket : buckets)
+            {
+                if (bucket != nullptr)
+                {
+                    start = (std::max)(start, bucket->EarliestStart(m_quantum));
+                }
+            }
+            // charging from now instead of the start keeps the buckets of other limits free of gaps, while one
+            // waits for its slowest limit
+            for (auto bucket : buckets)
+            {
+                if (bucket != nullptr)
+                {
+                    bucket->Charge(now, granted);
+                }
+            }
+
+            // the mutex is released while waiting; only a stop request notifies the condition
+            while (Clock::now() < start)
+            {
+                auto const reason = detail::CancellationGuard::Due(deadline, stopToken);
+                if (reason != detail::CancelReason::None)
+                {
+                    // the buckets may have changed meanwhile
+                    for (auto bucket : BucketsOf(host))
+                    {
+                        if (bucket != nullptr)
+                        {
+                            bucket->Refund(granted);
+                        }
+                    }
+                    detail::CancellationGuard::ThrowCancelled(reason);
+                }
+                m_wakeup.wait_until(lock, stopToken, (std::min)(start, deadline), [] { return false; });
+            }
+            return { granted, Clock::now() - now };
+        }
+
+        /**
+         * \brief returns \p unused bytes of a grant for \p host, e.g. if a read returned less data than requested
+         */
+        void Release(std::string const& host, size_t unused)
+        {
+            if (unused == 0)
+            {
+                return;
+            }
+            std::lock_guard lock(m_mutex);
+            for (auto bucket : BucketsOf(host))
+            {
+                if (bucket != nullptr)
+                {
+                    bucket->Refund(unused);
+                }
+            }
+        }
+
+        /**
+         * \return the limiter shared by the whole process
+         */
+        static BandwidthLimiter& Global()
+        {
+            static BandwidthLimiter limiter;
+            return limiter;
+        }
+
+    private:
+        /**
+         * \brief a token bucket stored as the time it's drained to the burst limit
+         */
+        class Bucket
+        {
+        public:
+            void SetRate(uint64_t bytesPerSecond)
+            {
+                m_rate = static_cast<double>(bytesPerSecond);
+                m_drained = Clock::now();
+            }
+
+            [[nodiscard]] bool Limited() const noexcept
+            {
+                return m_rate > 0;
+            }
+
+            [[nodiscard]] Clock::time_point EarliestStart(size_t burst) const
+            {
+                return m_drained - Duration(burst);
+            }
+
+            void Charge(Clock::time_point now, size_t bytes)
+            {
+                m_drained = (std::max)(m_drained, now) + Duration(bytes);
+            }
+
+            void Refund(size_t bytes)
+            {
+                m_drained = (std::max)(m_drained - Duration(bytes), Clock::now());
+            }
+
+        private:
+            [[nodiscard]] Clock::duration Duration(size_t bytes) const
+            {
+                return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(bytes) / m_rate));
+            }
+
+            double m_rate{ 0 };
+            Clock::time_point m_drained{ Clock::now() };
+        };
+
+        /**
+         * \return the limited buckets applying to \p host; nullptr for the others
+         */
+        std::array<Bucket*, 3> BucketsOf(std::string const& host)
+        {
+            std::array<Bucket*, 3> result{};
+            auto limited = [](Bucket* bucket) { return bucket->Limited() ? bucket : nullptr; };
+
+            result[0] = limited(&m_global);
+            if (auto const hostPos = m_hosts.find(host); hostPos != m_hosts.end())
+            {
+                result[1] = limited(&hostPos->second);
+            }
+            if (auto const sitePos = m_siteOfHost.find(host); sitePos != m_siteOfHost.end())
+            {
+                if (auto const bucketPos = m_sites.find(sitePos->second); bucketPos != m_sites.end())
+                {
+                    result[2] = limited(&bucketPos->second);
+                }
+            }
+            return result;
+        }
+
+        size_t const m_quantum;
+
+        std::mutex m_mutex;
+        std::condition_variable_any m_wakeup;
+        Bucket m_global;
+        std::map<std::string, Bucket, std::less<>> m_sites;
+        std::map<std::string, Bucket, std::less<>> m_hosts;
+        std::map<std::string, std::string, std::less<>> m_siteOfHost;
+    };
+
+    namespace detail
+    {
+
+        /**
+         * \brief applies the bandwidth limiter and the statistics of TransferOptions to a transfer loop
+         */
+        class ThrottledTransfer
+        {
+        public:
+            ThrottledTransfer(TransferOptions const& options, ssh_session session)
+                : m_limiter(options.m_bandwidthLimiter),
+                m_statistics(options.m_statistics),
+                m_deadline(options.m_deadline),
+                m_stopToken(options.m_stopToken),
+                m_start(BandwidthLimiter::Clock::now())
+            {
+                if (m_limiter != nullptr)
+                {
+                    char* host = nullptr;
+                    if (ssh_options_get(session, SSH_OPTIONS_HOST, &host) == SSH_OK && host != nullptr)
+                    {
+                        m_host = host;
+                        ssh_string_free_char(host);
+                    }
+                }
+            }
+
+            ThrottledTransfer(ThrottledTransfer const&) = delete;
+            ThrottledTransfer& operator=(ThrottledTransfer const&) = delete;
+
+            ~ThrottledTransfer()
+            {
+                if (m_statistics != nullptr)
+                {
+                    m_statistics->m_duration += BandwidthLimiter::Clock::now() - m_start;
+                }
+            }
+
+            /**
+             * \return the number of bytes that may be transferred next, at most \p wanted
+             *
+             * \exception OperationCancelled If the deadline or a stop request of the transfer ended the wait
+             */
+            size_t Acquire(size_t wanted)
+            {
+                if (m_limiter == nullptr)
+                {
+                    return wanted;
+                }
+                auto const grant = m_limiter->Acquire(m_host, wanted, m_deadline, m_stopToken);
+                if (m_statistics != nullptr)
+                {
+                    m_statistics->m_throttled += grant.m_throttled;
+                }
+                return grant.m_bytes;
+            }
+
+            /**
+             * \brief records the transfer of \p transferred of \p acquired bytes
+             */
+            void Transferred(size_t acquired, size_t transferred)
+            {
+                if (m_statistics != nullptr)
+                {
+                    m_statistics->m_bytes += transferred;
+                }
+                if (m_limiter != nullptr && transferred < acquired)
+                {
+                    m_limiter->Release(m_host, acquired - transferred);
+                }
+            }
+
+        private:
+            BandwidthLimiter* m_limiter;
+            TransferStatistics* m_statistics;
+            Deadline m_deadline;
+            std::stop_token m_stopToken;
+            BandwidthLimiter::Clock::time_point m_start;
+            std::string m_host;
+        };
+
+    }
+
+}
+
+#endif
@@ -0,0 +1,219 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_BUFFER_POOL
+#define LIBSSH_CPP_WRAP_BUFFER_POOL
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace libssh_wrap
+{
+
+    class BufferPool;
+
+    /**
+     * \brief a buffer borrowed from a BufferPool; returned to the pool on destruction
+     */
+    class PooledBuffer
+    {
+    public:
+        PooledBuffer() noexcept = default;
+
+        PooledBuffer(PooledBuffer&& other) noexcept
+            : m_pool(std::exchange(other.m_pool, nullptr)),
+            m_data(std::exchange(other.m_data, nullptr))
+        {
+        }
+
+        PooledBuffer& operator=(PooledBuffer&& other) noexcept
+        {
+            std::swap(m_pool, other.m_pool);
+            std::swap(m_data, other.m_data);
+            return *this;
+        }
+
+        ~PooledBuffer() noexcept;
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return m_data != nullptr;
+        }
+
+        [[nodiscard]] char* data() const noexcept
+        {
+            return m_data;
+        }
+
+        [[nodiscard]] size_t size() const noexcept;
+
+        [[nodiscard]] std::span<char> Span() const noexcept
+        {
+            return { data(), size() };
+        }
+
+    private:
+        friend class BufferPool;
+
+        PooledBuffer(BufferPool* pool, char* data) noexcept
+            : m_pool(pool),
+            m_data(data)
+        {
+        }
+
+        BufferPool* m_pool{ nullptr };
+        char* m_data{ nullptr };
+    };
+
+    /**
+     * \brief A pool of page aligned transfer buffers of equal size
+     *
+     * Returned buffers are kept for reuse, so transfers don't allocate once the pool is warm. The free lists are
+     * sharded by thread to keep lock contention low with many concurrent transfers. All buffers need to be returned
+     * before the pool is destroyed.
+     */
+    class BufferPool
+    {
+    public:
+        static constexpr size_t PageSize = 4096;
+
+        /**
+         * \param chunkSize the size of the buffers; rounded up to a multiple of the page size
+         * \param maxCached the maximum number of unused buffers kept
+         */
+        explicit BufferPool(size_t chunkSize = 256 * 1024, size_t maxCached = 256)
+            : m_chunkSize(((chunkSize + PageSize - 1) / PageSize) * PageSize),
+            m_maxCachedPerShard((maxCached + ShardCount - 1) / ShardCount)
+        {
+            for (auto& shard : m_shards)
+            {
+                shard.m_free.reserve(m_maxCachedPerShard);
+            }
+        }
+
+        BufferPool(BufferPool const&) = delete;
+        BufferPool& operator=(BufferPool const&) = delete;
+
+        ~BufferPool() noexcept
+        {
+            for (auto& shard : m_shards)
+            {
+                for (auto buffer : shard.m_free)
+                {
+                    Free(buffer);
+                }
+            }
+        }
+
+        [[nodiscard]] size_t ChunkSize() const noexcept
+        {
+            return m_chunkSize;
+        }
+
+        /**
+         * \return a buffer of ChunkSize() bytes
+         */
+        [[nodiscard]] PooledBuffer Acquire()
+        {
+            auto& shard = CurrentShard();
+            {
+                std::lock_guard lock(shard.m_mutex);
+                if (!shard.m_free.empty())
+                {
+                    char* buffer = shard.m_free.back();
+                    shard.m_free.pop_back();
+                    return PooledBuffer(this, buffer);
+                }
+            }
+            return PooledBuffer(this, static_cast<char*>(::operator new(m_chunkSize, std::align_val_t(PageSize))));
+        }
+
+        /**
+         * \return the pool shared by the whole process
+         */
+        static BufferPool& Default()
+        {
+            static BufferPool pool;
+            return pool;
+        }
+
+    private:
+        friend class PooledBuffer;
+
+        static constexpr size_t ShardCount = 8;
+
+        struct Shard
+        {
+            std::mutex m_mutex;
+            std::vector<char*> m_free;
+        };
+
+        Shard& CurrentShard() noexcept
+        {
+            static thread_local size_t const shardIndex = std::hash<std::thread::id>{}(std::this_thread::get_id()) % ShardCount;
+            return m_shards[shardIndex];
+        }
+
+        void Release(char* buffer) noexcept
+        {
+            auto& shard = CurrentShard();
+            {
+                std::lock_guard lock(shard.m_mutex);
+                if (shard.m_free.size() < m_maxCachedPerShard)
+                {
+                    shard.m_free.push_back(buffer);
+                    return;
+                }
+            }
+            Free(buffer);
+        }
+
+        void Free(char* buffer) noexcept
+        {
+            ::operator delete(buffer, m_chunkSize, std::align_val_t(PageSize));
+        }
+
+        size_t m_chunkSize;
+        size_t m_maxCachedPerShard;
+        std::array<Shard, ShardCount> m_shards;
+    };
+
+    inline PooledBuffer::~PooledBuffer() noexcept
+    {
+        if (m_data != nullptr)
+        {
+            m_pool->Release(m_data);
+        }
+    }
+
+    inline size_t PooledBuffer::size() const noexcept
+    {
+        return m_pool == nullptr ? 0 : m_pool->ChunkSize();
+    }
+
+}
+
+#endif
@@ -0,0 +1,384 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_CANCELLATION
+#define LIBSSH_CPP_WRAP_CANCELLATION
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+
+#include "libssh/libssh.h"
+
+#include "socket.hpp"
+#include "transfer_options.hpp"
+
+namespace libssh_wrap
+{
+
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    constexpr Deadline NoDeadline = Deadline::max();
+
+    /**
+     * \brief thrown by operations aborted because of their deadline or a stop request
+     */
+    class OperationCancelled : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    class AuthenticatedConnection;
+
+    namespace detail
+    {
+
+        enum class CancelReason
+        {
+            None,
+            Deadline,
+            StopRequested,
+        };
+
+        struct CancellationTarget;
+
+        struct WatchdogEntry
+        {
+            CancellationTarget* m_target;
+            CancelReason m_reason;
+        };
+
+        using WatchdogQueue = std::multimap<std::chrono::steady_clock::time_point, WatchdogEntry>;
+
+        /**
+         * \brief the session a CancellationGuard aborts
+         */
+        struct CancellationTarget
+        {
+            ssh_session m_session;
+            std::atomic<CancelReason> m_reason{ CancelReason::None };
+
+            /**
+             * \brief the scheduled abort; guarded by the mutex of the Watchdog
+             */
+            std::optional<WatchdogQueue::iterator> m_entry{};
+        };
+
+        /**
+         * \brief A thread aborting the blocking operations of sessions once they are due
+         *
+         * libssh offers no way to interrupt a blocking call, so the socket of the session is shut down; the call then
+         * fails like on a lost connection.
+         */
+        class Watchdog
+        {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            Watchdog()
+                : m_thread([this] { Run(); })
+            {
+            }
+
+            ~Watchdog()
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_stop = true;
+                }
+                m_changed.notify_all();
+                m_thread.join();
+            }
+
+            /**
+             * \brief (re)schedules aborting \p target at \p time
+             */
+            void Schedule(CancellationTarget& target, Clock::time_point time, CancelReason reason)
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    EraseEntry(target);
+                    target.m_entry = m_entries.emplace(time, WatchdogEntry{ &target, reason });
+                }
+                m_changed.notify_all();
+            }
+
+            /**
+             * \brief cancels the scheduled abort of \p target; \p target isn't accessed after this returns
+             */
+            void Remove(CancellationTarget& target)
+            {
+                std::lock_guard lock(m_mutex);
+                EraseEntry(target);
+            }
+
+            static Watchdog& Instance()
+            {
+                static Watchdog watchdog;
+                return watchdog;
+            }
+
+        private:
+            void EraseEntry(CancellationTarget& target)
+            {
+                if (target.m_entry.has_value())
+                {
+                    m_entries.erase(*target.m_entry);
+                    target.m_entry.reset();
+                }
+            }
+
+            void Run()
+            {
+                std::unique_lock lock(m_mutex);
+                while (!m_stop)
+                {
+                    if (m_entries.empty())
+                    {
+                        m_changed.wait(lock);
+                        continue;
+                    }
+                    auto const first = m_entries.begin();
+                    auto const now = Clock::now();
+                    if (first->first > now)
+                    {
+                        m_changed.wait_until(lock, first->first);
+                        continue;
+                    }
+
+                    auto const entry = first->second;
+                    m_entries.erase(first);
+                    entry.m_target->m_entry.reset();
+
+                    auto const socket = ssh_get_fd(entry.m_target->m_session);
+                    if (socket == SSH_INVALID_SOCKET)
+                    {
+                        // the session is still resolving or creating its socket
+                        entry.m_target->m_entry = m_entries.emplace(now + std::chrono::milliseconds(10), entry);
+                        continue;
+                    }
+                    entry.m_target->m_reason = entry.m_reason;
+                    ShutdownBoth(socket);
+                }
+            }
+
+            std::mutex m_mutex;
+            std::condition_variable m_changed;
+            WatchdogQueue m_entries;
+            bool m_stop{ false };
+            std::thread m_thread;
+        };
+
+        /**
+         * \brief aborts the blocking operations of a session while it exists, once \p deadline passes or a stop is
+         *        requested via \p stopToken
+         */
+        class CancellationGuard
+        {
+        public:
+            /**
+             * \exception OperationCancelled If the deadline already passed or a stop was already requested
+             */
+            CancellationGuard(ssh_session session, Deadline deadline, std::stop_token const& stopToken)
+                : CancellationGuard(session, CheckNotDue(deadline, stopToken), stopToken, NoPrecheck{})
+            {
+            }
+
+            struct NoPrecheck {};
+
+            /**
+             * \brief a guard aborting the session right away, if the deadline already passed or a stop was already
+             *        requested
+             */
+            CancellationGuard(ssh_session session, Deadline deadline, std::stop_token const& stopToken, NoPrecheck)
+                : m_target{ session }
+            {
+                if (deadline != NoDeadline)
+                {
+                    Watchdog::Instance().Schedule(m_target, deadline, CancelReason::Deadline);
+                    m_scheduled = true;
+                }
+                if (stopToken.stop_possible())
+                {
+                    m_scheduled = true;
+                    m_stopCallback.emplace(stopToken, StopHandler{ &m_target });
+                }
+            }
+
+            CancellationGuard(CancellationGuard const&) = delete;
+            CancellationGuard& operator=(CancellationGuard const&) = delete;
+
+            ~CancellationGuard()
+            {
+                m_stopCallback.reset(); // waits for a running callback
+                if (m_scheduled)
+                {
+                    Watchdog::Instance().Remove(m_target);
+                }
+            }
+
+            [[nodiscard]] bool Cancelled() const noexcept
+            {
+                return m_target.m_reason != CancelReason::None;
+            }
+
+            [[nodiscard]] CancelReason Reason() const noexcept
+            {
+                return m_target.m_reason;
+            }
+
+            void ThrowIfCancelled() const
+            {
+                ThrowCancelled(m_target.m_reason);
+            }
+
+            /**
+             * \return the reason an operation with \p deadline and \p stopToken is cancelled before it starts
+             */
+            [[nodiscard]] static CancelReason Due(Deadline deadline, std::stop_token const& stopToken) noexcept
+            {
+                if (stopToken.stop_requested())
+                {
+                    return CancelReason::StopRequested;
+                }
+                if (deadline != NoDeadline && deadline <= Watchdog::Clock::now())
+                {
+                    return CancelReason::Deadline;
+                }
+                return CancelReason::None;
+            }
+
+            /**
+             * \exception OperationCancelled If \p reason isn't CancelReason::None
+             */
+            static void ThrowCancelled(CancelReason reason)
+            {
+                switch (reason)
+                {
+                case CancelReason::None:
+                    return;
+                case CancelReason::Deadline:
+                    throw OperationCancelled("deadline exceeded");
+                case CancelReason::StopRequested:
+                    throw OperationCancelled("operation cancelled");
+                }
+            }
+
+        private:
+            static Deadline CheckNotDue(Deadline deadline, std::stop_token const& stopToken)
+            {
+                ThrowCancelled(Due(deadline, stopToken));
+                return deadline;
+            }
+
+            struct StopHandler
+            {
+                CancellationTarget* m_target;
+
+                void operator()() const
+                {
+                    Watchdog::Instance().Schedule(*m_target, Watchdog::Clock::now(), CancelReason::StopRequested);
+                }
+            };
+
+            CancellationTarget m_target;
+            bool m_scheduled{ false };
+            std::optional<std::stop_callback<StopHandler>> m_stopCallback;
+        };
+
+        /**
+         * \brief runs \p function, aborting it via a CancellationGuard; errors caused by the abort are reported as
+         *        OperationCancelled
+         */
+        template<class F>
+        decltype(auto) WithCancellation(ssh_session session, Deadline deadline, std::stop_token const& stopToken, F&& function)
+        {
+            if (deadline == NoDeadline && !stopToken.stop_possible())
+            {
+                return std::forward<F>(function)();
+            }
+
+            CancellationGuard guard(session, deadline, stopToken);
+            try
+            {
+                return std::forward<F>(function)();
+            }
+            catch (std::runtime_error const&)
+            {
+                guard.ThrowIfCancelled();
+                throw;
+            }
+        }
+
+        template<class F>
+        decltype(auto) WithCancellation(ssh_session session, TransferOptions const& options, F&& function)
+        {
+            return WithCancellation(session, options.m_deadline, options.m_stopToken, std::forward<F>(function));
+        }
+
+    }
+
+    /**
+     * \brief Aborts any blocking operation on a connection while the scope exists, once the deadline passes or a stop
+     *        is requested
+     *
+     * Covers the operations without a deadline parameter, e.g. SftpChannel::OpenFile or SftpChannel::MakeDirectory.
+     * Aborting shuts down the socket of the connection: the pending operation fails immediately and releases its
+     * buffers and thread, but the connection and all its channels are unusable afterwards. Use ThrowIfCancelled() in
+     * an exception handler to distinguish an abort from other errors.
+     */
+    class CancellationScope
+    {
+    public:
+        CancellationScope(std::shared_ptr<AuthenticatedConnection> const& connection, Deadline deadline, std::stop_token const& stopToken = {});
+
+        CancellationScope(std::shared_ptr<AuthenticatedConnection> const& connection, std::chrono::steady_clock::duration timeout, std::stop_token const& stopToken = {})
+            : CancellationScope(connection, std::chrono::steady_clock::now() + timeout, stopToken)
+        {
+        }
+
+        [[nodiscard]] bool Cancelled() const noexcept
+        {
+            return m_guard.Cancelled();
+        }
+
+        /**
+         * \exception OperationCancelled If the scope aborted the connection
+         */
+        void ThrowIfCancelled() const
+        {
+            m_guard.ThrowIfCancelled();
+        }
+
+    private:
+        detail::CancellationGuard m_guard;
+    };
+
+}
+
+#endif
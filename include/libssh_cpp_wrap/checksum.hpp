@@ -0,0 +1,328 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_CHECKSUM
+#define LIBSSH_CPP_WRAP_CHECKSUM
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "openssl/evp.h"
+
+#include "sftp_extensions.hpp"
+
+namespace libssh_wrap
+{
+
+    using Sha256Digest = std::array<uint8_t, 32>;
+
+    /**
+     * \return \p digest as lower case hex digits, as printed by sha256sum
+     */
+    inline std::string ToHex(Sha256Digest const& digest)
+    {
+        constexpr char digits[] = "0123456789abcdef";
+        std::string result;
+        result.reserve(digest.size() * 2);
+        for (auto byte : digest)
+        {
+            result += digits[byte >> 4];
+            result += digits[byte & 0xf];
+        }
+        return result;
+    }
+
+    /**
+     * \brief incremental sha-256 via the EVP interface of OpenSSL, which selects the SHA extensions or AVX2 code of
+     *        the cpu at runtime
+     */
+    class Sha256
+    {
+    public:
+        Sha256()
+            : m_context(EVP_MD_CTX_new())
+        {
+            if (!m_context || EVP_DigestInit_ex(m_context.get(), EVP_sha256(), nullptr) != 1)
+            {
+                throw std::runtime_error("error initializing sha-256");
+            }
+        }
+
+        void Update(void const* data, size_t size)
+        {
+            if (EVP_DigestUpdate(m_context.get(), data, size) != 1)
+            {
+                throw std::runtime_error("error updating sha-256");
+            }
+        }
+
+        Sha256Digest Finish()
+        {
+            Sha256Digest digest;
+            unsigned int size = 0;
+            if (EVP_DigestFinal_ex(m_context.get(), digest.data(), &size) != 1 || size != digest.size())
+            {
+                throw std::runtime_error("error finishing sha-256");
+            }
+            return digest;
+        }
+
+    private:
+        struct ContextDeleter
+        {
+            void operator()(EVP_MD_CTX* context) const noexcept
+            {
+                EVP_MD_CTX_free(context);
+            }
+        };
+
+        std::unique_ptr<EVP_MD_CTX, ContextDeleter> m_context;
+    };
+
+    /**
+     * \brief Computes the sha-256 of the bytes of a transfer while it's running
+     *
+     * Pass it via TransferOptions::m_checksum to FileStream::Read/Write or ScpSession::ReadFile/WriteFile. The data is
+     * copied into a queue of up to MaxQueuedBytes and hashed on a thread of its own, so the transfer loop only pays for
+     * the copy; once the last byte is transferred there's at most the queue left to hash. A transfer resuming at an
+     * offset only hashes the part it transferred.
+     */
+    class TransferChecksum
+    {
+    public:
+        static constexpr size_t ChunkSize = 256 * 1024;
+        static constexpr size_t MaxQueuedBytes = 8 * ChunkSize;
+
+        /**
+         * \param pipelined false to hash in the calling thread instead
+         */
+        explicit TransferChecksum(bool pipelined = true)
+            : m_pipelined(pipelined)
+        {
+        }
+
+        TransferChecksum(TransferChecksum const&) = delete;
+        TransferChecksum& operator=(TransferChecksum const&) = delete;
+
+        ~TransferChecksum()
+        {
+            StopWorker();
+        }
+
+        void Update(char const* data, size_t size)
+        {
+            if (m_digest.has_value())
+            {
+                throw std::runtime_error("checksum already finished");
+            }
+            if (size == 0)
+            {
+                return;
+            }
+            if (!m_pipelined)
+            {
+                m_hash.Update(data, size);
+                return;
+            }
+
+            std::unique_lock lock(m_mutex);
+            if (m_error)
+            {
+                std::rethrow_exception(m_error);
+            }
+            if (!m_worker.joinable())
+            {
+                m_worker = std::thread([this] { Work(); });
+            }
+
+            // small writes are appended to the last chunk the worker hasn't taken yet
+            if (!m_queue.empty() && m_queue.back().size() + size <= ChunkSize)
+            {
+                m_queue.back().insert(m_queue.back().end(), data, data + size);
+                m_queuedBytes += size;
+                return;
+            }
+
+            m_changed.wait(lock, [this] { return m_queuedBytes < MaxQueuedBytes; });
+            std::vector<char> chunk;
+            if (!m_free.empty())
+            {
+                chunk = std::move(m_free.back());
+                m_free.pop_back();
+            }
+            chunk.assign(data, data + size);
+            m_queue.push_back(std::move(chunk));
+            m_queuedBytes += size;
+            m_changed.notify_all();
+        }
+
+        /**
+         * \brief waits for the queued data to be hashed
+         *
+         * \return the hash of all data passed to Update; no more data may be added afterwards
+         */
+        Sha256Digest const& Digest()
+        {
+            if (!m_digest.has_value())
+            {
+                StopWorker();
+                if (m_error)
+                {
+                    std::rethrow_exception(m_error);
+                }
+                m_digest = m_hash.Finish();
+            }
+            return *m_digest;
+        }
+
+    private:
+        void Work()
+        {
+            std::unique_lock lock(m_mutex);
+            while (true)
+            {
+                m_changed.wait(lock, [this] { return !m_queue.empty() || m_stop; });
+                if (m_queue.empty())
+                {
+                    return;
+                }
+                auto chunk = std::move(m_queue.front());
+                m_queue.pop_front();
+                lock.unlock();
+
+                try
+                {
+                    m_hash.Update(chunk.data(), chunk.size());
+                }
+                catch (...)
+                {
+                    lock.lock();
+                    m_error = std::current_exception();
+                    m_queue.clear();
+                    m_queuedBytes = 0;
+                    m_changed.notify_all();
+                    return;
+                }
+
+                lock.lock();
+                m_queuedBytes -= chunk.size();
+                if (m_free.size() < 2)
+                {
+                    m_free.push_back(std::move(chunk));
+                }
+                m_changed.notify_all();
+            }
+        }
+
+        void StopWorker() noexcept
+        {
+            if (m_worker.joinable())
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_stop = true;
+                }
+                m_changed.notify_all();
+                m_worker.join();
+            }
+        }
+
+        bool m_pipelined;
+        Sha256 m_hash;
+        std::optional<Sha256Digest> m_digest;
+
+        std::mutex m_mutex;
+        std::condition_variable m_changed;
+        std::deque<std::vector<char>> m_queue;
+        std::vector<std::vector<char>> m_free;
+        size_t m_queuedBytes{ 0 };
+        bool m_stop{ false };
+        std::exception_ptr m_error;
+        std::thread m_worker;
+    };
+
+    namespace detail
+    {
+
+        /**
+         * \brief the command printing the sha-256 of \p path; tries the coreutils and the perl tool
+         */
+        inline std::string RemoteSha256Command(std::string_view path)
+        {
+            auto const quoted = ShellQuote(path);
+            return "sha256sum -b -- " + quoted + " 2>/dev/null || shasum -a 256 -b -- " + quoted;
+        }
+
+        /**
+         * \brief parses the first word of the output of RemoteSha256Command()
+         */
+        inline Sha256Digest ParseSha256Output(std::string_view output)
+        {
+            auto hexValue = [](char c) -> int
+                {
+                    if (c >= '0' && c <= '9') return c - '0';
+                    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+                    return -1;
+                };
+
+            Sha256Digest digest;
+            if (output.size() < digest.size() * 2)
+            {
+                throw std::runtime_error("unexpected output of the remote checksum command");
+            }
+            for (size_t i = 0; i != digest.size(); ++i)
+            {
+                int const high = hexValue(output[2 * i]);
+                int const low = hexValue(output[2 * i + 1]);
+                if (high < 0 || low < 0)
+                {
+                    throw std::runtime_error("unexpected output of the remote checksum command");
+                }
+                digest[i] = static_cast<uint8_t>((high << 4) | low);
+            }
+            return digest;
+        }
+
+        inline void CompareChecksums(Sha256Digest const& local, Sha256Digest const& remote, std::string_view path)
+        {
+            if (local != remote)
+            {
+                throw std::runtime_error("checksum mismatch for " + std::string(path) + ": transferred " + ToHex(local)
+                    + ", remote " + ToHex(remote));
+            }
+        }
+
+    }
+
+}
+
+#endif
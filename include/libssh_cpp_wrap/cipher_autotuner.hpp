@@ -0,0 +1,235 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_CIPHER_AUTOTUNER
+#define LIBSSH_CPP_WRAP_CIPHER_AUTOTUNER
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+#include "command_execution_channel.hpp"
+#include "connection.hpp"
+#include "session.hpp"
+#include "session_options.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \return true, if the cpu provides AES instructions (AES-NI on x86, the crypto extension on ARM)
+     */
+    inline bool CpuHasAesAcceleration() noexcept
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 25)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        return __builtin_cpu_supports("aes");
+#elif defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * \return the suites worth measuring on this cpu, most promising first
+     */
+    inline std::vector<CipherSuite> DefaultCipherCandidates()
+    {
+        std::vector<CipherSuite> result;
+        if (CpuHasAesAcceleration())
+        {
+            result.push_back({ "aes128-gcm@openssh.com", "" });
+            result.push_back({ "aes256-gcm@openssh.com", "" });
+            result.push_back({ "chacha20-poly1305@openssh.com", "" });
+            result.push_back({ "aes128-ctr", "hmac-sha2-256-etm@openssh.com" });
+        }
+        else
+        {
+            result.push_back({ "chacha20-poly1305@openssh.com", "" });
+            result.push_back({ "aes128-ctr", "hmac-sha2-256-etm@openssh.com" });
+        }
+        return result;
+    }
+
+    /**
+     * \brief measures the throughput of cipher suites per host and remembers the fastest one
+     *
+     * The measurement transfers data from the server via `head -c <n> /dev/zero`, so the server needs to provide
+     * a posix shell. Suites rejected by the server are skipped.
+     */
+    class CipherAutotuner
+    {
+    public:
+        /**
+         * \brief creates a session with all options except for the cipher suite set
+         */
+        using SessionFactory = std::function<Session()>;
+
+        using Authenticator = std::function<std::shared_ptr<AuthenticatedConnection>(Connection&&)>;
+
+        struct Measurement
+        {
+            CipherSuite m_suite;
+            double m_bytesPerSecond;
+        };
+
+        explicit CipherAutotuner(std::vector<CipherSuite> candidates = DefaultCipherCandidates(), size_t probeSize = 16 * 1024 * 1024)
+            : m_candidates(std::move(candidates)),
+            m_probeSize(probeSize)
+        {
+        }
+
+        /**
+         * \return the fastest suite for \p host, measuring the candidates, if there's no cached result
+         *
+         * \param host the cache key, e.g. "<address>:<port>"
+         */
+        std::optional<CipherSuite> Tune(std::string const& host, SessionFactory const& sessionFactory, Authenticator const& authenticator)
+        {
+            if (auto cached = Lookup(host))
+            {
+                return cached;
+            }
+
+            std::optional<Measurement> best;
+            for (auto const& candidate : m_candidates)
+            {
+                auto measurement = Measure(candidate, sessionFactory, authenticator);
+                if (measurement && (!best || measurement->m_bytesPerSecond > best->m_bytesPerSecond))
+                {
+                    best = std::move(measurement);
+                }
+            }
+
+            if (!best)
+            {
+                return std::nullopt;
+            }
+
+            std::unique_lock lock(m_mutex);
+            return m_cache.insert_or_assign(host, std::move(best->m_suite)).first->second;
+        }
+
+        /**
+         * \brief measures the throughput for a single suite
+         *
+         * \return an empty optional, if the server doesn't accept the suite or the probe command fails
+         */
+        std::optional<Measurement> Measure(CipherSuite const& suite, SessionFactory const& sessionFactory, Authenticator const& authenticator) const
+        {
+            std::shared_ptr<AuthenticatedConnection> connection;
+            try
+            {
+                Session session = sessionFactory();
+                session.SetOption(suite);
+                connection = authenticator(Connection(std::move(session)));
+            }
+            catch (std::runtime_error const&)
+            {
+                return std::nullopt;
+            }
+
+            std::string const command = "head -c " + std::to_string(m_probeSize) + " /dev/zero";
+            std::ostream discard(nullptr);
+            std::ostream errors(nullptr);
+
+            auto const begin = std::chrono::steady_clock::now();
+            try
+            {
+                ExecutionChannel channel(connection);
+                channel.Execute<65536>(command.c_str(), discard, errors);
+                if (channel.ExitStatus() != 0)
+                {
+                    // e.g. no head or a restricted shell; the missing output would look like an infinitely fast suite
+                    return std::nullopt;
+                }
+            }
+            catch (std::runtime_error const&)
+            {
+                return std::nullopt;
+            }
+            std::chrono::duration<double> const duration = std::chrono::steady_clock::now() - begin;
+
+            return Measurement{ suite, static_cast<double>(m_probeSize) / (std::max)(duration.count(), 1e-9) };
+        }
+
+        /**
+         * \return the cached suite for \p host, if any
+         */
+        [[nodiscard]] std::optional<CipherSuite> Lookup(std::string const& host) const
+        {
+            std::shared_lock lock(m_mutex);
+            auto pos = m_cache.find(host);
+            if (pos == m_cache.end())
+            {
+                return std::nullopt;
+            }
+            return pos->second;
+        }
+
+        /**
+         * \brief sets the cached suite for \p host on \p session
+         *
+         * \return true, if there was a cached suite
+         */
+        bool Apply(std::string const& host, Session& session) const
+        {
+            auto suite = Lookup(host);
+            if (suite)
+            {
+                session.SetOption(*suite);
+            }
+            return suite.has_value();
+        }
+
+        void Forget(std::string const& host)
+        {
+            std::unique_lock lock(m_mutex);
+            m_cache.erase(host);
+        }
+
+    private:
+        std::vector<CipherSuite> m_candidates;
+        size_t m_probeSize;
+
+        mutable std::shared_mutex m_mutex;
+        std::unordered_map<std::string, CipherSuite> m_cache;
+    };
+
+}
+
+#endif
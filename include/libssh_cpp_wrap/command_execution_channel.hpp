@@ -20,7 +20,9 @@
 #ifndef LIBSSH_CPP_WRAP_COMMAND_EXECUTION_CHANNEL
 #define LIBSSH_CPP_WRAP_COMMAND_EXECUTION_CHANNEL
 
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <future>
 #include <memory>
 #include <ostream>
@@ -30,8 +32,13 @@
 
 #include "libssh/libssh.h"
 
+#include "cancellation.hpp"
 #include "connection.hpp"
 #include "error_reporting.hpp"
+#include "executor.hpp"
+#include "expected.hpp"
+#include "tracing.hpp"
+#include "transfer_options.hpp"
 
 namespace libssh_wrap
 {
@@ -50,13 +57,13 @@ namespace libssh_wrap
             {
                 throw std::runtime_error("no valid connection passed");
             }
-            auto channel = ssh_channel_new(connection->GetSession());
+            auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelNew, ssh_channel_new(connection->GetSession()));
             if (channel == nullptr)
             {
                 throw std::runtime_error("error generating ssh command channel");
             }
             m_channel.reset(channel);
-            auto result = ssh_channel_open_session(channel);
+            auto result = LIBSSH_CPP_WRAP_TRACE(ChannelOpenSession, ssh_channel_open_session(channel));
             if (result != SSH_OK)
             {
                 ReportError("error opening channel session", connection->GetSession());
@@ -73,11 +80,35 @@ namespace libssh_wrap
         ExecutionChannel(ExecutionChannel&&) noexcept = default;
         ExecutionChannel& operator=(ExecutionChannel&&) noexcept = default;
 
+        /**
+         * \brief opens a channel without throwing on ssh errors
+         */
+        [[nodiscard]] static Expected<ExecutionChannel> TryOpen(std::shared_ptr<AuthenticatedConnection> connection)
+        {
+            if (!connection)
+            {
+                return Unexpected(SshError("no valid connection passed"));
+            }
+            ExecutionChannel result;
+            auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelNew, ssh_channel_new(connection->GetSession()));
+            if (channel == nullptr)
+            {
+                return Unexpected(SshError::FromSession("error generating ssh command channel", connection->GetSession()));
+            }
+            result.m_channel.reset(channel);
+            if (LIBSSH_CPP_WRAP_TRACE(ChannelOpenSession, ssh_channel_open_session(channel)) != SSH_OK)
+            {
+                return Unexpected(SshError::FromSession("error opening channel session", connection->GetSession()));
+            }
+            result.m_connection = std::move(connection);
+            return result;
+        }
+
         ~ExecutionChannel() noexcept
         {
             if (m_executed && m_channel) // note: test for channel necessary to avoid double close, if moved after m_executed is set to true
             {
-                [[maybe_unused]] auto result = ssh_channel_close(m_channel.get());
+                [[maybe_unused]] auto result = LIBSSH_CPP_WRAP_TRACE(ChannelClose, ssh_channel_close(m_channel.get()));
                 assert(result == SSH_OK); // potential issues? TODO: check error sources
             }
         }
@@ -85,29 +116,133 @@ namespace libssh_wrap
         template<size_t bufferSize = 1024>
         auto Execute(std::nullptr_t, std::ostream& outStream, std::ostream& errorStream) = delete;
 
+        /**
+         * \brief executes \p command writing its output to the streams
+         *
+         * \param options a buffer pool passed via \p options replaces the buffer of \p bufferSize bytes on the stack;
+         *                the deadline and stop token of \p options abort the execution
+         */
+        template<size_t bufferSize = 1024>
+        void Execute(const char* command, std::ostream& outStream, std::ostream& errorStream, TransferOptions const& options = {})
+        {
+            ValueOrThrow(TryExecute<bufferSize>(command, outStream, errorStream, options));
+        }
+
         template<size_t bufferSize = 1024>
-        void Execute(const char* command, std::ostream& outStream, std::ostream& errorStream)
+        auto TryExecute(std::nullptr_t, std::ostream& outStream, std::ostream& errorStream) = delete;
+
+        /**
+         * \brief executes \p command writing its output to the streams without throwing on ssh errors
+         *
+         * Exceptions of the streams are passed on.
+         */
+        template<size_t bufferSize = 1024>
+        [[nodiscard]] Expected<void> TryExecute(const char* command, std::ostream& outStream, std::ostream& errorStream, TransferOptions const& options = {})
+        {
+            if (!m_connection)
+            {
+                return Unexpected(SshError("no connection available"));
+            }
+            return detail::TryWithCancellation(m_connection->GetSession(), options, [&]() -> Expected<void>
+                {
+                    auto started = TryStart(command);
+                    if (!started)
+                    {
+                        return started;
+                    }
+                    return TryConsumeStreams<bufferSize>(outStream, errorStream, options);
+                });
+        }
+
+        /**
+         * \brief starts \p command without reading its output; use for commands reading their standard input
+         */
+        void Start(const char* command)
+        {
+            ValueOrThrow(TryStart(command));
+        }
+
+        void Start(std::nullptr_t) = delete;
+
+        /**
+         * \brief starts \p command without throwing on ssh errors
+         */
+        [[nodiscard]] Expected<void> TryStart(const char* command)
         {
             if (m_executed)
             {
-                throw std::runtime_error("there was already a command executed with this executor");
+                return Unexpected(SshError("there was already a command executed with this executor"));
             }
             if (!m_channel)
             {
-                throw std::runtime_error("no connection available");
+                return Unexpected(SshError("no connection available"));
             }
-            auto rc = ssh_channel_request_exec(m_channel.get(), command);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(ChannelRequestExec, ssh_channel_request_exec(m_channel.get(), command));
             if (rc != SSH_OK)
             {
-                ReportError("command execution failed", m_connection->GetSession());
+                return Unexpected(SshError::FromSession("command execution failed", m_connection->GetSession()));
             }
             m_executed = true;
+            return {};
+        }
+
+        Expected<void> TryStart(std::nullptr_t) = delete;
 
-            ConsumeStreams<bufferSize>(outStream, errorStream);
+        /**
+         * \brief writes \p size bytes to the standard input of the started command
+         */
+        void WriteInput(char const* data, size_t size)
+        {
+            if (!m_executed || !m_channel)
+            {
+                throw std::runtime_error("no command started");
+            }
+            while (size != 0)
+            {
+                auto const count = static_cast<uint32_t>((std::min)(size, size_t(UINT32_MAX)));
+                auto written = LIBSSH_CPP_WRAP_TRACE(ChannelWrite, ssh_channel_write(m_channel.get(), data, count));
+                if (written <= 0)
+                {
+                    ReportError("writing the stdin failed", m_connection->GetSession());
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+        }
+
+        /**
+         * \brief signals the end of the standard input to the started command
+         */
+        void CloseInput()
+        {
+            if (!m_executed || !m_channel)
+            {
+                throw std::runtime_error("no command started");
+            }
+            if (ssh_channel_send_eof(m_channel.get()) != SSH_OK)
+            {
+                ReportError("closing the stdin failed", m_connection->GetSession());
+            }
+        }
+
+        /**
+         * \brief reads the output of the started command until it ends
+         */
+        template<size_t bufferSize = 1024>
+        void ReadOutput(std::ostream& outStream, std::ostream& errorStream, TransferOptions const& options = {})
+        {
+            if (!m_executed || !m_channel)
+            {
+                throw std::runtime_error("no command started");
+            }
+            detail::WithCancellation(m_connection->GetSession(), options, [&]
+                {
+                    ConsumeStreams<bufferSize>(outStream, errorStream, options);
+                });
         }
 
         template<size_t bufferSize = 1024, class Clock = std::chrono::steady_clock>
-        void Execute(const char* command, std::ostream& outStream, std::ostream& errorStream, std::chrono::milliseconds timeout)
+        void Execute(const char* command, std::ostream& outStream, std::ostream& errorStream, std::chrono::milliseconds timeout, TransferOptions const& options = {})
         {
             if (m_executed)
             {
@@ -118,15 +253,18 @@ namespace libssh_wrap
                 throw std::runtime_error("no connection available");
             }
 
-            auto rc = ssh_channel_request_exec(m_channel.get(), command);
-            if (rc != SSH_OK)
-            {
-                ReportError("command execution failed", m_connection->GetSession());
-            }
-            m_executed = true;
+            detail::WithCancellation(m_connection->GetSession(), options, [&]
+                {
+                    auto rc = LIBSSH_CPP_WRAP_TRACE(ChannelRequestExec, ssh_channel_request_exec(m_channel.get(), command));
+                    if (rc != SSH_OK)
+                    {
+                        ReportError("command execution failed", m_connection->GetSession());
+                    }
+                    m_executed = true;
 
-            auto waitEnd = Clock::now() + timeout;
-            ConsumeStreamsTimeout<bufferSize, Clock>(outStream, errorStream, waitEnd);
+                    auto waitEnd = Clock::now() + timeout;
+                    ConsumeStreamsTimeout<bufferSize, Clock>(outStream, errorStream, waitEnd, options);
+                });
         }
 
         /**
@@ -134,6 +272,18 @@ namespace libssh_wrap
          */
         template<size_t bufferSize = 1024>
         std::future<std::shared_ptr<AuthenticatedConnection>> ExecuteAsync(const char* command, std::ostream& outStream, std::ostream& errorStream)
+        {
+            return ExecuteAsync<bufferSize>(IoExecutor(), command, outStream, errorStream);
+        }
+
+        /**
+         * \brief starts \p command and reads its output on \p executor
+         *
+         * \return a future that completes when the execution is done returning the connection
+         */
+        template<size_t bufferSize = 1024, Executor E>
+        std::future<std::shared_ptr<AuthenticatedConnection>> ExecuteAsync(E& executor, const char* command, std::ostream& outStream, std::ostream& errorStream,
+                                                                           TransferOptions const& options = {})
         {
             if (m_executed)
             {
@@ -143,29 +293,42 @@ namespace libssh_wrap
             {
                 throw std::runtime_error("no connection available");
             }
-            auto rc = ssh_channel_request_exec(m_channel.get(), command);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(ChannelRequestExec, ssh_channel_request_exec(m_channel.get(), command));
             if (rc != SSH_OK)
             {
                 throw std::runtime_error("command execution failed");
             }
             m_executed = true;
 
-            return std::async(std::launch::async,
-                &ExecutionChannel::AsyncConsume<bufferSize>,
-                std::make_shared<ExecutionChannel>(std::move(*this)),
-                std::reference_wrapper(outStream),
-                std::reference_wrapper(errorStream));
+            return Submit(executor, options.m_memoryResource, [channel = std::move(*this), &outStream, &errorStream, options]() mutable
+                {
+                    detail::WithCancellation(channel.m_connection->GetSession(), options, [&]
+                        {
+                            channel.ConsumeStreams<bufferSize>(outStream, errorStream, options);
+                        });
+                    auto connection = std::move(channel.m_connection);
+                    {
+                        // close the channel before the connection is handed back to the caller
+                        ExecutionChannel finished(std::move(channel));
+                    }
+                    return connection;
+                });
         }
 
-    private:
-
-        template<size_t bufferSize>
-        static std::shared_ptr<AuthenticatedConnection> AsyncConsume(std::shared_ptr<ExecutionChannel> const& executionChannel, std::ostream& outStream, std::ostream& errorStream)
+        /**
+         * \return the exit status of the executed command; waits for the status, if it didn't arrive yet
+         */
+        int ExitStatus()
         {
-            executionChannel->ConsumeStreams<bufferSize>(outStream, errorStream);
-            return std::move(executionChannel->m_connection);
+            if (!m_executed || !m_channel)
+            {
+                throw std::runtime_error("no command executed");
+            }
+            return ssh_channel_get_exit_status(m_channel.get());
         }
 
+    private:
+
         enum class StreamPipeResult
         {
             Data,
@@ -176,10 +339,9 @@ namespace libssh_wrap
         /**
          * \return true, if an error happened 
          */
-        template<size_t N>
-        static StreamPipeResult StreamPipeSome(ssh_channel channel, char(&buffer)[N], int isStdErr, std::ostream& stream)
+        static StreamPipeResult StreamPipeSome(ssh_channel channel, char* buffer, size_t size, int isStdErr, std::ostream& stream)
         {
-            int bytesRead = ssh_channel_read(channel, buffer, N, isStdErr);
+            int bytesRead = LIBSSH_CPP_WRAP_TRACE(ChannelRead, ssh_channel_read(channel, buffer, static_cast<uint32_t>(size), isStdErr));
             if (bytesRead == 0)
             {
                 return StreamPipeResult::Eof;
@@ -198,10 +360,9 @@ namespace libssh_wrap
         /**
          * \return true, if an error happened
          */
-        template<size_t N>
-        static StreamPipeResult StreamPipeSomeTimeout(ssh_channel channel, char(&buffer)[N], int isStdErr, std::ostream& stream, std::chrono::milliseconds timeout)
+        static StreamPipeResult StreamPipeSomeTimeout(ssh_channel channel, char* buffer, size_t size, int isStdErr, std::ostream& stream, std::chrono::milliseconds timeout)
         {
-            int bytesRead = ssh_channel_read_timeout(channel, buffer, N, isStdErr, timeout / std::chrono::milliseconds(1));
+            int bytesRead = LIBSSH_CPP_WRAP_TRACE(ChannelRead, ssh_channel_read_timeout(channel, buffer, static_cast<uint32_t>(size), isStdErr, timeout / std::chrono::milliseconds(1)));
             if (bytesRead == 0)
             {
                 return StreamPipeResult::Eof;
@@ -218,9 +379,15 @@ namespace libssh_wrap
         }
 
         template<size_t bufferSize>
-        void ConsumeStreams(std::ostream& outStream, std::ostream& errorStream) const
+        void ConsumeStreams(std::ostream& outStream, std::ostream& errorStream, TransferOptions const& options) const
+        {
+            ValueOrThrow(TryConsumeStreams<bufferSize>(outStream, errorStream, options));
+        }
+
+        template<size_t bufferSize>
+        Expected<void> TryConsumeStreams(std::ostream& outStream, std::ostream& errorStream, TransferOptions const& options) const
         {
-            char buffer[bufferSize];
+            detail::TransferBuffer<bufferSize> buffer(options);
 
             StreamPipeResult inResult = StreamPipeResult::Data;
             StreamPipeResult errResult = StreamPipeResult::Data;
@@ -229,7 +396,7 @@ namespace libssh_wrap
             {
                 if (inResult != StreamPipeResult::Eof)
                 {
-                    inResult = StreamPipeSome(m_channel.get(), buffer, 0, outStream);
+                    inResult = StreamPipeSome(m_channel.get(), buffer.data(), buffer.size(), 0, outStream);
                     if (inResult == StreamPipeResult::Error)
                     {
                         break;
@@ -237,7 +404,7 @@ namespace libssh_wrap
                 }
                 if (errResult != StreamPipeResult::Eof)
                 {
-                    errResult = StreamPipeSome(m_channel.get(), buffer, 1, errorStream);
+                    errResult = StreamPipeSome(m_channel.get(), buffer.data(), buffer.size(), 1, errorStream);
                 }
             }
 
@@ -247,15 +414,16 @@ namespace libssh_wrap
                 bool channelClosed = ssh_channel_is_closed(m_channel.get());
                 if (!channelClosed)
                 {
-                    ReportError("reading the stdin/stdout failed", m_connection->GetSession());
+                    return Unexpected(SshError::FromSession("reading the stdin/stdout failed", m_connection->GetSession()));
                 }
             }
+            return {};
         }
 
         template<size_t bufferSize, class Clock>
-        void ConsumeStreamsTimeout(std::ostream& outStream, std::ostream& errorStream, typename Clock::time_point waitEnd) const
+        void ConsumeStreamsTimeout(std::ostream& outStream, std::ostream& errorStream, typename Clock::time_point waitEnd, TransferOptions const& options) const
         {
-            char buffer[bufferSize];
+            detail::TransferBuffer<bufferSize> buffer(options);
 
             StreamPipeResult inResult = StreamPipeResult::Data;
             StreamPipeResult errResult = StreamPipeResult::Data;
@@ -269,7 +437,7 @@ namespace libssh_wrap
                     {
                         return;
                     }
-                    inResult = StreamPipeSomeTimeout(m_channel.get(), buffer, 0, outStream, remainingTime);
+                    inResult = StreamPipeSomeTimeout(m_channel.get(), buffer.data(), buffer.size(), 0, outStream, remainingTime);
                     if (inResult == StreamPipeResult::Error)
                     {
                         break;
@@ -282,7 +450,7 @@ namespace libssh_wrap
                     {
                         return;
                     }
-                    errResult = StreamPipeSomeTimeout(m_channel.get(), buffer, 1, errorStream, remainingTime);
+                    errResult = StreamPipeSomeTimeout(m_channel.get(), buffer.data(), buffer.size(), 1, errorStream, remainingTime);
                 }
             }
 
@@ -303,7 +471,7 @@ namespace libssh_wrap
         {
             void operator()(ssh_channel channel) const noexcept
             {
-                ssh_channel_close(channel);
+                LIBSSH_CPP_WRAP_TRACE(ChannelClose, ssh_channel_close(channel));
                 ssh_channel_free(channel);
             }
         };
@@ -0,0 +1,466 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_CONNECT
+#define LIBSSH_CPP_WRAP_CONNECT
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "libssh/libssh.h"
+
+#include "connection.hpp"
+#include "ip.hpp"
+#include "resolver.hpp"
+#include "session.hpp"
+#include "session_options.hpp"
+#include "socket.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief socket options applied before connecting; unset members keep the defaults of the system
+     */
+    struct SocketTuning
+    {
+        /**
+         * \brief disables Nagle's algorithm, which delays small packets like the ones of interactive sessions
+         */
+        std::optional<bool> m_noDelay{ true };
+
+        /**
+         * \brief SO_SNDBUF; links with a large bandwidth-delay product need buffers of at least one round trip of data
+         */
+        std::optional<int> m_sendBufferSize;
+
+        /**
+         * \brief SO_RCVBUF; needs to be set before connecting to affect the window scale negotiated with the server
+         */
+        std::optional<int> m_receiveBufferSize;
+
+        /**
+         * \brief idle time before the first tcp keepalive probe is sent; enables SO_KEEPALIVE
+         */
+        std::optional<std::chrono::seconds> m_keepAliveIdle;
+
+        /**
+         * \brief time between unanswered keepalive probes
+         */
+        std::optional<std::chrono::seconds> m_keepAliveInterval;
+
+        /**
+         * \brief the number of unanswered keepalive probes after which the connection is dropped
+         */
+        std::optional<int> m_keepAliveCount;
+
+        /**
+         * \brief the local address the socket is bound to; only addresses of its family are connected to
+         */
+        std::optional<IpAddress> m_bindAddress;
+    };
+
+    /**
+     * \brief applies \p tuning except for the bind address to \p socket
+     *
+     * Useful for sockets connected by the application and passed to the session via SocketDescriptor. The buffer sizes
+     * only have their full effect, if set before connecting.
+     *
+     * \exception ::std::runtime_error If the system rejects one of the options
+     */
+    inline void TuneSocket(socket_t socket, SocketTuning const& tuning)
+    {
+        auto set = [socket](int level, int name, int value)
+        {
+            if (!detail::SetSocketOption(socket, level, name, value))
+            {
+                throw std::runtime_error("error setting a socket option");
+            }
+        };
+
+        if (tuning.m_noDelay)
+        {
+            set(IPPROTO_TCP, TCP_NODELAY, *tuning.m_noDelay ? 1 : 0);
+        }
+        if (tuning.m_sendBufferSize)
+        {
+            set(SOL_SOCKET, SO_SNDBUF, *tuning.m_sendBufferSize);
+        }
+        if (tuning.m_receiveBufferSize)
+        {
+            set(SOL_SOCKET, SO_RCVBUF, *tuning.m_receiveBufferSize);
+        }
+        if (tuning.m_keepAliveIdle || tuning.m_keepAliveInterval || tuning.m_keepAliveCount)
+        {
+            set(SOL_SOCKET, SO_KEEPALIVE, 1);
+        }
+        if (tuning.m_keepAliveIdle)
+        {
+#if defined(TCP_KEEPIDLE)
+            set(IPPROTO_TCP, TCP_KEEPIDLE, static_cast<int>(tuning.m_keepAliveIdle->count()));
+#elif defined(TCP_KEEPALIVE)
+            set(IPPROTO_TCP, TCP_KEEPALIVE, static_cast<int>(tuning.m_keepAliveIdle->count()));
+#else
+            throw std::runtime_error("the keepalive idle time is not supported on this system");
+#endif
+        }
+        if (tuning.m_keepAliveInterval)
+        {
+#if defined(TCP_KEEPINTVL)
+            set(IPPROTO_TCP, TCP_KEEPINTVL, static_cast<int>(tuning.m_keepAliveInterval->count()));
+#else
+            throw std::runtime_error("the keepalive interval is not supported on this system");
+#endif
+        }
+        if (tuning.m_keepAliveCount)
+        {
+#if defined(TCP_KEEPCNT)
+            set(IPPROTO_TCP, TCP_KEEPCNT, *tuning.m_keepAliveCount);
+#else
+            throw std::runtime_error("the keepalive probe count is not supported on this system");
+#endif
+        }
+    }
+
+    /**
+     * \brief timing and socket options of the connection attempts (RFC 8305)
+     */
+    struct HappyEyeballsOptions
+    {
+        /**
+         * \brief time to wait for an attempt before starting the attempt for the next address
+         */
+        std::chrono::milliseconds m_attemptDelay{ 250 };
+
+        /**
+         * \brief time after which all attempts are given up
+         */
+        std::chrono::milliseconds m_timeout{ 10000 };
+
+        SocketTuning m_socket;
+    };
+
+    /**
+     * \return \p addresses reordered to alternate between the address families, starting with the family of the
+     *         first address
+     */
+    inline std::vector<IpAddress> InterleaveAddressFamilies(std::vector<IpAddress> const& addresses)
+    {
+        std::vector<IpAddress> first;
+        std::vector<IpAddress> second;
+        for (auto const& address : addresses)
+        {
+            (address.index() == addresses.front().index() ? first : second).push_back(address);
+        }
+
+        std::vector<IpAddress> result;
+        result.reserve(addresses.size());
+        for (size_t i = 0; i != (std::max)(first.size(), second.size()); ++i)
+        {
+            if (i < first.size())
+            {
+                result.push_back(first[i]);
+            }
+            if (i < second.size())
+            {
+                result.push_back(second[i]);
+            }
+        }
+        return result;
+    }
+
+    namespace detail
+    {
+
+        /**
+         * \brief creates a non blocking tcp socket tuned via \p tuning and starts connecting it to \p address
+         *
+         * \param connected set to true, if the connection was established right away
+         *
+         * \return the socket; an empty handle, if the attempt failed right away
+         *
+         * \exception ::std::runtime_error If the socket can't be tuned or bound to the bind address of \p tuning
+         */
+        inline SocketHandle StartConnect(IpAddress const& address, int port, SocketTuning const& tuning, bool& connected)
+        {
+            connected = false;
+            SocketAddress const target(address, port);
+            SocketHandle socket(::socket(target.Family(), SOCK_STREAM, IPPROTO_TCP));
+            if (!socket)
+            {
+                return socket;
+            }
+            TuneSocket(socket.Get(), tuning);
+            if (tuning.m_bindAddress)
+            {
+                SocketAddress const local(*tuning.m_bindAddress, 0);
+                if (::bind(socket.Get(), local.Get(), local.m_length) != 0)
+                {
+                    throw std::runtime_error("error binding the socket to the local address");
+                }
+            }
+            if (!SetNonBlocking(socket.Get(), true))
+            {
+                return SocketHandle();
+            }
+            if (::connect(socket.Get(), target.Get(), target.m_length) == 0)
+            {
+                connected = true;
+                return socket;
+            }
+            return LastOperationWouldBlock() ? std::move(socket) : SocketHandle();
+        }
+
+    }
+
+    /**
+     * \brief connects a tcp socket to the first of \p addresses to respond
+     *
+     * Attempts are started one after the other, each one \p options.m_attemptDelay after the previous one or
+     * immediately after the previous one failed; the first established connection wins and all other attempts are
+     * abandoned. \p options.m_socket is applied to every socket before it connects.
+     *
+     * \exception ::std::runtime_error If none of the addresses can be connected to in time or the socket options
+     *                                 can't be applied
+     */
+    [[nodiscard]] inline detail::SocketHandle ConnectSocket(std::vector<IpAddress> const& addresses, int port, HappyEyeballsOptions const& options = {})
+    {
+        using Clock = std::chrono::steady_clock;
+
+        auto const& bindAddress = options.m_socket.m_bindAddress;
+        std::vector<IpAddress> usable;
+        for (auto const& address : addresses)
+        {
+            if (!bindAddress || address.index() == bindAddress->index())
+            {
+                usable.push_back(address);
+            }
+        }
+        if (usable.empty() && !addresses.empty())
+        {
+            throw std::runtime_error("none of the addresses matches the family of the bind address");
+        }
+
+        auto const candidates = usable.empty() ? usable : InterleaveAddressFamilies(usable);
+        auto const deadline = Clock::now() + options.m_timeout;
+
+        std::vector<detail::SocketHandle> attempts;
+        std::vector<detail::PollDescriptor> descriptors;
+        size_t next = 0;
+        auto nextAttempt = Clock::now();
+
+        while (true)
+        {
+            auto now = Clock::now();
+            if (now >= deadline)
+            {
+                throw std::runtime_error("timeout connecting to the host");
+            }
+            if (next != candidates.size() && (now >= nextAttempt || attempts.empty()))
+            {
+                bool connected = false;
+                auto socket = detail::StartConnect(candidates[next++], port, options.m_socket, connected);
+                if (connected)
+                {
+                    detail::SetNonBlocking(socket.Get(), false);
+                    return socket;
+                }
+                if (socket)
+                {
+                    detail::PollDescriptor descriptor{};
+                    descriptor.fd = socket.Get();
+                    descriptor.events = POLLOUT;
+                    descriptors.push_back(descriptor);
+                    attempts.push_back(std::move(socket));
+                    nextAttempt = now + options.m_attemptDelay;
+                }
+                continue;
+            }
+
+            if (attempts.empty())
+            {
+                throw std::runtime_error("could not connect to any of the addresses");
+            }
+
+            auto const wakeUp = (next != candidates.size()) ? (std::min)(deadline, nextAttempt) : deadline;
+            if (detail::Poll(descriptors.data(), descriptors.size(),
+                             std::chrono::ceil<std::chrono::milliseconds>(wakeUp - now)) <= 0)
+            {
+                continue;
+            }
+
+            for (size_t i = 0; i != descriptors.size();)
+            {
+                if (descriptors[i].revents == 0)
+                {
+                    ++i;
+                    continue;
+                }
+                if (detail::SocketError(attempts[i].Get()) == 0)
+                {
+                    detail::SetNonBlocking(attempts[i].Get(), false);
+                    return std::move(attempts[i]);
+                }
+                attempts.erase(attempts.begin() + static_cast<std::ptrdiff_t>(i));
+                descriptors.erase(descriptors.begin() + static_cast<std::ptrdiff_t>(i));
+                nextAttempt = Clock::now();
+            }
+        }
+    }
+
+    /**
+     * \brief runs the ssh handshake of \p session over \p socket, which is connected already
+     *
+     * \p socket may come from a pool of pre-connected sockets, a custom proxy or be a unix domain socket; the session
+     * takes ownership, even if the handshake fails. \p host and \p port are only used to match known hosts and config
+     * files.
+     *
+     * \exception ::std::runtime_error If the ssh handshake fails
+     */
+    [[nodiscard]] inline Connection ConnectWithSocket(Session&& session, socket_t socket, std::string const& host, Port port = {})
+    {
+        detail::SocketHandle owner(socket);
+        session.SetOption(HostName(host.c_str()));
+        session.SetOption(port);
+        session.SetOption(SocketDescriptor{ owner.Get() });
+        (void)owner.Release();
+        return Connection(std::move(session));
+    }
+
+    /**
+     * \brief Connects \p session to \p host
+     *
+     * The name is resolved via \p resolver and the addresses are raced as described for ConnectSocket. The session
+     * uses the established socket; libssh closes it on disconnect. The host option of the session is set to \p host,
+     * so config files and known hosts see the name.
+     *
+     * \exception ::std::runtime_error If resolving, connecting or the ssh handshake fails
+     */
+    [[nodiscard]] inline Connection ConnectTo(Session&& session, std::string const& host, Port port = {},
+                                              HappyEyeballsOptions const& options = {},
+                                              Resolver& resolver = Resolver::Global())
+    {
+        auto socket = ConnectSocket(resolver.Resolve(host), port.m_port, options);
+        return ConnectWithSocket(std::move(session), socket.Release(), host, port);
+    }
+
+    /**
+     * \brief a host to connect to
+     */
+    struct ConnectTarget
+    {
+        std::string m_host;
+        Port m_port;
+    };
+
+    /**
+     * \brief the outcome of connecting to one of the targets passed to ConnectAll
+     */
+    struct ConnectResult
+    {
+        std::shared_ptr<AuthenticatedConnection> m_connection;
+
+        /**
+         * \brief the exception, if connecting or authenticating failed
+         */
+        std::exception_ptr m_error;
+    };
+
+    struct ConnectAllOptions
+    {
+        /**
+         * \brief maximum number of connections established at the same time
+         */
+        size_t m_parallelism{ 32 };
+
+        HappyEyeballsOptions m_happyEyeballs;
+    };
+
+    /**
+     * \brief connects and authenticates to all of \p targets concurrently
+     *
+     * \param sessionFactory creates the session for a target, e.g. via SessionTemplate::Instantiate
+     * \param authenticator authenticates a connection, e.g. `std::move(connection).Authenticate(key)`
+     *
+     * \return the results in the order of \p targets
+     */
+    inline std::vector<ConnectResult> ConnectAll(
+        std::vector<ConnectTarget> const& targets,
+        std::function<Session(ConnectTarget const&)> const& sessionFactory,
+        std::function<std::shared_ptr<AuthenticatedConnection>(Connection&&)> const& authenticator,
+        ConnectAllOptions const& options = {},
+        Resolver& resolver = Resolver::Global())
+    {
+        std::vector<ConnectResult> results(targets.size());
+        std::atomic<size_t> nextTarget{ 0 };
+
+        auto work = [&]()
+        {
+            for (size_t index = nextTarget++; index < targets.size(); index = nextTarget++)
+            {
+                auto const& target = targets[index];
+                try
+                {
+                    results[index].m_connection = authenticator(
+                        ConnectTo(sessionFactory(target), target.m_host, target.m_port, options.m_happyEyeballs, resolver));
+                }
+                catch (...)
+                {
+                    results[index].m_error = std::current_exception();
+                }
+            }
+        };
+
+        size_t const threadCount = (std::min)(targets.size(), (std::max)(options.m_parallelism, size_t(1)));
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        try
+        {
+            for (size_t i = 1; i < threadCount; ++i)
+            {
+                threads.emplace_back(work);
+            }
+        }
+        catch (std::system_error const&)
+        {
+            // continue with the threads started so far
+        }
+        work();
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        return results;
+    }
+
+}
+
+#endif
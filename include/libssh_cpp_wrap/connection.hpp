@@ -24,13 +24,20 @@
 #include <memory>
 #include <mutex>
 #include <stdexcept>
+#include <stop_token>
+#include <string>
 #include <type_traits>
 #include <utility>
 
 #include "libssh/libssh.h"
 
+#include "cancellation.hpp"
 #include "error_reporting.hpp"
+#include "expected.hpp"
+#include "known_hosts.hpp"
+#include "private_key.hpp"
 #include "session.hpp"
+#include "tracing.hpp"
 
 namespace libssh_wrap
 {
@@ -54,7 +61,7 @@ namespace libssh_wrap
             {
                 ReportInvalidSession();
             }
-            auto errorCode = ssh_connect(session.m_sshSession.get());
+            auto errorCode = LIBSSH_CPP_WRAP_TRACE(Connect, ssh_connect(session.m_sshSession.get()));
             if (errorCode != SSH_OK)
             {
                 ReportError("ssh_connect unsuccessful", session.m_sshSession.get());
@@ -62,11 +69,87 @@ namespace libssh_wrap
             m_session = std::move(session);
         }
 
+        /**
+         * \brief Create a ssh connection, aborting the handshake once \p deadline passes or a stop is requested via
+         *        \p stopToken
+         *
+         * \exception OperationCancelled If the connection attempt was aborted
+         * \exception ::std::runtime_error If \p session is not valid or connecting fails
+         */
+        Connection(Session&& session, Deadline deadline, std::stop_token const& stopToken = {})
+        {
+            if (!session)
+            {
+                ReportInvalidSession();
+            }
+            detail::WithCancellation(session.m_sshSession.get(), deadline, stopToken, [&session]
+                {
+                    auto errorCode = LIBSSH_CPP_WRAP_TRACE(Connect, ssh_connect(session.m_sshSession.get()));
+                    if (errorCode != SSH_OK)
+                    {
+                        ReportError("ssh_connect unsuccessful", session.m_sshSession.get());
+                    }
+                });
+            m_session = std::move(session);
+        }
+
+        /**
+         * \brief Create a ssh connection and verify the host key of the server against \p knownHosts
+         *
+         * \exception ::std::runtime_error If \p session is not valid, or the host key isn't listed for the host
+         */
+        Connection(Session&& session, KnownHostsIndex const& knownHosts)
+            : Connection(std::move(session))
+        {
+            auto const status = knownHosts.Check(GetSession());
+            if (status != HostKeyStatus::Known)
+            {
+                throw std::runtime_error(std::string("host key verification failed: the key is ") + ToString(status));
+            }
+        }
+
+        /**
+         * \brief Create a ssh connection without throwing on connection errors
+         *
+         * \return the connection or the error of ssh_connect; \p session is only moved from on success, so on failure
+         *         it still belongs to the caller
+         */
+        [[nodiscard]] static Expected<Connection> TryConnect(Session&& session)
+        {
+            if (!session)
+            {
+                return Unexpected(SshError("the session object is invalid"));
+            }
+            auto errorCode = LIBSSH_CPP_WRAP_TRACE(Connect, ssh_connect(session.m_sshSession.get()));
+            if (errorCode != SSH_OK)
+            {
+                return Unexpected(SshError::FromSession("ssh_connect unsuccessful", session.m_sshSession.get()));
+            }
+            return Connection(std::move(session), ConnectedTag{});
+        }
+
+        /**
+         * \brief Create a ssh connection without throwing on connection errors, aborting the handshake once
+         *        \p deadline passes or a stop is requested via \p stopToken
+         */
+        [[nodiscard]] static Expected<Connection> TryConnect(Session&& session, Deadline deadline, std::stop_token const& stopToken = {})
+        {
+            if (!session)
+            {
+                return Unexpected(SshError("the session object is invalid"));
+            }
+            auto const sshSession = session.m_sshSession.get();
+            return detail::TryWithCancellation(sshSession, deadline, stopToken, [&session]
+                {
+                    return TryConnect(std::move(session));
+                });
+        }
+
         ~Connection() noexcept
         {
             if (m_session)
             {
-                ssh_disconnect(m_session.m_sshSession.get());
+                LIBSSH_CPP_WRAP_TRACE(Disconnect, ssh_disconnect(m_session.m_sshSession.get()));
             }
         }
 
@@ -88,7 +171,7 @@ namespace libssh_wrap
          */
         [[nodiscard("dropping the return value results in a session destruction")]] Session Disconnect()
         {
-            ssh_disconnect(GetSession());
+            LIBSSH_CPP_WRAP_TRACE(Disconnect, ssh_disconnect(GetSession()));
             return std::move(m_session);
         }
 
@@ -97,7 +180,61 @@ namespace libssh_wrap
 
         std::shared_ptr<AuthenticatedConnection> Authenticate(std::nullptr_t) = delete;
 
+        /**
+         * \brief authenticate using a public key
+         *
+         * \exception ::std::runtime_error If \p key is empty or the server rejects it
+         */
+        [[nodiscard("dropping the return value results in a session destruction")]]
+        std::shared_ptr<AuthenticatedConnection> Authenticate(PrivateKey const& key) &&;
+
+        /**
+         * \brief authenticate using the keys provided by the ssh agent (SSH_AUTH_SOCK)
+         *
+         * \exception ::std::runtime_error If none of the agent's keys is accepted
+         */
+        [[nodiscard("dropping the return value results in a session destruction")]]
+        std::shared_ptr<AuthenticatedConnection> AuthenticateWithAgent() &&;
+
+        /**
+         * \brief authenticate using a password without throwing on authentication errors
+         *
+         * This object keeps the connection, if the authentication fails, so another method can be tried.
+         */
+        [[nodiscard]] Expected<std::shared_ptr<AuthenticatedConnection>> TryAuthenticate(char const* password) &&;
+
+        Expected<std::shared_ptr<AuthenticatedConnection>> TryAuthenticate(std::nullptr_t) = delete;
+
+        /**
+         * \brief authenticate using a public key without throwing on authentication errors
+         *
+         * This object keeps the connection, if the authentication fails, so another method can be tried.
+         */
+        [[nodiscard]] Expected<std::shared_ptr<AuthenticatedConnection>> TryAuthenticate(PrivateKey const& key) &&;
+
+        /**
+         * \brief authenticate using the keys of the ssh agent without throwing on authentication errors
+         *
+         * This object keeps the connection, if the authentication fails, so another method can be tried.
+         */
+        [[nodiscard]] Expected<std::shared_ptr<AuthenticatedConnection>> TryAuthenticateWithAgent() &&;
+
     private:
+        struct ConnectedTag {};
+
+        /**
+         * \brief takes ownership of a connected session
+         */
+        Connection(Session&& session, ConnectedTag) noexcept
+            : m_session(std::move(session))
+        {
+        }
+
+        /**
+         * \return the authenticated connection, if \p errorCode reports success; the error of the session otherwise
+         */
+        Expected<std::shared_ptr<AuthenticatedConnection>> CompleteAuthentication(int errorCode, char const* context);
+
         ssh_session GetSession()
         {
             if (!m_session)
@@ -117,7 +254,10 @@ namespace libssh_wrap
         Session m_session;
     };
 
+    class ConnectionActor;
+    class CancellationScope;
     class ExecutionChannel;
+    class PortForwarder;
     class ScpSession;
     class SftpChannel;
 
@@ -139,19 +279,69 @@ namespace libssh_wrap
             return m_connection.Disconnect();
         }
 
+        /**
+         * \return false, if the connection to the server was lost
+         */
+        [[nodiscard]] bool IsConnected()
+        {
+            std::lock_guard guard(m_mutex);
+            return m_connection && ssh_is_connected(m_connection.GetSession()) != 0;
+        }
+
         /**
          * Create a password authentication
          */
         [[deprecated("for internal use only")]] AuthenticatedConnection(Connection&& connection, char const* password)
         {
-            auto errorCode = ssh_userauth_password(connection.GetSession(), nullptr, password);
+            auto errorCode = LIBSSH_CPP_WRAP_TRACE(UserAuthPassword, ssh_userauth_password(connection.GetSession(), nullptr, password));
             if (errorCode != SSH_OK)
             {
                 ReportError("password authentication failed", connection.GetSession());
             }
             m_connection = std::move(connection);
         }
+
+        /**
+         * Create a public key authentication
+         */
+        [[deprecated("for internal use only")]] AuthenticatedConnection(Connection&& connection, PrivateKey const& key)
+        {
+            if (!key)
+            {
+                throw std::runtime_error("no private key provided");
+            }
+            auto errorCode = LIBSSH_CPP_WRAP_TRACE(UserAuthPublicKey, ssh_userauth_publickey(connection.GetSession(), nullptr, key.GetKey()));
+            if (errorCode != SSH_AUTH_SUCCESS)
+            {
+                ReportError("public key authentication failed", connection.GetSession());
+            }
+            m_connection = std::move(connection);
+        }
+
+        struct AgentTag {};
+
+        /**
+         * Create an agent authentication
+         */
+        [[deprecated("for internal use only")]] AuthenticatedConnection(Connection&& connection, AgentTag)
+        {
+            auto errorCode = LIBSSH_CPP_WRAP_TRACE(UserAuthAgent, ssh_userauth_agent(connection.GetSession(), nullptr));
+            if (errorCode != SSH_AUTH_SUCCESS)
+            {
+                ReportError("agent authentication failed", connection.GetSession());
+            }
+            m_connection = std::move(connection);
+        }
     private:
+        struct AuthenticatedTag {};
+
+        /**
+         * \brief takes ownership of an authenticated connection
+         */
+        AuthenticatedConnection(Connection&& connection, AuthenticatedTag) noexcept
+            : m_connection(std::move(connection))
+        {
+        }
 
         std::mutex m_mutex;
 
@@ -162,13 +352,64 @@ namespace libssh_wrap
         }
 
         friend class Connection;
+        friend class CancellationScope;
+        friend class ConnectionActor;
         friend class ExecutionChannel;
+        friend class PortForwarder;
         friend class ScpSession;
         friend class SftpChannel;
 
         Connection m_connection;
     };
 
+    inline CancellationScope::CancellationScope(std::shared_ptr<AuthenticatedConnection> const& connection, Deadline deadline, std::stop_token const& stopToken)
+        : m_guard(connection ? connection->GetSession() : throw std::runtime_error("no valid connection passed"), deadline, stopToken)
+    {
+    }
+
+    inline Expected<std::shared_ptr<AuthenticatedConnection>> Connection::CompleteAuthentication(int errorCode, char const* context)
+    {
+        if (errorCode != SSH_AUTH_SUCCESS)
+        {
+            return Unexpected(SshError::FromSession(context, m_session.m_sshSession.get()));
+        }
+        return std::shared_ptr<AuthenticatedConnection>(new AuthenticatedConnection(std::move(*this), AuthenticatedConnection::AuthenticatedTag{}));
+    }
+
+    inline Expected<std::shared_ptr<AuthenticatedConnection>> Connection::TryAuthenticate(char const* password) &&
+    {
+        if (!m_session)
+        {
+            return Unexpected(SshError("the session object is invalid"));
+        }
+        return CompleteAuthentication(LIBSSH_CPP_WRAP_TRACE(UserAuthPassword, ssh_userauth_password(GetSession(), nullptr, password)),
+                                      "password authentication failed");
+    }
+
+    inline Expected<std::shared_ptr<AuthenticatedConnection>> Connection::TryAuthenticate(PrivateKey const& key) &&
+    {
+        if (!m_session)
+        {
+            return Unexpected(SshError("the session object is invalid"));
+        }
+        if (!key)
+        {
+            return Unexpected(SshError("no private key provided"));
+        }
+        return CompleteAuthentication(LIBSSH_CPP_WRAP_TRACE(UserAuthPublicKey, ssh_userauth_publickey(GetSession(), nullptr, key.GetKey())),
+                                      "public key authentication failed");
+    }
+
+    inline Expected<std::shared_ptr<AuthenticatedConnection>> Connection::TryAuthenticateWithAgent() &&
+    {
+        if (!m_session)
+        {
+            return Unexpected(SshError("the session object is invalid"));
+        }
+        return CompleteAuthentication(LIBSSH_CPP_WRAP_TRACE(UserAuthAgent, ssh_userauth_agent(GetSession(), nullptr)),
+                                      "agent authentication failed");
+    }
+
     inline std::shared_ptr<AuthenticatedConnection> libssh_wrap::Connection::Authenticate(char const* password) &&
     {
 #ifdef _MSC_VER
@@ -178,6 +419,30 @@ namespace libssh_wrap
         return std::make_shared<AuthenticatedConnection>(std::move(*this), password);
 #ifdef _MSC_VER
 #pragma warning(pop)
+#endif
+    }
+
+    inline std::shared_ptr<AuthenticatedConnection> libssh_wrap::Connection::Authenticate(PrivateKey const& key) &&
+    {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996 )
+#endif
+        return std::make_shared<AuthenticatedConnection>(std::move(*this), key);
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+    }
+
+    inline std::shared_ptr<AuthenticatedConnection> libssh_wrap::Connection::AuthenticateWithAgent() &&
+    {
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996 )
+#endif
+        return std::make_shared<AuthenticatedConnection>(std::move(*this), AuthenticatedConnection::AgentTag{});
+#ifdef _MSC_VER
+#pragma warning(pop)
 #endif
     }
 }
@@ -0,0 +1,1100 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_CONNECTION_ACTOR
+#define LIBSSH_CPP_WRAP_CONNECTION_ACTOR
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "libssh/libssh.h"
+#include "libssh/sftp.h"
+
+#include "connection.hpp"
+#include "error_reporting.hpp"
+#include "file_permissions.hpp"
+#include "sftp_packet.hpp"
+#include "socket.hpp"
+#include "tracing.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief the scheduling class of work submitted to a ConnectionActor
+     */
+    enum class PriorityClass
+    {
+        /**
+         * \brief latency sensitive work, e.g. commands; runs before bulk work
+         */
+        Interactive,
+
+        /**
+         * \brief throughput oriented work, e.g. file transfers; uses small chunks while interactive work is pending
+         */
+        Bulk,
+    };
+
+    namespace detail
+    {
+        enum class StepResult
+        {
+            /**
+             * \brief the job did some work and wants to be stepped again
+             */
+            Progress,
+
+            /**
+             * \brief the job is waiting for data from the server
+             */
+            Idle,
+
+            Done,
+        };
+
+        /**
+         * \brief the amount of data a job may move in one step
+         */
+        struct StepBudget
+        {
+            /**
+             * \brief the maximum size of a read or write
+             */
+            size_t m_chunkSize;
+
+            /**
+             * \brief the maximum number of sftp requests a transfer keeps waiting for a reply
+             */
+            size_t m_maxOutstanding;
+        };
+
+        struct ActorChannelDeleter
+        {
+            void operator()(ssh_channel channel) const noexcept
+            {
+                ssh_channel_free(channel);
+            }
+        };
+
+        /**
+         * \brief the sftp channel shared by the transfers of a ConnectionActor
+         *
+         * libssh's sftp functions wait for the reply of every request. The actor exchanges the packets itself instead:
+         * requests are queued and written as far as the channel window allows, and replies are collected from the data
+         * available on the channel and kept until the job waiting for them picks them up. Nothing blocks.
+         */
+        class ActorSftp
+        {
+        public:
+            ActorSftp() noexcept = default;
+
+            ActorSftp(ActorSftp const&) = delete;
+            ActorSftp& operator=(ActorSftp const&) = delete;
+
+            /**
+             * \brief starts opening the sftp channel on first use
+             *
+             * \return true, once requests can be sent
+             *
+             * \exception ::std::runtime_error If the channel could not be opened or broke down
+             */
+            bool Ready(ssh_session session)
+            {
+                if (m_state == State::Closed)
+                {
+                    m_state = State::Opening;
+                    Pump(session);
+                }
+                if (m_failure)
+                {
+                    std::rethrow_exception(m_failure);
+                }
+                return m_state == State::Ready;
+            }
+
+            [[nodiscard]] uint32_t NextId() noexcept
+            {
+                return ++m_lastId;
+            }
+
+            /**
+             * \brief queues \p packet for sending
+             */
+            void Send(SftpPacket& packet)
+            {
+                auto const& data = packet.Finish();
+                m_output.insert(m_output.end(), data.begin(), data.end());
+            }
+
+            /**
+             * \return the reply to the request \p id, if it arrived
+             *
+             * \exception ::std::runtime_error If the channel broke down
+             */
+            std::optional<SftpReply> TakeReply(uint32_t id)
+            {
+                auto const pos = m_replies.find(id);
+                if (pos == m_replies.end())
+                {
+                    if (m_failure)
+                    {
+                        std::rethrow_exception(m_failure);
+                    }
+                    return std::nullopt;
+                }
+                auto reply = std::move(pos->second);
+                m_replies.erase(pos);
+                return reply;
+            }
+
+            /**
+             * \brief drops the reply to \p id, e.g. for the outstanding requests of a failed job
+             */
+            void Discard(uint32_t id)
+            {
+                if (m_replies.erase(id) == 0)
+                {
+                    m_discarded.insert(id);
+                }
+            }
+
+            /**
+             * \brief writes queued requests and collects the available replies
+             *
+             * Errors are stored and reported to the jobs by Ready and TakeReply.
+             *
+             * \return true, if any data was sent or received
+             */
+            bool Pump(ssh_session session) noexcept
+            {
+                if (m_state == State::Closed || m_failure)
+                {
+                    return false;
+                }
+                try
+                {
+                    return Advance(session);
+                }
+                catch (...)
+                {
+                    m_failure = std::current_exception();
+                    return true;
+                }
+            }
+
+        private:
+            enum class State
+            {
+                Closed,
+                Opening,
+                RequestingSubsystem,
+                Initializing,
+                Ready,
+            };
+
+            /**
+             * \brief the number of bytes read from the channel at once
+             */
+            static constexpr uint32_t ReadSize = 65536;
+
+            bool Advance(ssh_session session)
+            {
+                bool progress = false;
+                if (m_state == State::Opening)
+                {
+                    if (!m_channel)
+                    {
+                        auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelNew, ssh_channel_new(session));
+                        if (channel == nullptr)
+                        {
+                            throw std::runtime_error("error generating sftp channel");
+                        }
+                        m_channel.reset(channel);
+                    }
+                    auto const result = LIBSSH_CPP_WRAP_TRACE(ChannelOpenSession, ssh_channel_open_session(m_channel.get()));
+                    if (result == SSH_AGAIN)
+                    {
+                        return false;
+                    }
+                    if (result != SSH_OK)
+                    {
+                        ReportError("error opening the sftp channel", session);
+                    }
+                    m_state = State::RequestingSubsystem;
+                    progress = true;
+                }
+                if (m_state == State::RequestingSubsystem)
+                {
+                    auto const result = LIBSSH_CPP_WRAP_TRACE(ChannelRequestSftp, ssh_channel_request_sftp(m_channel.get()));
+                    if (result == SSH_AGAIN)
+                    {
+                        return progress;
+                    }
+                    if (result != SSH_OK)
+                    {
+                        ReportError("error requesting the sftp subsystem", session);
+                    }
+                    // SSH_FXP_INIT carries the version where other packets carry the request id
+                    SftpPacket init(SSH_FXP_INIT, LIBSFTP_VERSION);
+                    Send(init);
+                    m_state = State::Initializing;
+                    progress = true;
+                }
+                progress = Flush(session) || progress;
+                return Receive(session) || progress;
+            }
+
+            bool Flush(ssh_session session)
+            {
+                bool progress = false;
+                while (m_written != m_output.size())
+                {
+                    uint32_t const window = ssh_channel_window_size(m_channel.get());
+                    if (window == 0)
+                    {
+                        break;
+                    }
+                    auto const count = static_cast<uint32_t>((std::min)(m_output.size() - m_written, size_t(window)));
+                    auto const written = LIBSSH_CPP_WRAP_TRACE(ChannelWrite, ssh_channel_write(m_channel.get(), m_output.data() + m_written, count));
+                    if (written == SSH_ERROR)
+                    {
+                        ReportError("error sending the sftp request", session);
+                    }
+                    if (written <= 0)
+                    {
+                        break;
+                    }
+                    m_written += static_cast<size_t>(written);
+                    progress = true;
+                }
+                if (m_written == m_output.size() || m_written > m_output.size() / 2)
+                {
+                    m_output.erase(m_output.begin(), m_output.begin() + static_cast<std::ptrdiff_t>(m_written));
+                    m_written = 0;
+                }
+                return progress;
+            }
+
+            bool Receive(ssh_session session)
+            {
+                bool progress = false;
+                while (true)
+                {
+                    size_t const used = m_input.size();
+                    m_input.resize(used + ReadSize);
+                    int const count = LIBSSH_CPP_WRAP_TRACE(ChannelReadNonBlocking, ssh_channel_read_nonblocking(m_channel.get(), m_input.data() + used, ReadSize, 0));
+                    m_input.resize(used + static_cast<size_t>((std::max)(count, 0)));
+                    if (count == SSH_ERROR)
+                    {
+                        ReportError("error reading the sftp reply", session);
+                    }
+                    if (count <= 0)
+                    {
+                        if (ssh_channel_is_eof(m_channel.get()) != 0)
+                        {
+                            throw std::runtime_error("the server closed the sftp channel");
+                        }
+                        break;
+                    }
+                    progress = true;
+                }
+
+                size_t pos = 0;
+                while (m_input.size() - pos >= 4)
+                {
+                    uint32_t const length = ReadUInt32(m_input.data() + pos);
+                    if (length < 5 || length > MaxSftpPacketSize)
+                    {
+                        throw std::runtime_error("invalid sftp reply");
+                    }
+                    if (m_input.size() - pos - 4 < length)
+                    {
+                        break;
+                    }
+                    SftpReply reply;
+                    reply.m_type = m_input[pos + 4];
+                    reply.m_id = ReadUInt32(m_input.data() + pos + 5);
+                    reply.m_payload.assign(m_input.begin() + static_cast<std::ptrdiff_t>(pos + 9),
+                                           m_input.begin() + static_cast<std::ptrdiff_t>(pos + 4 + length));
+                    pos += 4 + length;
+                    Dispatch(std::move(reply));
+                }
+                m_input.erase(m_input.begin(), m_input.begin() + static_cast<std::ptrdiff_t>(pos));
+                return progress;
+            }
+
+            void Dispatch(SftpReply&& reply)
+            {
+                if (m_state == State::Initializing)
+                {
+                    if (reply.m_type != SSH_FXP_VERSION)
+                    {
+                        throw std::runtime_error("invalid sftp version reply");
+                    }
+                    m_state = State::Ready;
+                    return;
+                }
+                if (m_discarded.erase(reply.m_id) == 0)
+                {
+                    m_replies.emplace(reply.m_id, std::move(reply));
+                }
+            }
+
+            State m_state{ State::Closed };
+            std::unique_ptr<std::remove_pointer_t<ssh_channel>, ActorChannelDeleter> m_channel;
+            std::exception_ptr m_failure;
+            uint32_t m_lastId{ 0 };
+
+            std::vector<uint8_t> m_output;
+            size_t m_written{ 0 };
+            std::vector<uint8_t> m_input;
+
+            std::unordered_map<uint32_t, SftpReply> m_replies;
+            std::unordered_set<uint32_t> m_discarded;
+        };
+
+        /**
+         * \brief a unit of work run by a ConnectionActor in small steps
+         */
+        class ActorJob
+        {
+        public:
+            virtual ~ActorJob() = default;
+
+            /**
+             * \brief does a bounded amount of work without waiting for the server
+             */
+            virtual StepResult Step(ssh_session session, ActorSftp& sftp, StepBudget budget) = 0;
+
+            /**
+             * \brief completes the job with \p error
+             */
+            virtual void Fail(std::exception_ptr error) noexcept = 0;
+        };
+
+        class ExecJob : public ActorJob
+        {
+        public:
+            ExecJob(std::string command, std::ostream& outStream, std::ostream& errorStream, size_t bufferSize)
+                : m_command(std::move(command)),
+                m_outStream(outStream),
+                m_errorStream(errorStream),
+                m_buffer(bufferSize)
+            {
+            }
+
+            std::future<int> GetFuture()
+            {
+                return m_promise.get_future();
+            }
+
+            StepResult Step(ssh_session session, ActorSftp&, StepBudget budget) override
+            {
+                switch (m_state)
+                {
+                case State::Opening:
+                    return Open(session);
+                case State::Requesting:
+                    return RequestExec(session);
+                case State::Reading:
+                    break;
+                }
+
+                bool progress = false;
+                for (int isStdErr = 0; isStdErr != 2; ++isStdErr)
+                {
+                    int const bytesRead = LIBSSH_CPP_WRAP_TRACE(ChannelRead, ssh_channel_read_nonblocking(m_channel.get(), m_buffer.data(), static_cast<uint32_t>((std::min)(budget.m_chunkSize, m_buffer.size())), isStdErr));
+                    if (bytesRead == SSH_ERROR)
+                    {
+                        ReportError("reading the stdin/stdout failed", session);
+                    }
+                    if (bytesRead > 0)
+                    {
+                        (isStdErr ? m_errorStream : m_outStream).write(m_buffer.data(), bytesRead);
+                        progress = true;
+                    }
+                }
+
+                if (progress)
+                {
+                    return StepResult::Progress;
+                }
+                if (ssh_channel_is_eof(m_channel.get()) == 0)
+                {
+                    return StepResult::Idle;
+                }
+
+                // the exit status may follow the end of the output; libssh doesn't wait for it on a non-blocking session
+                int const exitStatus = ssh_channel_get_exit_status(m_channel.get());
+                if (exitStatus == -1 && ssh_channel_is_closed(m_channel.get()) == 0)
+                {
+                    return StepResult::Idle;
+                }
+                LIBSSH_CPP_WRAP_TRACE(ChannelClose, ssh_channel_close(m_channel.get()));
+                m_channel.reset();
+                m_promise.set_value(exitStatus);
+                return StepResult::Done;
+            }
+
+            void Fail(std::exception_ptr error) noexcept override
+            {
+                m_channel.reset();
+                m_promise.set_exception(std::move(error));
+            }
+
+        private:
+            enum class State
+            {
+                Opening,
+                Requesting,
+                Reading,
+            };
+
+            StepResult Open(ssh_session session)
+            {
+                if (!m_channel)
+                {
+                    auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelNew, ssh_channel_new(session));
+                    if (channel == nullptr)
+                    {
+                        throw std::runtime_error("error generating ssh command channel");
+                    }
+                    m_channel.reset(channel);
+                }
+                auto const result = LIBSSH_CPP_WRAP_TRACE(ChannelOpenSession, ssh_channel_open_session(m_channel.get()));
+                if (result == SSH_AGAIN)
+                {
+                    return StepResult::Idle;
+                }
+                if (result != SSH_OK)
+                {
+                    ReportError("error opening channel session", session);
+                }
+                m_state = State::Requesting;
+                return StepResult::Progress;
+            }
+
+            StepResult RequestExec(ssh_session session)
+            {
+                auto const result = LIBSSH_CPP_WRAP_TRACE(ChannelRequestExec, ssh_channel_request_exec(m_channel.get(), m_command.c_str()));
+                if (result == SSH_AGAIN)
+                {
+                    return StepResult::Idle;
+                }
+                if (result != SSH_OK)
+                {
+                    ReportError("command execution failed", session);
+                }
+                m_state = State::Reading;
+                return StepResult::Progress;
+            }
+
+            std::string m_command;
+            std::ostream& m_outStream;
+            std::ostream& m_errorStream;
+            std::vector<char> m_buffer;
+            State m_state{ State::Opening };
+            std::unique_ptr<std::remove_pointer_t<ssh_channel>, ActorChannelDeleter> m_channel;
+            std::promise<int> m_promise;
+        };
+
+        /**
+         * \brief base for jobs transferring a sftp file with several requests in flight
+         */
+        class FileTransferJob : public ActorJob
+        {
+        public:
+            FileTransferJob(std::string remotePath, uint32_t openFlags, std::optional<FilePermissions> permissions, size_t chunkSize)
+                : m_buffer(chunkSize),
+                m_remotePath(std::move(remotePath)),
+                m_openFlags(openFlags),
+                m_permissions(permissions)
+            {
+            }
+
+            std::future<uint64_t> GetFuture()
+            {
+                return m_promise.get_future();
+            }
+
+            StepResult Step(ssh_session session, ActorSftp& sftp, StepBudget budget) override
+            {
+                m_sftp = &sftp;
+                if (!sftp.Ready(session))
+                {
+                    return StepResult::Idle;
+                }
+
+                switch (m_state)
+                {
+                case State::Start:
+                    {
+                        m_requestId = sftp.NextId();
+                        SftpPacket packet(SSH_FXP_OPEN, m_requestId);
+                        packet.AppendString(m_remotePath);
+                        packet.AppendUInt32(m_openFlags);
+                        packet.AppendUInt32(m_permissions.has_value() ? SSH_FILEXFER_ATTR_PERMISSIONS : 0);
+                        if (m_permissions.has_value())
+                        {
+                            packet.AppendUInt32(static_cast<uint32_t>(static_cast<mode_t>(*m_permissions)));
+                        }
+                        sftp.Send(packet);
+                        m_state = State::Opening;
+                        return StepResult::Progress;
+                    }
+                case State::Opening:
+                    {
+                        auto const reply = sftp.TakeReply(m_requestId);
+                        if (!reply)
+                        {
+                            return StepResult::Idle;
+                        }
+                        if (reply->m_type != SSH_FXP_HANDLE)
+                        {
+                            ThrowSftpStatus("error opening file", *reply);
+                        }
+                        auto const& payload = reply->m_payload;
+                        if (payload.size() < 4 || ReadUInt32(payload.data()) != payload.size() - 4)
+                        {
+                            throw std::runtime_error("invalid sftp reply");
+                        }
+                        m_handle.assign(payload.begin() + 4, payload.end());
+                        m_state = State::Transferring;
+                        return StepResult::Progress;
+                    }
+                case State::Transferring:
+                    {
+                        StepBudget const limited{ (std::min)(budget.m_chunkSize, m_buffer.size()), (std::max)(budget.m_maxOutstanding, size_t(1)) };
+                        if (Transfer(sftp, limited))
+                        {
+                            return StepResult::Progress;
+                        }
+                        if (!Complete())
+                        {
+                            return StepResult::Idle;
+                        }
+                        m_requestId = sftp.NextId();
+                        SftpPacket packet(SSH_FXP_CLOSE, m_requestId);
+                        packet.AppendString(m_handle.data(), m_handle.size());
+                        sftp.Send(packet);
+                        m_handle.clear();
+                        m_state = State::Closing;
+                        return StepResult::Progress;
+                    }
+                case State::Closing:
+                    break;
+                }
+
+                auto const reply = sftp.TakeReply(m_requestId);
+                if (!reply)
+                {
+                    return StepResult::Idle;
+                }
+                if (reply->Status() != SSH_FX_OK)
+                {
+                    ThrowSftpStatus("error closing file", *reply);
+                }
+                m_promise.set_value(m_transferred);
+                return StepResult::Done;
+            }
+
+            void Fail(std::exception_ptr error) noexcept override
+            {
+                if (m_sftp != nullptr)
+                {
+                    try
+                    {
+                        // the replies would otherwise be kept forever
+                        for (auto const& request : m_pending)
+                        {
+                            m_sftp->Discard(request.m_id);
+                        }
+                        if (m_state == State::Opening || m_state == State::Closing)
+                        {
+                            m_sftp->Discard(m_requestId);
+                        }
+                        if (!m_handle.empty())
+                        {
+                            uint32_t const id = m_sftp->NextId();
+                            SftpPacket packet(SSH_FXP_CLOSE, id);
+                            packet.AppendString(m_handle.data(), m_handle.size());
+                            m_sftp->Send(packet);
+                            m_sftp->Discard(id);
+                        }
+                    }
+                    catch (...)
+                    {
+                        // the channel is unusable anyways
+                    }
+                }
+                m_promise.set_exception(std::move(error));
+            }
+
+        protected:
+            struct Request
+            {
+                uint32_t m_id;
+                uint64_t m_offset;
+                uint32_t m_size;
+            };
+
+            /**
+             * \brief sends new requests and processes the replies that arrived
+             *
+             * \return true, if the job made progress
+             */
+            virtual bool Transfer(ActorSftp& sftp, StepBudget budget) = 0;
+
+            /**
+             * \return true, once all data was transferred and acknowledged
+             */
+            virtual bool Complete() const noexcept = 0;
+
+            std::vector<char> m_buffer;
+            std::vector<uint8_t> m_handle;
+            std::deque<Request> m_pending;
+            uint64_t m_transferred{ 0 };
+
+        private:
+            enum class State
+            {
+                Start,
+                Opening,
+                Transferring,
+                Closing,
+            };
+
+            std::string m_remotePath;
+            uint32_t m_openFlags;
+            std::optional<FilePermissions> m_permissions;
+            State m_state{ State::Start };
+            uint32_t m_requestId{ 0 };
+            ActorSftp* m_sftp{ nullptr };
+            std::promise<uint64_t> m_promise;
+        };
+
+        class UploadJob : public FileTransferJob
+        {
+        public:
+            UploadJob(std::istream& in, std::string remotePath, FilePermissions permissions, size_t chunkSize)
+                : FileTransferJob(std::move(remotePath), SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC, permissions, chunkSize),
+                m_in(in)
+            {
+            }
+
+        protected:
+            bool Transfer(ActorSftp& sftp, StepBudget budget) override
+            {
+                bool progress = false;
+                for (auto pos = m_pending.begin(); pos != m_pending.end();)
+                {
+                    auto const reply = sftp.TakeReply(pos->m_id);
+                    if (!reply)
+                    {
+                        ++pos;
+                        continue;
+                    }
+                    if (reply->Status() != SSH_FX_OK)
+                    {
+                        ThrowSftpStatus("error writing file", *reply);
+                    }
+                    m_transferred += pos->m_size;
+                    pos = m_pending.erase(pos);
+                    progress = true;
+                }
+
+                // one chunk per step keeps the share of the connection fair
+                if (!m_endOfInput && m_pending.size() < budget.m_maxOutstanding)
+                {
+                    m_in.read(m_buffer.data(), static_cast<std::streamsize>(budget.m_chunkSize));
+                    if (m_in.bad())
+                    {
+                        throw std::runtime_error("error reading input stream");
+                    }
+                    m_endOfInput = !m_in;
+                    auto const count = static_cast<uint32_t>(m_in.gcount());
+                    if (count != 0)
+                    {
+                        uint32_t const id = sftp.NextId();
+                        SftpPacket packet(SSH_FXP_WRITE, id);
+                        packet.AppendString(m_handle.data(), m_handle.size());
+                        packet.AppendUInt64(m_offset);
+                        packet.AppendString(m_buffer.data(), count);
+                        sftp.Send(packet);
+                        m_pending.push_back(Request{ id, m_offset, count });
+                        m_offset += count;
+                    }
+                    progress = true;
+                }
+                return progress;
+            }
+
+            bool Complete() const noexcept override
+            {
+                return m_endOfInput && m_pending.empty();
+            }
+
+        private:
+            std::istream& m_in;
+            uint64_t m_offset{ 0 };
+            bool m_endOfInput{ false };
+        };
+
+        class DownloadJob : public FileTransferJob
+        {
+        public:
+            DownloadJob(std::string remotePath, std::ostream& out, size_t chunkSize)
+                : FileTransferJob(std::move(remotePath), SSH_FXF_READ, std::nullopt, chunkSize),
+                m_out(out)
+            {
+            }
+
+        protected:
+            bool Transfer(ActorSftp& sftp, StepBudget budget) override
+            {
+                bool progress = false;
+
+                // the data is written in the order of the requests
+                size_t moved = 0;
+                while (!m_pending.empty() && moved < budget.m_chunkSize)
+                {
+                    auto const reply = sftp.TakeReply(m_pending.front().m_id);
+                    if (!reply)
+                    {
+                        break;
+                    }
+                    auto const request = m_pending.front();
+                    m_pending.pop_front();
+                    progress = true;
+
+                    if (reply->m_type != SSH_FXP_DATA)
+                    {
+                        if (reply->Status() != SSH_FX_EOF)
+                        {
+                            ThrowSftpStatus("error reading file", *reply);
+                        }
+                        m_endOfFile = true;
+                        break;
+                    }
+                    auto const& payload = reply->m_payload;
+                    if (payload.size() < 4 || ReadUInt32(payload.data()) != payload.size() - 4 || payload.size() - 4 > request.m_size)
+                    {
+                        throw std::runtime_error("invalid sftp reply");
+                    }
+                    auto const count = static_cast<uint32_t>(payload.size() - 4);
+                    if (count == 0)
+                    {
+                        m_endOfFile = true;
+                        break;
+                    }
+                    m_out.write(reinterpret_cast<char const*>(payload.data() + 4), count);
+                    if (!m_out)
+                    {
+                        throw std::runtime_error("error writing the contents read via ssh to output stream");
+                    }
+                    m_transferred += count;
+                    moved += count;
+                    if (count < request.m_size)
+                    {
+                        // the rest of a short read goes before the requests already sent for later parts
+                        m_pending.push_front(SendRead(sftp, request.m_offset + count, request.m_size - count));
+                    }
+                }
+
+                if (m_endOfFile)
+                {
+                    // the requests following the end of the file
+                    for (auto const& request : m_pending)
+                    {
+                        sftp.Discard(request.m_id);
+                    }
+                    m_pending.clear();
+                    return progress;
+                }
+
+                if (m_pending.size() < budget.m_maxOutstanding)
+                {
+                    auto const size = static_cast<uint32_t>((std::min)(budget.m_chunkSize, size_t(MaxSftpPacketSize - 1024)));
+                    m_pending.push_back(SendRead(sftp, m_offset, size));
+                    m_offset += size;
+                    progress = true;
+                }
+                return progress;
+            }
+
+            bool Complete() const noexcept override
+            {
+                return m_endOfFile;
+            }
+
+        private:
+            Request SendRead(ActorSftp& sftp, uint64_t offset, uint32_t size)
+            {
+                uint32_t const id = sftp.NextId();
+                SftpPacket packet(SSH_FXP_READ, id);
+                packet.AppendString(m_handle.data(), m_handle.size());
+                packet.AppendUInt64(offset);
+                packet.AppendUInt32(size);
+                sftp.Send(packet);
+                return Request{ id, offset, size };
+            }
+
+            std::ostream& m_out;
+            uint64_t m_offset{ 0 };
+            bool m_endOfFile{ false };
+        };
+    }
+
+    /**
+     * \brief Serializes all libssh calls for a connection on a single thread
+     *
+     * libssh sessions must not be used from multiple threads at once. The actor owns the session: any number of threads
+     * may submit commands and transfers, which run interleaved on the actor's thread, one step (a read of the available
+     * command output or one chunk of a transfer) per job in turn. Submitted work completes via the returned futures.
+     *
+     * The session is switched to non-blocking mode while the actor exists, and no step waits for the server: channels
+     * are opened and commands started without waiting for the replies, and transfers keep up to \c maxOutstanding sftp
+     * requests in flight and pick up the replies as they arrive.
+     *
+     * Streams passed to the actor need to stay valid until the corresponding future is ready. The connection must not
+     * be used by anything but the actor while the actor exists.
+     *
+     * Each round steps the jobs of PriorityClass::Interactive before the bulk jobs. While interactive jobs exist, bulk
+     * jobs send new requests of at most \c contendedChunkSize bytes one at a time, so the data queued in front of a
+     * command's packets stays small even during large transfers.
+     */
+    class ConnectionActor
+    {
+    public:
+        explicit ConnectionActor(std::shared_ptr<AuthenticatedConnection> connection, size_t chunkSize = 32768, size_t maxOutstanding = 16,
+                                 size_t contendedChunkSize = 4096)
+            : m_connection(std::move(connection)),
+            m_chunkSize((std::clamp)(chunkSize, size_t(1), size_t(detail::MaxSftpPacketSize - 1024))),
+            m_contendedChunkSize((std::max)((std::min)(contendedChunkSize, m_chunkSize), size_t(1))),
+            m_maxOutstanding((std::max)(maxOutstanding, size_t(1)))
+        {
+            if (!m_connection)
+            {
+                throw std::runtime_error("no valid connection passed");
+            }
+            m_thread = std::thread(&ConnectionActor::Run, this);
+        }
+
+        ConnectionActor(ConnectionActor const&) = delete;
+        ConnectionActor& operator=(ConnectionActor const&) = delete;
+
+        /**
+         * \brief stops the actor; unfinished jobs fail
+         */
+        ~ConnectionActor() noexcept
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            m_thread.join();
+        }
+
+        /**
+         * \brief runs \p command in a new channel
+         *
+         * \return the exit status of the command
+         */
+        std::future<int> Execute(std::string command, std::ostream& outStream, std::ostream& errorStream,
+                                 PriorityClass priority = PriorityClass::Interactive)
+        {
+            auto job = std::make_unique<detail::ExecJob>(std::move(command), outStream, errorStream, m_chunkSize);
+            auto future = job->GetFuture();
+            Submit(std::move(job), priority);
+            return future;
+        }
+
+        /**
+         * \brief writes the remaining contents of \p in to \p remotePath, replacing existing content
+         *
+         * \return the number of bytes written
+         */
+        std::future<uint64_t> Upload(std::istream& in, std::string remotePath, FilePermissions permissions,
+                                     PriorityClass priority = PriorityClass::Bulk)
+        {
+            auto job = std::make_unique<detail::UploadJob>(in, std::move(remotePath), permissions, m_chunkSize);
+            auto future = job->GetFuture();
+            Submit(std::move(job), priority);
+            return future;
+        }
+
+        /**
+         * \brief writes the contents of \p remotePath to \p out
+         *
+         * \return the number of bytes read
+         */
+        std::future<uint64_t> Download(std::string remotePath, std::ostream& out, PriorityClass priority = PriorityClass::Bulk)
+        {
+            auto job = std::make_unique<detail::DownloadJob>(std::move(remotePath), out, m_chunkSize);
+            auto future = job->GetFuture();
+            Submit(std::move(job), priority);
+            return future;
+        }
+
+    private:
+        using JobList = std::list<std::unique_ptr<detail::ActorJob>>;
+
+        void Submit(std::unique_ptr<detail::ActorJob> job, PriorityClass priority)
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_stop)
+                {
+                    throw std::runtime_error("the connection actor is stopped");
+                }
+                (priority == PriorityClass::Interactive ? m_submittedInteractive : m_submittedBulk).push_back(std::move(job));
+            }
+            m_condition.notify_one();
+        }
+
+        /**
+         * \brief steps each job of \p jobs once
+         *
+         * \return true, if any job made progress
+         */
+        static bool StepJobs(JobList& jobs, ssh_session session, detail::ActorSftp& sftp, detail::StepBudget budget) noexcept
+        {
+            bool progress = false;
+            for (auto pos = jobs.begin(); pos != jobs.end();)
+            {
+                detail::StepResult result;
+                try
+                {
+                    result = (*pos)->Step(session, sftp, budget);
+                }
+                catch (...)
+                {
+                    (*pos)->Fail(std::current_exception());
+                    result = detail::StepResult::Done;
+                }
+
+                progress = progress || result != detail::StepResult::Idle;
+                pos = (result == detail::StepResult::Done) ? jobs.erase(pos) : std::next(pos);
+            }
+            return progress;
+        }
+
+        void Run() noexcept
+        {
+            auto session = m_connection->GetSession();
+            ssh_set_blocking(session, 0);
+            detail::ActorSftp sftp;
+            JobList interactive;
+            JobList bulk;
+
+            while (true)
+            {
+                {
+                    std::unique_lock lock(m_mutex);
+                    if (interactive.empty() && bulk.empty())
+                    {
+                        m_condition.wait(lock, [this] { return m_stop || !m_submittedInteractive.empty() || !m_submittedBulk.empty(); });
+                    }
+                    if (m_stop)
+                    {
+                        break;
+                    }
+                    interactive.splice(interactive.end(), m_submittedInteractive);
+                    bulk.splice(bulk.end(), m_submittedBulk);
+                }
+
+                detail::StepBudget const full{ m_chunkSize, m_maxOutstanding };
+                bool progress = StepJobs(interactive, session, sftp, full);
+                progress = StepJobs(bulk, session, sftp, interactive.empty() ? full : detail::StepBudget{ m_contendedChunkSize, 1 }) || progress;
+
+                // sends the requests queued by the jobs and collects the replies for the next round
+                progress = sftp.Pump(session) || progress;
+
+                if (!progress)
+                {
+                    WaitForData(session);
+                }
+            }
+
+            auto const error = std::make_exception_ptr(std::runtime_error("the connection actor was stopped"));
+            {
+                std::lock_guard lock(m_mutex);
+                interactive.splice(interactive.end(), m_submittedInteractive);
+                bulk.splice(bulk.end(), m_submittedBulk);
+            }
+            for (auto jobs : { &interactive, &bulk })
+            {
+                for (auto& job : *jobs)
+                {
+                    job->Fail(error);
+                }
+                jobs->clear();
+            }
+            ssh_set_blocking(session, 1);
+        }
+
+        /**
+         * \brief waits for the socket to become readable; returns after a short timeout to pick up new jobs
+         */
+        static void WaitForData(ssh_session session) noexcept
+        {
+            detail::PollDescriptor descriptor{};
+            descriptor.fd = ssh_get_fd(session);
+            descriptor.events = POLLIN;
+            detail::Poll(&descriptor, 1, std::chrono::milliseconds(10));
+        }
+
+        std::shared_ptr<AuthenticatedConnection> m_connection;
+        size_t m_chunkSize;
+        size_t m_contendedChunkSize;
+        size_t m_maxOutstanding;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        JobList m_submittedInteractive;
+        JobList m_submittedBulk;
+        bool m_stop{ false };
+
+        std::thread m_thread;
+    };
+
+}
+
+#endif
@@ -0,0 +1,398 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_EXECUTOR
+#define LIBSSH_CPP_WRAP_EXECUTOR
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief a move only callable without parameters and return value
+     */
+    class Task
+    {
+    public:
+        Task() noexcept = default;
+
+        template<class F>
+            requires (!std::is_same_v<std::remove_cvref_t<F>, Task>) && std::is_invocable_v<std::decay_t<F>&>
+        Task(F&& function)
+            : m_impl(new Impl<std::decay_t<F>>(std::forward<F>(function), nullptr))
+        {
+        }
+
+        /**
+         * \brief creates a task storing \p function in memory allocated from \p resource
+         */
+        template<class F>
+            requires std::is_invocable_v<std::decay_t<F>&>
+        Task(std::allocator_arg_t, std::pmr::memory_resource* resource, F&& function)
+        {
+            using ImplType = Impl<std::decay_t<F>>;
+            void* memory = resource->allocate(sizeof(ImplType), alignof(ImplType));
+            try
+            {
+                m_impl.reset(new (memory) ImplType(std::forward<F>(function), resource));
+            }
+            catch (...)
+            {
+                resource->deallocate(memory, sizeof(ImplType), alignof(ImplType));
+                throw;
+            }
+        }
+
+        Task(Task&&) noexcept = default;
+        Task& operator=(Task&&) noexcept = default;
+
+        void operator()()
+        {
+            m_impl->Run();
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return static_cast<bool>(m_impl);
+        }
+
+    private:
+        struct Base
+        {
+            virtual void Run() = 0;
+            virtual void Destroy() noexcept = 0;
+
+        protected:
+            ~Base() = default;
+        };
+
+        template<class F>
+        struct Impl final : Base
+        {
+            template<class G>
+            Impl(G&& function, std::pmr::memory_resource* resource)
+                : m_function(std::forward<G>(function)),
+                m_resource(resource)
+            {
+            }
+
+            void Run() override
+            {
+                m_function();
+            }
+
+            void Destroy() noexcept override
+            {
+                if (m_resource == nullptr)
+                {
+                    delete this;
+                }
+                else
+                {
+                    auto resource = m_resource;
+                    this->~Impl();
+                    resource->deallocate(this, sizeof(Impl), alignof(Impl));
+                }
+            }
+
+            F m_function;
+            std::pmr::memory_resource* m_resource;
+        };
+
+        struct ImplDeleter
+        {
+            void operator()(Base* impl) const noexcept
+            {
+                impl->Destroy();
+            }
+        };
+
+        std::unique_ptr<Base, ImplDeleter> m_impl;
+    };
+
+    /**
+     * \brief something running tasks, e.g. a thread pool
+     */
+    template<class T>
+    concept Executor = requires(T & executor, Task && task)
+    {
+        executor.Post(std::move(task));
+    };
+
+    /**
+     * \brief runs tasks immediately on the posting thread
+     */
+    struct InlineExecutor
+    {
+        void Post(Task&& task)
+        {
+            task();
+        }
+    };
+
+    /**
+     * \brief A work stealing thread pool
+     *
+     * Every worker has its own queue; tasks posted from a worker go to the worker's queue and are taken LIFO by the
+     * worker itself, idle workers steal from the other end of the queues of other workers. Tasks posted from other
+     * threads are distributed round robin.
+     */
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(size_t threadCount = (std::max)(std::thread::hardware_concurrency(), 1u))
+        {
+            threadCount = (std::max)(threadCount, size_t(1));
+            m_queues.reserve(threadCount);
+            for (size_t i = 0; i != threadCount; ++i)
+            {
+                m_queues.push_back(std::make_unique<Queue>());
+            }
+            m_threads.reserve(threadCount);
+            for (size_t i = 0; i != threadCount; ++i)
+            {
+                m_threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+            }
+        }
+
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator=(ThreadPool const&) = delete;
+
+        /**
+         * \brief runs the remaining tasks and stops the workers
+         */
+        ~ThreadPool() noexcept
+        {
+            {
+                std::lock_guard lock(m_sleepMutex);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+            for (auto& thread : m_threads)
+            {
+                thread.join();
+            }
+        }
+
+        void Post(Task&& task)
+        {
+            size_t const index = (t_pool == this) ? t_workerIndex : (m_nextQueue++ % m_queues.size());
+            {
+                std::lock_guard lock(m_queues[index]->m_mutex);
+                m_queues[index]->m_tasks.push_back(std::move(task));
+            }
+            {
+                std::lock_guard lock(m_sleepMutex);
+                ++m_pending;
+            }
+            m_wake.notify_one();
+        }
+
+        [[nodiscard]] size_t ThreadCount() const noexcept
+        {
+            return m_threads.size();
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex m_mutex;
+            std::deque<Task> m_tasks;
+        };
+
+        bool TryTake(size_t index, Task& task)
+        {
+            {
+                auto& own = *m_queues[index];
+                std::lock_guard lock(own.m_mutex);
+                if (!own.m_tasks.empty())
+                {
+                    task = std::move(own.m_tasks.back());
+                    own.m_tasks.pop_back();
+                    return true;
+                }
+            }
+            for (size_t offset = 1; offset != m_queues.size(); ++offset)
+            {
+                auto& other = *m_queues[(index + offset) % m_queues.size()];
+                std::lock_guard lock(other.m_mutex);
+                if (!other.m_tasks.empty())
+                {
+                    task = std::move(other.m_tasks.front());
+                    other.m_tasks.pop_front();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void WorkerLoop(size_t index) noexcept
+        {
+            t_pool = this;
+            t_workerIndex = index;
+
+            while (true)
+            {
+                Task task;
+                if (TryTake(index, task))
+                {
+                    {
+                        std::lock_guard lock(m_sleepMutex);
+                        --m_pending;
+                    }
+                    try
+                    {
+                        task();
+                    }
+                    catch (...)
+                    {
+                        // tasks report errors via their own channels, e.g. promises
+                    }
+                    continue;
+                }
+
+                std::unique_lock lock(m_sleepMutex);
+                if (m_stop && m_pending == 0)
+                {
+                    return;
+                }
+                m_wake.wait(lock, [this] { return m_stop || m_pending != 0; });
+                if (m_stop && m_pending == 0)
+                {
+                    return;
+                }
+            }
+        }
+
+        static inline thread_local ThreadPool* t_pool = nullptr;
+        static inline thread_local size_t t_workerIndex = 0;
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::atomic<size_t> m_nextQueue{ 0 };
+
+        std::mutex m_sleepMutex;
+        std::condition_variable m_wake;
+        size_t m_pending{ 0 };
+        bool m_stop{ false };
+
+        std::vector<std::thread> m_threads;
+    };
+
+    /**
+     * \return the pool for cpu bound work, one thread per core
+     */
+    inline ThreadPool& DefaultExecutor()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    /**
+     * \return the pool for blocking libssh calls; bounded to avoid a thread per call under bursty load
+     */
+    inline ThreadPool& IoExecutor()
+    {
+        static ThreadPool pool((std::min)(size_t(64), (std::max)(size_t(4), size_t(4) * std::thread::hardware_concurrency())));
+        return pool;
+    }
+
+    namespace detail
+    {
+        /**
+         * \brief invokes a function and passes the result or the exception to a promise
+         */
+        template<class Result, class F>
+        struct PromiseFulfiller
+        {
+            void operator()()
+            {
+                try
+                {
+                    if constexpr (std::is_void_v<Result>)
+                    {
+                        m_function();
+                        m_promise.set_value();
+                    }
+                    else
+                    {
+                        m_promise.set_value(m_function());
+                    }
+                }
+                catch (...)
+                {
+                    m_promise.set_exception(std::current_exception());
+                }
+            }
+
+            std::promise<Result> m_promise;
+            F m_function;
+        };
+    }
+
+    /**
+     * \brief runs \p function on \p executor
+     *
+     * \return a future for the result of \p function
+     */
+    template<Executor E, class F>
+    auto Submit(E& executor, F&& function) -> std::future<std::invoke_result_t<std::decay_t<F>&>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>&>;
+
+        std::promise<Result> promise;
+        auto future = promise.get_future();
+        executor.Post(Task(detail::PromiseFulfiller<Result, std::decay_t<F>>{ std::move(promise), std::forward<F>(function) }));
+        return future;
+    }
+
+    /**
+     * \brief runs \p function on \p executor allocating the task and the shared state of the future from \p resource
+     *
+     * Passing a pool resource avoids heap allocations per operation once the pool is warm. The executor releases the
+     * task after the future became ready, so \p resource needs to outlive the executor.
+     *
+     * \return a future for the result of \p function
+     */
+    template<Executor E, class F>
+    auto Submit(E& executor, std::pmr::memory_resource* resource, F&& function) -> std::future<std::invoke_result_t<std::decay_t<F>&>>
+    {
+        using Result = std::invoke_result_t<std::decay_t<F>&>;
+
+        std::promise<Result> promise(std::allocator_arg, std::pmr::polymorphic_allocator<>(resource));
+        auto future = promise.get_future();
+        executor.Post(Task(std::allocator_arg, resource, detail::PromiseFulfiller<Result, std::decay_t<F>>{ std::move(promise), std::forward<F>(function) }));
+        return future;
+    }
+
+}
+
+#endif
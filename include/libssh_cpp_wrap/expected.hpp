@@ -0,0 +1,396 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_EXPECTED
+#define LIBSSH_CPP_WRAP_EXPECTED
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "libssh/libssh.h"
+#include "libssh/sftp.h"
+
+#include "buffer_pool.hpp"
+#include "cancellation.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief A failed operation of the non-throwing Try* functions
+     *
+     * Creating an error doesn't allocate: the context is a string literal and the text of the libssh error is copied to
+     * a fixed buffer, truncated if necessary. The message is only built by Message().
+     */
+    class SshError
+    {
+    public:
+        static constexpr int NoSftpStatus = -1;
+
+        static constexpr size_t MaxDetailsLength = 255;
+
+        /**
+         * \param context a description of the failed operation; needs to outlive the error, e.g. a string literal
+         * \param details the error text of libssh
+         */
+        explicit SshError(char const* context, int sshCode = SSH_NO_ERROR, int sftpStatus = NoSftpStatus, std::string_view details = {}) noexcept
+            : m_context(context),
+            m_sshCode(sshCode),
+            m_sftpStatus(sftpStatus),
+            m_detailsLength((std::min)(details.size(), MaxDetailsLength))
+        {
+            std::memcpy(m_details, details.data(), m_detailsLength);
+        }
+
+        SshError(std::nullptr_t, int = SSH_NO_ERROR, int = NoSftpStatus, std::string_view = {}) = delete;
+
+        /**
+         * \brief the error of the last failed libssh call on \p entity, e.g. a session
+         */
+        [[nodiscard]] static SshError FromSession(char const* context, void* entity) noexcept
+        {
+            auto const message = ssh_get_error(entity);
+            return SshError(context, ssh_get_error_code(entity), NoSftpStatus,
+                            message == nullptr ? std::string_view("SSH ERROR UNAVAILABLE") : std::string_view(message));
+        }
+
+        /**
+         * \brief the error of the last failed request of \p sftp
+         */
+        [[nodiscard]] static SshError FromSftp(char const* context, sftp_session sftp) noexcept
+        {
+            auto error = FromSession(context, sftp->session);
+            error.m_sftpStatus = sftp_get_error(sftp);
+            return error;
+        }
+
+        [[nodiscard]] static SshError Cancelled(detail::CancelReason reason) noexcept
+        {
+            SshError error(reason == detail::CancelReason::Deadline ? "deadline exceeded" : "operation cancelled");
+            error.m_cancelReason = reason;
+            return error;
+        }
+
+        [[nodiscard]] char const* Context() const noexcept
+        {
+            return m_context;
+        }
+
+        /**
+         * \return the libssh error code (SSH_NO_ERROR, SSH_REQUEST_DENIED, SSH_FATAL, ...)
+         */
+        [[nodiscard]] int SshCode() const noexcept
+        {
+            return m_sshCode;
+        }
+
+        /**
+         * \return the status of the failed sftp request (SSH_FX_NO_SUCH_FILE, ...); NoSftpStatus for other operations
+         */
+        [[nodiscard]] int SftpStatus() const noexcept
+        {
+            return m_sftpStatus;
+        }
+
+        [[nodiscard]] std::string_view Details() const noexcept
+        {
+            return { m_details, m_detailsLength };
+        }
+
+        /**
+         * \return true, if the operation was aborted because of its deadline or a stop request
+         */
+        [[nodiscard]] bool IsCancelled() const noexcept
+        {
+            return m_cancelReason != detail::CancelReason::None;
+        }
+
+        /**
+         * \return the message the throwing variant of the operation reports, e.g. "error opening file: ..."
+         */
+        [[nodiscard]] std::string Message() const
+        {
+            std::string message = m_context;
+            if (m_detailsLength != 0)
+            {
+                message += ": ";
+                message.append(m_details, m_detailsLength);
+            }
+            return message;
+        }
+
+        /**
+         * \exception OperationCancelled If the operation was cancelled
+         * \exception ::std::runtime_error otherwise
+         */
+        [[noreturn]] void Throw() const
+        {
+            detail::CancellationGuard::ThrowCancelled(m_cancelReason);
+            throw std::runtime_error(Message());
+        }
+
+    private:
+        char const* m_context;
+        int m_sshCode;
+        int m_sftpStatus;
+        detail::CancelReason m_cancelReason{ detail::CancelReason::None };
+        size_t m_detailsLength;
+        char m_details[MaxDetailsLength]{};
+    };
+
+    /**
+     * \brief the error alternative of Expected
+     */
+    class Unexpected
+    {
+    public:
+        explicit Unexpected(SshError const& error) noexcept
+            : m_error(error)
+        {
+        }
+
+        [[nodiscard]] SshError const& error() const noexcept
+        {
+            return m_error;
+        }
+
+    private:
+        SshError m_error;
+    };
+
+    /**
+     * \brief A value or the error preventing it, modelled on a subset of std::expected<T, SshError>
+     *
+     * This type is used regardless of the standard library, so the behaviour doesn't depend on the language version:
+     * unlike std::expected, value() throws the exception of SshError::Throw(), as ValueOrThrow does.
+     */
+    template<class T>
+    class Expected
+    {
+    public:
+        using value_type = T;
+        using error_type = SshError;
+
+        template<class U = T>
+            requires std::is_constructible_v<T, U&&> && (!std::is_same_v<std::remove_cvref_t<U>, Expected>)
+                && (!std::is_same_v<std::remove_cvref_t<U>, Unexpected>)
+        Expected(U&& value)
+            : m_storage(std::in_place_index<0>, std::forward<U>(value))
+        {
+        }
+
+        Expected(Unexpected const& error) noexcept
+            : m_storage(std::in_place_index<1>, error.error())
+        {
+        }
+
+        [[nodiscard]] bool has_value() const noexcept
+        {
+            return m_storage.index() == 0;
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+
+        [[nodiscard]] T& operator*() & noexcept
+        {
+            return *std::get_if<0>(&m_storage);
+        }
+
+        [[nodiscard]] T const& operator*() const& noexcept
+        {
+            return *std::get_if<0>(&m_storage);
+        }
+
+        [[nodiscard]] T&& operator*() && noexcept
+        {
+            return std::move(*std::get_if<0>(&m_storage));
+        }
+
+        [[nodiscard]] T* operator->() noexcept
+        {
+            return std::get_if<0>(&m_storage);
+        }
+
+        [[nodiscard]] T const* operator->() const noexcept
+        {
+            return std::get_if<0>(&m_storage);
+        }
+
+        [[nodiscard]] T& value() &
+        {
+            ThrowIfError();
+            return **this;
+        }
+
+        [[nodiscard]] T&& value() &&
+        {
+            ThrowIfError();
+            return std::move(**this);
+        }
+
+        [[nodiscard]] SshError const& error() const noexcept
+        {
+            return *std::get_if<1>(&m_storage);
+        }
+
+    private:
+        void ThrowIfError() const
+        {
+            if (!has_value())
+            {
+                error().Throw();
+            }
+        }
+
+        std::variant<T, SshError> m_storage;
+    };
+
+    template<>
+    class Expected<void>
+    {
+    public:
+        using value_type = void;
+        using error_type = SshError;
+
+        Expected() noexcept = default;
+
+        Expected(Unexpected const& error) noexcept
+            : m_error(error.error())
+        {
+        }
+
+        [[nodiscard]] bool has_value() const noexcept
+        {
+            return !m_error.has_value();
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept
+        {
+            return has_value();
+        }
+
+        void value() const
+        {
+            if (m_error.has_value())
+            {
+                m_error->Throw();
+            }
+        }
+
+        [[nodiscard]] SshError const& error() const noexcept
+        {
+            return *m_error;
+        }
+
+    private:
+        std::optional<SshError> m_error;
+    };
+
+    /**
+     * \return the value of \p result
+     *
+     * \exception OperationCancelled If the operation was cancelled
+     * \exception ::std::runtime_error If the operation failed otherwise
+     */
+    template<class T>
+        requires (!std::is_void_v<T>)
+    T ValueOrThrow(Expected<T>&& result)
+    {
+        if (!result)
+        {
+            result.error().Throw();
+        }
+        return std::move(*result);
+    }
+
+    /**
+     * \exception OperationCancelled If the operation was cancelled
+     * \exception ::std::runtime_error If the operation failed otherwise
+     */
+    inline void ValueOrThrow(Expected<void> const& result)
+    {
+        if (!result)
+        {
+            result.error().Throw();
+        }
+    }
+
+    namespace detail
+    {
+
+        /**
+         * \brief runs \p function, which returns an Expected, aborting it via a CancellationGuard; errors caused by
+         *        the abort are returned as SshError::Cancelled
+         */
+        template<class F>
+        auto TryWithCancellation(ssh_session session, Deadline deadline, std::stop_token const& stopToken, F&& function)
+            -> std::invoke_result_t<F&&>
+        {
+            using Result = std::invoke_result_t<F&&>;
+            if (deadline == NoDeadline && !stopToken.stop_possible())
+            {
+                return std::forward<F>(function)();
+            }
+
+            auto const due = CancellationGuard::Due(deadline, stopToken);
+            if (due != CancelReason::None)
+            {
+                return Result(Unexpected(SshError::Cancelled(due)));
+            }
+
+            CancellationGuard guard(session, deadline, stopToken, CancellationGuard::NoPrecheck{});
+            try
+            {
+                auto result = std::forward<F>(function)();
+                if (!result && guard.Cancelled())
+                {
+                    return Result(Unexpected(SshError::Cancelled(guard.Reason())));
+                }
+                return result;
+            }
+            catch (std::runtime_error const&)
+            {
+                guard.ThrowIfCancelled();
+                throw;
+            }
+        }
+
+        template<class F>
+        auto TryWithCancellation(ssh_session session, TransferOptions const& options, F&& function)
+        {
+            return TryWithCancellation(session, options.m_deadline, options.m_stopToken, std::forward<F>(function));
+        }
+
+    }
+
+}
+
+#endif
@@ -0,0 +1,521 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_HOST_SET
+#define LIBSSH_CPP_WRAP_HOST_SET
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ip.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief an inclusive range of ip v4 addresses
+     */
+    struct IpV4Range
+    {
+        uint32_t m_first;
+        uint32_t m_last;
+
+        [[nodiscard]] constexpr uint64_t Size() const noexcept
+        {
+            return static_cast<uint64_t>(m_last) - m_first + 1;
+        }
+
+        /**
+         * \return the range covered by the CIDR block \p network / \p prefixLength
+         */
+        [[nodiscard]] static constexpr IpV4Range FromCidr(IpV4 network, uint32_t prefixLength) noexcept
+        {
+            uint32_t const mask = (prefixLength == 0) ? 0 : ~uint32_t(0) << (32 - (std::min)(prefixLength, uint32_t(32)));
+            uint32_t const first = network.ToUInt32() & mask;
+            return { first, first | ~mask };
+        }
+
+        friend constexpr bool operator==(IpV4Range const&, IpV4Range const&) noexcept = default;
+    };
+
+    /**
+     * \brief A set of ip v4 addresses stored as sorted, disjoint ranges
+     *
+     * Memory use depends on the number of ranges, not on the number of addresses.
+     */
+    class HostSet
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = IpV4;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = IpV4;
+
+            Iterator() noexcept = default;
+
+            IpV4 operator*() const noexcept
+            {
+                return IpV4::FromUInt32(m_current);
+            }
+
+            Iterator& operator++() noexcept
+            {
+                if (m_current == m_range->m_last)
+                {
+                    ++m_range;
+                    m_current = (m_range == m_end) ? 0 : m_range->m_first;
+                }
+                else
+                {
+                    ++m_current;
+                }
+                return *this;
+            }
+
+            Iterator operator++(int) noexcept
+            {
+                auto result = *this;
+                ++*this;
+                return result;
+            }
+
+            friend bool operator==(Iterator const& a, Iterator const& b) noexcept
+            {
+                return a.m_range == b.m_range && a.m_current == b.m_current;
+            }
+
+        private:
+            friend class HostSet;
+
+            Iterator(std::vector<IpV4Range>::const_iterator range, std::vector<IpV4Range>::const_iterator end) noexcept
+                : m_range(range),
+                m_end(end),
+                m_current(range == end ? 0 : range->m_first)
+            {
+            }
+
+            std::vector<IpV4Range>::const_iterator m_range;
+            std::vector<IpV4Range>::const_iterator m_end;
+            uint32_t m_current{ 0 };
+        };
+
+        HostSet() noexcept = default;
+
+        /**
+         * \brief creates a set from ranges in any order; overlapping and adjacent ranges are merged
+         */
+        explicit HostSet(std::vector<IpV4Range> ranges)
+            : m_ranges(std::move(ranges))
+        {
+            Normalize();
+        }
+
+        /**
+         * \brief parses a list of targets
+         *
+         * Entries are separated by whitespace, commas or line breaks; '#' starts a comment extending to the end of the
+         * line. Supported entries are addresses ("10.0.0.1"), CIDR blocks ("10.0.0.0/24"), ranges
+         * ("10.0.0.1-10.0.0.20") and ranges of the last byte ("10.0.0.1-20").
+         *
+         * \exception ::std::runtime_error If an entry cannot be parsed
+         */
+        [[nodiscard]] static HostSet Parse(std::string_view text)
+        {
+            std::vector<IpV4Range> ranges;
+            size_t line = 1;
+            size_t position = 0;
+            while (position < text.size())
+            {
+                char const c = text[position];
+                if (c == '\n')
+                {
+                    ++line;
+                    ++position;
+                }
+                else if (c == ' ' || c == '\t' || c == '\r' || c == ',')
+                {
+                    ++position;
+                }
+                else if (c == '#')
+                {
+                    position = text.find('\n', position);
+                    if (position == std::string_view::npos)
+                    {
+                        break;
+                    }
+                }
+                else
+                {
+                    size_t end = position;
+                    while (end < text.size() && !IsSeparator(text[end]))
+                    {
+                        ++end;
+                    }
+                    auto const entry = text.substr(position, end - position);
+                    auto range = ParseEntry(entry);
+                    if (!range)
+                    {
+                        throw std::runtime_error("invalid host entry in line " + std::to_string(line) + ": " + std::string(entry));
+                    }
+                    ranges.push_back(*range);
+                    position = end;
+                }
+            }
+            return HostSet(std::move(ranges));
+        }
+
+        /**
+         * \brief parses the file at \p path as described for Parse
+         */
+        [[nodiscard]] static HostSet ParseFile(std::filesystem::path const& path)
+        {
+            std::ifstream input(path, std::ios::binary);
+            if (!input)
+            {
+                throw std::runtime_error("could not open " + path.string());
+            }
+            std::string content;
+            input.seekg(0, std::ios::end);
+            content.resize(static_cast<size_t>(input.tellg()));
+            input.seekg(0, std::ios::beg);
+            input.read(content.data(), static_cast<std::streamsize>(content.size()));
+            return Parse(content);
+        }
+
+        void Add(IpV4 address)
+        {
+            Add(IpV4Range{ address.ToUInt32(), address.ToUInt32() });
+        }
+
+        void Add(IpV4Range range)
+        {
+            *this = Union(*this, HostSet(std::vector<IpV4Range>{ range }));
+        }
+
+        [[nodiscard]] bool Contains(IpV4 address) const noexcept
+        {
+            uint32_t const value = address.ToUInt32();
+            auto pos = std::upper_bound(m_ranges.begin(), m_ranges.end(), value,
+                                        [](uint32_t v, IpV4Range const& range) { return v < range.m_first; });
+            return pos != m_ranges.begin() && std::prev(pos)->m_last >= value;
+        }
+
+        /**
+         * \return the number of addresses
+         */
+        [[nodiscard]] uint64_t Size() const noexcept
+        {
+            uint64_t result = 0;
+            for (auto const& range : m_ranges)
+            {
+                result += range.Size();
+            }
+            return result;
+        }
+
+        [[nodiscard]] bool Empty() const noexcept
+        {
+            return m_ranges.empty();
+        }
+
+        [[nodiscard]] std::vector<IpV4Range> const& Ranges() const noexcept
+        {
+            return m_ranges;
+        }
+
+        [[nodiscard]] Iterator begin() const noexcept
+        {
+            return Iterator(m_ranges.begin(), m_ranges.end());
+        }
+
+        [[nodiscard]] Iterator end() const noexcept
+        {
+            return Iterator(m_ranges.end(), m_ranges.end());
+        }
+
+        /**
+         * \return part \p index of \p count parts of about equal size; the parts are disjoint and cover the set
+         */
+        [[nodiscard]] HostSet Shard(size_t index, size_t count) const
+        {
+            if (count == 0 || index >= count)
+            {
+                throw std::out_of_range("invalid shard index");
+            }
+            uint64_t const size = Size();
+            uint64_t const begin = size * index / count;
+            uint64_t const end = size * (index + 1) / count;
+            return Slice(begin, end);
+        }
+
+        /**
+         * \return the addresses with rank in [\p begin, \p end)
+         */
+        [[nodiscard]] HostSet Slice(uint64_t begin, uint64_t end) const
+        {
+            HostSet result;
+            uint64_t offset = 0;
+            for (auto const& range : m_ranges)
+            {
+                uint64_t const rangeEnd = offset + range.Size();
+                if (rangeEnd > begin && offset < end)
+                {
+                    uint64_t const first = (std::max)(begin, offset) - offset;
+                    uint64_t const last = (std::min)(end, rangeEnd) - offset - 1;
+                    result.m_ranges.push_back({ range.m_first + static_cast<uint32_t>(first), range.m_first + static_cast<uint32_t>(last) });
+                }
+                if (rangeEnd >= end)
+                {
+                    break;
+                }
+                offset = rangeEnd;
+            }
+            return result;
+        }
+
+        [[nodiscard]] static HostSet Union(HostSet const& a, HostSet const& b)
+        {
+            HostSet result;
+            result.m_ranges.reserve(a.m_ranges.size() + b.m_ranges.size());
+            std::merge(a.m_ranges.begin(), a.m_ranges.end(), b.m_ranges.begin(), b.m_ranges.end(),
+                       std::back_inserter(result.m_ranges),
+                       [](IpV4Range const& x, IpV4Range const& y) { return x.m_first < y.m_first; });
+            result.MergeSorted();
+            return result;
+        }
+
+        [[nodiscard]] static HostSet Intersection(HostSet const& a, HostSet const& b)
+        {
+            HostSet result;
+            auto x = a.m_ranges.begin();
+            auto y = b.m_ranges.begin();
+            while (x != a.m_ranges.end() && y != b.m_ranges.end())
+            {
+                uint32_t const first = (std::max)(x->m_first, y->m_first);
+                uint32_t const last = (std::min)(x->m_last, y->m_last);
+                if (first <= last)
+                {
+                    result.m_ranges.push_back({ first, last });
+                }
+                if (x->m_last < y->m_last)
+                {
+                    ++x;
+                }
+                else
+                {
+                    ++y;
+                }
+            }
+            return result;
+        }
+
+        /**
+         * \return the addresses of \p a not contained in \p b
+         */
+        [[nodiscard]] static HostSet Difference(HostSet const& a, HostSet const& b)
+        {
+            HostSet result;
+            auto y = b.m_ranges.begin();
+            for (auto const& range : a.m_ranges)
+            {
+                uint64_t first = range.m_first;
+                while (y != b.m_ranges.end() && y->m_last < first)
+                {
+                    ++y;
+                }
+                for (auto z = y; z != b.m_ranges.end() && z->m_first <= range.m_last; ++z)
+                {
+                    if (z->m_first > first)
+                    {
+                        result.m_ranges.push_back({ static_cast<uint32_t>(first), z->m_first - 1 });
+                    }
+                    first = static_cast<uint64_t>(z->m_last) + 1;
+                }
+                if (first <= range.m_last)
+                {
+                    result.m_ranges.push_back({ static_cast<uint32_t>(first), range.m_last });
+                }
+            }
+            return result;
+        }
+
+        friend HostSet operator|(HostSet const& a, HostSet const& b)
+        {
+            return Union(a, b);
+        }
+
+        friend HostSet operator&(HostSet const& a, HostSet const& b)
+        {
+            return Intersection(a, b);
+        }
+
+        friend HostSet operator-(HostSet const& a, HostSet const& b)
+        {
+            return Difference(a, b);
+        }
+
+        friend bool operator==(HostSet const&, HostSet const&) = default;
+
+    private:
+        static constexpr bool IsSeparator(char c) noexcept
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ',' || c == '#';
+        }
+
+        /**
+         * \brief parses a decimal number of at most \p maxValue at \p position
+         */
+        static constexpr std::optional<uint32_t> ParseNumber(std::string_view text, size_t& position, uint32_t maxValue) noexcept
+        {
+            uint32_t value = 0;
+            size_t const begin = position;
+            while (position < text.size() && text[position] >= '0' && text[position] <= '9' && position - begin < 3)
+            {
+                value = value * 10 + static_cast<uint32_t>(text[position] - '0');
+                ++position;
+            }
+            if (position == begin || value > maxValue)
+            {
+                return std::nullopt;
+            }
+            return value;
+        }
+
+        static constexpr std::optional<uint32_t> ParseAddress(std::string_view text, size_t& position) noexcept
+        {
+            uint32_t result = 0;
+            for (int part = 0; part != 4; ++part)
+            {
+                if (part != 0)
+                {
+                    if (position >= text.size() || text[position] != '.')
+                    {
+                        return std::nullopt;
+                    }
+                    ++position;
+                }
+                auto const value = ParseNumber(text, position, 255);
+                if (!value)
+                {
+                    return std::nullopt;
+                }
+                result = (result << 8) | *value;
+            }
+            return result;
+        }
+
+        static constexpr std::optional<IpV4Range> ParseEntry(std::string_view entry) noexcept
+        {
+            size_t position = 0;
+            auto const first = ParseAddress(entry, position);
+            if (!first)
+            {
+                return std::nullopt;
+            }
+            if (position == entry.size())
+            {
+                return IpV4Range{ *first, *first };
+            }
+
+            char const kind = entry[position++];
+            if (kind == '/')
+            {
+                auto const prefixLength = ParseNumber(entry, position, 32);
+                if (!prefixLength || position != entry.size())
+                {
+                    return std::nullopt;
+                }
+                return IpV4Range::FromCidr(IpV4::FromUInt32(*first), *prefixLength);
+            }
+            if (kind == '-')
+            {
+                size_t const lastBegin = position;
+                auto last = ParseAddress(entry, position);
+                if (!last)
+                {
+                    // range of the last byte
+                    position = lastBegin;
+                    auto const lastByte = ParseNumber(entry, position, 255);
+                    if (!lastByte)
+                    {
+                        return std::nullopt;
+                    }
+                    last = (*first & 0xffffff00u) | *lastByte;
+                }
+                if (position != entry.size() || *last < *first)
+                {
+                    return std::nullopt;
+                }
+                return IpV4Range{ *first, *last };
+            }
+            return std::nullopt;
+        }
+
+        void Normalize()
+        {
+            std::sort(m_ranges.begin(), m_ranges.end(),
+                      [](IpV4Range const& x, IpV4Range const& y) { return x.m_first < y.m_first; });
+            MergeSorted();
+        }
+
+        /**
+         * \brief merges overlapping and adjacent ranges of the sorted m_ranges
+         */
+        void MergeSorted()
+        {
+            if (m_ranges.empty())
+            {
+                return;
+            }
+            size_t out = 0;
+            for (size_t i = 1; i != m_ranges.size(); ++i)
+            {
+                auto& current = m_ranges[out];
+                if (static_cast<uint64_t>(current.m_last) + 1 >= m_ranges[i].m_first)
+                {
+                    current.m_last = (std::max)(current.m_last, m_ranges[i].m_last);
+                }
+                else
+                {
+                    m_ranges[++out] = m_ranges[i];
+                }
+            }
+            m_ranges.resize(out + 1);
+        }
+
+        std::vector<IpV4Range> m_ranges;
+    };
+
+}
+
+#endif
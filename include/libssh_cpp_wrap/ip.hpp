@@ -26,6 +26,8 @@
 #include <cstdio>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <variant>
 
 namespace libssh_wrap
 {
@@ -98,6 +100,23 @@ namespace libssh_wrap
             return *this;
         }
 
+        /**
+         * \return the address in host byte order, e.g. 0x7f000001 for 127.0.0.1
+         */
+        [[nodiscard]] constexpr uint32_t ToUInt32() const noexcept
+        {
+            return (static_cast<uint32_t>(m_parts[0]) << 24)
+                | (static_cast<uint32_t>(m_parts[1]) << 16)
+                | (static_cast<uint32_t>(m_parts[2]) << 8)
+                | static_cast<uint32_t>(m_parts[3]);
+        }
+
+        [[nodiscard]] static constexpr IpV4 FromUInt32(uint32_t value) noexcept
+        {
+            return IpV4(static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+                        static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value));
+        }
+
         static constexpr size_t MaxCStringLength = sizeof("255.255.255.255");
 
         void FillToCString(char(&out)[MaxCStringLength]) const noexcept
@@ -179,6 +198,277 @@ namespace libssh_wrap
         std::array<uint8_t, 4> m_parts;
     };
 
+    /**
+     * \brief An ip v6 address
+     *
+     * Can be used as ssh session option; in that case the connection target is set to the address.
+     */
+    class IpV6
+    {
+    public:
+        constexpr IpV6(std::array<uint8_t, 16> const& bytes) noexcept
+            : m_bytes(bytes)
+        {
+        }
+
+        constexpr IpV6() noexcept
+            : m_bytes{}
+        {
+        }
+
+        /**
+         * \brief parses the textual representation (RFC 4291), e.g. "2001:db8::1" or "::ffff:192.0.2.1"
+         *
+         * Invalid input results in the unspecified address "::".
+         */
+        constexpr IpV6(char const* stringRep)
+            : m_bytes{}
+        {
+            std::array<uint16_t, 8> groups{};
+            size_t count = 0;
+            size_t gap = 0; // index of the "::"
+            bool hasGap = false;
+            size_t index = 0;
+            bool error = false;
+
+            if (stringRep[0] == ':')
+            {
+                if (stringRep[1] != ':')
+                {
+                    return;
+                }
+                hasGap = true;
+                index = 2;
+            }
+
+            while (!error && stringRep[index] != '\0')
+            {
+                if (count == 8)
+                {
+                    error = true;
+                    break;
+                }
+
+                size_t const groupBegin = index;
+                uint32_t group = 0;
+                size_t digits = 0;
+                for (; digits < 5; ++digits, ++index)
+                {
+                    int const value = HexValue(stringRep[index]);
+                    if (value < 0)
+                    {
+                        break;
+                    }
+                    group = group * 16 + static_cast<uint32_t>(value);
+                }
+
+                if (stringRep[index] == '.')
+                {
+                    // embedded ip v4 address as last 32 bits
+                    IpV4 const ipV4(stringRep + groupBegin);
+                    if (count > 6 || (ipV4 == IpV4() && !IsZeroIpV4(stringRep + groupBegin)))
+                    {
+                        error = true;
+                        break;
+                    }
+                    groups[count++] = static_cast<uint16_t>((ipV4[0] << 8) | ipV4[1]);
+                    groups[count++] = static_cast<uint16_t>((ipV4[2] << 8) | ipV4[3]);
+                    while (stringRep[index] != '\0')
+                    {
+                        ++index;
+                    }
+                    break;
+                }
+
+                if (digits == 0 || digits > 4)
+                {
+                    error = true;
+                    break;
+                }
+                groups[count++] = static_cast<uint16_t>(group);
+
+                if (stringRep[index] == ':')
+                {
+                    if (stringRep[index + 1] == ':')
+                    {
+                        if (hasGap)
+                        {
+                            error = true;
+                        }
+                        hasGap = true;
+                        gap = count;
+                        index += 2;
+                    }
+                    else
+                    {
+                        ++index;
+                        error = stringRep[index] == '\0';
+                    }
+                }
+                else if (stringRep[index] != '\0')
+                {
+                    error = true;
+                }
+            }
+
+            if (error || (!hasGap && count != 8) || (hasGap && count == 8))
+            {
+                return;
+            }
+
+            if (hasGap)
+            {
+                // move the groups following the "::" to the end
+                size_t const shift = 8 - count;
+                for (size_t i = count; i != gap; --i)
+                {
+                    groups[i - 1 + shift] = groups[i - 1];
+                    groups[i - 1] = 0;
+                }
+            }
+
+            for (size_t i = 0; i != 8; ++i)
+            {
+                m_bytes[2 * i] = static_cast<uint8_t>(groups[i] >> 8);
+                m_bytes[2 * i + 1] = static_cast<uint8_t>(groups[i] & 0xff);
+            }
+        }
+
+        static constexpr size_t MaxCStringLength = sizeof("ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff");
+
+        /**
+         * \brief writes the canonical representation (RFC 5952)
+         */
+        int FillToCString(char out[], size_t outSize) const noexcept
+        {
+            // find the longest run of at least 2 zero groups
+            size_t bestBegin = 8;
+            size_t bestLength = 1;
+            for (size_t i = 0; i != 8;)
+            {
+                size_t j = i;
+                while (j != 8 && Group(j) == 0)
+                {
+                    ++j;
+                }
+                if (j - i > bestLength)
+                {
+                    bestBegin = i;
+                    bestLength = j - i;
+                }
+                i = (j == i) ? i + 1 : j;
+            }
+
+            char buffer[MaxCStringLength];
+            size_t length = 0;
+            for (size_t i = 0; i != 8; ++i)
+            {
+                if (i == bestBegin)
+                {
+                    buffer[length++] = ':';
+                    if (i == 0)
+                    {
+                        buffer[length++] = ':';
+                    }
+                    i += bestLength - 1;
+                    continue;
+                }
+                length += static_cast<size_t>(std::snprintf(buffer + length, sizeof(buffer) - length, "%x", static_cast<unsigned>(Group(i))));
+                if (i != 7)
+                {
+                    buffer[length++] = ':';
+                }
+            }
+            buffer[length] = '\0';
+            return std::snprintf(out, outSize, "%s", buffer);
+        }
+
+        void FillToCString(char(&out)[MaxCStringLength]) const noexcept
+        {
+            FillToCString(out, MaxCStringLength);
+        }
+
+        operator std::string() const
+        {
+            char buffer[MaxCStringLength];
+            FillToCString(buffer);
+            return buffer;
+        }
+
+        friend auto operator<=>(IpV6 const&, IpV6 const&) noexcept = default;
+
+        friend std::ostream& operator<<(std::ostream& s, IpV6 const& ip)
+        {
+            char buffer[MaxCStringLength];
+            ip.FillToCString(buffer);
+            return s << buffer;
+        }
+
+        constexpr uint8_t operator[](uint32_t index) const
+        {
+            return m_bytes[index];
+        }
+
+        constexpr uint8_t& operator[](uint32_t index)
+        {
+            return m_bytes[index];
+        }
+
+        [[nodiscard]] constexpr std::array<uint8_t, 16> const& Bytes() const noexcept
+        {
+            return m_bytes;
+        }
+
+        /**
+         * \return the address ::ffff:a.b.c.d for \p ip
+         */
+        [[nodiscard]] static constexpr IpV6 MappedIpV4(IpV4 const& ip) noexcept
+        {
+            return IpV6(std::array<uint8_t, 16>{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff, ip[0], ip[1], ip[2], ip[3] });
+        }
+
+    private:
+        constexpr uint16_t Group(size_t index) const noexcept
+        {
+            return static_cast<uint16_t>((m_bytes[2 * index] << 8) | m_bytes[2 * index + 1]);
+        }
+
+        static constexpr int HexValue(char c) noexcept
+        {
+            if (c >= '0' && c <= '9')
+            {
+                return c - '0';
+            }
+            if (c >= 'a' && c <= 'f')
+            {
+                return c - 'a' + 10;
+            }
+            if (c >= 'A' && c <= 'F')
+            {
+                return c - 'A' + 10;
+            }
+            return -1;
+        }
+
+        static constexpr bool IsZeroIpV4(char const* stringRep) noexcept
+        {
+            std::string_view const rep(stringRep);
+            return rep == "0.0.0.0";
+        }
+
+        std::array<uint8_t, 16> m_bytes;
+    };
+
+    /**
+     * \brief an ip v4 or ip v6 address
+     */
+    using IpAddress = std::variant<IpV4, IpV6>;
+
+    inline std::string ToString(IpAddress const& address)
+    {
+        return std::visit([](auto const& ip) { return static_cast<std::string>(ip); }, address);
+    }
+
 }
 
 #endif
\ No newline at end of file
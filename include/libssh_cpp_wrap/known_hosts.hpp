@@ -0,0 +1,538 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_KNOWN_HOSTS
+#define LIBSSH_CPP_WRAP_KNOWN_HOSTS
+
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "libssh/libssh.h"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief the result of checking a server's host key
+     */
+    enum class HostKeyStatus
+    {
+        /**
+         * \brief the key is listed for the host
+         */
+        Known,
+
+        /**
+         * \brief there are keys listed for the host, but none of them matches
+         */
+        Changed,
+
+        /**
+         * \brief there are no keys listed for the host
+         */
+        Unknown,
+
+        /**
+         * \brief the key is marked as @revoked
+         */
+        Revoked,
+    };
+
+    constexpr char const* ToString(HostKeyStatus status) noexcept
+    {
+        switch (status)
+        {
+        case HostKeyStatus::Known: return "known";
+        case HostKeyStatus::Changed: return "changed";
+        case HostKeyStatus::Unknown: return "unknown";
+        case HostKeyStatus::Revoked: return "revoked";
+        }
+        return "invalid";
+    }
+
+    namespace detail
+    {
+        /**
+         * \brief glob matching as used by known_hosts patterns ('*' and '?')
+         */
+        inline bool MatchHostPattern(std::string_view pattern, std::string_view name) noexcept
+        {
+            size_t p = 0;
+            size_t n = 0;
+            size_t starPattern = std::string_view::npos;
+            size_t starName = 0;
+            while (n < name.size())
+            {
+                if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n]))
+                {
+                    ++p;
+                    ++n;
+                }
+                else if (p < pattern.size() && pattern[p] == '*')
+                {
+                    starPattern = p++;
+                    starName = n;
+                }
+                else if (starPattern != std::string_view::npos)
+                {
+                    p = starPattern + 1;
+                    n = ++starName;
+                }
+                else
+                {
+                    return false;
+                }
+            }
+            while (p < pattern.size() && pattern[p] == '*')
+            {
+                ++p;
+            }
+            return p == pattern.size();
+        }
+
+        inline std::optional<std::string> DecodeBase64(std::string_view encoded)
+        {
+            if (encoded.empty() || encoded.size() % 4 != 0)
+            {
+                return std::nullopt;
+            }
+            std::string result(encoded.size() / 4 * 3, '\0');
+            int const length = EVP_DecodeBlock(reinterpret_cast<unsigned char*>(result.data()),
+                                               reinterpret_cast<unsigned char const*>(encoded.data()),
+                                               static_cast<int>(encoded.size()));
+            if (length < 0)
+            {
+                return std::nullopt;
+            }
+            // EVP_DecodeBlock doesn't account for padding
+            size_t padding = 0;
+            for (size_t i = encoded.size(); i != 0 && encoded[i - 1] == '='; --i)
+            {
+                ++padding;
+            }
+            result.resize(static_cast<size_t>(length) - padding);
+            return result;
+        }
+
+        /**
+         * \brief a host entry hashed as "|1|<base64 salt>|<base64 HMAC-SHA1(salt, name)>"
+         */
+        struct HashedHost
+        {
+            std::string m_salt;
+            std::string m_hash;
+
+            bool Matches(std::string_view name) const noexcept
+            {
+                std::array<unsigned char, EVP_MAX_MD_SIZE> digest;
+                unsigned int digestLength = 0;
+                if (HMAC(EVP_sha1(), m_salt.data(), static_cast<int>(m_salt.size()),
+                         reinterpret_cast<unsigned char const*>(name.data()), name.size(),
+                         digest.data(), &digestLength) == nullptr)
+                {
+                    return false;
+                }
+                return std::string_view(reinterpret_cast<char const*>(digest.data()), digestLength) == m_hash;
+            }
+        };
+
+        struct KnownHostKey
+        {
+            std::string m_key;
+            bool m_revoked{ false };
+        };
+
+        /**
+         * \brief the parsed content of a known_hosts file
+         *
+         * Plain host names are looked up in a hash map; hashed and wildcard entries need to be checked one by one,
+         * so the result for a name is memoized after the first lookup.
+         */
+        class KnownHostsData
+        {
+        public:
+            explicit KnownHostsData(std::istream& input)
+            {
+                std::string line;
+                while (std::getline(input, line))
+                {
+                    ParseLine(line);
+                }
+            }
+
+            /**
+             * \return the keys listed for \p name ("host" or "[host]:port")
+             */
+            std::shared_ptr<std::vector<KnownHostKey> const> Find(std::string const& name) const
+            {
+                {
+                    std::shared_lock lock(m_memoMutex);
+                    auto pos = m_memo.find(name);
+                    if (pos != m_memo.end())
+                    {
+                        return pos->second;
+                    }
+                }
+
+                auto keys = std::make_shared<std::vector<KnownHostKey>>();
+                auto plain = m_plain.find(name);
+                if (plain != m_plain.end())
+                {
+                    keys->insert(keys->end(), plain->second.begin(), plain->second.end());
+                }
+                for (auto const& [host, key] : m_hashed)
+                {
+                    if (host.Matches(name))
+                    {
+                        keys->push_back(key);
+                    }
+                }
+                for (auto const& entry : m_patterns)
+                {
+                    if (MatchesPatternList(entry.m_patterns, name))
+                    {
+                        keys->push_back(entry.m_key);
+                    }
+                }
+
+                std::unique_lock lock(m_memoMutex);
+                return m_memo.emplace(name, std::move(keys)).first->second;
+            }
+
+        private:
+            struct PatternEntry
+            {
+                std::vector<std::string> m_patterns;
+                KnownHostKey m_key;
+            };
+
+            static bool MatchesPatternList(std::vector<std::string> const& patterns, std::string_view name) noexcept
+            {
+                bool matched = false;
+                for (auto const& pattern : patterns)
+                {
+                    if (pattern.front() == '!')
+                    {
+                        if (MatchHostPattern(std::string_view(pattern).substr(1), name))
+                        {
+                            return false;
+                        }
+                    }
+                    else if (MatchHostPattern(pattern, name))
+                    {
+                        matched = true;
+                    }
+                }
+                return matched;
+            }
+
+            static std::string_view NextField(std::string_view& line) noexcept
+            {
+                auto const begin = line.find_first_not_of(" \t");
+                if (begin == std::string_view::npos)
+                {
+                    line = {};
+                    return {};
+                }
+                line.remove_prefix(begin);
+                auto const end = line.find_first_of(" \t");
+                auto const result = line.substr(0, end);
+                line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+                return result;
+            }
+
+            void ParseLine(std::string_view line)
+            {
+                auto hosts = NextField(line);
+                if (hosts.empty() || hosts.front() == '#')
+                {
+                    return;
+                }
+
+                KnownHostKey key;
+                if (hosts.front() == '@')
+                {
+                    if (hosts == "@revoked")
+                    {
+                        key.m_revoked = true;
+                    }
+                    else
+                    {
+                        // @cert-authority lines describe CA keys, not host keys
+                        return;
+                    }
+                    hosts = NextField(line);
+                }
+
+                auto const keyType = NextField(line);
+                auto const keyData = NextField(line);
+                if (keyType.empty() || keyData.empty())
+                {
+                    return;
+                }
+                key.m_key = keyData;
+
+                if (hosts.substr(0, 3) == "|1|")
+                {
+                    auto const separator = hosts.find('|', 3);
+                    if (separator == std::string_view::npos)
+                    {
+                        return;
+                    }
+                    auto salt = DecodeBase64(hosts.substr(3, separator - 3));
+                    auto hash = DecodeBase64(hosts.substr(separator + 1));
+                    if (salt && hash)
+                    {
+                        m_hashed.emplace_back(HashedHost{ std::move(*salt), std::move(*hash) }, std::move(key));
+                    }
+                    return;
+                }
+
+                std::vector<std::string> patterns;
+                bool wildcard = false;
+                while (!hosts.empty())
+                {
+                    auto const end = hosts.find(',');
+                    auto const pattern = hosts.substr(0, end);
+                    hosts.remove_prefix(end == std::string_view::npos ? hosts.size() : end + 1);
+                    if (pattern.empty())
+                    {
+                        continue;
+                    }
+                    wildcard = wildcard || pattern.find_first_of("*?!") != std::string_view::npos;
+                    patterns.emplace_back(pattern);
+                }
+
+                if (wildcard)
+                {
+                    m_patterns.push_back({ std::move(patterns), std::move(key) });
+                }
+                else
+                {
+                    for (auto& pattern : patterns)
+                    {
+                        m_plain[std::move(pattern)].push_back(key);
+                    }
+                }
+            }
+
+            std::unordered_map<std::string, std::vector<KnownHostKey>> m_plain;
+            std::vector<std::pair<HashedHost, KnownHostKey>> m_hashed;
+            std::vector<PatternEntry> m_patterns;
+
+            mutable std::shared_mutex m_memoMutex;
+            mutable std::unordered_map<std::string, std::shared_ptr<std::vector<KnownHostKey> const>> m_memo;
+        };
+    }
+
+    /**
+     * \brief An in-memory index of a known_hosts file in the OpenSSH format
+     *
+     * The file is parsed once and reparsed only after its modification time changes. Lookups may be done
+     * concurrently from any number of threads.
+     */
+    class KnownHostsIndex
+    {
+    public:
+        explicit KnownHostsIndex(std::filesystem::path path)
+            : m_path(std::move(path))
+        {
+        }
+
+        KnownHostsIndex(KnownHostsIndex const&) = delete;
+        KnownHostsIndex& operator=(KnownHostsIndex const&) = delete;
+
+        std::filesystem::path const& Path() const noexcept
+        {
+            return m_path;
+        }
+
+        /**
+         * \return the name used for \p host and \p port in known_hosts files
+         */
+        static std::string HostEntryName(std::string_view host, unsigned int port)
+        {
+            if (port == 22)
+            {
+                return std::string(host);
+            }
+            std::string result;
+            result.reserve(host.size() + 8);
+            result += '[';
+            result += host;
+            result += "]:";
+            result += std::to_string(port);
+            return result;
+        }
+
+        /**
+         * \brief checks \p base64Key (the key blob as written in the known_hosts file) for \p host and \p port
+         */
+        HostKeyStatus Check(std::string_view host, unsigned int port, std::string_view base64Key) const
+        {
+            auto const keys = GetData()->Find(HostEntryName(host, port));
+            bool known = false;
+            for (auto const& key : *keys)
+            {
+                if (key.m_key == base64Key)
+                {
+                    if (key.m_revoked)
+                    {
+                        return HostKeyStatus::Revoked;
+                    }
+                    known = true;
+                }
+            }
+            if (known)
+            {
+                return HostKeyStatus::Known;
+            }
+            return keys->empty() ? HostKeyStatus::Unknown : HostKeyStatus::Changed;
+        }
+
+        /**
+         * \brief checks the host key of the connected \p session
+         *
+         * \exception ::std::runtime_error If host, port or key of the session cannot be retrieved
+         */
+        HostKeyStatus Check(ssh_session session) const
+        {
+            char* host = nullptr;
+            unsigned int port = 0;
+            if (ssh_options_get(session, SSH_OPTIONS_HOST, &host) != SSH_OK || ssh_options_get_port(session, &port) != SSH_OK)
+            {
+                ssh_string_free_char(host);
+                throw std::runtime_error("could not retrieve the host of the session");
+            }
+            std::unique_ptr<char, CharDeleter> hostHolder(host);
+
+            ssh_key key = nullptr;
+            if (ssh_get_server_publickey(session, &key) != SSH_OK)
+            {
+                throw std::runtime_error("could not retrieve the host key of the server");
+            }
+            std::unique_ptr<std::remove_pointer_t<ssh_key>, KeyDeleter> keyHolder(key);
+
+            char* base64Key = nullptr;
+            if (ssh_pki_export_pubkey_base64(key, &base64Key) != SSH_OK)
+            {
+                throw std::runtime_error("could not encode the host key of the server");
+            }
+            std::unique_ptr<char, CharDeleter> base64KeyHolder(base64Key);
+
+            return Check(host, port, base64Key);
+        }
+
+        /**
+         * \brief the index for ~/.ssh/known_hosts shared by the whole process
+         */
+        static KnownHostsIndex& UserDefault()
+        {
+            static KnownHostsIndex index([]
+                {
+                    char const* home = std::getenv("HOME");
+#ifdef _WIN32
+                    if (home == nullptr)
+                    {
+                        home = std::getenv("USERPROFILE");
+                    }
+#endif
+                    return std::filesystem::path(home == nullptr ? "." : home) / ".ssh" / "known_hosts";
+                }());
+            return index;
+        }
+
+    private:
+        struct CharDeleter
+        {
+            void operator()(char* value) const noexcept
+            {
+                ssh_string_free_char(value);
+            }
+        };
+
+        struct KeyDeleter
+        {
+            void operator()(ssh_key key) const noexcept
+            {
+                ssh_key_free(key);
+            }
+        };
+
+        std::shared_ptr<detail::KnownHostsData const> GetData() const
+        {
+            std::error_code error;
+            auto const modified = std::filesystem::last_write_time(m_path, error);
+            auto const timestamp = error ? std::filesystem::file_time_type::min() : modified;
+
+            {
+                std::shared_lock lock(m_mutex);
+                if (m_data && m_timestamp == timestamp)
+                {
+                    return m_data;
+                }
+            }
+
+            std::shared_ptr<detail::KnownHostsData const> data;
+            if (error)
+            {
+                std::istringstream empty;
+                data = std::make_shared<detail::KnownHostsData const>(empty);
+            }
+            else
+            {
+                std::ifstream input(m_path);
+                data = std::make_shared<detail::KnownHostsData const>(input);
+            }
+
+            std::unique_lock lock(m_mutex);
+            m_data = data;
+            m_timestamp = timestamp;
+            return data;
+        }
+
+        std::filesystem::path m_path;
+
+        mutable std::shared_mutex m_mutex;
+        mutable std::shared_ptr<detail::KnownHostsData const> m_data;
+        mutable std::filesystem::file_time_type m_timestamp;
+    };
+
+}
+
+#endif
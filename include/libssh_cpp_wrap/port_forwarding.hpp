@@ -0,0 +1,743 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_PORT_FORWARDING
+#define LIBSSH_CPP_WRAP_PORT_FORWARDING
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "libssh/libssh.h"
+
+#include "buffer_pool.hpp"
+#include "connect.hpp"
+#include "connection.hpp"
+#include "error_reporting.hpp"
+#include "ip.hpp"
+#include "resolver.hpp"
+#include "socket.hpp"
+#include "tracing.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief connections to a local port relayed to a destination reachable from the server
+     */
+    struct LocalForward
+    {
+        IpAddress m_bindAddress{ IpV4(127, 0, 0, 1) };
+
+        /**
+         * \brief the local port; 0 for a port chosen by the system
+         */
+        int m_localPort{ 0 };
+
+        /**
+         * \brief the destination as seen from the server
+         */
+        std::string m_remoteHost;
+        int m_remotePort{ 0 };
+    };
+
+    /**
+     * \brief connections to a port of the server relayed to a destination reachable from this process
+     */
+    struct RemoteForward
+    {
+        /**
+         * \brief the address the server listens on; empty for all addresses
+         */
+        std::string m_bindAddress;
+
+        /**
+         * \brief the port the server listens on; 0 for a port chosen by the server
+         */
+        int m_remotePort{ 0 };
+
+        std::string m_targetHost;
+        int m_targetPort{ 0 };
+    };
+
+    /**
+     * \brief Relays forwarded tcp connections over an authenticated connection
+     *
+     * A single thread owns the session and relays between the local sockets and the channels in a poll loop; the session
+     * is switched to non blocking mode while the forwarder exists. Every connection uses two buffers from a pool, one
+     * per direction. Data is only written to a channel as far as the remote window allows and a channel is only read
+     * while the data previously read from it has been passed on, so slow peers throttle the other side instead of
+     * filling memory.
+     *
+     * Targets of remote forwards are connected without blocking the loop; the addresses of a target are tried one after
+     * the other until one accepts the connection or the timeout of the connect options passes.
+     *
+     * The connection must not be used by anything but the forwarder while the forwarder exists.
+     */
+    class PortForwarder
+    {
+    public:
+        explicit PortForwarder(std::shared_ptr<AuthenticatedConnection> connection, size_t bufferSize = 65536,
+                               HappyEyeballsOptions connectOptions = { std::chrono::milliseconds(250), std::chrono::milliseconds(2000), {} })
+            : m_connection(std::move(connection)),
+            m_buffers(bufferSize),
+            m_connectOptions(connectOptions)
+        {
+            if (!m_connection)
+            {
+                throw std::runtime_error("no valid connection passed");
+            }
+            m_session = m_connection->GetSession();
+            m_thread = std::thread(&PortForwarder::Run, this);
+        }
+
+        PortForwarder(PortForwarder const&) = delete;
+        PortForwarder& operator=(PortForwarder const&) = delete;
+
+        /**
+         * \brief closes all forwarded connections and cancels the remote forwards
+         */
+        ~PortForwarder() noexcept
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_thread.join();
+        }
+
+        /**
+         * \brief starts listening locally for connections to relay
+         *
+         * \return the local port listened on
+         *
+         * \exception ::std::runtime_error If the local port cannot be bound
+         */
+        int AddLocalForward(LocalForward const& forward)
+        {
+            if (forward.m_remoteHost.empty())
+            {
+                throw std::runtime_error("no remote host specified");
+            }
+
+            detail::SocketAddress const address(forward.m_bindAddress, forward.m_localPort);
+            detail::SocketHandle socket(::socket(address.Family(), SOCK_STREAM, IPPROTO_TCP));
+            if (!socket)
+            {
+                throw std::runtime_error("error creating listening socket");
+            }
+            int const reuse = 1;
+            setsockopt(socket.Get(), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char const*>(&reuse), sizeof(reuse));
+            if (::bind(socket.Get(), address.Get(), address.m_length) != 0
+                || ::listen(socket.Get(), SOMAXCONN) != 0
+                || !detail::SetNonBlocking(socket.Get(), true))
+            {
+                throw std::runtime_error("error listening on the local port");
+            }
+
+            sockaddr_storage bound{};
+            socklen_t boundLength = sizeof(bound);
+            if (getsockname(socket.Get(), reinterpret_cast<sockaddr*>(&bound), &boundLength) != 0)
+            {
+                throw std::runtime_error("error determining the local port");
+            }
+            int const port = ntohs(bound.ss_family == AF_INET
+                                   ? reinterpret_cast<sockaddr_in const&>(bound).sin_port
+                                   : reinterpret_cast<sockaddr_in6 const&>(bound).sin6_port);
+
+            std::lock_guard lock(m_mutex);
+            ThrowIfStopped();
+            m_newListeners.push_back(Listener{ std::move(socket), forward });
+            return port;
+        }
+
+        /**
+         * \brief requests the server to listen for connections to relay
+         *
+         * \p forward.m_targetHost is resolved immediately.
+         *
+         * \return a future for the port the server listens on
+         */
+        std::future<int> AddRemoteForward(RemoteForward const& forward, Resolver& resolver = Resolver::Global())
+        {
+            PendingRemoteForward pending{ forward, resolver.Resolve(forward.m_targetHost), {} };
+            auto future = pending.m_promise.get_future();
+
+            std::lock_guard lock(m_mutex);
+            ThrowIfStopped();
+            m_pendingRemoteForwards.push_back(std::move(pending));
+            return future;
+        }
+
+        /**
+         * \return the number of connections currently relayed
+         */
+        [[nodiscard]] size_t ActiveConnections() const noexcept
+        {
+            return m_activeConnections.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * \return false, if the forwarder stopped, because the connection was lost
+         */
+        [[nodiscard]] bool IsRunning() const
+        {
+            std::lock_guard lock(m_mutex);
+            return !m_failed;
+        }
+
+    private:
+        struct Listener
+        {
+            detail::SocketHandle m_socket;
+            LocalForward m_forward;
+        };
+
+        struct PendingRemoteForward
+        {
+            RemoteForward m_forward;
+            std::vector<IpAddress> m_targetAddresses;
+            std::promise<int> m_promise;
+        };
+
+        struct ActiveRemoteForward
+        {
+            std::string m_bindAddress;
+            std::vector<IpAddress> m_targetAddresses;
+            int m_targetPort;
+        };
+
+        struct ChannelDeleter
+        {
+            void operator()(ssh_channel channel) const noexcept
+            {
+                LIBSSH_CPP_WRAP_TRACE(ChannelClose, ssh_channel_close(channel));
+                ssh_channel_free(channel);
+            }
+        };
+
+        /**
+         * \brief the data in flight in one direction of a relayed connection
+         */
+        struct RelayDirection
+        {
+            PooledBuffer m_buffer;
+            size_t m_begin{ 0 };
+            size_t m_end{ 0 };
+            bool m_sourceEof{ false };
+            bool m_eofForwarded{ false };
+
+            [[nodiscard]] bool Pending() const noexcept
+            {
+                return m_begin != m_end;
+            }
+        };
+
+        struct Relay
+        {
+            detail::SocketHandle m_socket;
+            std::unique_ptr<std::remove_pointer_t<ssh_channel>, ChannelDeleter> m_channel;
+
+            /**
+             * \brief true, while the channel of a local forward isn't open yet
+             */
+            bool m_opening{ false };
+            std::string m_remoteHost;
+            int m_remotePort{ 0 };
+            std::string m_originatorHost;
+            int m_originatorPort{ 0 };
+
+            /**
+             * \brief true, while the socket of a remote forward connects to the target
+             */
+            bool m_connecting{ false };
+            std::vector<IpAddress> m_targetAddresses;
+            size_t m_nextTarget{ 0 };
+            int m_targetPort{ 0 };
+            std::chrono::steady_clock::time_point m_connectDeadline;
+
+            RelayDirection m_toChannel;
+            RelayDirection m_toSocket;
+            bool m_done{ false };
+        };
+
+        void ThrowIfStopped() const
+        {
+            if (m_stop || m_failed)
+            {
+                throw std::runtime_error("the port forwarder is stopped");
+            }
+        }
+
+        std::unique_ptr<Relay> NewRelay(detail::SocketHandle socket, ssh_channel channel)
+        {
+            auto relay = std::make_unique<Relay>();
+            relay->m_socket = std::move(socket);
+            relay->m_channel.reset(channel);
+            relay->m_toChannel.m_buffer = m_buffers.Acquire();
+            relay->m_toSocket.m_buffer = m_buffers.Acquire();
+            return relay;
+        }
+
+        void AcceptLocalConnections(Listener& listener, std::vector<std::unique_ptr<Relay>>& relays)
+        {
+            while (true)
+            {
+                sockaddr_storage peer{};
+                socklen_t peerLength = sizeof(peer);
+                detail::SocketHandle socket(::accept(listener.m_socket.Get(), reinterpret_cast<sockaddr*>(&peer), &peerLength));
+                if (!socket)
+                {
+                    return;
+                }
+                detail::SetNonBlocking(socket.Get(), true);
+                int const noDelay = 1;
+                setsockopt(socket.Get(), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<char const*>(&noDelay), sizeof(noDelay));
+
+                auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelNew, ssh_channel_new(m_session));
+                if (channel == nullptr)
+                {
+                    continue;
+                }
+
+                auto relay = NewRelay(std::move(socket), channel);
+                relay->m_opening = true;
+                relay->m_remoteHost = listener.m_forward.m_remoteHost;
+                relay->m_remotePort = listener.m_forward.m_remotePort;
+                IpAddress peerAddress;
+                if (detail::ToIpAddress(reinterpret_cast<sockaddr const*>(&peer), peerAddress))
+                {
+                    relay->m_originatorHost = ToString(peerAddress);
+                    relay->m_originatorPort = ntohs(peer.ss_family == AF_INET
+                                                    ? reinterpret_cast<sockaddr_in const&>(peer).sin_port
+                                                    : reinterpret_cast<sockaddr_in6 const&>(peer).sin6_port);
+                }
+                else
+                {
+                    relay->m_originatorHost = "127.0.0.1";
+                }
+                relays.push_back(std::move(relay));
+                ++m_activeConnections;
+            }
+        }
+
+        void AcceptRemoteConnections(std::map<int, ActiveRemoteForward> const& remoteForwards, std::vector<std::unique_ptr<Relay>>& relays)
+        {
+            while (true)
+            {
+                int port = 0;
+                auto channel = LIBSSH_CPP_WRAP_TRACE(ChannelAcceptForward, ssh_channel_accept_forward(m_session, 0, &port));
+                if (channel == nullptr)
+                {
+                    return;
+                }
+
+                std::unique_ptr<std::remove_pointer_t<ssh_channel>, ChannelDeleter> channelHandle(channel);
+                auto pos = remoteForwards.find(port);
+                if (pos == remoteForwards.end())
+                {
+                    continue;
+                }
+
+                auto relay = NewRelay(detail::SocketHandle(), channelHandle.release());
+                relay->m_targetAddresses = InterleaveAddressFamilies(pos->second.m_targetAddresses);
+                relay->m_targetPort = pos->second.m_targetPort;
+                relay->m_connectDeadline = std::chrono::steady_clock::now() + m_connectOptions.m_timeout;
+                if (!ConnectNextTarget(*relay))
+                {
+                    continue;
+                }
+                relays.push_back(std::move(relay));
+                ++m_activeConnections;
+            }
+        }
+
+        /**
+         * \brief starts connecting the socket of \p relay to the next of its target addresses
+         *
+         * \return false, if no address is left to try
+         */
+        bool ConnectNextTarget(Relay& relay) const
+        {
+            while (relay.m_nextTarget != relay.m_targetAddresses.size())
+            {
+                bool connected = false;
+                try
+                {
+                    relay.m_socket = detail::StartConnect(relay.m_targetAddresses[relay.m_nextTarget++], relay.m_targetPort,
+                                                          m_connectOptions.m_socket, connected);
+                }
+                catch (std::runtime_error const&)
+                {
+                    continue;
+                }
+                if (relay.m_socket)
+                {
+                    relay.m_connecting = !connected;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void RequestRemoteForwards(std::vector<PendingRemoteForward>& pending, std::map<int, ActiveRemoteForward>& active)
+        {
+            for (auto pos = pending.begin(); pos != pending.end();)
+            {
+                auto const& forward = pos->m_forward;
+                int boundPort = 0;
+                auto result = LIBSSH_CPP_WRAP_TRACE(ChannelListenForward,
+                                                    ssh_channel_listen_forward(m_session,
+                                                                               forward.m_bindAddress.empty() ? nullptr : forward.m_bindAddress.c_str(),
+                                                                               forward.m_remotePort,
+                                                                               &boundPort));
+                if (result == SSH_AGAIN)
+                {
+                    ++pos;
+                    continue;
+                }
+                if (result == SSH_OK)
+                {
+                    int const port = (boundPort != 0) ? boundPort : forward.m_remotePort;
+                    active[port] = ActiveRemoteForward{ forward.m_bindAddress, std::move(pos->m_targetAddresses), forward.m_targetPort };
+                    pos->m_promise.set_value(port);
+                }
+                else
+                {
+                    try
+                    {
+                        ReportError("error requesting the remote forward", m_session);
+                    }
+                    catch (...)
+                    {
+                        pos->m_promise.set_exception(std::current_exception());
+                    }
+                }
+                pos = pending.erase(pos);
+            }
+        }
+
+        /**
+         * \return true, if data was moved or the state of the relay changed
+         */
+        bool Step(Relay& relay) const
+        {
+            auto const channel = relay.m_channel.get();
+            auto const socket = relay.m_socket.Get();
+            bool progress = false;
+
+            if (relay.m_connecting)
+            {
+                detail::PollDescriptor descriptor{};
+                descriptor.fd = socket;
+                descriptor.events = POLLOUT;
+                if (detail::Poll(&descriptor, 1, std::chrono::milliseconds(0)) <= 0)
+                {
+                    if (std::chrono::steady_clock::now() < relay.m_connectDeadline)
+                    {
+                        return false;
+                    }
+                    relay.m_done = true;
+                    return true;
+                }
+                if (detail::SocketError(socket) != 0)
+                {
+                    relay.m_done = !ConnectNextTarget(relay);
+                    return true;
+                }
+                relay.m_connecting = false;
+                progress = true;
+            }
+
+            if (relay.m_opening)
+            {
+                auto result = LIBSSH_CPP_WRAP_TRACE(ChannelOpenForward,
+                                                    ssh_channel_open_forward(channel, relay.m_remoteHost.c_str(), relay.m_remotePort,
+                                                                             relay.m_originatorHost.c_str(), relay.m_originatorPort));
+                if (result == SSH_AGAIN)
+                {
+                    return false;
+                }
+                if (result != SSH_OK)
+                {
+                    relay.m_done = true;
+                    return true;
+                }
+                relay.m_opening = false;
+                progress = true;
+            }
+
+            // socket -> channel
+            auto& up = relay.m_toChannel;
+            if (!up.Pending() && !up.m_sourceEof)
+            {
+                uint32_t const window = ssh_channel_window_size(channel);
+                if (window != 0)
+                {
+                    auto received = detail::Receive(socket, up.m_buffer.data(), (std::min)(up.m_buffer.size(), size_t(window)));
+                    if (received > 0)
+                    {
+                        up.m_begin = 0;
+                        up.m_end = static_cast<size_t>(received);
+                        progress = true;
+                    }
+                    else if (received == 0)
+                    {
+                        up.m_sourceEof = true;
+                        progress = true;
+                    }
+                    else if (!detail::LastOperationWouldBlock())
+                    {
+                        relay.m_done = true;
+                        return true;
+                    }
+                }
+            }
+            if (up.Pending())
+            {
+                uint32_t const window = ssh_channel_window_size(channel);
+                if (window != 0)
+                {
+                    auto const count = static_cast<uint32_t>((std::min)(up.m_end - up.m_begin, size_t(window)));
+                    auto written = LIBSSH_CPP_WRAP_TRACE(ChannelWrite, ssh_channel_write(channel, up.m_buffer.data() + up.m_begin, count));
+                    if (written > 0)
+                    {
+                        up.m_begin += static_cast<size_t>(written);
+                        progress = true;
+                    }
+                    else if (written == SSH_ERROR)
+                    {
+                        relay.m_done = true;
+                        return true;
+                    }
+                }
+            }
+            if (!up.Pending() && up.m_sourceEof && !up.m_eofForwarded)
+            {
+                ssh_channel_send_eof(channel);
+                up.m_eofForwarded = true;
+            }
+
+            // channel -> socket
+            auto& down = relay.m_toSocket;
+            if (!down.Pending() && !down.m_sourceEof)
+            {
+                auto read = LIBSSH_CPP_WRAP_TRACE(ChannelReadNonBlocking,
+                                                  ssh_channel_read_nonblocking(channel, down.m_buffer.data(), static_cast<uint32_t>(down.m_buffer.size()), 0));
+                if (read > 0)
+                {
+                    down.m_begin = 0;
+                    down.m_end = static_cast<size_t>(read);
+                    progress = true;
+                }
+                else if (read == SSH_ERROR)
+                {
+                    relay.m_done = true;
+                    return true;
+                }
+                else if (ssh_channel_is_eof(channel))
+                {
+                    down.m_sourceEof = true;
+                    progress = true;
+                }
+            }
+            if (down.Pending())
+            {
+                auto sent = detail::Send(socket, down.m_buffer.data() + down.m_begin, down.m_end - down.m_begin);
+                if (sent > 0)
+                {
+                    down.m_begin += static_cast<size_t>(sent);
+                    progress = true;
+                }
+                else if (sent < 0 && !detail::LastOperationWouldBlock())
+                {
+                    relay.m_done = true;
+                    return true;
+                }
+            }
+            if (!down.Pending() && down.m_sourceEof && !down.m_eofForwarded)
+            {
+                detail::ShutdownWrite(socket);
+                down.m_eofForwarded = true;
+            }
+
+            if ((up.m_eofForwarded && down.m_eofForwarded) || (ssh_channel_is_closed(channel) && !down.Pending()))
+            {
+                relay.m_done = true;
+            }
+            return progress;
+        }
+
+        void Run() noexcept
+        {
+            std::vector<Listener> listeners;
+            std::vector<PendingRemoteForward> pendingRemoteForwards;
+            std::map<int, ActiveRemoteForward> remoteForwards;
+            std::vector<std::unique_ptr<Relay>> relays;
+            std::vector<detail::PollDescriptor> descriptors;
+
+            ssh_set_blocking(m_session, 0);
+
+            while (true)
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    if (m_stop)
+                    {
+                        break;
+                    }
+                    std::move(m_newListeners.begin(), m_newListeners.end(), std::back_inserter(listeners));
+                    m_newListeners.clear();
+                    std::move(m_pendingRemoteForwards.begin(), m_pendingRemoteForwards.end(), std::back_inserter(pendingRemoteForwards));
+                    m_pendingRemoteForwards.clear();
+                }
+
+                if (ssh_is_connected(m_session) == 0)
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_failed = true;
+                    break;
+                }
+
+                RequestRemoteForwards(pendingRemoteForwards, remoteForwards);
+                for (auto& listener : listeners)
+                {
+                    AcceptLocalConnections(listener, relays);
+                }
+                if (!remoteForwards.empty())
+                {
+                    AcceptRemoteConnections(remoteForwards, relays);
+                }
+
+                bool progress = false;
+                for (auto& relay : relays)
+                {
+                    progress = Step(*relay) || progress;
+                }
+                auto const finished = std::remove_if(relays.begin(), relays.end(), [](auto const& relay) { return relay->m_done; });
+                m_activeConnections -= static_cast<size_t>(relays.end() - finished);
+                relays.erase(finished, relays.end());
+
+                if (!progress)
+                {
+                    WaitForEvents(listeners, relays, descriptors);
+                }
+            }
+
+            for (auto& pending : pendingRemoteForwards)
+            {
+                pending.m_promise.set_exception(std::make_exception_ptr(std::runtime_error("the port forwarder was stopped")));
+            }
+            {
+                std::lock_guard lock(m_mutex);
+                for (auto& pending : m_pendingRemoteForwards)
+                {
+                    pending.m_promise.set_exception(std::make_exception_ptr(std::runtime_error("the port forwarder was stopped")));
+                }
+                m_pendingRemoteForwards.clear();
+            }
+
+            ssh_set_blocking(m_session, 1);
+            relays.clear();
+            m_activeConnections = 0;
+            if (ssh_is_connected(m_session) != 0)
+            {
+                for (auto const& [port, forward] : remoteForwards)
+                {
+                    LIBSSH_CPP_WRAP_TRACE(ChannelCancelForward,
+                                          ssh_channel_cancel_forward(m_session, forward.m_bindAddress.empty() ? nullptr : forward.m_bindAddress.c_str(), port));
+                }
+            }
+        }
+
+        /**
+         * \brief waits for any socket to become ready; returns after a short timeout to pick up new forwards
+         */
+        void WaitForEvents(std::vector<Listener> const& listeners, std::vector<std::unique_ptr<Relay>> const& relays,
+                           std::vector<detail::PollDescriptor>& descriptors) const noexcept
+        {
+            descriptors.clear();
+
+            detail::PollDescriptor session{};
+            session.fd = ssh_get_fd(m_session);
+            session.events = POLLIN;
+            descriptors.push_back(session);
+
+            for (auto const& listener : listeners)
+            {
+                detail::PollDescriptor descriptor{};
+                descriptor.fd = listener.m_socket.Get();
+                descriptor.events = POLLIN;
+                descriptors.push_back(descriptor);
+            }
+            for (auto const& relay : relays)
+            {
+                detail::PollDescriptor descriptor{};
+                descriptor.fd = relay->m_socket.Get();
+                // with a closed window the data stays in the socket; the window adjust arrives via the session socket
+                if (!relay->m_opening && !relay->m_connecting && !relay->m_toChannel.Pending() && !relay->m_toChannel.m_sourceEof
+                    && ssh_channel_window_size(relay->m_channel.get()) != 0)
+                {
+                    descriptor.events |= POLLIN;
+                }
+                if (relay->m_connecting || relay->m_toSocket.Pending())
+                {
+                    descriptor.events |= POLLOUT;
+                }
+                if (descriptor.events != 0)
+                {
+                    descriptors.push_back(descriptor);
+                }
+            }
+
+            detail::Poll(descriptors.data(), descriptors.size(), std::chrono::milliseconds(10));
+        }
+
+        std::shared_ptr<AuthenticatedConnection> m_connection;
+        ssh_session m_session{ nullptr };
+        BufferPool m_buffers;
+        HappyEyeballsOptions m_connectOptions;
+
+        mutable std::mutex m_mutex;
+        std::vector<Listener> m_newListeners;
+        std::vector<PendingRemoteForward> m_pendingRemoteForwards;
+        bool m_stop{ false };
+        bool m_failed{ false };
+
+        std::atomic<size_t> m_activeConnections{ 0 };
+
+        std::thread m_thread;
+    };
+
+}
+
+#endif
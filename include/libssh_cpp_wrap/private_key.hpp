@@ -0,0 +1,160 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_PRIVATE_KEY
+#define LIBSSH_CPP_WRAP_PRIVATE_KEY
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "libssh/libssh.h"
+
+#include "tracing.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief A decoded private key
+     *
+     * The key is imported (and decrypted) once and never modified afterwards; copies share the key and may be used
+     * for authenticating any number of connections from any thread.
+     */
+    class PrivateKey
+    {
+    public:
+        PrivateKey() noexcept = default;
+
+        /**
+         * \brief imports a private key file
+         *
+         * \param passphrase the passphrase of an encrypted key; nullptr for unencrypted keys
+         *
+         * \exception ::std::runtime_error If the file cannot be read or decrypted
+         */
+        [[nodiscard]] static PrivateKey FromFile(char const* path, char const* passphrase = nullptr)
+        {
+            ssh_key key = nullptr;
+            auto const errorCode = LIBSSH_CPP_WRAP_TRACE(PkiImportPrivateKey, ssh_pki_import_privkey_file(path, passphrase, nullptr, nullptr, &key));
+            if (errorCode != SSH_OK)
+            {
+                ssh_key_free(key);
+                throw std::runtime_error(std::string(errorCode == SSH_EOF ? "private key file not found: " : "could not import private key: ") + path);
+            }
+            return PrivateKey(key);
+        }
+
+        static PrivateKey FromFile(std::nullptr_t, char const* = nullptr) = delete;
+
+        /**
+         * \return true if and only if this object refers to a key
+         */
+        [[nodiscard]] operator bool() const noexcept
+        {
+            return static_cast<bool>(m_key);
+        }
+
+    private:
+        friend class AuthenticatedConnection;
+        friend class Connection;
+
+        explicit PrivateKey(ssh_key key) noexcept
+            : m_key(key, KeyDeleter{})
+        {
+        }
+
+        struct KeyDeleter
+        {
+            void operator()(ssh_key key) const noexcept
+            {
+                ssh_key_free(key);
+            }
+        };
+
+        /**
+         * \note libssh takes non-const keys, but only reads them
+         */
+        ssh_key GetKey() const noexcept
+        {
+            return m_key.get();
+        }
+
+        std::shared_ptr<std::remove_pointer_t<ssh_key>> m_key;
+    };
+
+    /**
+     * \brief Imports every private key file at most once
+     *
+     * Keys are looked up by path; a key failing to import is not cached.
+     */
+    class PrivateKeyCache
+    {
+    public:
+        /**
+         * \return the key stored at \p path, importing it on first use
+         *
+         * \exception ::std::runtime_error If the file cannot be read or decrypted
+         */
+        PrivateKey Get(std::string const& path, char const* passphrase = nullptr)
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                auto pos = m_keys.find(path);
+                if (pos != m_keys.end())
+                {
+                    return pos->second;
+                }
+            }
+
+            // import without holding the lock; concurrent imports of the same file keep the first key stored
+            auto key = PrivateKey::FromFile(path.c_str(), passphrase);
+
+            std::lock_guard lock(m_mutex);
+            return m_keys.emplace(path, std::move(key)).first->second;
+        }
+
+        void Clear()
+        {
+            std::lock_guard lock(m_mutex);
+            m_keys.clear();
+        }
+
+        /**
+         * \return the cache shared by the whole process
+         */
+        static PrivateKeyCache& Global()
+        {
+            static PrivateKeyCache cache;
+            return cache;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::map<std::string, PrivateKey, std::less<>> m_keys;
+    };
+
+}
+
+#endif
@@ -0,0 +1,391 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_RESILIENT_CONNECTION
+#define LIBSSH_CPP_WRAP_RESILIENT_CONNECTION
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "command_execution_channel.hpp"
+#include "connection.hpp"
+#include "file_permissions.hpp"
+#include "sftp_channel.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief delays between reconnection attempts
+     */
+    struct ReconnectPolicy
+    {
+        std::chrono::milliseconds m_initialDelay{ 100 };
+        std::chrono::milliseconds m_maxDelay{ 30000 };
+        double m_multiplier{ 2.0 };
+
+        /**
+         * \brief number of failed attempts after which the connection is given up; 0 for no limit
+         */
+        size_t m_maxAttempts{ 10 };
+
+        /**
+         * \brief number of times an idempotent operation is replayed
+         */
+        size_t m_maxReplays{ 3 };
+    };
+
+    /**
+     * \brief specifies, if an operation may be run again after the connection dropped during its execution
+     */
+    enum class Replay
+    {
+        Allowed,
+        Forbidden,
+    };
+
+    /**
+     * \brief An authenticated connection that is reestablished in the background after it drops
+     *
+     * Operations are run via Run; an operation failing while the connection is lost triggers a reconnect, and
+     * idempotent operations are run again on the new connection. Errors occurring while the connection is still
+     * alive are passed on unchanged.
+     */
+    class ResilientConnection
+    {
+    public:
+        /**
+         * \brief establishes and authenticates a new connection, e.g. via SessionTemplate and Connection::Authenticate
+         */
+        using Factory = std::function<std::shared_ptr<AuthenticatedConnection>()>;
+
+        /**
+         * \brief connects using \p factory
+         *
+         * \exception ::std::runtime_error If the initial connection cannot be established
+         */
+        explicit ResilientConnection(Factory factory, ReconnectPolicy policy = {})
+            : m_factory(std::move(factory)),
+            m_policy(policy),
+            m_connection(m_factory())
+        {
+            if (!m_connection)
+            {
+                throw std::runtime_error("the connection factory didn't return a connection");
+            }
+            m_reconnectThread = std::thread(&ResilientConnection::ReconnectLoop, this);
+        }
+
+        ResilientConnection(ResilientConnection const&) = delete;
+        ResilientConnection& operator=(ResilientConnection const&) = delete;
+
+        ~ResilientConnection() noexcept
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            m_reconnectThread.join();
+        }
+
+        /**
+         * \return the current connection, waiting for an ongoing reconnect
+         *
+         * \exception ::std::runtime_error If reconnecting was given up; the error is reported until Reconnect is called
+         */
+        std::shared_ptr<AuthenticatedConnection> Get()
+        {
+            std::unique_lock lock(m_mutex);
+            m_condition.wait(lock, [this] { return !m_reconnectRequested || m_failure || m_stop; });
+            if (m_failure)
+            {
+                std::rethrow_exception(m_failure);
+            }
+            return m_connection;
+        }
+
+        /**
+         * \brief reports \p connection as dropped; starts a reconnect, if it's the current connection
+         */
+        void ReportFailure(std::shared_ptr<AuthenticatedConnection> const& connection)
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                if (connection != m_connection || m_reconnectRequested)
+                {
+                    return;
+                }
+                m_reconnectRequested = true;
+                m_failure = nullptr;
+            }
+            m_condition.notify_all();
+        }
+
+        /**
+         * \brief starts a reconnect unless one is ongoing, e.g. to try again after Get reported that reconnecting was given up
+         */
+        void Reconnect()
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_reconnectRequested)
+                {
+                    return;
+                }
+                m_reconnectRequested = true;
+                m_failure = nullptr;
+            }
+            m_condition.notify_all();
+        }
+
+        /**
+         * \brief runs \p operation with the current connection
+         *
+         * If \p operation throws and the connection is found to be lost, a reconnect is started; with
+         * Replay::Allowed the operation is then run again on the new connection.
+         *
+         * \return the result of \p operation
+         */
+        template<class Operation>
+        auto Run(Operation&& operation, Replay replay = Replay::Allowed)
+            -> std::invoke_result_t<Operation&, std::shared_ptr<AuthenticatedConnection> const&>
+        {
+            for (size_t attempt = 0;; ++attempt)
+            {
+                auto connection = Get();
+                try
+                {
+                    return operation(connection);
+                }
+                catch (std::runtime_error const&)
+                {
+                    if (connection->IsConnected())
+                    {
+                        throw;
+                    }
+                    ReportFailure(connection);
+                    if (replay == Replay::Forbidden || attempt >= m_policy.m_maxReplays)
+                    {
+                        throw;
+                    }
+                }
+            }
+        }
+
+        /**
+         * \brief executes \p command, running it again after a reconnect
+         *
+         * The output is buffered and written to the streams once the command completed, so output of an interrupted
+         * execution isn't duplicated. Only use this for commands that can safely be run more than once.
+         */
+        template<size_t bufferSize = 1024>
+        void ExecuteIdempotent(char const* command, std::ostream& outStream, std::ostream& errorStream)
+        {
+            std::string out;
+            std::string err;
+            Run([&](std::shared_ptr<AuthenticatedConnection> const& connection)
+                {
+                    std::ostringstream outBuffer;
+                    std::ostringstream errBuffer;
+                    ExecutionChannel(connection).Execute<bufferSize>(command, outBuffer, errBuffer);
+                    out = std::move(outBuffer).str();
+                    err = std::move(errBuffer).str();
+                });
+            outStream.write(out.data(), static_cast<std::streamsize>(out.size()));
+            errorStream.write(err.data(), static_cast<std::streamsize>(err.size()));
+        }
+
+        template<size_t bufferSize = 1024>
+        void ExecuteIdempotent(std::nullptr_t, std::ostream&, std::ostream&) = delete;
+
+        /**
+         * \brief uploads \p in to \p remotePath; continues at the size of the remote file after a reconnect
+         *
+         * Every sftp write is acknowledged by the server, so the remote size is the amount of data transferred.
+         *
+         * \param in a seekable stream positioned at the start of the data
+         */
+        template<size_t bufferSize = 32768>
+        void UploadResumable(std::istream& in, char const* remotePath, FilePermissions permissions)
+        {
+            auto const start = in.tellg();
+            if (start == std::istream::pos_type(-1))
+            {
+                throw std::runtime_error("resumable uploads require a seekable stream");
+            }
+
+            bool firstAttempt = true;
+            Run([&](std::shared_ptr<AuthenticatedConnection> const& connection)
+                {
+                    SftpChannel channel(connection);
+                    uint64_t offset = 0;
+                    FileStream file = [&]
+                    {
+                        if (firstAttempt)
+                        {
+                            // only a truncated file tells the remote size apart from stale contents
+                            FileStream truncated = channel.OpenFile(remotePath, permissions, FileAccessMode::WriteOnly);
+                            firstAttempt = false;
+                            return truncated;
+                        }
+                        offset = channel.FileSize(remotePath).value_or(0);
+                        return channel.OpenFile(remotePath, permissions, FileAccessMode::WriteOnly, FileExistenceRequirement::MayExist, FileTruncation::Append);
+                    }();
+
+                    in.clear();
+                    in.seekg(start + static_cast<std::streamoff>(offset));
+                    file.Seek(offset);
+
+                    std::vector<char> buffer(bufferSize);
+                    while (in)
+                    {
+                        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                        if (in.bad())
+                        {
+                            throw std::logic_error("error reading input stream");
+                        }
+                        if (in.gcount() > 0)
+                        {
+                            file.WriteChunk(buffer.data(), static_cast<size_t>(in.gcount()));
+                        }
+                    }
+                });
+        }
+
+        template<size_t bufferSize = 32768>
+        void UploadResumable(std::istream&, std::nullptr_t, FilePermissions) = delete;
+
+        /**
+         * \brief downloads \p remotePath to \p out; continues after the data already written after a reconnect
+         */
+        template<size_t bufferSize = 32768>
+        void DownloadResumable(char const* remotePath, std::ostream& out)
+        {
+            uint64_t written = 0;
+            Run([&](std::shared_ptr<AuthenticatedConnection> const& connection)
+                {
+                    SftpChannel channel(connection);
+                    FileStream file = channel.OpenFile(remotePath, 0, FileAccessMode::ReadOnly, 0);
+                    file.Seek(written);
+
+                    std::vector<char> buffer(bufferSize);
+                    for (size_t count = file.ReadChunk(buffer.data(), buffer.size()); count != 0; count = file.ReadChunk(buffer.data(), buffer.size()))
+                    {
+                        out.write(buffer.data(), static_cast<std::streamsize>(count));
+                        if (!out)
+                        {
+                            throw std::logic_error("error writing the contents read via ssh to output stream");
+                        }
+                        written += count;
+                    }
+                });
+        }
+
+        template<size_t bufferSize = 32768>
+        void DownloadResumable(std::nullptr_t, std::ostream&) = delete;
+
+    private:
+        void ReconnectLoop()
+        {
+            std::unique_lock lock(m_mutex);
+            while (true)
+            {
+                m_condition.wait(lock, [this] { return m_reconnectRequested || m_stop; });
+                if (m_stop)
+                {
+                    return;
+                }
+
+                auto delay = m_policy.m_initialDelay;
+                for (size_t attempt = 1;; ++attempt)
+                {
+                    lock.unlock();
+                    std::shared_ptr<AuthenticatedConnection> connection;
+                    std::exception_ptr error;
+                    try
+                    {
+                        connection = m_factory();
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                    lock.lock();
+
+                    if (connection)
+                    {
+                        m_connection = std::move(connection);
+                        break;
+                    }
+                    if (m_stop)
+                    {
+                        return;
+                    }
+                    if (m_policy.m_maxAttempts != 0 && attempt >= m_policy.m_maxAttempts)
+                    {
+                        m_failure = error ? error : std::make_exception_ptr(std::runtime_error("could not reconnect"));
+                        break;
+                    }
+
+                    m_condition.wait_for(lock, delay, [this] { return m_stop; });
+                    if (m_stop)
+                    {
+                        return;
+                    }
+                    delay = (std::min)(m_policy.m_maxDelay,
+                                       std::chrono::milliseconds(static_cast<std::chrono::milliseconds::rep>(delay.count() * m_policy.m_multiplier)));
+                }
+
+                m_reconnectRequested = false;
+                m_condition.notify_all();
+            }
+        }
+
+        Factory m_factory;
+        ReconnectPolicy m_policy;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::shared_ptr<AuthenticatedConnection> m_connection;
+        bool m_reconnectRequested{ false };
+        bool m_stop{ false };
+        std::exception_ptr m_failure;
+
+        std::thread m_reconnectThread;
+    };
+
+}
+
+#endif
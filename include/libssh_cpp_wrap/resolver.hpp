@@ -0,0 +1,220 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_RESOLVER
+#define LIBSSH_CPP_WRAP_RESOLVER
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ip.hpp"
+#include "socket.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief Resolves host names and caches the results
+     *
+     * getaddrinfo doesn't expose the TTL of the DNS records, so results are kept for a configurable duration instead;
+     * keep it below the TTL of the records. Failed lookups are cached for a shorter duration. Concurrent lookups of
+     * the same name share a single getaddrinfo call.
+     */
+    class Resolver
+    {
+    public:
+        explicit Resolver(std::chrono::steady_clock::duration timeToLive = std::chrono::seconds(60),
+                          std::chrono::steady_clock::duration negativeTimeToLive = std::chrono::seconds(5))
+            : m_timeToLive(timeToLive),
+            m_negativeTimeToLive(negativeTimeToLive)
+        {
+        }
+
+        Resolver(Resolver const&) = delete;
+        Resolver& operator=(Resolver const&) = delete;
+
+        /**
+         * \return the addresses of \p host in the order recommended by the system (RFC 6724)
+         *
+         * Address literals are returned without lookup.
+         *
+         * \exception ::std::runtime_error If the name cannot be resolved
+         */
+        std::vector<IpAddress> Resolve(std::string const& host)
+        {
+            if (auto literal = ParseLiteral(host))
+            {
+                return { *literal };
+            }
+
+            std::shared_future<std::vector<IpAddress>> result;
+            std::promise<std::vector<IpAddress>> promise;
+            bool resolveHere = false;
+            {
+                std::lock_guard lock(m_mutex);
+                auto const now = std::chrono::steady_clock::now();
+                auto pos = m_entries.find(host);
+                if (pos != m_entries.end() && pos->second.m_expiry > now)
+                {
+                    result = pos->second.m_result;
+                }
+                else
+                {
+                    result = promise.get_future().share();
+                    // in flight lookups never expire; the expiry is set once the lookup completes
+                    m_entries.insert_or_assign(host, Entry{ result, std::chrono::steady_clock::time_point::max() });
+                    resolveHere = true;
+                }
+            }
+
+            if (resolveHere)
+            {
+                bool success = true;
+                try
+                {
+                    promise.set_value(Lookup(host));
+                }
+                catch (...)
+                {
+                    success = false;
+                    promise.set_exception(std::current_exception());
+                }
+
+                std::lock_guard lock(m_mutex);
+                auto pos = m_entries.find(host);
+                if (pos != m_entries.end())
+                {
+                    pos->second.m_expiry = std::chrono::steady_clock::now() + (success ? m_timeToLive : m_negativeTimeToLive);
+                }
+            }
+
+            return result.get();
+        }
+
+        /**
+         * \brief removes \p host from the cache
+         */
+        void Invalidate(std::string const& host)
+        {
+            std::lock_guard lock(m_mutex);
+            m_entries.erase(host);
+        }
+
+        void Clear()
+        {
+            std::lock_guard lock(m_mutex);
+            m_entries.clear();
+        }
+
+        /**
+         * \return the resolver shared by the whole process
+         */
+        static Resolver& Global()
+        {
+            static Resolver resolver;
+            return resolver;
+        }
+
+    private:
+        struct Entry
+        {
+            std::shared_future<std::vector<IpAddress>> m_result;
+            std::chrono::steady_clock::time_point m_expiry;
+        };
+
+        static std::optional<IpAddress> ParseLiteral(std::string const& host)
+        {
+            if (host.find(':') != std::string::npos)
+            {
+                IpV6 const ip(host.c_str());
+                if (ip != IpV6() || host == "::")
+                {
+                    return ip;
+                }
+            }
+            else
+            {
+                IpV4 const ip(host.c_str());
+                if (ip != IpV4() || host == "0.0.0.0")
+                {
+                    return ip;
+                }
+            }
+            return std::nullopt;
+        }
+
+        static std::vector<IpAddress> Lookup(std::string const& host)
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = AI_ADDRCONFIG;
+
+            addrinfo* info = nullptr;
+            int const errorCode = getaddrinfo(host.c_str(), nullptr, &hints, &info);
+            if (errorCode != 0)
+            {
+                throw std::runtime_error("could not resolve " + host + ": " + gai_strerror(errorCode));
+            }
+            std::unique_ptr<addrinfo, AddrInfoDeleter> holder(info);
+
+            std::vector<IpAddress> result;
+            for (auto current = info; current != nullptr; current = current->ai_next)
+            {
+                IpAddress address;
+                if (detail::ToIpAddress(current->ai_addr, address)
+                    && std::find(result.begin(), result.end(), address) == result.end())
+                {
+                    result.push_back(address);
+                }
+            }
+            if (result.empty())
+            {
+                throw std::runtime_error("no addresses found for " + host);
+            }
+            return result;
+        }
+
+        struct AddrInfoDeleter
+        {
+            void operator()(addrinfo* info) const noexcept
+            {
+                freeaddrinfo(info);
+            }
+        };
+
+        std::chrono::steady_clock::duration m_timeToLive;
+        std::chrono::steady_clock::duration m_negativeTimeToLive;
+
+        std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_entries;
+    };
+
+}
+
+#endif
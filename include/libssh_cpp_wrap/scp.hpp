@@ -25,12 +25,21 @@
 #include <concepts>
 #include <memory>
 #include <iostream>
+#include <sstream>
+#include <string>
 
 #include "libssh/libssh.h"
 
+#include "bandwidth_limiter.hpp"
+#include "cancellation.hpp"
+#include "checksum.hpp"
+#include "command_execution_channel.hpp"
 #include "connection.hpp"
 #include "error_reporting.hpp"
+#include "expected.hpp"
 #include "file_permissions.hpp"
+#include "tracing.hpp"
+#include "transfer_options.hpp"
 
 namespace libssh_wrap
 {
@@ -61,13 +70,13 @@ namespace libssh_wrap
                 throw std::runtime_error("null passed as location");
             }
 
-            auto session = ssh_scp_new(connection->GetSession(), (recursive ? SSH_SCP_RECURSIVE : 0) | static_cast<int>(mode), location);
+            auto session = LIBSSH_CPP_WRAP_TRACE(ScpNew, ssh_scp_new(connection->GetSession(), (recursive ? SSH_SCP_RECURSIVE : 0) | static_cast<int>(mode), location));
             if (session == nullptr)
             {
                 throw std::runtime_error("error generating scp session");
             }
             m_session.reset(session);
-            if (ssh_scp_init(session) != SSH_OK)
+            if (LIBSSH_CPP_WRAP_TRACE(ScpInit, ssh_scp_init(session)) != SSH_OK)
             {
                 throw std::runtime_error("error initializing the sftp session");
             }
@@ -86,11 +95,43 @@ namespace libssh_wrap
         ScpSession(ScpSession&&) noexcept = default;
         ScpSession& operator=(ScpSession&&) noexcept = default;
 
+        /**
+         * \brief opens a scp session without throwing on ssh errors
+         */
+        [[nodiscard]] static Expected<ScpSession> TryOpen(std::shared_ptr<AuthenticatedConnection> connection, char const* location, ScpAccessMode mode, bool recursive = false)
+        {
+            if (!connection)
+            {
+                return Unexpected(SshError("no valid connection passed"));
+            }
+
+            if (location == nullptr)
+            {
+                return Unexpected(SshError("null passed as location"));
+            }
+
+            ScpSession result;
+            auto session = LIBSSH_CPP_WRAP_TRACE(ScpNew, ssh_scp_new(connection->GetSession(), (recursive ? SSH_SCP_RECURSIVE : 0) | static_cast<int>(mode), location));
+            if (session == nullptr)
+            {
+                return Unexpected(SshError::FromSession("error generating scp session", connection->GetSession()));
+            }
+            result.m_session.reset(session);
+            if (LIBSSH_CPP_WRAP_TRACE(ScpInit, ssh_scp_init(session)) != SSH_OK)
+            {
+                return Unexpected(SshError::FromSession("error initializing the scp session", connection->GetSession()));
+            }
+            result.m_connection = std::move(connection);
+            return result;
+        }
+
+        static Expected<ScpSession> TryOpen(std::shared_ptr<AuthenticatedConnection>, std::nullptr_t, ScpAccessMode, bool = false) = delete;
+
         ~ScpSession() noexcept
         {
             if (m_session)
             {
-                [[maybe_unused]] auto err = ssh_scp_close(m_session.get());
+                [[maybe_unused]] auto err = LIBSSH_CPP_WRAP_TRACE(ScpClose, ssh_scp_close(m_session.get()));
                 assert(err == SSH_OK);
             }
         }
@@ -105,7 +146,7 @@ namespace libssh_wrap
             {
                 throw std::runtime_error("no directory name provided");
             }
-            auto res = ssh_scp_push_directory(m_session.get(), directory, mode);
+            auto res = LIBSSH_CPP_WRAP_TRACE(ScpPushDirectory, ssh_scp_push_directory(m_session.get(), directory, mode));
             if (res != SSH_OK)
             {
                 ReportError("ssh_scp_push_directory", m_connection->GetSession());
@@ -125,7 +166,7 @@ namespace libssh_wrap
             {
                 throw std::runtime_error("not inside a directory");
             }
-            auto res = ssh_scp_leave_directory(m_session.get());
+            auto res = LIBSSH_CPP_WRAP_TRACE(ScpLeaveDirectory, ssh_scp_leave_directory(m_session.get()));
             if (res != SSH_OK)
             {
                 ReportError("ssh_scp_push_directory", m_connection->GetSession());
@@ -133,83 +174,175 @@ namespace libssh_wrap
             --m_directoryDepth;
         }
 
+        /**
+         * \brief writes \p inputSize bytes read from \p input to the remote file \p filename
+         *
+         * \param options a buffer pool passed via \p options replaces the buffer of \p bufferSize bytes on the stack;
+         *                the deadline and stop token of \p options abort the transfer
+         *
+         * \exception OperationCancelled If the transfer was aborted; the connection is unusable afterwards
+         */
         template<size_t bufferSize = 1024>
-        void WriteFile(const char* filename, std::istream& input, size_t inputSize, FilePermissions mode)
+        void WriteFile(const char* filename, std::istream& input, size_t inputSize, FilePermissions mode, TransferOptions const& options = {})
+        {
+            ValueOrThrow(TryWriteFile<bufferSize>(filename, input, inputSize, mode, options));
+        }
+
+        template<size_t bufferSize = 1024>
+        void WriteFile(std::nullptr_t, std::istream& input, size_t inputSize, FilePermissions mode, TransferOptions const& options = {}) = delete;
+
+        /**
+         * \brief WriteFile without throwing on ssh errors
+         */
+        template<size_t bufferSize = 1024>
+        [[nodiscard]] Expected<void> TryWriteFile(const char* filename, std::istream& input, size_t inputSize, FilePermissions mode, TransferOptions const& options = {})
         {
             if (!m_session)
             {
-                throw std::runtime_error("no active scp session");
+                return Unexpected(SshError("no active scp session"));
             }
 
             if (filename == nullptr)
             {
-                throw std::runtime_error("null provided as filename");
+                return Unexpected(SshError("null provided as filename"));
             }
 
-            {
-                auto err = ssh_scp_push_file(m_session.get(), filename, inputSize, mode);
-                if (err != SSH_OK)
+            return detail::TryWithCancellation(m_connection->GetSession(), options, [&]() -> Expected<void>
                 {
-                    ReportError("ssh_scp_push_file", m_connection->GetSession());
-                }
-            }
-
-            {
-                char buffer[bufferSize];
-
-                while (inputSize != 0)
-                {
-                    size_t const readCount = (std::min)(inputSize, bufferSize);
-                    input.read(buffer, readCount);
+                    {
+                        auto err = LIBSSH_CPP_WRAP_TRACE(ScpPushFile, ssh_scp_push_file(m_session.get(), filename, inputSize, mode));
+                        if (err != SSH_OK)
+                        {
+                            return Unexpected(SshError::FromSession("ssh_scp_push_file", m_connection->GetSession()));
+                        }
+                    }
 
-                    auto err = ssh_scp_write(m_session.get(), buffer, readCount);
-                    if (err != SSH_OK)
                     {
-                        ReportError("ssh_scp_write", m_connection->GetSession());
+                        detail::TransferBuffer<bufferSize> buffer(options);
+                        detail::ThrottledTransfer throttle(options, m_connection->GetSession());
+
+                        while (inputSize != 0)
+                        {
+                            size_t const readCount = (std::min)(inputSize, buffer.size());
+                            input.read(buffer.data(), readCount);
+
+                            for (size_t offset = 0; offset != readCount;)
+                            {
+                                auto const granted = throttle.Acquire(readCount - offset);
+                                auto err = LIBSSH_CPP_WRAP_TRACE(ScpWrite, ssh_scp_write(m_session.get(), buffer.data() + offset, granted));
+                                if (err != SSH_OK)
+                                {
+                                    return Unexpected(SshError::FromSession("ssh_scp_write", m_connection->GetSession()));
+                                }
+                                throttle.Transferred(granted, granted);
+                                if (options.m_checksum != nullptr)
+                                {
+                                    options.m_checksum->Update(buffer.data() + offset, granted);
+                                }
+                                offset += granted;
+                            }
+                            inputSize -= readCount;
+                        }
                     }
-                    inputSize -= readCount;
-                }
-            }
+                    return {};
+                });
         }
 
         template<size_t bufferSize = 1024>
-        void WriteFile(std::nullptr_t, std::istream& input, size_t inputSize, FilePermissions mode) = delete;
+        Expected<void> TryWriteFile(std::nullptr_t, std::istream& input, size_t inputSize, FilePermissions mode, TransferOptions const& options = {}) = delete;
+
+        /**
+         * \brief reads the next file into \p out
+         *
+         * \param options a buffer pool passed via \p options replaces the buffer of \p bufferSize bytes on the stack;
+         *                the deadline and stop token of \p options abort the transfer
+         *
+         * \exception OperationCancelled If the transfer was aborted; the connection is unusable afterwards
+         */
+        template<size_t bufferSize = 1024>
+        void ReadFile(std::ostream& out, TransferOptions const& options = {})
+        {
+            ValueOrThrow(TryReadFile<bufferSize>(out, options));
+        }
 
+        /**
+         * \brief ReadFile without throwing on ssh errors
+         */
         template<size_t bufferSize = 1024>
-        void ReadFile(std::ostream& out)
+        [[nodiscard]] Expected<void> TryReadFile(std::ostream& out, TransferOptions const& options = {})
         {
             if (!m_session)
             {
-                throw std::runtime_error("no active scp session");
+                return Unexpected(SshError("no active scp session"));
             }
 
-            {
-                auto err = ssh_scp_pull_request(m_session.get());
-                if (err != SSH_SCP_REQUEST_NEWFILE)
+            return detail::TryWithCancellation(m_connection->GetSession(), options, [&]() -> Expected<void>
                 {
-                    ReportError("ssh_scp_pull_request", m_connection->GetSession());
-                }
-            }
+                    {
+                        auto err = LIBSSH_CPP_WRAP_TRACE(ScpPullRequest, ssh_scp_pull_request(m_session.get()));
+                        if (err != SSH_SCP_REQUEST_NEWFILE)
+                        {
+                            return Unexpected(SshError::FromSession("ssh_scp_pull_request", m_connection->GetSession()));
+                        }
+                    }
 
-            char buffer[bufferSize];
+                    detail::TransferBuffer<bufferSize> buffer(options);
+
+                    auto const size = ssh_scp_request_get_size(m_session.get());
+
+                    detail::ThrottledTransfer throttle(options, m_connection->GetSession());
+
+                    int read = 0;
+                    while (read < size) {
+                        int readCount = (std::min)(size - read, buffer.size());
+                        auto const granted = throttle.Acquire(static_cast<size_t>(readCount));
+                        int numBytes = LIBSSH_CPP_WRAP_TRACE(ScpRead, ssh_scp_read(m_session.get(), buffer.data(), granted));
+                        if (numBytes < 0)
+                        {
+                            return Unexpected(SshError::FromSession("ssh_scp_read", m_connection->GetSession()));
+                        }
+                        throttle.Transferred(granted, static_cast<size_t>(numBytes));
+                        if (numBytes != 0)
+                        {
+                            out.write(buffer.data(), static_cast<size_t>(numBytes));
+                            if (options.m_checksum != nullptr)
+                            {
+                                options.m_checksum->Update(buffer.data(), static_cast<size_t>(numBytes));
+                            }
+                            read += numBytes;
+                        }
+                    }
+                    return {};
+                });
+        }
 
-            auto const size = ssh_scp_request_get_size(m_session.get());
+        /**
+         * \brief compares the bytes passed to \p checksum by a transfer with the contents of \p path on the server
+         *
+         * The checksum is computed by sha256sum via exec; relative paths are resolved from the home directory, not
+         * from the location of this session. The local queue of \p checksum is hashed while the server is busy.
+         *
+         * \exception ::std::runtime_error If the checksums differ or the remote command fails
+         */
+        void VerifyChecksum(char const* path, TransferChecksum& checksum)
+        {
+            if (!m_connection)
+            {
+                throw std::runtime_error("no active scp session");
+            }
 
-            int read = 0;
-            while (read < size) {
-                int readCount = (std::min)(size - read, bufferSize);
-                int numBytes = ssh_scp_read(m_session.get(), buffer, readCount);
-                if (numBytes < 0)
-                {
-                    ReportError("ssh_scp_read", m_connection->GetSession());
-                }
-                else if (numBytes != 0)
-                {
-                    out.write(buffer, static_cast<size_t>(numBytes));
-                    read += numBytes;
-                }
+            std::ostringstream out;
+            std::ostringstream error;
+            ExecutionChannel channel(m_connection);
+            channel.Execute(detail::RemoteSha256Command(path).c_str(), out, error);
+            if (channel.ExitStatus() != 0)
+            {
+                throw std::runtime_error("remote checksum command failed: " + error.str());
             }
+            detail::CompareChecksums(checksum.Digest(), detail::ParseSha256Output(out.str()), path);
         }
+
+        void VerifyChecksum(std::nullptr_t, TransferChecksum&) = delete;
     private:
 
         size_t m_directoryDepth{ 0 };
@@ -26,11 +26,10 @@
 
 #include "libssh/libssh.h"
 
-#include "connection.hpp"
-
 namespace libssh_wrap
 {
     class Connection;
+    class SessionTemplate;
 
     class Session
     {
@@ -48,7 +47,7 @@ namespace libssh_wrap
         /**
          * Creates a new session
          */
-        static [[nodiscard("dropping the return value results in a session destruction")]] Session Create()
+        [[nodiscard("dropping the return value results in a session destruction")]] static Session Create()
         {
             auto session = ssh_new();
             if (session == nullptr)
@@ -81,6 +80,7 @@ namespace libssh_wrap
 
     private:
         friend class Connection;
+        friend class SessionTemplate;
 
         struct SessionDeleter
         {
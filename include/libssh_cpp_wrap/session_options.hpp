@@ -21,8 +21,10 @@
 #define LIBSSH_CPP_WRAP_SSH_SESSION
 
 #include <cstddef>
+#include <string>
 #include <string_view>
 #include <type_traits>
+#include <variant>
 
 #include "libssh/libssh.h"
 
@@ -40,6 +42,24 @@ namespace libssh_wrap
         return ssh_options_set(&session, SSH_OPTIONS_HOST, buffer);
     }
 
+    /**
+     * Sets the ssh host to the given ip
+     */
+    inline int ApplyOption(std::remove_pointer_t<ssh_session>& session, IpV6 const& ip) noexcept
+    {
+        char buffer[IpV6::MaxCStringLength];
+        ip.FillToCString(buffer);
+        return ssh_options_set(&session, SSH_OPTIONS_HOST, buffer);
+    }
+
+    /**
+     * Sets the ssh host to the given ip
+     */
+    inline int ApplyOption(std::remove_pointer_t<ssh_session>& session, IpAddress const& ip) noexcept
+    {
+        return std::visit([&session](auto const& address) { return ApplyOption(session, address); }, ip);
+    }
+
     /**
      * \todo add check, if call is noexcept
      */
@@ -63,6 +83,28 @@ namespace libssh_wrap
         }
     };
 
+    /**
+     * \brief A ssh session option specifying the target by host name
+     *
+     * libssh resolves the name on ssh_connect; see ConnectTo for connecting via the resolver cache.
+     */
+    struct HostName
+    {
+        constexpr HostName(char const* name)
+            : m_name(name)
+        {
+        }
+
+        HostName(std::nullptr_t) = delete;
+
+        char const* m_name;
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_set(&session, SSH_OPTIONS_HOST, m_name);
+        }
+    };
+
     /**
      * \brief A ssh session option specifying the user name
      */
@@ -83,6 +125,161 @@ namespace libssh_wrap
         }
     };
 
+    /**
+     * \brief A ssh session option making libssh use an already connected socket instead of connecting itself
+     *
+     * Any stream socket works, e.g. one taken from a pool of pre-connected sockets, a tunnel of a custom proxy or a
+     * unix domain socket. The session takes ownership; libssh closes the socket on disconnect. The host name should
+     * still be set, since known hosts and config files are matched against it.
+     */
+    struct SocketDescriptor
+    {
+        socket_t m_socket{ SSH_INVALID_SOCKET };
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_set(&session, SSH_OPTIONS_FD, &m_socket);
+        }
+    };
+
+    /**
+     * \brief A ssh session option specifying, if libssh disables Nagle's algorithm on the sockets it connects itself
+     */
+    struct NoDelay
+    {
+        bool m_noDelay{ true };
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            int const value = m_noDelay ? 1 : 0;
+            return ssh_options_set(&session, SSH_OPTIONS_NODELAY, &value);
+        }
+    };
+
+    /**
+     * \brief A ssh session option parsing a ssh config file
+     *
+     * The host the config is matched against needs to be set before this option is applied.
+     * A null path parses the default files (~/.ssh/config and the global client config).
+     */
+    struct SshConfig
+    {
+        char const* m_path{ nullptr };
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_parse_config(&session, m_path);
+        }
+    };
+
+    /**
+     * \brief A ssh session option specifying, if ssh_connect parses the default config files
+     */
+    struct ProcessConfig
+    {
+        bool m_process{ true };
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_set(&session, SSH_OPTIONS_PROCESS_CONFIG, &m_process);
+        }
+    };
+
+    /**
+     * \brief A ssh session option passing a string to the libssh option \p option
+     */
+    template<ssh_options_e option>
+    struct StringOption
+    {
+        constexpr StringOption(char const* value)
+            : m_value(value)
+        {
+        }
+
+        StringOption(std::nullptr_t) = delete;
+
+        char const* m_value;
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_set(&session, option, m_value);
+        }
+    };
+
+    /**
+     * \brief comma separated list of the ciphers allowed for client to server traffic, e.g. "aes128-gcm@openssh.com"
+     */
+    using CiphersClientToServer = StringOption<SSH_OPTIONS_CIPHERS_C_S>;
+
+    /**
+     * \brief comma separated list of the ciphers allowed for server to client traffic
+     */
+    using CiphersServerToClient = StringOption<SSH_OPTIONS_CIPHERS_S_C>;
+
+    /**
+     * \brief comma separated list of the MACs allowed for client to server traffic, e.g. "hmac-sha2-256-etm@openssh.com"
+     */
+    using HmacClientToServer = StringOption<SSH_OPTIONS_HMAC_C_S>;
+
+    /**
+     * \brief comma separated list of the MACs allowed for server to client traffic
+     */
+    using HmacServerToClient = StringOption<SSH_OPTIONS_HMAC_S_C>;
+
+    /**
+     * \brief "yes", "no" or a comma separated list of compression algorithms for both directions
+     */
+    using Compression = StringOption<SSH_OPTIONS_COMPRESSION>;
+
+    /**
+     * \brief the local address the sockets connected by libssh are bound to; see SocketTuning for ConnectTo
+     */
+    using BindAddress = StringOption<SSH_OPTIONS_BINDADDR>;
+
+    /**
+     * \brief A ssh session option specifying the zlib compression level (1 fastest - 9 smallest)
+     */
+    struct CompressionLevel
+    {
+        int m_level{ 7 };
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            return ssh_options_set(&session, SSH_OPTIONS_COMPRESSION_LEVEL, &m_level);
+        }
+    };
+
+    /**
+     * \brief A ssh session option setting cipher and MAC for both directions
+     *
+     * An empty MAC keeps the libssh defaults, which is what AEAD ciphers like aes*-gcm or chacha20-poly1305 need.
+     */
+    struct CipherSuite
+    {
+        std::string m_cipher;
+        std::string m_hmac;
+
+        friend bool operator==(CipherSuite const&, CipherSuite const&) = default;
+
+        int operator()(std::remove_pointer_t<ssh_session>& session) const noexcept
+        {
+            int result = ssh_options_set(&session, SSH_OPTIONS_CIPHERS_C_S, m_cipher.c_str());
+            if (result == SSH_OK)
+            {
+                result = ssh_options_set(&session, SSH_OPTIONS_CIPHERS_S_C, m_cipher.c_str());
+            }
+            if (result == SSH_OK && !m_hmac.empty())
+            {
+                result = ssh_options_set(&session, SSH_OPTIONS_HMAC_C_S, m_hmac.c_str());
+                if (result == SSH_OK)
+                {
+                    result = ssh_options_set(&session, SSH_OPTIONS_HMAC_S_C, m_hmac.c_str());
+                }
+            }
+            return result;
+        }
+    };
+
 }
 
 #endif
\ No newline at end of file
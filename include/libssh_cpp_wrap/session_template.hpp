@@ -0,0 +1,122 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_SESSION_TEMPLATE
+#define LIBSSH_CPP_WRAP_SESSION_TEMPLATE
+
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "libssh/libssh.h"
+
+#include "session.hpp"
+#include "session_options.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief An immutable set of session options validated once and copied into new sessions
+     *
+     * The options are applied to a prototype session on creation, so invalid options are reported by Create
+     * instead of by every session. Config files are parsed into the prototype once as well; sessions created
+     * from the template don't parse the config files again on ssh_connect.
+     *
+     * Copies of a template share the prototype; creating sessions from multiple threads is allowed.
+     */
+    class SessionTemplate
+    {
+    public:
+        /**
+         * \brief creates a template from \p options
+         *
+         * If none of the options is a SshConfig, the default config files are parsed after all options are applied,
+         * unless ProcessConfig{ false } is passed to skip config files entirely.
+         *
+         * \exception ::std::runtime_error If an option is rejected by libssh
+         */
+        template<class...Options>
+        [[nodiscard]] static SessionTemplate Create(Options const&...options)
+        {
+            Session prototype = Session::Create();
+            (prototype.SetOption(options), ...);
+
+            constexpr bool hasConfig = (std::is_same_v<Options, SshConfig> || ...);
+            if constexpr (!hasConfig)
+            {
+                // the last ProcessConfig wins, as it would for a plain session
+                bool processConfig = true;
+                ([&processConfig](auto const& option)
+                    {
+                        if constexpr (std::is_same_v<std::decay_t<decltype(option)>, ProcessConfig>)
+                        {
+                            processConfig = option.m_process;
+                        }
+                    }(options), ...);
+                if (processConfig)
+                {
+                    prototype.SetOption(SshConfig{});
+                }
+            }
+            prototype.SetOption(ProcessConfig{ false });
+
+            return SessionTemplate(std::move(prototype));
+        }
+
+        SessionTemplate(SessionTemplate const&) noexcept = default;
+        SessionTemplate& operator=(SessionTemplate const&) noexcept = default;
+        SessionTemplate(SessionTemplate&&) noexcept = default;
+        SessionTemplate& operator=(SessionTemplate&&) noexcept = default;
+
+        /**
+         * \brief creates a new session with the options of the template followed by \p overrides
+         *
+         * \note config files are not matched against a host passed as override
+         *
+         * \exception ::std::runtime_error If the session cannot be created or an override is rejected
+         */
+        template<class...Options>
+        [[nodiscard("dropping the return value results in a session destruction")]] Session Instantiate(Options const&...overrides) const
+        {
+            ssh_session copy = nullptr;
+            if (ssh_options_copy(m_prototype.get(), &copy) != SSH_OK)
+            {
+                ssh_free(copy);
+                throw std::runtime_error("could not copy the session options");
+            }
+            Session result(copy);
+            result.SetOption(ProcessConfig{ false });
+            (result.SetOption(overrides), ...);
+            return result;
+        }
+
+    private:
+        explicit SessionTemplate(Session&& prototype) noexcept
+            : m_prototype(std::move(prototype.m_sshSession))
+        {
+        }
+
+        std::shared_ptr<std::remove_pointer_t<ssh_session>> m_prototype;
+    };
+
+}
+
+#endif
@@ -0,0 +1,326 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_SFTP_BATCH
+#define LIBSSH_CPP_WRAP_SFTP_BATCH
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "libssh/sftp.h"
+
+#include "file_permissions.hpp"
+#include "sftp_channel.hpp"
+#include "sftp_extensions.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief the outcome of a single operation of a SftpBatch
+     */
+    struct SftpBatchResult
+    {
+        std::string m_path;
+
+        /**
+         * \brief SSH_OK or the sftp status code returned by the server
+         */
+        int m_status{ SSH_OK };
+
+        /**
+         * \brief the predicate passed with the operation considered the status an error
+         */
+        bool m_failed{ false };
+    };
+
+    /**
+     * \brief Queues metadata operations and sends them to the server without waiting for the individual replies
+     *
+     * Up to \c maxInFlight requests are outstanding at any time, so a batch of n operations takes about
+     * n / maxInFlight round trips instead of n. The server may execute outstanding requests in any order; use
+     * Barrier() where an operation depends on earlier ones, e.g. between creating a directory and its subdirectories.
+     *
+     * The requests are written to the channel of the sftp session directly; the SftpChannel must not be used while
+     * Run() is executing and should be discarded, if Run() throws.
+     */
+    class SftpBatch
+    {
+    public:
+        explicit SftpBatch(SftpChannel& channel, size_t maxInFlight = 64)
+            : m_channel(channel),
+            m_maxInFlight(maxInFlight == 0 ? 1 : maxInFlight)
+        {
+        }
+
+        SftpBatch(SftpBatch const&) = delete;
+        SftpBatch& operator=(SftpBatch const&) = delete;
+
+        /**
+         * \param predicate receives SSH_OK or the sftp status code; a failed creation of an existing directory is
+         *                  reported as SSH_FX_FILE_ALREADY_EXISTS, so IgnoreAlreadyExists can be used
+         */
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& MakeDirectory(char const* dirName, FilePermissions permissions, Predicate&& predicate = &DoNotIgnoreError)
+        {
+            return Add(OperationType::MakeDirectory, dirName, permissions, std::forward<Predicate>(predicate));
+        }
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& MakeDirectory(std::nullptr_t, FilePermissions, Predicate&& = {}) = delete;
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& RemoveDirectory(char const* dirName, Predicate&& predicate = &DoNotIgnoreError)
+        {
+            return Add(OperationType::RemoveDirectory, dirName, 0, std::forward<Predicate>(predicate));
+        }
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& RemoveDirectory(std::nullptr_t, Predicate&& = {}) = delete;
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& DeleteFile(char const* fileName, Predicate&& predicate = &DoNotIgnoreError)
+        {
+            return Add(OperationType::DeleteFile, fileName, 0, std::forward<Predicate>(predicate));
+        }
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& DeleteFile(std::nullptr_t, Predicate&& = {}) = delete;
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& Chmod(char const* fileName, FilePermissions targetPermissions, Predicate&& predicate = &DoNotIgnoreError)
+        {
+            return Add(OperationType::Chmod, fileName, targetPermissions, std::forward<Predicate>(predicate));
+        }
+
+        template<ErrorPredicate Predicate = decltype(&DoNotIgnoreError)>
+        SftpBatch& Chmod(std::nullptr_t, FilePermissions, Predicate&& = {}) = delete;
+
+        /**
+         * \brief operations added after the call are only sent once all operations added before it completed
+         */
+        SftpBatch& Barrier()
+        {
+            if (m_barriers.empty() || m_barriers.back() != m_operations.size())
+            {
+                m_barriers.push_back(m_operations.size());
+            }
+            return *this;
+        }
+
+        [[nodiscard]] size_t Size() const noexcept
+        {
+            return m_operations.size();
+        }
+
+        /**
+         * \brief executes and removes all queued operations
+         *
+         * \return the results in the order the operations were added
+         *
+         * \exception ::std::runtime_error If the communication with the server fails; errors of single operations are
+         *                                 only reported via the result
+         */
+        std::vector<SftpBatchResult> Run()
+        {
+            if (!m_channel.m_session)
+            {
+                throw std::runtime_error("no active sftp session");
+            }
+
+            auto operations = std::exchange(m_operations, {});
+            auto barriers = std::exchange(m_barriers, {});
+            barriers.push_back(operations.size());
+
+            std::vector<SftpBatchResult> results(operations.size());
+            size_t begin = 0;
+            for (size_t end : barriers)
+            {
+                RunSegment(operations, begin, end, results);
+                begin = end;
+            }
+            return results;
+        }
+
+    private:
+        enum class OperationType
+        {
+            MakeDirectory,
+            RemoveDirectory,
+            DeleteFile,
+            Chmod,
+        };
+
+        struct Operation
+        {
+            OperationType m_type;
+            std::string m_path;
+            mode_t m_permissions;
+            std::function<bool(int)> m_predicate;
+        };
+
+        /**
+         * \brief a request waiting for its reply
+         */
+        struct Pending
+        {
+            size_t m_index;
+
+            /**
+             * \brief the request is the stat following a failed mkdir
+             */
+            bool m_existenceCheck;
+        };
+
+        template<class Predicate>
+        SftpBatch& Add(OperationType type, char const* path, mode_t permissions, Predicate&& predicate)
+        {
+            std::function<bool(int)> function(std::forward<Predicate>(predicate));
+            if (!function)
+            {
+                // a null function pointer would make Run throw after the requests were sent
+                function = &DoNotIgnoreError;
+            }
+            m_operations.push_back(Operation{ type, path, permissions, std::move(function) });
+            return *this;
+        }
+
+        static void AppendRequest(std::vector<uint8_t>& buffer, Operation const& operation, uint32_t id)
+        {
+            auto append = [&buffer](uint8_t type, uint32_t id, std::string const& path, std::optional<mode_t> permissions)
+                {
+                    detail::SftpPacket packet(type, id);
+                    packet.AppendString(path);
+                    if (permissions.has_value())
+                    {
+                        packet.AppendUInt32(SSH_FILEXFER_ATTR_PERMISSIONS);
+                        packet.AppendUInt32(*permissions);
+                    }
+                    auto const& data = packet.Finish();
+                    buffer.insert(buffer.end(), data.begin(), data.end());
+                };
+
+            switch (operation.m_type)
+            {
+            case OperationType::MakeDirectory:
+                append(SSH_FXP_MKDIR, id, operation.m_path, operation.m_permissions);
+                break;
+            case OperationType::RemoveDirectory:
+                append(SSH_FXP_RMDIR, id, operation.m_path, std::nullopt);
+                break;
+            case OperationType::DeleteFile:
+                append(SSH_FXP_REMOVE, id, operation.m_path, std::nullopt);
+                break;
+            case OperationType::Chmod:
+                append(SSH_FXP_SETSTAT, id, operation.m_path, operation.m_permissions);
+                break;
+            }
+        }
+
+        static void AppendExistenceCheck(std::vector<uint8_t>& buffer, std::string const& path, uint32_t id)
+        {
+            detail::SftpPacket packet(SSH_FXP_STAT, id);
+            packet.AppendString(path);
+            auto const& data = packet.Finish();
+            buffer.insert(buffer.end(), data.begin(), data.end());
+        }
+
+        void RunSegment(std::vector<Operation>& operations, size_t begin, size_t end, std::vector<SftpBatchResult>& results)
+        {
+            auto sftp = m_channel.m_session.get();
+
+            std::unordered_map<uint32_t, Pending> pending;
+            std::vector<size_t> existenceChecks;
+            std::vector<uint8_t> buffer;
+            size_t next = begin;
+
+            auto complete = [&](size_t index, int status)
+                {
+                    auto& operation = operations[index];
+                    auto& result = results[index];
+                    result.m_path = std::move(operation.m_path);
+                    result.m_status = status;
+                    result.m_failed = operation.m_predicate(status);
+                };
+
+            while (next != end || !pending.empty() || !existenceChecks.empty())
+            {
+                // fill the window with one write; follow-up requests first, since they belong to older operations
+                buffer.clear();
+                while (!existenceChecks.empty() && pending.size() < m_maxInFlight)
+                {
+                    uint32_t const id = ++sftp->id_counter;
+                    AppendExistenceCheck(buffer, operations[existenceChecks.back()].m_path, id);
+                    pending.emplace(id, Pending{ existenceChecks.back(), true });
+                    existenceChecks.pop_back();
+                }
+                while (next != end && pending.size() < m_maxInFlight)
+                {
+                    uint32_t const id = ++sftp->id_counter;
+                    AppendRequest(buffer, operations[next], id);
+                    pending.emplace(id, Pending{ next, false });
+                    ++next;
+                }
+                if (!buffer.empty())
+                {
+                    detail::SendSftpPackets(sftp, buffer.data(), buffer.size());
+                }
+
+                auto const reply = detail::ReadSftpReply(sftp);
+                auto const pos = pending.find(reply.m_id);
+                if (pos == pending.end())
+                {
+                    throw std::runtime_error("unexpected sftp reply");
+                }
+                auto const request = pos->second;
+                pending.erase(pos);
+
+                if (request.m_existenceCheck)
+                {
+                    complete(request.m_index, (reply.m_type == SSH_FXP_ATTRS) ? SSH_FX_FILE_ALREADY_EXISTS : SSH_FX_FAILURE);
+                    continue;
+                }
+
+                auto const status = static_cast<int>(reply.Status());
+                if (status == SSH_FX_FAILURE && operations[request.m_index].m_type == OperationType::MakeDirectory)
+                {
+                    // version 3 servers don't distinguish an existing directory from other failures
+                    existenceChecks.push_back(request.m_index);
+                    continue;
+                }
+                complete(request.m_index, status == SSH_FX_OK ? SSH_OK : status);
+            }
+        }
+
+        SftpChannel& m_channel;
+        size_t m_maxInFlight;
+        std::vector<Operation> m_operations;
+        std::vector<size_t> m_barriers;
+    };
+
+}
+
+#endif
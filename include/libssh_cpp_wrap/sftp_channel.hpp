@@ -20,13 +20,19 @@
 #ifndef LIBSSH_CPP_WRAP_SFTP_CHANNEL
 #define LIBSSH_CPP_WRAP_SFTP_CHANNEL
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <future>
+#include <cstdint>
 #include <memory>
 #include <istream>
+#include <optional>
 #include <ostream>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <thread>
@@ -36,8 +42,18 @@
 
 #include "libssh/sftp.h"
 
+#include "bandwidth_limiter.hpp"
+#include "cancellation.hpp"
+#include "checksum.hpp"
+#include "command_execution_channel.hpp"
 #include "connection.hpp"
+#include "error_reporting.hpp"
+#include "executor.hpp"
+#include "expected.hpp"
 #include "file_permissions.hpp"
+#include "sftp_extensions.hpp"
+#include "tracing.hpp"
+#include "transfer_options.hpp"
 
 namespace libssh_wrap
 {
@@ -77,7 +93,17 @@ namespace libssh_wrap
         return error != SSH_OK && error != SSH_FX_FILE_ALREADY_EXISTS;
     }
 
+    /**
+     * \brief behaviour of a rename, if the destination exists
+     */
+    enum class RenameExisting
+    {
+        Fail,
+        Replace,
+    };
+
     class FileStream;
+    class SftpBatch;
 
     /**
      * \brief a channel for executing a ssh command
@@ -94,13 +120,13 @@ namespace libssh_wrap
                 throw std::runtime_error("no valid connection passed");
             }
 
-            auto session = sftp_new(connection->GetSession());
+            auto session = LIBSSH_CPP_WRAP_TRACE(SftpNew, sftp_new(connection->GetSession()));
             if (session == nullptr)
             {
                 throw std::runtime_error("error generating sftp session");
             }
             m_session.reset(session);
-            if (sftp_init(session) != SSH_OK)
+            if (LIBSSH_CPP_WRAP_TRACE(SftpInit, sftp_init(session)) != SSH_OK)
             {
                 throw std::runtime_error("error initializing the sftp session");
             }
@@ -115,6 +141,31 @@ namespace libssh_wrap
         SftpChannel(SftpChannel&&) noexcept = default;
         SftpChannel& operator=(SftpChannel&&) noexcept = default;
 
+        /**
+         * \brief opens a sftp channel without throwing on ssh errors
+         */
+        [[nodiscard]] static Expected<SftpChannel> TryOpen(std::shared_ptr<AuthenticatedConnection> connection)
+        {
+            if (!connection)
+            {
+                return Unexpected(SshError("no valid connection passed"));
+            }
+
+            SftpChannel result;
+            auto session = LIBSSH_CPP_WRAP_TRACE(SftpNew, sftp_new(connection->GetSession()));
+            if (session == nullptr)
+            {
+                return Unexpected(SshError::FromSession("error generating sftp session", connection->GetSession()));
+            }
+            result.m_session.reset(session);
+            if (LIBSSH_CPP_WRAP_TRACE(SftpInit, sftp_init(session)) != SSH_OK)
+            {
+                return Unexpected(SshError::FromSftp("error initializing the sftp session", session));
+            }
+            result.m_connection = std::move(connection);
+            return result;
+        }
+
         /**
          * \note named MakeDirectory instead of CreateDirectory to avoid the macro from the windows headers
          *       interfering with the nameing
@@ -127,7 +178,7 @@ namespace libssh_wrap
                 throw std::runtime_error("no active sftp session");
             }
             
-            auto rc = sftp_mkdir(m_session.get(), dirName, permissions);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(SftpMkdir, sftp_mkdir(m_session.get(), dirName, permissions));
             if (std::forward<Predicate>(predicate)(rc))
             {
                 throw std::runtime_error("error creating directory");
@@ -145,7 +196,7 @@ namespace libssh_wrap
                 throw std::runtime_error("no active sftp session");
             }
             
-            auto rc = sftp_rmdir(m_session.get(), dirName);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(SftpRmdir, sftp_rmdir(m_session.get(), dirName));
             if (std::forward<Predicate>(predicate)(rc))
             {
                 throw std::runtime_error("error creating directory");
@@ -163,7 +214,7 @@ namespace libssh_wrap
                 throw std::runtime_error("no active sftp session");
             }
             
-            auto rc = sftp_unlink(m_session.get(), fileName);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(SftpUnlink, sftp_unlink(m_session.get(), fileName));
             if (std::forward<Predicate>(predicate)(rc))
             {
                 throw std::runtime_error("error creating directory");
@@ -181,7 +232,7 @@ namespace libssh_wrap
                 throw std::runtime_error("no active sftp session");
             }
             
-            auto rc = sftp_chmod(m_session.get(), fileName, targetPermissions);
+            auto rc = LIBSSH_CPP_WRAP_TRACE(SftpChmod, sftp_chmod(m_session.get(), fileName, targetPermissions));
             if (std::forward<Predicate>(predicate)(rc))
             {
                 throw std::runtime_error("error creating directory");
@@ -191,6 +242,42 @@ namespace libssh_wrap
         template<ErrorPredicate Predicate>
         void Chmod(std::nullptr_t, FilePermissions, Predicate&& = {}) = delete;
 
+        /**
+         * \return the size of the remote file; an empty optional, if the file doesn't exist
+         */
+        std::optional<uint64_t> FileSize(char const* fileName)
+        {
+            return ValueOrThrow(TryFileSize(fileName));
+        }
+
+        std::optional<uint64_t> FileSize(std::nullptr_t) = delete;
+
+        /**
+         * \brief FileSize without throwing on ssh errors
+         */
+        [[nodiscard]] Expected<std::optional<uint64_t>> TryFileSize(char const* fileName)
+        {
+            if (!m_session)
+            {
+                return Unexpected(SshError("no active sftp session"));
+            }
+
+            auto attributes = LIBSSH_CPP_WRAP_TRACE(SftpStat, sftp_stat(m_session.get(), fileName));
+            if (attributes == nullptr)
+            {
+                if (sftp_get_error(m_session.get()) == SSH_FX_NO_SUCH_FILE)
+                {
+                    return std::optional<uint64_t>();
+                }
+                return Unexpected(SshError::FromSftp("error retrieving file attributes", m_session.get()));
+            }
+            uint64_t const size = attributes->size;
+            sftp_attributes_free(attributes);
+            return std::optional<uint64_t>(size);
+        }
+
+        Expected<std::optional<uint64_t>> TryFileSize(std::nullptr_t) = delete;
+
         /**
          * \note truncate is removed, if the file is opened readonly
          */
@@ -200,7 +287,135 @@ namespace libssh_wrap
             FileAccessMode accessMode,
             FirstModifierType&& accessSpecifiers = FirstModifierType(static_cast<int>(FileExistenceRequirement::MayExist) | static_cast<int>(FileTruncation::Truncate)),
             ModifierTypes&&... types);
+
+        /**
+         * \brief OpenFile without throwing on ssh errors; the sftp status of the error tells e.g. a missing file
+         */
+        template<class FirstModifierType = int, class...ModifierTypes>
+        [[nodiscard]] Expected<FileStream> TryOpenFile(char const* fileName,
+            FilePermissions permissions,
+            FileAccessMode accessMode,
+            FirstModifierType&& accessSpecifiers = FirstModifierType(static_cast<int>(FileExistenceRequirement::MayExist) | static_cast<int>(FileTruncation::Truncate)),
+            ModifierTypes&&... types);
+
+        /**
+         * \brief copies \p source to \p destination on the server without transferring the contents
+         *
+         * Uses the copy-data extension, if the server supports it, and runs cp via exec otherwise. Unsupported
+         * methods are remembered in \p cache.
+         *
+         * \exception ::std::runtime_error If the copy fails or the server supports neither method
+         */
+        void CopyRemote(char const* source, char const* destination, SftpCapabilityCache& cache = SftpCapabilityCache::Global());
+
+        void CopyRemote(std::nullptr_t, char const*, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
+        void CopyRemote(char const*, std::nullptr_t, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
+
+        /**
+         * \brief renames \p source to \p destination
+         *
+         * Replacing an existing destination uses the posix-rename@openssh.com extension, if the server supports it,
+         * and runs mv via exec otherwise; plain sftp renames fail for existing destinations.
+         */
+        void RenameRemote(char const* source, char const* destination, RenameExisting existing = RenameExisting::Fail,
+                          SftpCapabilityCache& cache = SftpCapabilityCache::Global());
+
+        void RenameRemote(std::nullptr_t, char const*, RenameExisting = RenameExisting::Fail, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
+        void RenameRemote(char const*, std::nullptr_t, RenameExisting = RenameExisting::Fail, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
+
+        /**
+         * \return the sha-256 of \p fileName computed by the server
+         *
+         * Uses the check-file extension, if the server supports it, and runs sha256sum via exec otherwise.
+         */
+        Sha256Digest RemoteSha256(char const* fileName, SftpCapabilityCache& cache = SftpCapabilityCache::Global());
+
+        Sha256Digest RemoteSha256(std::nullptr_t, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
+
+        /**
+         * \brief compares the bytes passed to \p checksum by a transfer with the contents of \p fileName on the server
+         *
+         * The local queue of \p checksum is hashed while the server computes its checksum.
+         *
+         * \exception ::std::runtime_error If the checksums differ
+         */
+        void VerifyChecksum(char const* fileName, TransferChecksum& checksum, SftpCapabilityCache& cache = SftpCapabilityCache::Global())
+        {
+            auto const remote = RemoteSha256(fileName, cache);
+            detail::CompareChecksums(checksum.Digest(), remote, fileName);
+        }
+
+        void VerifyChecksum(std::nullptr_t, TransferChecksum&, SftpCapabilityCache& = SftpCapabilityCache::Global()) = delete;
     private:
+        friend class SftpBatch;
+
+
+        SftpServerCapabilities ProbeCapabilities() const
+        {
+            SftpServerCapabilities capabilities;
+            capabilities.m_copyData = sftp_extension_supported(m_session.get(), "copy-data", "1") != 0;
+            capabilities.m_posixRename = sftp_extension_supported(m_session.get(), "posix-rename@openssh.com", "1") != 0;
+
+            // the data of check-file lists the hash algorithms, so only the name is compared
+            auto const extensionCount = sftp_extensions_get_count(m_session.get());
+            for (unsigned int i = 0; i != extensionCount; ++i)
+            {
+                auto const name = sftp_extensions_get_name(m_session.get(), i);
+                if (name != nullptr && std::string_view(name) == "check-file")
+                {
+                    capabilities.m_checkFile = true;
+                }
+            }
+            return capabilities;
+        }
+
+        /**
+         * \brief runs \p command in a new channel; records in \p cache, if the server doesn't allow it
+         *
+         * Only a denied channel or exec request and the exit codes of the shell for commands it can't run tell that;
+         * other errors, e.g. a lost connection, are passed on without touching \p cache.
+         *
+         * \param toolMayBeMissing true, if \p command relies on a tool the server may lack; the shell failing to run it
+         *                         then says nothing about other commands
+         *
+         * \return the standard output of the command
+         */
+        std::string RunShellCommand(std::string const& command, std::string const& server, SftpServerCapabilities capabilities, SftpCapabilityCache& cache,
+                                    bool toolMayBeMissing = false)
+        {
+            if (capabilities.m_shellCommands == false)
+            {
+                throw std::runtime_error("the server supports neither the sftp extension nor shell commands");
+            }
+
+            std::ostringstream out;
+            std::ostringstream error;
+            auto channel = ExecutionChannel::TryOpen(m_connection);
+            auto const executed = channel ? channel->TryExecute(command.c_str(), out, error) : Expected<void>(Unexpected(channel.error()));
+            if (!executed)
+            {
+                if (executed.error().SshCode() == SSH_REQUEST_DENIED)
+                {
+                    capabilities.m_shellCommands = false;
+                    cache.Update(server, capabilities);
+                }
+                executed.error().Throw();
+            }
+            int const status = channel->ExitStatus();
+
+            // 126 / 127: the shell couldn't run the command
+            bool const available = (status != 126 && status != 127);
+            if (capabilities.m_shellCommands != available && (available || !toolMayBeMissing))
+            {
+                capabilities.m_shellCommands = available;
+                cache.Update(server, capabilities);
+            }
+            if (status != 0)
+            {
+                throw std::runtime_error("remote command failed: " + error.str());
+            }
+            return out.str();
+        }
 
         std::shared_ptr<AuthenticatedConnection> m_connection;
 
@@ -225,33 +440,121 @@ namespace libssh_wrap
         FileStream(FileStream&&) noexcept = default;
         FileStream& operator=(FileStream&&) noexcept = default;
 
-        template<size_t bufferSize = 1024>
-        void Write(std::istream& in)
+        /**
+         * \brief writes \p size bytes at the current position
+         */
+        void WriteChunk(char const* data, size_t size)
         {
             if (!m_file)
             {
                 throw std::runtime_error("file not opened");
             }
+            auto written = LIBSSH_CPP_WRAP_TRACE(SftpWrite, sftp_write(m_file.get(), data, size));
+            if (written < 0 || static_cast<size_t>(written) != size)
+            {
+                throw std::runtime_error("error writing file");
+            }
+        }
 
-            char buffer[bufferSize];
+        /**
+         * \brief reads up to \p size bytes from the current position
+         *
+         * \return the number of bytes read, 0 at the end of the file
+         */
+        size_t ReadChunk(char* buffer, size_t size)
+        {
+            if (!m_file)
+            {
+                throw std::runtime_error("file not opened");
+            }
+            auto readCount = LIBSSH_CPP_WRAP_TRACE(SftpRead, sftp_read(m_file.get(), buffer, size));
+            if (readCount < 0)
+            {
+                throw std::runtime_error("error reading file");
+            }
+            return static_cast<size_t>(readCount);
+        }
 
-            do
+        /**
+         * \brief moves the position of the next read or write to \p offset
+         */
+        void Seek(uint64_t offset)
+        {
+            if (!m_file)
             {
-                in.read(buffer, bufferSize);
-                if (in.bad())
-                {
-                    throw std::runtime_error("error reading input stream");
-                }
-                auto read = in.gcount();
-                if (read > 0)
+                throw std::runtime_error("file not opened");
+            }
+            if (sftp_seek64(m_file.get(), offset) != SSH_OK)
+            {
+                throw std::runtime_error("error seeking in file");
+            }
+        }
+
+        [[nodiscard]] uint64_t Tell()
+        {
+            if (!m_file)
+            {
+                throw std::runtime_error("file not opened");
+            }
+            return sftp_tell64(m_file.get());
+        }
+
+        /**
+         * \brief writes the contents of \p in to the file
+         *
+         * \param options a buffer pool passed via \p options replaces the buffer of \p bufferSize bytes on the stack;
+         *                the deadline and stop token of \p options abort the transfer
+         *
+         * \exception OperationCancelled If the transfer was aborted; the connection is unusable afterwards
+         */
+        template<size_t bufferSize = 1024>
+        void Write(std::istream& in, TransferOptions const& options = {})
+        {
+            ValueOrThrow(TryWrite<bufferSize>(in, options));
+        }
+
+        /**
+         * \brief Write without throwing on ssh errors
+         */
+        template<size_t bufferSize = 1024>
+        [[nodiscard]] Expected<void> TryWrite(std::istream& in, TransferOptions const& options = {})
+        {
+            if (!m_file)
+            {
+                return Unexpected(SshError("file not opened"));
+            }
+
+            return detail::TryWithCancellation(m_file->sftp->session, options, [&]() -> Expected<void>
                 {
-                    auto written = sftp_write(m_file.get(), buffer, read);
-                    if (written != read)
+                    detail::TransferBuffer<bufferSize> buffer(options);
+                    detail::ThrottledTransfer throttle(options, m_file->sftp->session);
+
+                    do
                     {
-                        throw std::runtime_error("error writing file");
-                    }
-                }
-            } while (in);
+                        in.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                        if (in.bad())
+                        {
+                            return Unexpected(SshError("error reading input stream"));
+                        }
+                        auto const read = static_cast<size_t>(in.gcount());
+                        for (size_t offset = 0; offset != read;)
+                        {
+                            auto const granted = throttle.Acquire(read - offset);
+                            auto written = LIBSSH_CPP_WRAP_TRACE(SftpWrite, sftp_write(m_file.get(), buffer.data() + offset, granted));
+                            if (written < 0 || static_cast<size_t>(written) != granted)
+                            {
+                                return Unexpected(SshError::FromSftp("error writing file", m_file->sftp));
+                            }
+                            throttle.Transferred(granted, granted);
+                            if (options.m_checksum != nullptr)
+                            {
+                                options.m_checksum->Update(buffer.data() + offset, granted);
+                            }
+                            offset += granted;
+                        }
+                    } while (in);
+                    return {};
+                });
         }
 
         template<size_t bufferSize = 1024>
@@ -262,42 +565,87 @@ namespace libssh_wrap
                 throw std::runtime_error("file not opened");
             }
 
-            auto ptr = std::make_shared<FileStream>(std::move(*this));
-            return std::async([](std::shared_ptr<FileStream> const& ptr, std::istream& in)
+            return Submit(IoExecutor(), [stream = std::move(*this), &in]() mutable
                 {
-                    ptr->Write<bufferSize>(in);
-                    return ptr;
-                },
-                ptr,
-                std::reference_wrapper(in));
+                    stream.Write<bufferSize>(in);
+                    return std::make_shared<FileStream>(std::move(stream));
+                });
         }
 
-        template<size_t bufferSize = 1024>
-        void Read(std::ostream& out)
+        /**
+         * \brief writes \p in on \p executor
+         *
+         * \return a future for this stream, once the write is complete
+         */
+        template<size_t bufferSize = 1024, Executor E>
+        std::future<FileStream> WriteAsync(E& executor, std::istream& in, TransferOptions const& options = {})
         {
             if (!m_file)
             {
                 throw std::runtime_error("file not opened");
             }
 
-            char buffer[bufferSize];
+            return Submit(executor, options.m_memoryResource, [stream = std::move(*this), &in, options]() mutable
+                {
+                    stream.Write<bufferSize>(in, options);
+                    return std::move(stream);
+                });
+        }
 
-            ssize_t readCount;
-            do
+        /**
+         * \brief reads the file into \p out
+         *
+         * \param options a buffer pool passed via \p options replaces the buffer of \p bufferSize bytes on the stack;
+         *                the deadline and stop token of \p options abort the transfer
+         *
+         * \exception OperationCancelled If the transfer was aborted; the connection is unusable afterwards
+         */
+        template<size_t bufferSize = 1024>
+        void Read(std::ostream& out, TransferOptions const& options = {})
+        {
+            ValueOrThrow(TryRead<bufferSize>(out, options));
+        }
+
+        /**
+         * \brief Read without throwing on ssh errors
+         */
+        template<size_t bufferSize = 1024>
+        [[nodiscard]] Expected<void> TryRead(std::ostream& out, TransferOptions const& options = {})
+        {
+            if (!m_file)
             {
-                readCount = sftp_read(m_file.get(), buffer, bufferSize);
+                return Unexpected(SshError("file not opened"));
+            }
 
-                if (readCount < 0)
+            return detail::TryWithCancellation(m_file->sftp->session, options, [&]() -> Expected<void>
                 {
-                    throw std::runtime_error("error reading file");
-                }
+                    detail::TransferBuffer<bufferSize> buffer(options);
+                    detail::ThrottledTransfer throttle(options, m_file->sftp->session);
 
-                out.write(buffer, readCount);
-                if (!out)
-                {
-                    throw std::runtime_error("error writing the contents read via ssh to output stream");
-                }
-            } while (readCount > 0);
+                    ssize_t readCount;
+                    do
+                    {
+                        auto const granted = throttle.Acquire(buffer.size());
+                        readCount = LIBSSH_CPP_WRAP_TRACE(SftpRead, sftp_read(m_file.get(), buffer.data(), granted));
+
+                        if (readCount < 0)
+                        {
+                            return Unexpected(SshError::FromSftp("error reading file", m_file->sftp));
+                        }
+                        throttle.Transferred(granted, static_cast<size_t>(readCount));
+
+                        out.write(buffer.data(), readCount);
+                        if (!out)
+                        {
+                            return Unexpected(SshError("error writing the contents read via ssh to output stream"));
+                        }
+                        if (options.m_checksum != nullptr)
+                        {
+                            options.m_checksum->Update(buffer.data(), static_cast<size_t>(readCount));
+                        }
+                    } while (readCount > 0);
+                    return {};
+                });
         }
 
         template<size_t bufferSize = 1024>
@@ -308,14 +656,31 @@ namespace libssh_wrap
                 throw std::runtime_error("file not opened");
             }
 
-            auto ptr = std::make_shared<FileStream>(std::move(*this));
-            return std::async([](std::shared_ptr<FileStream> const& ptr, std::ostream& out)
+            return Submit(IoExecutor(), [stream = std::move(*this), &out]() mutable
                 {
-                    ptr->Read<bufferSize>(out);
-                    return ptr;
-                },
-                ptr,
-                std::reference_wrapper(out));
+                    stream.Read<bufferSize>(out);
+                    return std::make_shared<FileStream>(std::move(stream));
+                });
+        }
+
+        /**
+         * \brief reads the file into \p out on \p executor
+         *
+         * \return a future for this stream, once the read is complete
+         */
+        template<size_t bufferSize = 1024, Executor E>
+        std::future<FileStream> ReadAsync(E& executor, std::ostream& out, TransferOptions const& options = {})
+        {
+            if (!m_file)
+            {
+                throw std::runtime_error("file not opened");
+            }
+
+            return Submit(executor, options.m_memoryResource, [stream = std::move(*this), &out, options]() mutable
+                {
+                    stream.Read<bufferSize>(out, options);
+                    return std::move(stream);
+                });
         }
     private:
 
@@ -323,11 +688,14 @@ namespace libssh_wrap
         {
             void operator()(sftp_file file) const noexcept
             {
-                [[maybe_unused]] int result = sftp_close(file);
+                [[maybe_unused]] int result = LIBSSH_CPP_WRAP_TRACE(SftpClose, sftp_close(file));
                 assert(result == SSH_OK);
             }
         };
 
+        friend class SftpChannel;
+        friend class SftpPipeline;
+
         std::unique_ptr<std::remove_pointer_t<sftp_file>, ChannelDeleter> m_file;
     };
 
@@ -338,6 +706,21 @@ namespace libssh_wrap
         FirstModifierType&& accessSpecifiers,
         ModifierTypes && ...modifiers)
     {
+        return ValueOrThrow(TryOpenFile(fileName, permissions, accessMode, std::forward<FirstModifierType>(accessSpecifiers),
+                                        std::forward<ModifierTypes>(modifiers)...));
+    }
+
+    template<class FirstModifierType, class ...ModifierTypes>
+    inline Expected<FileStream> SftpChannel::TryOpenFile(char const* fileName,
+        FilePermissions permissions,
+        FileAccessMode accessMode,
+        FirstModifierType&& accessSpecifiers,
+        ModifierTypes && ...modifiers)
+    {
+        if (!m_session)
+        {
+            return Unexpected(SshError("no active sftp session"));
+        }
         int effectiveAccessMode = ((static_cast<int>(accessMode) | static_cast<int>(std::forward<FirstModifierType>(accessSpecifiers)))
             | ... | static_cast<int>(std::forward<ModifierTypes>(modifiers)));
 
@@ -347,13 +730,158 @@ namespace libssh_wrap
             static_assert(static_cast<int>(FileTruncation::Append) == 0, "relying on file trunction being 0 here");
             effectiveAccessMode &= ~static_cast<int>(FileTruncation::Truncate);
         }
-        auto file = sftp_open(m_session.get(), fileName, effectiveAccessMode, permissions);
+        auto file = LIBSSH_CPP_WRAP_TRACE(SftpOpen, sftp_open(m_session.get(), fileName, effectiveAccessMode, permissions));
         if (file == nullptr)
         {
-            ReportError("error opening file", m_session->session);
+            return Unexpected(SshError::FromSftp("error opening file", m_session.get()));
         }
         return FileStream(file);
     }
+
+    inline void SftpChannel::CopyRemote(char const* source, char const* destination, SftpCapabilityCache& cache)
+    {
+        if (!m_session)
+        {
+            throw std::runtime_error("no active sftp session");
+        }
+
+        auto const server = detail::ServerKey(m_session->session);
+        auto capabilities = cache.Get(server, [this] { return ProbeCapabilities(); });
+
+        if (capabilities.m_copyData)
+        {
+            auto attributes = LIBSSH_CPP_WRAP_TRACE(SftpStat, sftp_stat(m_session.get(), source));
+            if (attributes == nullptr)
+            {
+                SshError::FromSftp("error retrieving file attributes", m_session.get()).Throw();
+            }
+            FilePermissions const permissions(attributes->permissions & 07777);
+            sftp_attributes_free(attributes);
+
+            FileStream in = OpenFile(source, 0, FileAccessMode::ReadOnly, 0);
+            FileStream out = OpenFile(destination, permissions, FileAccessMode::WriteOnly);
+            auto const status = detail::SftpExtendedRequest(m_session.get(), "copy-data", [&](detail::SftpPacket& packet)
+                {
+                    packet.AppendString(in.m_file->handle);
+                    packet.AppendUInt64(0);
+                    packet.AppendUInt64(0); // up to the end of the file
+                    packet.AppendString(out.m_file->handle);
+                    packet.AppendUInt64(0);
+                });
+            if (status == SSH_FX_OK)
+            {
+                return;
+            }
+            if (status != SSH_FX_OP_UNSUPPORTED)
+            {
+                throw std::runtime_error("error copying the remote file");
+            }
+            capabilities.m_copyData = false;
+            cache.Update(server, capabilities);
+        }
+
+        RunShellCommand("cp -p -- " + detail::ShellQuote(source) + ' ' + detail::ShellQuote(destination), server, capabilities, cache);
+    }
+
+    inline void SftpChannel::RenameRemote(char const* source, char const* destination, RenameExisting existing, SftpCapabilityCache& cache)
+    {
+        if (!m_session)
+        {
+            throw std::runtime_error("no active sftp session");
+        }
+
+        if (existing == RenameExisting::Fail)
+        {
+            if (LIBSSH_CPP_WRAP_TRACE(SftpRename, sftp_rename(m_session.get(), source, destination)) != SSH_OK)
+            {
+                ReportError("error renaming file", m_session->session);
+            }
+            return;
+        }
+
+        auto const server = detail::ServerKey(m_session->session);
+        auto capabilities = cache.Get(server, [this] { return ProbeCapabilities(); });
+
+        if (capabilities.m_posixRename)
+        {
+            auto const status = detail::SftpExtendedRequest(m_session.get(), "posix-rename@openssh.com", [&](detail::SftpPacket& packet)
+                {
+                    packet.AppendString(source);
+                    packet.AppendString(destination);
+                });
+            if (status == SSH_FX_OK)
+            {
+                return;
+            }
+            if (status != SSH_FX_OP_UNSUPPORTED)
+            {
+                throw std::runtime_error("error renaming file");
+            }
+            capabilities.m_posixRename = false;
+            cache.Update(server, capabilities);
+        }
+
+        RunShellCommand("mv -f -- " + detail::ShellQuote(source) + ' ' + detail::ShellQuote(destination), server, capabilities, cache);
+    }
+
+    inline Sha256Digest SftpChannel::RemoteSha256(char const* fileName, SftpCapabilityCache& cache)
+    {
+        if (!m_session)
+        {
+            throw std::runtime_error("no active sftp session");
+        }
+
+        auto const server = detail::ServerKey(m_session->session);
+        auto capabilities = cache.Get(server, [this] { return ProbeCapabilities(); });
+
+        if (capabilities.m_checkFile)
+        {
+            auto const reply = detail::SftpExtendedQuery(m_session.get(), "check-file-name", [&](detail::SftpPacket& packet)
+                {
+                    packet.AppendString(fileName);
+                    packet.AppendString("sha256");
+                    packet.AppendUInt64(0);
+                    packet.AppendUInt64(0); // up to the end of the file
+                    packet.AppendUInt32(0); // a single hash for the whole range
+                });
+            if (reply.m_type == SSH_FXP_EXTENDED_REPLY)
+            {
+                // string "check-file", string algorithm, hash
+                auto const& payload = reply.m_payload;
+                size_t offset = 0;
+                for (int field = 0; field != 2; ++field)
+                {
+                    if (payload.size() - offset < 4)
+                    {
+                        throw std::runtime_error("invalid check-file reply");
+                    }
+                    size_t const length = detail::ReadUInt32(payload.data() + offset);
+                    offset += 4;
+                    if (payload.size() - offset < length)
+                    {
+                        throw std::runtime_error("invalid check-file reply");
+                    }
+                    offset += length;
+                }
+                Sha256Digest digest;
+                if (payload.size() - offset != digest.size())
+                {
+                    throw std::runtime_error("invalid check-file reply");
+                }
+                std::copy(payload.begin() + static_cast<std::ptrdiff_t>(offset), payload.end(), digest.begin());
+                return digest;
+            }
+            auto const status = reply.Status();
+            if (status != SSH_FX_OP_UNSUPPORTED)
+            {
+                throw std::runtime_error("error computing the remote checksum");
+            }
+            capabilities.m_checkFile = false;
+            cache.Update(server, capabilities);
+        }
+
+        return detail::ParseSha256Output(RunShellCommand(detail::RemoteSha256Command(fileName), server, capabilities, cache, true));
+    }
 }
 
 #endif
\ No newline at end of file
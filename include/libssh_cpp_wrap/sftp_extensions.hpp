@@ -0,0 +1,283 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_SFTP_EXTENSIONS
+#define LIBSSH_CPP_WRAP_SFTP_EXTENSIONS
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "libssh/libssh.h"
+#include "libssh/sftp.h"
+
+#include "sftp_packet.hpp"
+#include "tracing.hpp"
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief optional features of a sftp server
+     */
+    struct SftpServerCapabilities
+    {
+        /**
+         * \brief the server supports the copy-data extension
+         */
+        bool m_copyData{ false };
+
+        /**
+         * \brief the server supports the posix-rename@openssh.com extension
+         */
+        bool m_posixRename{ false };
+
+        /**
+         * \brief the server supports the check-file extension
+         */
+        bool m_checkFile{ false };
+
+        /**
+         * \brief the server provides a shell with cp and mv; empty until tried
+         */
+        std::optional<bool> m_shellCommands;
+    };
+
+    /**
+     * \brief Remembers the capabilities of sftp servers by host and port
+     *
+     * Unsupported features are usually only discovered by a failing request, e.g. a server advertising an extension
+     * but rejecting it or an account without shell access; the cache keeps later operations from retrying them.
+     */
+    class SftpCapabilityCache
+    {
+    public:
+        /**
+         * \return the capabilities cached for \p server; \p probe determines them, if there's no entry yet
+         */
+        SftpServerCapabilities Get(std::string const& server, std::function<SftpServerCapabilities()> const& probe)
+        {
+            {
+                std::lock_guard lock(m_mutex);
+                auto pos = m_entries.find(server);
+                if (pos != m_entries.end())
+                {
+                    return pos->second;
+                }
+            }
+            auto capabilities = probe();
+            std::lock_guard lock(m_mutex);
+            return m_entries.try_emplace(server, std::move(capabilities)).first->second;
+        }
+
+        /**
+         * \brief replaces the entry of \p server
+         */
+        void Update(std::string const& server, SftpServerCapabilities const& capabilities)
+        {
+            std::lock_guard lock(m_mutex);
+            m_entries[server] = capabilities;
+        }
+
+        void Clear()
+        {
+            std::lock_guard lock(m_mutex);
+            m_entries.clear();
+        }
+
+        static SftpCapabilityCache& Global()
+        {
+            static SftpCapabilityCache cache;
+            return cache;
+        }
+
+    private:
+        std::mutex m_mutex;
+        std::map<std::string, SftpServerCapabilities> m_entries;
+    };
+
+    namespace detail
+    {
+
+        /**
+         * \return "host:port" of the server \p session is connected to
+         */
+        inline std::string ServerKey(ssh_session session)
+        {
+            std::string key;
+            char* host = nullptr;
+            if (ssh_options_get(session, SSH_OPTIONS_HOST, &host) == SSH_OK && host != nullptr)
+            {
+                key = host;
+                ssh_string_free_char(host);
+            }
+            unsigned int port = 22;
+            ssh_options_get_port(session, &port);
+            key += ':';
+            key += std::to_string(port);
+            return key;
+        }
+
+#ifndef LIBSSH_CPP_WRAP_ASSUME_SFTP_SESSION_LAYOUT
+        // the raw packet functions below use the channel, id counter and reply queue of sftp_session_struct;
+        // define LIBSSH_CPP_WRAP_ASSUME_SFTP_SESSION_LAYOUT after checking these members for other libssh versions
+        static_assert(LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 9, 0) && LIBSSH_VERSION_INT < SSH_VERSION_INT(0, 12, 0),
+                      "the raw sftp packet functions are only verified for libssh 0.9 - 0.11");
+#endif
+
+        /**
+         * \brief checks that libssh holds no reply, which would be lost or mixed up with the raw packets
+         *
+         * Replies libssh read for other requests, e.g. of an ongoing sftp_async_read, are stored in the queue of the
+         * session; a non-empty queue means the SftpChannel is used concurrently.
+         */
+        inline void AssertNoLibsshRequestPending([[maybe_unused]] sftp_session sftp) noexcept
+        {
+            assert(sftp->queue == nullptr && "the sftp session must not be used by libssh while raw packets are exchanged");
+        }
+
+        inline void ChannelReadExactly(ssh_channel channel, uint8_t* data, size_t size)
+        {
+            while (size != 0)
+            {
+                int const count = LIBSSH_CPP_WRAP_TRACE(ChannelRead, ssh_channel_read(channel, data, static_cast<uint32_t>(size), 0));
+                if (count <= 0)
+                {
+                    throw std::runtime_error("error reading the sftp reply");
+                }
+                data += count;
+                size -= static_cast<size_t>(count);
+            }
+        }
+
+        /**
+         * \brief writes \p size bytes of complete sftp packets to the channel of \p sftp
+         */
+        inline void SendSftpPackets(sftp_session sftp, uint8_t const* data, size_t size)
+        {
+            AssertNoLibsshRequestPending(sftp);
+            while (size != 0)
+            {
+                auto const written = LIBSSH_CPP_WRAP_TRACE(ChannelWrite, ssh_channel_write(sftp->channel, data, static_cast<uint32_t>(size)));
+                if (written <= 0)
+                {
+                    throw std::runtime_error("error sending the sftp request");
+                }
+                data += written;
+                size -= static_cast<size_t>(written);
+            }
+        }
+
+        /**
+         * \brief reads the next packet from the channel of \p sftp
+         */
+        inline SftpReply ReadSftpReply(sftp_session sftp)
+        {
+            AssertNoLibsshRequestPending(sftp);
+            uint8_t header[9];
+            ChannelReadExactly(sftp->channel, header, sizeof(header));
+            uint32_t const length = ReadUInt32(header);
+            if (length < 5 || length > MaxSftpPacketSize)
+            {
+                throw std::runtime_error("invalid sftp reply");
+            }
+            SftpReply reply;
+            reply.m_type = header[4];
+            reply.m_id = ReadUInt32(header + 5);
+            reply.m_payload.resize(length - 5);
+            ChannelReadExactly(sftp->channel, reply.m_payload.data(), reply.m_payload.size());
+            return reply;
+        }
+
+        /**
+         * \brief sends an extended request, which libssh has no function for, and waits for the reply
+         *
+         * The request is sent directly on the channel of \p sftp, so no other request may be outstanding and the
+         * session must not be used by other threads meanwhile.
+         */
+        template<class PayloadWriter>
+        SftpReply SftpExtendedQuery(sftp_session sftp, std::string_view name, PayloadWriter&& writePayload)
+        {
+            uint32_t const id = ++sftp->id_counter;
+            SftpPacket packet(SSH_FXP_EXTENDED, id);
+            packet.AppendString(name);
+            writePayload(packet);
+
+            auto const& data = packet.Finish();
+            SendSftpPackets(sftp, data.data(), data.size());
+
+            auto reply = ReadSftpReply(sftp);
+            if (reply.m_id != id)
+            {
+                throw std::runtime_error("unexpected sftp reply");
+            }
+            return reply;
+        }
+
+        /**
+         * \brief sends an extended request without reply data
+         *
+         * \return the status code of the reply
+         */
+        template<class PayloadWriter>
+        uint32_t SftpExtendedRequest(sftp_session sftp, std::string_view name, PayloadWriter&& writePayload)
+        {
+            auto const reply = SftpExtendedQuery(sftp, name, std::forward<PayloadWriter>(writePayload));
+            if (reply.m_type == SSH_FXP_EXTENDED_REPLY)
+            {
+                return SSH_FX_OK;
+            }
+            return reply.Status();
+        }
+
+        /**
+         * \return \p value quoted for a posix shell
+         */
+        inline std::string ShellQuote(std::string_view value)
+        {
+            std::string result = "'";
+            for (char c : value)
+            {
+                if (c == '\'')
+                {
+                    result += "'\\''";
+                }
+                else
+                {
+                    result += c;
+                }
+            }
+            result += '\'';
+            return result;
+        }
+
+    }
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_SFTP_PACKET
+#define LIBSSH_CPP_WRAP_SFTP_PACKET
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "libssh/libssh.h"
+#include "libssh/sftp.h"
+
+namespace libssh_wrap
+{
+    namespace detail
+    {
+
+        /**
+         * \brief builds a sftp packet in the wire format of draft-ietf-secsh-filexfer-02
+         */
+        class SftpPacket
+        {
+        public:
+            SftpPacket(uint8_t type, uint32_t id)
+            {
+                m_data.resize(4);
+                m_data.push_back(type);
+                AppendUInt32(id);
+            }
+
+            void AppendUInt32(uint32_t value)
+            {
+                for (int shift = 24; shift >= 0; shift -= 8)
+                {
+                    m_data.push_back(static_cast<uint8_t>(value >> shift));
+                }
+            }
+
+            void AppendUInt64(uint64_t value)
+            {
+                AppendUInt32(static_cast<uint32_t>(value >> 32));
+                AppendUInt32(static_cast<uint32_t>(value));
+            }
+
+            void AppendString(void const* data, size_t size)
+            {
+                AppendUInt32(static_cast<uint32_t>(size));
+                auto bytes = static_cast<uint8_t const*>(data);
+                m_data.insert(m_data.end(), bytes, bytes + size);
+            }
+
+            void AppendString(std::string_view value)
+            {
+                AppendString(value.data(), value.size());
+            }
+
+            void AppendString(ssh_string value)
+            {
+                AppendString(ssh_string_data(value), ssh_string_len(value));
+            }
+
+            /**
+             * \return the packet with the length prefix filled in
+             */
+            std::vector<uint8_t> const& Finish()
+            {
+                auto const length = static_cast<uint32_t>(m_data.size() - 4);
+                for (int i = 0; i != 4; ++i)
+                {
+                    m_data[static_cast<size_t>(i)] = static_cast<uint8_t>(length >> (24 - 8 * i));
+                }
+                return m_data;
+            }
+
+        private:
+            std::vector<uint8_t> m_data;
+        };
+
+        inline uint32_t ReadUInt32(uint8_t const* data) noexcept
+        {
+            return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+        }
+
+        /**
+         * \brief the largest packet accepted from the server; the limit of OpenSSH's sftp-server
+         */
+        constexpr uint32_t MaxSftpPacketSize = 256 * 1024;
+
+        /**
+         * \brief a packet received from the sftp server
+         */
+        struct SftpReply
+        {
+            uint8_t m_type{ 0 };
+            uint32_t m_id{ 0 };
+            std::vector<uint8_t> m_payload;
+
+            /**
+             * \return the status code of a SSH_FXP_STATUS reply
+             */
+            [[nodiscard]] uint32_t Status() const
+            {
+                if (m_type != SSH_FXP_STATUS || m_payload.size() < 4)
+                {
+                    throw std::runtime_error("invalid sftp reply");
+                }
+                return ReadUInt32(m_payload.data());
+            }
+        };
+
+        /**
+         * \exception ::std::runtime_error Always; reports \p message with the status code of \p reply, or
+         *            SSH_FX_BAD_MESSAGE if it isn't a status reply
+         */
+        [[noreturn]] inline void ThrowSftpStatus(char const* message, SftpReply const& reply)
+        {
+            uint32_t const status = (reply.m_type == SSH_FXP_STATUS && reply.m_payload.size() >= 4) ? ReadUInt32(reply.m_payload.data()) : SSH_FX_BAD_MESSAGE;
+            throw std::runtime_error(std::string(message) + ": sftp status " + std::to_string(status));
+        }
+
+    }
+
+}
+
+#endif
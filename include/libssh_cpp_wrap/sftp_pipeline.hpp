@@ -0,0 +1,471 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_SFTP_PIPELINE
+#define LIBSSH_CPP_WRAP_SFTP_PIPELINE
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "libssh/sftp.h"
+
+#include "bandwidth_limiter.hpp"
+#include "cancellation.hpp"
+#include "checksum.hpp"
+#include "sftp_channel.hpp"
+#include "sftp_extensions.hpp"
+#include "transfer_options.hpp"
+
+namespace libssh_wrap
+{
+
+    struct SftpPipelineOptions
+    {
+        /**
+         * \brief the number of bytes per read or write request; at most 255 KiB
+         */
+        uint32_t m_requestSize{ 32768 };
+
+        /**
+         * \brief the maximum number of requests waiting for a reply
+         */
+        size_t m_maxOutstanding{ 64 };
+
+        /**
+         * \brief start with a few outstanding requests and add more while the round trip time stays close to its
+         *        minimum; false to use m_maxOutstanding from the start
+         */
+        bool m_autoTune{ true };
+
+        TransferOptions m_transfer;
+    };
+
+    /**
+     * \brief Transfers a file with many sftp read or write requests in flight
+     *
+     * FileStream::Read and Write wait for the reply to each request, which limits a transfer to one request size per
+     * round trip. The pipeline keeps up to SftpPipelineOptions::m_maxOutstanding requests outstanding instead, so the
+     * amount of data in flight can match the bandwidth-delay product of the link. With auto tuning the number of
+     * outstanding requests grows by one per reply while the pipeline is full and the round trip time stays below twice
+     * its minimum, i.e. it doubles every round trip until the link starts to queue, similar to tcp slow start.
+     *
+     * The requests are written to the channel of the sftp session directly; the session must not be used otherwise
+     * while a transfer is running. A failing transfer still reads the replies to its outstanding requests before it
+     * throws, so the session can be used for further requests. The tuned state is kept between transfers of the same
+     * pipeline.
+     */
+    class SftpPipeline
+    {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr uint32_t MaxRequestSize = detail::MaxSftpPacketSize - 1024;
+        static constexpr size_t InitialOutstanding = 4;
+
+        explicit SftpPipeline(FileStream& file, SftpPipelineOptions options = {})
+            : m_file(file),
+            m_options(std::move(options))
+        {
+            m_options.m_requestSize = std::clamp(m_options.m_requestSize, uint32_t(512), MaxRequestSize);
+            m_options.m_maxOutstanding = (std::max)(m_options.m_maxOutstanding, size_t(1));
+            m_outstanding = m_options.m_autoTune ? (std::min)(InitialOutstanding, m_options.m_maxOutstanding) : m_options.m_maxOutstanding;
+        }
+
+        SftpPipeline(SftpPipeline const&) = delete;
+        SftpPipeline& operator=(SftpPipeline const&) = delete;
+
+        /**
+         * \return the current limit of outstanding requests
+         */
+        [[nodiscard]] size_t Outstanding() const noexcept
+        {
+            return m_outstanding;
+        }
+
+        /**
+         * \return the shortest round trip of a request measured so far
+         */
+        [[nodiscard]] Clock::duration MinRoundTrip() const noexcept
+        {
+            return m_minRoundTrip;
+        }
+
+        /**
+         * \brief writes the contents of \p in at the current position of the file
+         *
+         * \return the number of bytes written
+         *
+         * \exception ::std::runtime_error If reading \p in or a write request fails
+         */
+        uint64_t Write(std::istream& in)
+        {
+            auto file = CheckedFile();
+            auto const sftp = file->sftp;
+            auto const& options = m_options.m_transfer;
+
+            return detail::WithCancellation(sftp->session, options, [&]
+                {
+                    detail::ThrottledTransfer throttle(options, sftp->session);
+                    std::vector<char> buffer(m_options.m_requestSize);
+                    std::vector<uint8_t> packets;
+                    std::unordered_map<uint32_t, Request> pending;
+                    uint64_t const start = sftp_tell64(file);
+                    uint64_t offset = start;
+                    bool endOfInput = false;
+
+                    try
+                    {
+                        while (!endOfInput || !pending.empty())
+                        {
+                            while (!endOfInput && pending.size() < m_outstanding)
+                            {
+                                auto const granted = throttle.Acquire(buffer.size());
+                                in.read(buffer.data(), static_cast<std::streamsize>(granted));
+                                if (in.bad())
+                                {
+                                    throw std::runtime_error("error reading input stream");
+                                }
+                                auto const count = static_cast<size_t>(in.gcount());
+                                throttle.Transferred(granted, count);
+                                endOfInput = !in;
+                                if (count == 0)
+                                {
+                                    break;
+                                }
+                                if (options.m_checksum != nullptr)
+                                {
+                                    options.m_checksum->Update(buffer.data(), count);
+                                }
+
+                                uint32_t const id = ++sftp->id_counter;
+                                detail::SftpPacket packet(SSH_FXP_WRITE, id);
+                                packet.AppendString(file->handle);
+                                packet.AppendUInt64(offset);
+                                packet.AppendString(buffer.data(), count);
+                                auto const& data = packet.Finish();
+                                packets.insert(packets.end(), data.begin(), data.end());
+                                pending.emplace(id, Request{ offset, static_cast<uint32_t>(count), Clock::now() });
+                                offset += count;
+
+                                if (packets.size() >= buffer.size())
+                                {
+                                    detail::SendSftpPackets(sftp, packets.data(), packets.size());
+                                    packets.clear();
+                                }
+                            }
+                            if (!packets.empty())
+                            {
+                                detail::SendSftpPackets(sftp, packets.data(), packets.size());
+                                packets.clear();
+                            }
+                            if (pending.empty())
+                            {
+                                break;
+                            }
+
+                            auto const reply = detail::ReadSftpReply(sftp);
+                            auto const pos = pending.find(reply.m_id);
+                            if (pos == pending.end())
+                            {
+                                throw std::runtime_error("unexpected sftp reply");
+                            }
+                            auto const current = pos->second;
+                            OnReply(current, pending.size());
+                            pending.erase(pos);
+                            if (reply.Status() != SSH_FX_OK)
+                            {
+                                detail::ThrowSftpStatus("error writing file", reply);
+                            }
+                        }
+                    }
+                    catch (...)
+                    {
+                        DrainReplies(sftp, packets, pending);
+                        throw;
+                    }
+
+                    Seek(file, offset);
+                    return offset - start;
+                });
+        }
+
+        /**
+         * \brief reads the file from the current position to its end into \p out
+         *
+         * \return the number of bytes read
+         *
+         * \exception ::std::runtime_error If a read request fails or writing to \p out fails
+         */
+        uint64_t Read(std::ostream& out)
+        {
+            auto file = CheckedFile();
+            auto const sftp = file->sftp;
+            auto const& options = m_options.m_transfer;
+
+            return detail::WithCancellation(sftp->session, options, [&]
+                {
+                    detail::ThrottledTransfer throttle(options, sftp->session);
+                    std::vector<uint8_t> packets;
+                    std::unordered_map<uint32_t, Request> pending;
+
+                    // parts of short reads that still need to be requested
+                    std::deque<std::pair<uint64_t, uint32_t>> missing;
+
+                    // data received ahead of the next position to write
+                    std::map<uint64_t, std::vector<uint8_t>> received;
+
+                    uint64_t const start = sftp_tell64(file);
+                    uint64_t nextRequest = start;
+                    uint64_t written = start;
+                    std::optional<uint64_t> end;
+
+                    auto request = [&](uint64_t offset, uint32_t size)
+                        {
+                            uint32_t const id = ++sftp->id_counter;
+                            detail::SftpPacket packet(SSH_FXP_READ, id);
+                            packet.AppendString(file->handle);
+                            packet.AppendUInt64(offset);
+                            packet.AppendUInt32(size);
+                            auto const& data = packet.Finish();
+                            packets.insert(packets.end(), data.begin(), data.end());
+                            pending.emplace(id, Request{ offset, size, Clock::now() });
+                        };
+
+                    try
+                    {
+                        while (true)
+                        {
+                            while (pending.size() < m_outstanding)
+                            {
+                                while (!missing.empty() && end.has_value() && missing.front().first >= *end)
+                                {
+                                    missing.pop_front();
+                                }
+                                if (!missing.empty())
+                                {
+                                    auto [offset, size] = missing.front();
+                                    auto const granted = static_cast<uint32_t>(throttle.Acquire(size));
+                                    if (granted < size)
+                                    {
+                                        missing.front() = { offset + granted, size - granted };
+                                    }
+                                    else
+                                    {
+                                        missing.pop_front();
+                                    }
+                                    request(offset, granted);
+                                }
+                                else if (!end.has_value())
+                                {
+                                    auto const granted = static_cast<uint32_t>(throttle.Acquire(m_options.m_requestSize));
+                                    request(nextRequest, granted);
+                                    nextRequest += granted;
+                                }
+                                else
+                                {
+                                    break;
+                                }
+                            }
+                            if (!packets.empty())
+                            {
+                                detail::SendSftpPackets(sftp, packets.data(), packets.size());
+                                packets.clear();
+                            }
+                            if (pending.empty())
+                            {
+                                break;
+                            }
+
+                            auto const reply = detail::ReadSftpReply(sftp);
+                            auto const pos = pending.find(reply.m_id);
+                            if (pos == pending.end())
+                            {
+                                throw std::runtime_error("unexpected sftp reply");
+                            }
+                            auto const current = pos->second;
+                            OnReply(current, pending.size());
+                            pending.erase(pos);
+
+                            if (reply.m_type == SSH_FXP_DATA)
+                            {
+                                auto const& payload = reply.m_payload;
+                                if (payload.size() < 4 || detail::ReadUInt32(payload.data()) != payload.size() - 4
+                                    || payload.size() - 4 > current.m_size)
+                                {
+                                    throw std::runtime_error("invalid sftp reply");
+                                }
+                                auto const count = static_cast<uint32_t>(payload.size() - 4);
+                                throttle.Transferred(current.m_size, count);
+                                if (count == 0)
+                                {
+                                    end = (std::min)(end.value_or(current.m_offset), current.m_offset);
+                                }
+                                else if (count < current.m_size)
+                                {
+                                    missing.emplace_back(current.m_offset + count, current.m_size - count);
+                                }
+                                if (count != 0)
+                                {
+                                    received.emplace(current.m_offset, std::vector<uint8_t>(payload.begin() + 4, payload.end()));
+                                }
+                            }
+                            else if (reply.Status() == SSH_FX_EOF)
+                            {
+                                throttle.Transferred(current.m_size, 0);
+                                end = (std::min)(end.value_or(current.m_offset), current.m_offset);
+                            }
+                            else
+                            {
+                                detail::ThrowSftpStatus("error reading file", reply);
+                            }
+
+                            for (auto first = received.begin(); first != received.end() && first->first == written; first = received.begin())
+                            {
+                                auto const& data = first->second;
+                                out.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+                                if (!out)
+                                {
+                                    throw std::runtime_error("error writing the contents read via ssh to output stream");
+                                }
+                                if (options.m_checksum != nullptr)
+                                {
+                                    options.m_checksum->Update(reinterpret_cast<char const*>(data.data()), data.size());
+                                }
+                                written += data.size();
+                                received.erase(first);
+                            }
+                        }
+                    }
+                    catch (...)
+                    {
+                        DrainReplies(sftp, packets, pending);
+                        throw;
+                    }
+
+                    if (!received.empty())
+                    {
+                        throw std::runtime_error("the server returned data beyond the end of the file");
+                    }
+                    Seek(file, written);
+                    return written - start;
+                });
+        }
+
+    private:
+        struct Request
+        {
+            uint64_t m_offset;
+            uint32_t m_size;
+            Clock::time_point m_sent;
+        };
+
+        sftp_file CheckedFile() const
+        {
+            if (!m_file.m_file)
+            {
+                throw std::runtime_error("file not opened");
+            }
+            return m_file.m_file.get();
+        }
+
+        /**
+         * \brief sends the requests still buffered in \p packets and reads the replies to all \p pending requests
+         *
+         * Called before an error leaves a transfer, so no reply is left on the channel to be taken for the reply of a
+         * later request. If the session fails meanwhile, it's unusable anyway and the original error is reported.
+         */
+        static void DrainReplies(sftp_session sftp, std::vector<uint8_t> const& packets, std::unordered_map<uint32_t, Request>& pending) noexcept
+        {
+            try
+            {
+                if (!packets.empty())
+                {
+                    detail::SendSftpPackets(sftp, packets.data(), packets.size());
+                }
+                while (!pending.empty())
+                {
+                    // replies to unknown ids are skipped as well
+                    pending.erase(detail::ReadSftpReply(sftp).m_id);
+                }
+            }
+            catch (...)
+            {
+            }
+        }
+
+        static void Seek(sftp_file file, uint64_t offset)
+        {
+            if (sftp_seek64(file, offset) != SSH_OK)
+            {
+                throw std::runtime_error("error seeking in file");
+            }
+        }
+
+        /**
+         * \param pending the number of outstanding requests including the answered one
+         */
+        void OnReply(Request const& request, size_t pending)
+        {
+            auto const now = Clock::now();
+            auto const roundTrip = now - request.m_sent;
+            if (m_minRoundTrip == Clock::duration::zero() || roundTrip < m_minRoundTrip)
+            {
+                m_minRoundTrip = roundTrip;
+            }
+            if (!m_options.m_autoTune)
+            {
+                return;
+            }
+
+            if (roundTrip > 2 * m_minRoundTrip + std::chrono::milliseconds(1))
+            {
+                // requests queue up on the link or in the server: back off by an eighth, at most once per round trip
+                if (now - m_lastDecrease > m_minRoundTrip && m_outstanding > InitialOutstanding)
+                {
+                    m_outstanding -= (std::max)(m_outstanding / 8, size_t(1));
+                    m_outstanding = (std::max)(m_outstanding, InitialOutstanding);
+                    m_lastDecrease = now;
+                }
+            }
+            else if (pending >= m_outstanding && m_outstanding < m_options.m_maxOutstanding)
+            {
+                ++m_outstanding;
+            }
+        }
+
+        FileStream& m_file;
+        SftpPipelineOptions m_options;
+        size_t m_outstanding;
+        Clock::duration m_minRoundTrip{ Clock::duration::zero() };
+        Clock::time_point m_lastDecrease{};
+    };
+
+}
+
+#endif
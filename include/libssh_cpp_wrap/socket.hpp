@@ -0,0 +1,300 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_SOCKET
+#define LIBSSH_CPP_WRAP_SOCKET
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <variant>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "libssh/libssh.h"
+
+#include "ip.hpp"
+
+namespace libssh_wrap::detail
+{
+
+#ifdef _WIN32
+    using PollDescriptor = WSAPOLLFD;
+#else
+    using PollDescriptor = pollfd;
+#endif
+
+    inline void CloseSocket(socket_t socket) noexcept
+    {
+#ifdef _WIN32
+        closesocket(socket);
+#else
+        close(socket);
+#endif
+    }
+
+    inline bool SetNonBlocking(socket_t socket, bool nonBlocking) noexcept
+    {
+#ifdef _WIN32
+        u_long mode = nonBlocking ? 1 : 0;
+        return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+        int const flags = fcntl(socket, F_GETFL, 0);
+        return flags >= 0 && fcntl(socket, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) == 0;
+#endif
+    }
+
+    /**
+     * \return true, if the last socket operation failed, because it would block
+     */
+    inline bool LastOperationWouldBlock() noexcept
+    {
+#ifdef _WIN32
+        int const error = WSAGetLastError();
+        return error == WSAEWOULDBLOCK || error == WSAEINPROGRESS;
+#else
+        return errno == EINPROGRESS || errno == EWOULDBLOCK || errno == EAGAIN;
+#endif
+    }
+
+    inline int Poll(PollDescriptor* descriptors, size_t count, std::chrono::milliseconds timeout) noexcept
+    {
+        int const timeoutMs = static_cast<int>((std::max)(timeout.count(), std::chrono::milliseconds::rep(0)));
+#ifdef _WIN32
+        return WSAPoll(descriptors, static_cast<ULONG>(count), timeoutMs);
+#else
+        return poll(descriptors, static_cast<nfds_t>(count), timeoutMs);
+#endif
+    }
+
+    /**
+     * \return the pending error of a socket (SO_ERROR)
+     */
+    inline int SocketError(socket_t socket) noexcept
+    {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if (getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0)
+        {
+            return -1;
+        }
+        return error;
+    }
+
+    /**
+     * \brief sets an integer socket option
+     */
+    inline bool SetSocketOption(socket_t socket, int level, int name, int value) noexcept
+    {
+        return setsockopt(socket, level, name, reinterpret_cast<char const*>(&value), sizeof(value)) == 0;
+    }
+
+    /**
+     * \brief receives up to \p size bytes into \p buffer
+     *
+     * \return the number of bytes received, 0 at the end of the stream or a negative value on error
+     */
+    inline ptrdiff_t Receive(socket_t socket, char* buffer, size_t size) noexcept
+    {
+#ifdef _WIN32
+        return ::recv(socket, buffer, static_cast<int>((std::min)(size, size_t(INT_MAX))), 0);
+#else
+        return ::recv(socket, buffer, size, 0);
+#endif
+    }
+
+    /**
+     * \brief sends up to \p size bytes of \p data without raising SIGPIPE
+     *
+     * \return the number of bytes sent or a negative value on error
+     */
+    inline ptrdiff_t Send(socket_t socket, char const* data, size_t size) noexcept
+    {
+#ifdef _WIN32
+        return ::send(socket, data, static_cast<int>((std::min)(size, size_t(INT_MAX))), 0);
+#elif defined(MSG_NOSIGNAL)
+        return ::send(socket, data, size, MSG_NOSIGNAL);
+#else
+        return ::send(socket, data, size, 0);
+#endif
+    }
+
+    /**
+     * \brief signals the end of the outgoing data to the peer
+     */
+    inline void ShutdownWrite(socket_t socket) noexcept
+    {
+#ifdef _WIN32
+        ::shutdown(socket, SD_SEND);
+#else
+        ::shutdown(socket, SHUT_WR);
+#endif
+    }
+
+    /**
+     * \brief ends the traffic in both directions; operations blocked on the socket return with an error
+     */
+    inline void ShutdownBoth(socket_t socket) noexcept
+    {
+#ifdef _WIN32
+        ::shutdown(socket, SD_BOTH);
+#else
+        ::shutdown(socket, SHUT_RDWR);
+#endif
+    }
+
+    /**
+     * \brief an address usable with the socket api
+     */
+    struct SocketAddress
+    {
+        sockaddr_storage m_storage{};
+        socklen_t m_length{ 0 };
+
+        SocketAddress(IpAddress const& ip, int port) noexcept
+        {
+            if (auto ipV4 = std::get_if<IpV4>(&ip))
+            {
+                auto& address = reinterpret_cast<sockaddr_in&>(m_storage);
+                address.sin_family = AF_INET;
+                address.sin_port = htons(static_cast<uint16_t>(port));
+                uint8_t const bytes[4] = { (*ipV4)[0], (*ipV4)[1], (*ipV4)[2], (*ipV4)[3] };
+                std::memcpy(&address.sin_addr, bytes, sizeof(bytes));
+                m_length = sizeof(address);
+            }
+            else
+            {
+                auto& address = reinterpret_cast<sockaddr_in6&>(m_storage);
+                address.sin6_family = AF_INET6;
+                address.sin6_port = htons(static_cast<uint16_t>(port));
+                std::memcpy(&address.sin6_addr, std::get<IpV6>(ip).Bytes().data(), 16);
+                m_length = sizeof(address);
+            }
+        }
+
+        [[nodiscard]] int Family() const noexcept
+        {
+            return m_storage.ss_family;
+        }
+
+        [[nodiscard]] sockaddr const* Get() const noexcept
+        {
+            return reinterpret_cast<sockaddr const*>(&m_storage);
+        }
+    };
+
+    /**
+     * \brief stores the address of \p address in \p result
+     *
+     * \return false for families other than AF_INET and AF_INET6
+     */
+    inline bool ToIpAddress(sockaddr const* address, IpAddress& result) noexcept
+    {
+        if (address->sa_family == AF_INET)
+        {
+            uint8_t bytes[4];
+            std::memcpy(bytes, &reinterpret_cast<sockaddr_in const*>(address)->sin_addr, sizeof(bytes));
+            result = IpV4(bytes[0], bytes[1], bytes[2], bytes[3]);
+            return true;
+        }
+        if (address->sa_family == AF_INET6)
+        {
+            std::array<uint8_t, 16> bytes;
+            std::memcpy(bytes.data(), &reinterpret_cast<sockaddr_in6 const*>(address)->sin6_addr, bytes.size());
+            result = IpV6(bytes);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * \brief owns a socket
+     */
+    class SocketHandle
+    {
+    public:
+        SocketHandle() noexcept = default;
+
+        explicit SocketHandle(socket_t socket) noexcept
+            : m_socket(socket)
+        {
+        }
+
+        SocketHandle(SocketHandle&& other) noexcept
+            : m_socket(std::exchange(other.m_socket, SSH_INVALID_SOCKET))
+        {
+        }
+
+        SocketHandle& operator=(SocketHandle&& other) noexcept
+        {
+            std::swap(m_socket, other.m_socket);
+            return *this;
+        }
+
+        ~SocketHandle() noexcept
+        {
+            if (m_socket != SSH_INVALID_SOCKET)
+            {
+                CloseSocket(m_socket);
+            }
+        }
+
+        [[nodiscard]] operator bool() const noexcept
+        {
+            return m_socket != SSH_INVALID_SOCKET;
+        }
+
+        [[nodiscard]] socket_t Get() const noexcept
+        {
+            return m_socket;
+        }
+
+        /**
+         * \brief gives up ownership of the socket
+         */
+        [[nodiscard]] socket_t Release() noexcept
+        {
+            return std::exchange(m_socket, SSH_INVALID_SOCKET);
+        }
+
+    private:
+        socket_t m_socket{ SSH_INVALID_SOCKET };
+    };
+
+}
+
+#endif
@@ -0,0 +1,1054 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TAR
+#define LIBSSH_CPP_WRAP_TAR
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <zlib.h>
+
+#ifdef LIBSSH_CPP_WRAP_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "executor.hpp"
+
+namespace libssh_wrap
+{
+
+    enum class TarCompression
+    {
+        None,
+        Gzip,
+
+        /**
+         * \brief requires LIBSSH_CPP_WRAP_ENABLE_ZSTD
+         */
+        Zstd,
+    };
+
+    namespace detail
+    {
+
+        /**
+         * \brief receives the output of a stage of the archive pipeline
+         */
+        using ByteSink = std::function<void(char const* data, size_t size)>;
+
+        constexpr size_t TarBlockSize = 512;
+
+        /**
+         * \brief Writes a ustar archive to a sink
+         *
+         * Names exceeding the ustar limits are stored via GNU long name entries, sizes exceeding the octal field in
+         * base-256 encoding; both are understood by GNU and BSD tar.
+         */
+        class TarWriter
+        {
+        public:
+            explicit TarWriter(ByteSink sink)
+                : m_sink(std::move(sink))
+            {
+            }
+
+            void AddDirectory(std::string const& name, uint32_t mode, int64_t modificationTime)
+            {
+                WriteHeader(name.back() == '/' ? name : name + '/', mode, 0, modificationTime, '5', {});
+            }
+
+            void AddSymlink(std::string const& name, std::string const& target, int64_t modificationTime)
+            {
+                if (target.size() > 100)
+                {
+                    WriteLongNameEntry('K', target);
+                }
+                WriteHeader(name, 0777, 0, modificationTime, '2', target.substr(0, 100));
+            }
+
+            /**
+             * \brief adds a file of \p size bytes read from \p in using \p buffer
+             */
+            void AddFile(std::string const& name, uint32_t mode, uint64_t size, int64_t modificationTime, std::istream& in, char* buffer, size_t bufferSize)
+            {
+                WriteHeader(name, mode, size, modificationTime, '0', {});
+                uint64_t remaining = size;
+                while (remaining != 0)
+                {
+                    auto const count = static_cast<size_t>((std::min)(remaining, uint64_t(bufferSize)));
+                    in.read(buffer, static_cast<std::streamsize>(count));
+                    if (static_cast<size_t>(in.gcount()) != count)
+                    {
+                        throw std::runtime_error("error reading " + name);
+                    }
+                    m_sink(buffer, count);
+                    remaining -= count;
+                }
+                Pad(size);
+            }
+
+            /**
+             * \brief writes the end of archive marker
+             */
+            void Finish()
+            {
+                char const zeros[2 * TarBlockSize]{};
+                m_sink(zeros, sizeof(zeros));
+            }
+
+        private:
+            using Header = std::array<char, TarBlockSize>;
+
+            static void WriteOctal(char* field, size_t fieldSize, uint64_t value) noexcept
+            {
+                field[fieldSize - 1] = '\0';
+                for (size_t i = fieldSize - 1; i != 0; --i)
+                {
+                    field[i - 1] = static_cast<char>('0' + (value & 7));
+                    value >>= 3;
+                }
+            }
+
+            static void WriteNumber(char* field, size_t fieldSize, uint64_t value) noexcept
+            {
+                if (value >> (3 * (fieldSize - 1)) == 0)
+                {
+                    WriteOctal(field, fieldSize, value);
+                    return;
+                }
+                // base-256 with the high bit of the first byte set
+                for (size_t i = fieldSize; i != 0; --i)
+                {
+                    field[i - 1] = static_cast<char>(value & 0xff);
+                    value >>= 8;
+                }
+                field[0] = static_cast<char>(0x80);
+            }
+
+            /**
+             * \return true, if \p name could be stored in the name and prefix fields of \p header
+             */
+            static bool StoreName(Header& header, std::string const& name) noexcept
+            {
+                if (name.size() <= 100)
+                {
+                    std::memcpy(header.data(), name.data(), name.size());
+                    return true;
+                }
+                // split at a slash, so the remainder fits into the name field and the start into the prefix field
+                for (size_t split = name.find('/'); split != std::string::npos; split = name.find('/', split + 1))
+                {
+                    if (split <= 155 && name.size() - split - 1 <= 100 && split + 1 != name.size())
+                    {
+                        std::memcpy(header.data() + 345, name.data(), split);
+                        std::memcpy(header.data(), name.data() + split + 1, name.size() - split - 1);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            void WriteLongNameEntry(char type, std::string const& value)
+            {
+                Header header{};
+                std::memcpy(header.data(), "././@LongLink", 13);
+                FinishHeader(header, 0, value.size() + 1, 0, type, {});
+                m_sink(value.c_str(), value.size() + 1);
+                Pad(value.size() + 1);
+            }
+
+            void WriteHeader(std::string const& name, uint32_t mode, uint64_t size, int64_t modificationTime, char type, std::string_view linkName)
+            {
+                Header header{};
+                if (!StoreName(header, name))
+                {
+                    WriteLongNameEntry('L', name);
+                    std::memcpy(header.data(), name.data(), 100);
+                }
+                FinishHeader(header, mode, size, modificationTime, type, linkName);
+            }
+
+            void FinishHeader(Header& header, uint32_t mode, uint64_t size, int64_t modificationTime, char type, std::string_view linkName)
+            {
+                WriteOctal(header.data() + 100, 8, mode & 07777);
+                WriteOctal(header.data() + 108, 8, 0);
+                WriteOctal(header.data() + 116, 8, 0);
+                WriteNumber(header.data() + 124, 12, size);
+                WriteOctal(header.data() + 136, 12, static_cast<uint64_t>((std::max)(modificationTime, int64_t(0))));
+                header[156] = type;
+                if (!linkName.empty())
+                {
+                    std::memcpy(header.data() + 157, linkName.data(), (std::min)(linkName.size(), size_t(100)));
+                }
+                std::memcpy(header.data() + 257, "ustar", 6);
+                std::memcpy(header.data() + 263, "00", 2);
+
+                std::memset(header.data() + 148, ' ', 8);
+                uint32_t checksum = 0;
+                for (char c : header)
+                {
+                    checksum += static_cast<unsigned char>(c);
+                }
+                WriteOctal(header.data() + 148, 7, checksum);
+                header[155] = ' ';
+
+                m_sink(header.data(), header.size());
+            }
+
+            void Pad(uint64_t size)
+            {
+                auto const padding = static_cast<size_t>((TarBlockSize - size % TarBlockSize) % TarBlockSize);
+                if (padding != 0)
+                {
+                    char const zeros[TarBlockSize]{};
+                    m_sink(zeros, padding);
+                }
+            }
+
+            ByteSink m_sink;
+        };
+
+        /**
+         * \brief Extracts a tar archive fed in pieces of arbitrary size below a directory
+         *
+         * Regular files, directories and symbolic links are extracted, other entries are skipped. Entries with
+         * absolute paths or ".." components are rejected. Archives should only be extracted from trusted sources,
+         * since symbolic links in the archive are created as stored.
+         */
+        class TarReader
+        {
+        public:
+            /**
+             * \brief the largest long name, long link name or pax extended header accepted; they are kept in memory
+             */
+            static constexpr uint64_t MaxMetadataSize = 1024 * 1024;
+
+            explicit TarReader(std::filesystem::path directory)
+                : m_directory(std::move(directory))
+            {
+            }
+
+            void Feed(char const* data, size_t size)
+            {
+                while (size != 0)
+                {
+                    switch (m_state)
+                    {
+                    case State::Header:
+                    {
+                        auto const count = (std::min)(size, TarBlockSize - m_headerFill);
+                        std::memcpy(m_header.data() + m_headerFill, data, count);
+                        m_headerFill += count;
+                        data += count;
+                        size -= count;
+                        if (m_headerFill == TarBlockSize)
+                        {
+                            m_headerFill = 0;
+                            ProcessHeader();
+                        }
+                        break;
+                    }
+                    case State::Data:
+                    {
+                        auto const count = static_cast<size_t>((std::min)(uint64_t(size), m_remaining));
+                        if (m_target == Target::File)
+                        {
+                            m_file.write(data, static_cast<std::streamsize>(count));
+                            if (!m_file)
+                            {
+                                throw std::runtime_error("error writing " + m_path.string());
+                            }
+                        }
+                        else if (m_target == Target::Metadata)
+                        {
+                            m_metadata.append(data, count);
+                        }
+                        data += count;
+                        size -= count;
+                        m_remaining -= count;
+                        if (m_remaining == 0)
+                        {
+                            FinishEntry();
+                        }
+                        break;
+                    }
+                    case State::Padding:
+                    {
+                        auto const count = static_cast<size_t>((std::min)(uint64_t(size), m_remaining));
+                        data += count;
+                        size -= count;
+                        m_remaining -= count;
+                        if (m_remaining == 0)
+                        {
+                            m_state = State::Header;
+                        }
+                        break;
+                    }
+                    case State::End:
+                        return;
+                    }
+                }
+            }
+
+            /**
+             * \exception ::std::runtime_error If the archive was truncated
+             */
+            void Finish() const
+            {
+                if (m_state != State::End && !(m_state == State::Header && m_headerFill == 0 && m_sawEntry))
+                {
+                    throw std::runtime_error("the tar archive is truncated");
+                }
+            }
+
+        private:
+            enum class State
+            {
+                Header,
+                Data,
+                Padding,
+                End,
+            };
+
+            enum class Target
+            {
+                Skip,
+                File,
+                Metadata,
+            };
+
+            static uint64_t ParseNumber(char const* field, size_t fieldSize) noexcept
+            {
+                uint64_t value = 0;
+                if (static_cast<unsigned char>(field[0]) & 0x80)
+                {
+                    value = static_cast<unsigned char>(field[0]) & 0x7f;
+                    for (size_t i = 1; i != fieldSize; ++i)
+                    {
+                        value = (value << 8) | static_cast<unsigned char>(field[i]);
+                    }
+                    return value;
+                }
+                for (size_t i = 0; i != fieldSize && field[i] != '\0'; ++i)
+                {
+                    if (field[i] >= '0' && field[i] <= '7')
+                    {
+                        value = (value << 3) | static_cast<uint64_t>(field[i] - '0');
+                    }
+                }
+                return value;
+            }
+
+            static std::string ParseString(char const* field, size_t fieldSize)
+            {
+                return std::string(field, std::find(field, field + fieldSize, '\0'));
+            }
+
+            std::filesystem::path ResolvePath(std::string const& name) const
+            {
+                std::filesystem::path relative(name);
+                if (relative.is_absolute() || relative.has_root_name())
+                {
+                    throw std::runtime_error("the tar archive contains the absolute path " + name);
+                }
+                for (auto const& part : relative)
+                {
+                    if (part == "..")
+                    {
+                        throw std::runtime_error("the tar archive contains the path " + name + " leaving the target directory");
+                    }
+                }
+
+                // a symbolic link extracted earlier, e.g. "evil -> /tmp", must not redirect "evil/file" out of the directory
+                auto const normal = relative.lexically_normal();
+                std::filesystem::path result = m_directory;
+                for (auto part = normal.begin(), last = std::prev(normal.end()); part != last; ++part)
+                {
+                    result /= *part;
+                    if (std::filesystem::is_symlink(std::filesystem::symlink_status(result)))
+                    {
+                        throw std::runtime_error("the tar archive contains the path " + name + " leading through a symbolic link");
+                    }
+                }
+                return result / normal.filename();
+            }
+
+            /**
+             * \exception ::std::runtime_error If \p text isn't a decimal number in the range of T
+             */
+            template<class T>
+            static T ParseDecimal(std::string_view text)
+            {
+                T value{};
+                auto const [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+                if (error != std::errc() || end != text.data() + text.size())
+                {
+                    throw std::runtime_error("invalid number in a pax header of the tar archive");
+                }
+                return value;
+            }
+
+            /**
+             * \brief applies the records of a pax extended header
+             *
+             * \exception ::std::runtime_error If a record is malformed
+             */
+            void ParsePaxRecords(std::string const& records)
+            {
+                size_t pos = 0;
+                while (pos < records.size())
+                {
+                    auto const space = records.find(' ', pos);
+                    if (space == std::string::npos)
+                    {
+                        throw std::runtime_error("invalid pax record in the tar archive");
+                    }
+                    // "<length> <key>=<value>\n", the length counting the whole record
+                    auto const length = ParseDecimal<size_t>(std::string_view(records).substr(pos, space - pos));
+                    if (length < space - pos + 2 || length > records.size() - pos || records[pos + length - 1] != '\n')
+                    {
+                        throw std::runtime_error("invalid pax record in the tar archive");
+                    }
+                    std::string_view const record(records.data() + space + 1, pos + length - space - 2);
+                    auto const equals = record.find('=');
+                    if (equals != std::string_view::npos)
+                    {
+                        auto const key = record.substr(0, equals);
+                        auto const value = std::string(record.substr(equals + 1));
+                        if (key == "path")
+                        {
+                            m_longName = value;
+                        }
+                        else if (key == "linkpath")
+                        {
+                            m_longLinkName = value;
+                        }
+                        else if (key == "size")
+                        {
+                            m_paxSize = ParseDecimal<uint64_t>(value);
+                        }
+                    }
+                    pos += length;
+                }
+            }
+
+            void ProcessHeader()
+            {
+                if (std::all_of(m_header.begin(), m_header.end(), [](char c) { return c == '\0'; }))
+                {
+                    if (++m_zeroBlocks == 2)
+                    {
+                        m_state = State::End;
+                    }
+                    return;
+                }
+                m_zeroBlocks = 0;
+
+                uint32_t storedChecksum = static_cast<uint32_t>(ParseNumber(m_header.data() + 148, 8));
+                uint32_t checksum = 0;
+                for (size_t i = 0; i != TarBlockSize; ++i)
+                {
+                    checksum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(m_header[i]);
+                }
+                if (checksum != storedChecksum)
+                {
+                    throw std::runtime_error("invalid tar header checksum");
+                }
+
+                char const type = m_header[156];
+                uint64_t size = ParseNumber(m_header.data() + 124, 12);
+                m_path.clear();
+                m_metadata.clear();
+                m_target = Target::Skip;
+                m_entryType = type;
+
+                if (type == 'L' || type == 'K' || type == 'x')
+                {
+                    if (size > MaxMetadataSize)
+                    {
+                        throw std::runtime_error("the tar archive contains a metadata entry of " + std::to_string(size) + " bytes");
+                    }
+                    m_target = Target::Metadata;
+                }
+                else if (type == 'g')
+                {
+                    m_target = Target::Skip;
+                }
+                else
+                {
+                    m_sawEntry = true;
+                    std::string name = std::exchange(m_longName, {});
+                    if (name.empty())
+                    {
+                        name = ParseString(m_header.data(), 100);
+                        auto const prefix = ParseString(m_header.data() + 345, 155);
+                        if (!prefix.empty() && std::memcmp(m_header.data() + 257, "ustar", 5) == 0)
+                        {
+                            name = prefix + '/' + name;
+                        }
+                    }
+                    std::string linkName = std::exchange(m_longLinkName, {});
+                    if (linkName.empty())
+                    {
+                        linkName = ParseString(m_header.data() + 157, 100);
+                    }
+                    if (m_paxSize)
+                    {
+                        size = *std::exchange(m_paxSize, std::nullopt);
+                    }
+                    auto const mode = static_cast<uint32_t>(ParseNumber(m_header.data() + 100, 8));
+                    m_modificationTime = static_cast<int64_t>(ParseNumber(m_header.data() + 136, 12));
+
+                    while (!name.empty() && name.back() == '/')
+                    {
+                        name.pop_back();
+                    }
+                    if (!name.empty() && name != ".")
+                    {
+                        CreateEntry(type, name, linkName, mode);
+                    }
+                }
+
+                m_remaining = size;
+                m_padding = (TarBlockSize - size % TarBlockSize) % TarBlockSize;
+                if (m_remaining == 0)
+                {
+                    FinishEntry();
+                }
+                else
+                {
+                    m_state = State::Data;
+                }
+            }
+
+            void CreateEntry(char type, std::string const& name, std::string const& linkName, uint32_t mode)
+            {
+                m_path = ResolvePath(name);
+                namespace fs = std::filesystem;
+                switch (type)
+                {
+                case '5':
+                    if (fs::is_symlink(fs::symlink_status(m_path)))
+                    {
+                        // the permissions below would be applied to the target of the link
+                        fs::remove(m_path);
+                    }
+                    fs::create_directories(m_path);
+                    fs::permissions(m_path, static_cast<fs::perms>(mode & 07777) | fs::perms::owner_write | fs::perms::owner_exec);
+                    break;
+                case '2':
+                    fs::create_directories(m_path.parent_path());
+                    fs::remove(m_path);
+                    fs::create_symlink(linkName, m_path);
+                    break;
+                case '0':
+                case '\0':
+                case '7':
+                    fs::create_directories(m_path.parent_path());
+                    // don't write through an existing symbolic link
+                    fs::remove(m_path);
+                    m_file.open(m_path, std::ios::binary | std::ios::trunc);
+                    if (!m_file)
+                    {
+                        throw std::runtime_error("error creating " + m_path.string());
+                    }
+                    m_fileMode = mode;
+                    m_target = Target::File;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            void FinishEntry()
+            {
+                if (m_target == Target::File)
+                {
+                    m_file.close();
+                    std::filesystem::permissions(m_path, static_cast<std::filesystem::perms>(m_fileMode & 07777));
+                    std::error_code error; // keeping the time is best effort
+                    std::filesystem::last_write_time(m_path,
+                                                     std::chrono::file_clock::from_sys(std::chrono::system_clock::time_point(std::chrono::seconds(m_modificationTime))),
+                                                     error);
+                }
+                else if (m_target == Target::Metadata)
+                {
+                    if (m_entryType == 'x')
+                    {
+                        ParsePaxRecords(m_metadata);
+                    }
+                    else
+                    {
+                        auto value = m_metadata.substr(0, m_metadata.find('\0'));
+                        (m_entryType == 'L' ? m_longName : m_longLinkName) = std::move(value);
+                    }
+                }
+                m_target = Target::Skip;
+                if (m_padding != 0)
+                {
+                    m_remaining = m_padding;
+                    m_state = State::Padding;
+                }
+                else
+                {
+                    m_state = State::Header;
+                }
+            }
+
+            std::filesystem::path m_directory;
+
+            State m_state{ State::Header };
+            std::array<char, TarBlockSize> m_header{};
+            size_t m_headerFill{ 0 };
+            size_t m_zeroBlocks{ 0 };
+            bool m_sawEntry{ false };
+
+            char m_entryType{ '\0' };
+            Target m_target{ Target::Skip };
+            uint64_t m_remaining{ 0 };
+            uint64_t m_padding{ 0 };
+            std::filesystem::path m_path;
+            std::ofstream m_file;
+            uint32_t m_fileMode{ 0 };
+            int64_t m_modificationTime{ 0 };
+
+            std::string m_metadata;
+            std::string m_longName;
+            std::string m_longLinkName;
+            std::optional<uint64_t> m_paxSize;
+        };
+
+        /**
+         * \brief a compression or decompression stage of the archive pipeline
+         */
+        class StreamCodec
+        {
+        public:
+            virtual ~StreamCodec() = default;
+
+            virtual void Write(char const* data, size_t size) = 0;
+
+            /**
+             * \brief flushes the remaining output
+             */
+            virtual void Finish() = 0;
+        };
+
+        class PassThroughCodec : public StreamCodec
+        {
+        public:
+            explicit PassThroughCodec(ByteSink sink)
+                : m_sink(std::move(sink))
+            {
+            }
+
+            void Write(char const* data, size_t size) override
+            {
+                m_sink(data, size);
+            }
+
+            void Finish() override
+            {
+            }
+
+        private:
+            ByteSink m_sink;
+        };
+
+        /**
+         * \brief Compresses blocks of the input independently on a thread pool
+         *
+         * Every block becomes a separate gzip member; concatenated members form a valid gzip stream (RFC 1952), which
+         * gzip and tar decompress as a whole. At most \p maxBlocksInFlight blocks are buffered.
+         */
+        class ParallelGzipCompressor : public StreamCodec
+        {
+        public:
+            ParallelGzipCompressor(ByteSink sink, int level, size_t blockSize, size_t maxBlocksInFlight)
+                : m_sink(std::move(sink)),
+                m_level(level),
+                m_blockSize(blockSize),
+                m_maxBlocksInFlight((std::max)(maxBlocksInFlight, size_t(1)))
+            {
+                m_block.reserve(m_blockSize);
+            }
+
+            void Write(char const* data, size_t size) override
+            {
+                while (size != 0)
+                {
+                    auto const count = (std::min)(size, m_blockSize - m_block.size());
+                    m_block.insert(m_block.end(), data, data + count);
+                    data += count;
+                    size -= count;
+                    if (m_block.size() == m_blockSize)
+                    {
+                        SubmitBlock();
+                    }
+                }
+            }
+
+            void Finish() override
+            {
+                if (!m_block.empty())
+                {
+                    SubmitBlock();
+                }
+                while (!m_inFlight.empty())
+                {
+                    EmitOldest();
+                }
+            }
+
+            /**
+             * \return \p input as a complete gzip member
+             */
+            static std::vector<char> CompressMember(std::vector<char> const& input, int level)
+            {
+                z_stream stream{};
+                if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                {
+                    throw std::runtime_error("error initializing gzip compression");
+                }
+                std::vector<char> output(deflateBound(&stream, static_cast<uLong>(input.size())));
+                stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+                stream.avail_in = static_cast<uInt>(input.size());
+                stream.next_out = reinterpret_cast<Bytef*>(output.data());
+                stream.avail_out = static_cast<uInt>(output.size());
+                auto const result = deflate(&stream, Z_FINISH);
+                output.resize(stream.total_out);
+                deflateEnd(&stream);
+                if (result != Z_STREAM_END)
+                {
+                    throw std::runtime_error("error compressing data");
+                }
+                return output;
+            }
+
+        private:
+            void SubmitBlock()
+            {
+                if (m_inFlight.size() == m_maxBlocksInFlight)
+                {
+                    EmitOldest();
+                }
+                m_inFlight.push_back(Submit(DefaultExecutor(), [block = std::move(m_block), level = m_level]
+                    {
+                        return CompressMember(block, level);
+                    }));
+                m_block = {};
+                m_block.reserve(m_blockSize);
+            }
+
+            void EmitOldest()
+            {
+                auto compressed = m_inFlight.front().get();
+                m_inFlight.pop_front();
+                m_sink(compressed.data(), compressed.size());
+            }
+
+            ByteSink m_sink;
+            int m_level;
+            size_t m_blockSize;
+            size_t m_maxBlocksInFlight;
+            std::vector<char> m_block;
+            std::deque<std::future<std::vector<char>>> m_inFlight;
+        };
+
+        /**
+         * \brief decompresses gzip data consisting of any number of members
+         */
+        class GzipDecompressor : public StreamCodec
+        {
+        public:
+            explicit GzipDecompressor(ByteSink sink)
+                : m_sink(std::move(sink))
+            {
+                if (inflateInit2(&m_stream, 15 + 16) != Z_OK)
+                {
+                    throw std::runtime_error("error initializing gzip decompression");
+                }
+            }
+
+            GzipDecompressor(GzipDecompressor const&) = delete;
+            GzipDecompressor& operator=(GzipDecompressor const&) = delete;
+
+            ~GzipDecompressor() override
+            {
+                inflateEnd(&m_stream);
+            }
+
+            void Write(char const* data, size_t size) override
+            {
+                m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                m_stream.avail_in = static_cast<uInt>(size);
+                while (m_stream.avail_in != 0)
+                {
+                    if (m_memberDone)
+                    {
+                        inflateReset(&m_stream);
+                        m_memberDone = false;
+                    }
+                    m_stream.next_out = reinterpret_cast<Bytef*>(m_output.data());
+                    m_stream.avail_out = static_cast<uInt>(m_output.size());
+                    auto const result = inflate(&m_stream, Z_NO_FLUSH);
+                    if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                    {
+                        throw std::runtime_error("invalid gzip data");
+                    }
+                    m_sink(m_output.data(), m_output.size() - m_stream.avail_out);
+                    m_memberDone = (result == Z_STREAM_END);
+                    if (result == Z_BUF_ERROR)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            void Finish() override
+            {
+                if (!m_memberDone)
+                {
+                    throw std::runtime_error("the gzip data is truncated");
+                }
+            }
+
+        private:
+            ByteSink m_sink;
+            z_stream m_stream{};
+            bool m_memberDone{ false };
+            std::array<char, 65536> m_output;
+        };
+
+#ifdef LIBSSH_CPP_WRAP_ENABLE_ZSTD
+        /**
+         * \brief compresses with zstd using its own worker threads
+         */
+        class ZstdCompressor : public StreamCodec
+        {
+        public:
+            ZstdCompressor(ByteSink sink, int level, size_t threads)
+                : m_sink(std::move(sink)),
+                m_context(ZSTD_createCCtx()),
+                m_output(ZSTD_CStreamOutSize())
+            {
+                if (m_context == nullptr)
+                {
+                    throw std::runtime_error("error initializing zstd compression");
+                }
+                ZSTD_CCtx_setParameter(m_context, ZSTD_c_compressionLevel, level);
+                ZSTD_CCtx_setParameter(m_context, ZSTD_c_nbWorkers, static_cast<int>(threads));
+            }
+
+            ZstdCompressor(ZstdCompressor const&) = delete;
+            ZstdCompressor& operator=(ZstdCompressor const&) = delete;
+
+            ~ZstdCompressor() override
+            {
+                ZSTD_freeCCtx(m_context);
+            }
+
+            void Write(char const* data, size_t size) override
+            {
+                ZSTD_inBuffer input{ data, size, 0 };
+                while (input.pos != input.size)
+                {
+                    Compress(input, ZSTD_e_continue);
+                }
+            }
+
+            void Finish() override
+            {
+                ZSTD_inBuffer input{ nullptr, 0, 0 };
+                while (Compress(input, ZSTD_e_end) != 0)
+                {
+                }
+            }
+
+        private:
+            size_t Compress(ZSTD_inBuffer& input, ZSTD_EndDirective directive)
+            {
+                ZSTD_outBuffer output{ m_output.data(), m_output.size(), 0 };
+                auto const remaining = ZSTD_compressStream2(m_context, &output, &input, directive);
+                if (ZSTD_isError(remaining))
+                {
+                    throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+                }
+                m_sink(m_output.data(), output.pos);
+                return remaining;
+            }
+
+            ByteSink m_sink;
+            ZSTD_CCtx* m_context;
+            std::vector<char> m_output;
+        };
+
+        class ZstdDecompressor : public StreamCodec
+        {
+        public:
+            explicit ZstdDecompressor(ByteSink sink)
+                : m_sink(std::move(sink)),
+                m_context(ZSTD_createDCtx()),
+                m_output(ZSTD_DStreamOutSize())
+            {
+                if (m_context == nullptr)
+                {
+                    throw std::runtime_error("error initializing zstd decompression");
+                }
+            }
+
+            ZstdDecompressor(ZstdDecompressor const&) = delete;
+            ZstdDecompressor& operator=(ZstdDecompressor const&) = delete;
+
+            ~ZstdDecompressor() override
+            {
+                ZSTD_freeDCtx(m_context);
+            }
+
+            void Write(char const* data, size_t size) override
+            {
+                ZSTD_inBuffer input{ data, size, 0 };
+                while (input.pos != input.size)
+                {
+                    ZSTD_outBuffer output{ m_output.data(), m_output.size(), 0 };
+                    m_lastResult = ZSTD_decompressStream(m_context, &output, &input);
+                    if (ZSTD_isError(m_lastResult))
+                    {
+                        throw std::runtime_error(std::string("zstd decompression failed: ") + ZSTD_getErrorName(m_lastResult));
+                    }
+                    m_sink(m_output.data(), output.pos);
+                }
+            }
+
+            void Finish() override
+            {
+                if (m_lastResult != 0)
+                {
+                    throw std::runtime_error("the zstd data is truncated");
+                }
+            }
+
+        private:
+            ByteSink m_sink;
+            ZSTD_DCtx* m_context;
+            std::vector<char> m_output;
+            size_t m_lastResult{ 0 };
+        };
+#endif
+
+        /**
+         * \return the compression stage for \p compression
+         */
+        inline std::unique_ptr<StreamCodec> MakeCompressor(TarCompression compression, ByteSink sink, int level, size_t blockSize, size_t threads)
+        {
+            switch (compression)
+            {
+            case TarCompression::None:
+                return std::make_unique<PassThroughCodec>(std::move(sink));
+            case TarCompression::Gzip:
+                return std::make_unique<ParallelGzipCompressor>(std::move(sink), level < 0 ? Z_DEFAULT_COMPRESSION : level, blockSize, 2 * threads);
+            case TarCompression::Zstd:
+#ifdef LIBSSH_CPP_WRAP_ENABLE_ZSTD
+                return std::make_unique<ZstdCompressor>(std::move(sink), level < 0 ? ZSTD_CLEVEL_DEFAULT : level, threads);
+#else
+                break;
+#endif
+            }
+            throw std::runtime_error("unsupported compression; zstd requires LIBSSH_CPP_WRAP_ENABLE_ZSTD");
+        }
+
+        /**
+         * \return the decompression stage for \p compression
+         */
+        inline std::unique_ptr<StreamCodec> MakeDecompressor(TarCompression compression, ByteSink sink)
+        {
+            switch (compression)
+            {
+            case TarCompression::None:
+                return std::make_unique<PassThroughCodec>(std::move(sink));
+            case TarCompression::Gzip:
+                return std::make_unique<GzipDecompressor>(std::move(sink));
+            case TarCompression::Zstd:
+#ifdef LIBSSH_CPP_WRAP_ENABLE_ZSTD
+                return std::make_unique<ZstdDecompressor>(std::move(sink));
+#else
+                break;
+#endif
+            }
+            throw std::runtime_error("unsupported compression; zstd requires LIBSSH_CPP_WRAP_ENABLE_ZSTD");
+        }
+
+        /**
+         * \brief an unbuffered stream buffer passing everything written to a sink
+         */
+        class SinkStreamBuffer : public std::streambuf
+        {
+        public:
+            explicit SinkStreamBuffer(ByteSink sink)
+                : m_sink(std::move(sink))
+            {
+            }
+
+        protected:
+            std::streamsize xsputn(char const* data, std::streamsize count) override
+            {
+                m_sink(data, static_cast<size_t>(count));
+                return count;
+            }
+
+            int_type overflow(int_type c) override
+            {
+                if (!traits_type::eq_int_type(c, traits_type::eof()))
+                {
+                    char const value = traits_type::to_char_type(c);
+                    m_sink(&value, 1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+        private:
+            ByteSink m_sink;
+        };
+
+    }
+
+}
+
+#endif
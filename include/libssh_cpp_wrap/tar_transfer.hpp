@@ -0,0 +1,225 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TAR_TRANSFER
+#define LIBSSH_CPP_WRAP_TAR_TRANSFER
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "command_execution_channel.hpp"
+#include "connection.hpp"
+#include "executor.hpp"
+#include "sftp_extensions.hpp"
+#include "tar.hpp"
+#include "transfer_options.hpp"
+
+namespace libssh_wrap
+{
+
+    struct TarOptions
+    {
+        TarCompression m_compression{ TarCompression::None };
+
+        /**
+         * \brief the compression level; -1 for the default of the algorithm
+         */
+        int m_level{ -1 };
+
+        /**
+         * \brief the number of threads compressing locally; 0 for the number of threads of DefaultExecutor()
+         */
+        size_t m_threads{ 0 };
+
+        /**
+         * \brief the amount of data compressed as one unit by a thread; at most two blocks per thread are buffered
+         */
+        size_t m_blockSize{ 1024 * 1024 };
+
+        TransferOptions m_transfer;
+    };
+
+    namespace detail
+    {
+
+        inline size_t CompressionThreads(TarOptions const& options)
+        {
+            return options.m_threads != 0 ? options.m_threads : DefaultExecutor().ThreadCount();
+        }
+
+        inline int64_t ModificationTime(std::filesystem::path const& path)
+        {
+            std::error_code error;
+            auto const time = std::filesystem::last_write_time(path, error);
+            if (error)
+            {
+                return 0;
+            }
+            return std::chrono::duration_cast<std::chrono::seconds>(
+                std::chrono::file_clock::to_sys(time).time_since_epoch()).count();
+        }
+
+        /**
+         * \brief lets the exit status of a pipeline report failures of any command, if the shell supports it
+         */
+        constexpr char const* PipeFailPrefix = "(set -o pipefail) 2>/dev/null && set -o pipefail; ";
+
+        inline std::string RemoteExtractCommand(std::string const& directory, TarCompression compression)
+        {
+            auto const quoted = ShellQuote(directory);
+            std::string command = "mkdir -p -- " + quoted + " && ";
+            switch (compression)
+            {
+            case TarCompression::None:
+                return command + "tar -xf - -C " + quoted;
+            case TarCompression::Gzip:
+                return command + "tar -xzf - -C " + quoted;
+            case TarCompression::Zstd:
+                return PipeFailPrefix + command + "zstd -dcq | tar -xf - -C " + quoted;
+            }
+            throw std::runtime_error("unsupported compression");
+        }
+
+        inline std::string RemoteCreateCommand(std::string const& directory, TarCompression compression, int level)
+        {
+            std::string command = std::string(PipeFailPrefix) + "cd " + ShellQuote(directory) + " && tar -cf - .";
+            auto const levelOption = (level < 0) ? std::string() : " -" + std::to_string(level);
+            switch (compression)
+            {
+            case TarCompression::None:
+                return command;
+            case TarCompression::Gzip:
+                // pigz compresses on all cores of the server
+                return command + " | { if command -v pigz >/dev/null 2>&1; then pigz -c" + levelOption
+                    + "; else gzip -c" + levelOption + "; fi; }";
+            case TarCompression::Zstd:
+                return command + " | zstd -cq -T0" + levelOption;
+            }
+            throw std::runtime_error("unsupported compression");
+        }
+
+    }
+
+    /**
+     * \brief copies the tree below \p localDirectory to \p remoteDirectory as a single tar stream
+     *
+     * The archive is produced while it's sent and extracted by tar on the server, so there's one round trip for the
+     * whole tree instead of several per file. Requires tar (and zstd for TarCompression::Zstd) on the server.
+     *
+     * \exception ::std::runtime_error If reading the tree or the remote extraction fails
+     */
+    inline void UploadDirectory(std::shared_ptr<AuthenticatedConnection> const& connection,
+                                std::filesystem::path const& localDirectory,
+                                std::string const& remoteDirectory,
+                                TarOptions const& options = {})
+    {
+        namespace fs = std::filesystem;
+
+        ExecutionChannel channel(connection);
+        channel.Start(detail::RemoteExtractCommand(remoteDirectory, options.m_compression).c_str());
+
+        auto compressor = detail::MakeCompressor(options.m_compression,
+                                                 [&channel](char const* data, size_t size) { channel.WriteInput(data, size); },
+                                                 options.m_level, options.m_blockSize, detail::CompressionThreads(options));
+        detail::TarWriter writer([&compressor](char const* data, size_t size) { compressor->Write(data, size); });
+        detail::TransferBuffer<32768> buffer(options.m_transfer);
+
+        for (auto const& entry : fs::recursive_directory_iterator(localDirectory))
+        {
+            auto const& path = entry.path();
+            auto const name = path.lexically_relative(localDirectory).generic_string();
+            auto const status = entry.symlink_status();
+            auto const mode = static_cast<uint32_t>(status.permissions()) & 07777;
+
+            if (fs::is_symlink(status))
+            {
+                writer.AddSymlink(name, fs::read_symlink(path).generic_string(), 0);
+            }
+            else if (fs::is_directory(status))
+            {
+                writer.AddDirectory(name, mode, detail::ModificationTime(path));
+            }
+            else if (fs::is_regular_file(status))
+            {
+                std::ifstream in(path, std::ios::binary);
+                if (!in)
+                {
+                    throw std::runtime_error("error opening " + path.string());
+                }
+                writer.AddFile(name, mode, entry.file_size(), detail::ModificationTime(path), in, buffer.data(), buffer.size());
+            }
+        }
+        writer.Finish();
+        compressor->Finish();
+        channel.CloseInput();
+
+        std::ostringstream out;
+        std::ostringstream error;
+        channel.ReadOutput(out, error, options.m_transfer);
+        if (channel.ExitStatus() != 0)
+        {
+            throw std::runtime_error("remote extraction failed: " + error.str());
+        }
+    }
+
+    /**
+     * \brief copies the tree below \p remoteDirectory to \p localDirectory as a single tar stream created by tar on the
+     *        server
+     *
+     * The stream is extracted while it's received; compression on the server uses pigz or zstd with all cores, if
+     * available.
+     *
+     * \exception ::std::runtime_error If the remote archive creation or the extraction fails
+     */
+    inline void DownloadDirectory(std::shared_ptr<AuthenticatedConnection> const& connection,
+                                  std::string const& remoteDirectory,
+                                  std::filesystem::path const& localDirectory,
+                                  TarOptions const& options = {})
+    {
+        std::filesystem::create_directories(localDirectory);
+
+        detail::TarReader reader(localDirectory);
+        auto decompressor = detail::MakeDecompressor(options.m_compression,
+                                                     [&reader](char const* data, size_t size) { reader.Feed(data, size); });
+        detail::SinkStreamBuffer sink([&decompressor](char const* data, size_t size) { decompressor->Write(data, size); });
+        std::ostream out(&sink);
+        out.exceptions(std::ios::badbit); // pass on extraction errors instead of only setting the stream state
+        std::ostringstream error;
+
+        ExecutionChannel channel(connection);
+        channel.Execute<32768>(detail::RemoteCreateCommand(remoteDirectory, options.m_compression, options.m_level).c_str(),
+                               out, error, options.m_transfer);
+        if (channel.ExitStatus() != 0)
+        {
+            throw std::runtime_error("remote archive creation failed: " + error.str());
+        }
+        decompressor->Finish();
+        reader.Finish();
+    }
+
+}
+
+#endif
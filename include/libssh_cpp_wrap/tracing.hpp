@@ -0,0 +1,258 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TRACING
+#define LIBSSH_CPP_WRAP_TRACING
+
+#include <atomic>
+#include <chrono>
+#include <type_traits>
+
+namespace libssh_wrap
+{
+
+    /**
+     * \brief the libssh functions the wrapper reports spans for
+     */
+    enum class TraceOperation
+    {
+        Connect,
+        Disconnect,
+        UserAuthPassword,
+        UserAuthPublicKey,
+        UserAuthAgent,
+        PkiImportPrivateKey,
+        ChannelNew,
+        ChannelOpenSession,
+        ChannelRequestExec,
+        ChannelRequestSftp,
+        ChannelRead,
+        ChannelClose,
+        ChannelOpenForward,
+        ChannelListenForward,
+        ChannelAcceptForward,
+        ChannelCancelForward,
+        ChannelReadNonBlocking,
+        ChannelWrite,
+        SftpNew,
+        SftpInit,
+        SftpMkdir,
+        SftpRmdir,
+        SftpUnlink,
+        SftpChmod,
+        SftpStat,
+        SftpRename,
+        SftpOpen,
+        SftpClose,
+        SftpRead,
+        SftpWrite,
+        ScpNew,
+        ScpInit,
+        ScpClose,
+        ScpPushDirectory,
+        ScpLeaveDirectory,
+        ScpPushFile,
+        ScpWrite,
+        ScpPullRequest,
+        ScpRead,
+    };
+
+    /**
+     * \return the name of the libssh function corresponding to \p operation
+     */
+    constexpr char const* ToString(TraceOperation operation) noexcept
+    {
+        switch (operation)
+        {
+        case TraceOperation::Connect: return "ssh_connect";
+        case TraceOperation::Disconnect: return "ssh_disconnect";
+        case TraceOperation::UserAuthPassword: return "ssh_userauth_password";
+        case TraceOperation::UserAuthPublicKey: return "ssh_userauth_publickey";
+        case TraceOperation::UserAuthAgent: return "ssh_userauth_agent";
+        case TraceOperation::PkiImportPrivateKey: return "ssh_pki_import_privkey_file";
+        case TraceOperation::ChannelNew: return "ssh_channel_new";
+        case TraceOperation::ChannelOpenSession: return "ssh_channel_open_session";
+        case TraceOperation::ChannelRequestExec: return "ssh_channel_request_exec";
+        case TraceOperation::ChannelRequestSftp: return "ssh_channel_request_sftp";
+        case TraceOperation::ChannelRead: return "ssh_channel_read";
+        case TraceOperation::ChannelClose: return "ssh_channel_close";
+        case TraceOperation::ChannelOpenForward: return "ssh_channel_open_forward";
+        case TraceOperation::ChannelListenForward: return "ssh_channel_listen_forward";
+        case TraceOperation::ChannelAcceptForward: return "ssh_channel_accept_forward";
+        case TraceOperation::ChannelCancelForward: return "ssh_channel_cancel_forward";
+        case TraceOperation::ChannelReadNonBlocking: return "ssh_channel_read_nonblocking";
+        case TraceOperation::ChannelWrite: return "ssh_channel_write";
+        case TraceOperation::SftpNew: return "sftp_new";
+        case TraceOperation::SftpInit: return "sftp_init";
+        case TraceOperation::SftpMkdir: return "sftp_mkdir";
+        case TraceOperation::SftpRmdir: return "sftp_rmdir";
+        case TraceOperation::SftpUnlink: return "sftp_unlink";
+        case TraceOperation::SftpChmod: return "sftp_chmod";
+        case TraceOperation::SftpStat: return "sftp_stat";
+        case TraceOperation::SftpRename: return "sftp_rename";
+        case TraceOperation::SftpOpen: return "sftp_open";
+        case TraceOperation::SftpClose: return "sftp_close";
+        case TraceOperation::SftpRead: return "sftp_read";
+        case TraceOperation::SftpWrite: return "sftp_write";
+        case TraceOperation::ScpNew: return "ssh_scp_new";
+        case TraceOperation::ScpInit: return "ssh_scp_init";
+        case TraceOperation::ScpClose: return "ssh_scp_close";
+        case TraceOperation::ScpPushDirectory: return "ssh_scp_push_directory";
+        case TraceOperation::ScpLeaveDirectory: return "ssh_scp_leave_directory";
+        case TraceOperation::ScpPushFile: return "ssh_scp_push_file";
+        case TraceOperation::ScpWrite: return "ssh_scp_write";
+        case TraceOperation::ScpPullRequest: return "ssh_scp_pull_request";
+        case TraceOperation::ScpRead: return "ssh_scp_read";
+        }
+        return "unknown";
+    }
+
+    /**
+     * \brief a completed libssh call
+     */
+    struct TraceSpan
+    {
+        TraceOperation m_operation;
+        std::chrono::steady_clock::time_point m_begin;
+        std::chrono::steady_clock::time_point m_end;
+
+        /**
+         * \brief the return value of the call; pointer results are reported as SSH_OK / SSH_ERROR
+         *        depending on whether they're null and calls without return value as SSH_OK
+         */
+        long long m_result;
+    };
+
+    /**
+     * \brief receiver of the trace data; register an instance via SetTraceSink
+     *
+     * The functions are called on the thread doing the libssh call, so implementations need to be thread safe,
+     * if the wrapper is used from multiple threads.
+     */
+    class TraceSink
+    {
+    public:
+        virtual ~TraceSink() = default;
+
+        /**
+         * \brief event reported immediately before the libssh function is called
+         */
+        virtual void OnSpanBegin([[maybe_unused]] TraceOperation operation) noexcept
+        {
+        }
+
+        virtual void OnSpanEnd(TraceSpan const& span) noexcept = 0;
+    };
+
+    /**
+     * \brief A TraceSink forwarding to the static member functions of \p Policy
+     *
+     * \tparam Policy a type providing static OnSpanBegin(TraceOperation) and OnSpanEnd(TraceSpan const&) functions
+     */
+    template<class Policy>
+    class PolicyTraceSink final : public TraceSink
+    {
+    public:
+        void OnSpanBegin(TraceOperation operation) noexcept override
+        {
+            Policy::OnSpanBegin(operation);
+        }
+
+        void OnSpanEnd(TraceSpan const& span) noexcept override
+        {
+            Policy::OnSpanEnd(span);
+        }
+    };
+
+    namespace detail
+    {
+        inline std::atomic<TraceSink*>& TraceSinkStorage() noexcept
+        {
+            static std::atomic<TraceSink*> sink{ nullptr };
+            return sink;
+        }
+
+        template<class T>
+        long long ToTraceResult(T const& result) noexcept
+        {
+            if constexpr (std::is_pointer_v<T>)
+            {
+                return result == nullptr ? -1 : 0;
+            }
+            else
+            {
+                return static_cast<long long>(result);
+            }
+        }
+
+        template<class F>
+        decltype(auto) TraceCall(TraceOperation operation, F&& call)
+        {
+            TraceSink* const sink = TraceSinkStorage().load(std::memory_order_acquire);
+            if (sink == nullptr)
+            {
+                return std::forward<F>(call)();
+            }
+
+            sink->OnSpanBegin(operation);
+            auto const begin = std::chrono::steady_clock::now();
+            if constexpr (std::is_void_v<decltype(std::forward<F>(call)())>)
+            {
+                std::forward<F>(call)();
+                sink->OnSpanEnd(TraceSpan{ operation, begin, std::chrono::steady_clock::now(), 0 });
+            }
+            else
+            {
+                auto result = std::forward<F>(call)();
+                sink->OnSpanEnd(TraceSpan{ operation, begin, std::chrono::steady_clock::now(), ToTraceResult(result) });
+                return result;
+            }
+        }
+    }
+
+    /**
+     * \brief registers the sink receiving spans for all libssh calls of the wrapper
+     *
+     * Pass nullptr to unregister the sink. The sink must outlive any libssh call started while it's registered.
+     *
+     * \note spans are only reported, if LIBSSH_CPP_WRAP_ENABLE_TRACING is defined
+     */
+    inline void SetTraceSink(TraceSink* sink) noexcept
+    {
+        detail::TraceSinkStorage().store(sink, std::memory_order_release);
+    }
+
+    /**
+     * \return the currently registered sink or nullptr
+     */
+    [[nodiscard]] inline TraceSink* GetTraceSink() noexcept
+    {
+        return detail::TraceSinkStorage().load(std::memory_order_acquire);
+    }
+}
+
+// wraps a libssh call; expands to the plain call, if tracing is disabled
+#ifdef LIBSSH_CPP_WRAP_ENABLE_TRACING
+#define LIBSSH_CPP_WRAP_TRACE(operation, call) \
+    (::libssh_wrap::detail::TraceCall(::libssh_wrap::TraceOperation::operation, [&]() -> decltype(auto) { return call; }))
+#else
+#define LIBSSH_CPP_WRAP_TRACE(operation, call) (call)
+#endif
+
+#endif
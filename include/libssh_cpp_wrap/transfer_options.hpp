@@ -0,0 +1,114 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TRANSFER_OPTIONS
+#define LIBSSH_CPP_WRAP_TRANSFER_OPTIONS
+
+#include <chrono>
+#include <cstddef>
+#include <memory_resource>
+#include <stop_token>
+
+#include "buffer_pool.hpp"
+
+namespace libssh_wrap
+{
+
+    class BandwidthLimiter;
+    class TransferChecksum;
+    struct TransferStatistics;
+
+    /**
+     * \brief options shared by the transfer operations
+     */
+    struct TransferOptions
+    {
+        /**
+         * \brief the pool providing the transfer buffer; nullptr for a buffer of the size passed as template
+         *        parameter on the stack
+         */
+        BufferPool* m_bufferPool{ nullptr };
+
+        /**
+         * \brief the memory used for the state of asynchronous operations
+         */
+        std::pmr::memory_resource* m_memoryResource{ std::pmr::get_default_resource() };
+
+        /**
+         * \brief receives the transferred bytes, if not nullptr; see checksum.hpp
+         */
+        TransferChecksum* m_checksum{ nullptr };
+
+        /**
+         * \brief limits the rate of the transfer, if not nullptr; see bandwidth_limiter.hpp
+         */
+        BandwidthLimiter* m_bandwidthLimiter{ nullptr };
+
+        /**
+         * \brief receives the amount transferred, the duration and the time spent throttled, if not nullptr
+         */
+        TransferStatistics* m_statistics{ nullptr };
+
+        /**
+         * \brief the time the transfer is aborted at; see cancellation.hpp
+         */
+        std::chrono::steady_clock::time_point m_deadline{ std::chrono::steady_clock::time_point::max() };
+
+        /**
+         * \brief aborts the transfer, once a stop is requested
+         */
+        std::stop_token m_stopToken;
+    };
+
+    namespace detail
+    {
+        /**
+         * \brief the buffer used by a transfer as selected via TransferOptions
+         */
+        template<size_t localSize>
+        class TransferBuffer
+        {
+        public:
+            explicit TransferBuffer(TransferOptions const& options)
+            {
+                if (options.m_bufferPool != nullptr)
+                {
+                    m_pooled = options.m_bufferPool->Acquire();
+                }
+            }
+
+            [[nodiscard]] char* data() noexcept
+            {
+                return m_pooled ? m_pooled.data() : m_local;
+            }
+
+            [[nodiscard]] size_t size() const noexcept
+            {
+                return m_pooled ? m_pooled.size() : localSize;
+            }
+
+        private:
+            PooledBuffer m_pooled;
+            char m_local[localSize];
+        };
+    }
+
+}
+
+#endif
@@ -0,0 +1,2174 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TESTING_TEST_SERVER
+#define LIBSSH_CPP_WRAP_TESTING_TEST_SERVER
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "libssh/libssh.h"
+#include "libssh/server.h"
+#include "libssh/sftp.h"
+#if __has_include("libssh/sftpserver.h")
+#include "libssh/sftpserver.h"
+#endif
+
+#include "libssh_cpp_wrap/ip.hpp"
+
+namespace libssh_wrap::testing
+{
+
+    /**
+     * \brief the outcome of a command executed via an exec channel of the test server
+     */
+    struct CommandResult
+    {
+        std::string m_out;
+        std::string m_err;
+        int m_exitStatus{ 0 };
+    };
+
+    using CommandHandler = std::function<CommandResult(std::string const& command)>;
+
+    /**
+     * \brief runs \p command via /bin/sh -c collecting stdout and stderr
+     */
+    inline CommandResult RunShellCommand(std::string const& command)
+    {
+        int outPipe[2];
+        int errPipe[2];
+        if (pipe(outPipe) != 0)
+        {
+            throw std::runtime_error("error creating pipe");
+        }
+        if (pipe(errPipe) != 0)
+        {
+            close(outPipe[0]);
+            close(outPipe[1]);
+            throw std::runtime_error("error creating pipe");
+        }
+
+        pid_t const child = fork();
+        if (child == 0)
+        {
+            dup2(outPipe[1], STDOUT_FILENO);
+            dup2(errPipe[1], STDERR_FILENO);
+            close(outPipe[0]);
+            close(outPipe[1]);
+            close(errPipe[0]);
+            close(errPipe[1]);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(outPipe[1]);
+        close(errPipe[1]);
+
+        CommandResult result;
+        if (child < 0)
+        {
+            close(outPipe[0]);
+            close(errPipe[0]);
+            throw std::runtime_error("error starting the command");
+        }
+
+        pollfd fds[2]{ { outPipe[0], POLLIN, 0 }, { errPipe[0], POLLIN, 0 } };
+        std::string* targets[2]{ &result.m_out, &result.m_err };
+        int openPipes = 2;
+        char buffer[16384];
+        while (openPipes != 0)
+        {
+            if (poll(fds, 2, -1) < 0 && errno != EINTR)
+            {
+                break;
+            }
+            for (int i = 0; i != 2; ++i)
+            {
+                if (fds[i].fd >= 0 && fds[i].revents != 0)
+                {
+                    auto const count = read(fds[i].fd, buffer, sizeof(buffer));
+                    if (count > 0)
+                    {
+                        targets[i]->append(buffer, static_cast<size_t>(count));
+                    }
+                    else if (count == 0 || errno != EINTR)
+                    {
+                        close(fds[i].fd);
+                        fds[i].fd = -1;
+                        --openPipes;
+                    }
+                }
+            }
+        }
+
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        result.m_exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 255;
+        return result;
+    }
+
+    struct TestServerOptions
+    {
+        std::string m_user{ "test" };
+        std::string m_password{ "test" };
+
+        /**
+         * \brief if not empty, all remote paths of SFTP and SCP requests are resolved relative to this directory
+         */
+        std::filesystem::path m_root;
+
+        /**
+         * \brief artificial delay applied before answering each request (exec, SFTP packet, SCP control message)
+         */
+        std::chrono::microseconds m_requestDelay{ 0 };
+
+        /**
+         * \brief cap for the payload throughput of a single connection in both directions; 0 for unlimited
+         */
+        size_t m_bytesPerSecond{ 0 };
+
+        /**
+         * \brief handles the commands of exec channels, e.g. RunShellCommand; the standard input sent by the client is
+         *        ignored
+         *
+         * If empty, the commands are run by /bin/sh in a child process, which receives the standard input sent by the
+         * client and whose output is forwarded while it runs.
+         */
+        CommandHandler m_commandHandler;
+    };
+
+    namespace detail
+    {
+
+        inline uint32_t ErrnoToSftpStatus(int error) noexcept
+        {
+            switch (error)
+            {
+            case ENOENT:
+            case ENOTDIR:
+                return SSH_FX_NO_SUCH_FILE;
+            case EACCES:
+            case EPERM:
+                return SSH_FX_PERMISSION_DENIED;
+            case EEXIST:
+                return SSH_FX_FILE_ALREADY_EXISTS;
+            default:
+                return SSH_FX_FAILURE;
+            }
+        }
+
+        /**
+         * \brief splits a command line the way a posix shell does for simple quoted arguments
+         */
+        inline std::vector<std::string> SplitCommandLine(std::string_view command)
+        {
+            std::vector<std::string> result;
+            std::string current;
+            bool inWord = false;
+            for (size_t i = 0; i < command.size(); ++i)
+            {
+                char const c = command[i];
+                if (c == '\'' || c == '"')
+                {
+                    auto const end = command.find(c, i + 1);
+                    current.append(command.substr(i + 1, end - i - 1));
+                    i = (end == std::string_view::npos) ? command.size() : end;
+                    inWord = true;
+                }
+                else if (c == '\\' && i + 1 < command.size())
+                {
+                    current.push_back(command[++i]);
+                    inWord = true;
+                }
+                else if (c == ' ' || c == '\t')
+                {
+                    if (inWord)
+                    {
+                        result.push_back(std::move(current));
+                        current.clear();
+                        inWord = false;
+                    }
+                }
+                else
+                {
+                    current.push_back(c);
+                    inWord = true;
+                }
+            }
+            if (inWord)
+            {
+                result.push_back(std::move(current));
+            }
+            return result;
+        }
+
+        /**
+         * \brief the state shared by all channels of one client connection
+         */
+        class ConnectionContext
+        {
+        public:
+            ConnectionContext(ssh_session session, TestServerOptions const& options)
+                : m_session(session),
+                m_options(options)
+            {
+            }
+
+            ssh_session Session() const noexcept
+            {
+                return m_session;
+            }
+
+            TestServerOptions const& Options() const noexcept
+            {
+                return m_options;
+            }
+
+            std::filesystem::path ResolvePath(std::string_view remotePath) const
+            {
+                if (m_options.m_root.empty())
+                {
+                    return std::filesystem::path(remotePath);
+                }
+                return m_options.m_root / std::filesystem::path(remotePath).relative_path();
+            }
+
+            /**
+             * \brief the event the connection is polled with; nullptr while the connection isn't running
+             */
+            ssh_event Event() const noexcept
+            {
+                return m_event;
+            }
+
+            void SetEvent(ssh_event event) noexcept
+            {
+                m_event = event;
+            }
+
+            void DelayRequest() const
+            {
+                if (m_options.m_requestDelay.count() > 0)
+                {
+                    std::this_thread::sleep_for(m_options.m_requestDelay);
+                }
+            }
+
+            /**
+             * \brief blocks until transferring \p bytes more bytes keeps the connection below the throughput cap
+             */
+            void Throttle(size_t bytes)
+            {
+                if (m_options.m_bytesPerSecond == 0)
+                {
+                    return;
+                }
+                auto const now = std::chrono::steady_clock::now();
+                m_nextTransfer = (std::max)(m_nextTransfer, now)
+                    + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                        std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(m_options.m_bytesPerSecond)));
+                std::this_thread::sleep_until(m_nextTransfer);
+            }
+
+            /**
+             * \brief writes all of \p data to \p channel respecting the throughput cap
+             */
+            bool WriteThrottled(ssh_channel channel, char const* data, size_t size, bool toStdErr = false)
+            {
+                constexpr size_t ChunkSize = 32768;
+                while (size != 0)
+                {
+                    size_t const count = (std::min)(size, ChunkSize);
+                    Throttle(count);
+                    int const written = toStdErr
+                        ? ssh_channel_write_stderr(channel, data, static_cast<uint32_t>(count))
+                        : ssh_channel_write(channel, data, static_cast<uint32_t>(count));
+                    if (written < 0)
+                    {
+                        return false;
+                    }
+                    data += written;
+                    size -= static_cast<size_t>(written);
+                }
+                return true;
+            }
+
+        private:
+            ssh_session m_session;
+            TestServerOptions const& m_options;
+            ssh_event m_event{ nullptr };
+            std::chrono::steady_clock::time_point m_nextTransfer{};
+        };
+
+        /**
+         * \brief the server side logic for a channel after the client requested exec or a subsystem
+         */
+        class ChannelHandler
+        {
+        public:
+            ChannelHandler(ConnectionContext& context, ssh_channel channel) noexcept
+                : m_context(context),
+                m_channel(channel)
+            {
+            }
+
+            virtual ~ChannelHandler()
+            {
+                if (m_channel != nullptr)
+                {
+                    ssh_channel_close(m_channel);
+                    ssh_channel_free(m_channel);
+                }
+            }
+
+            ChannelHandler(ChannelHandler const&) = delete;
+            ChannelHandler& operator=(ChannelHandler const&) = delete;
+
+            /**
+             * \brief does the work possible without waiting for the client
+             *
+             * \return false, if the channel is done
+             */
+            virtual bool Step() = 0;
+
+            /**
+             * \return true, if Step should be called again without waiting for incoming data
+             */
+            virtual bool Busy() const noexcept
+            {
+                return false;
+            }
+
+        protected:
+
+            void Finish(int exitStatus)
+            {
+                ssh_channel_request_send_exit_status(m_channel, exitStatus);
+                ssh_channel_send_eof(m_channel);
+            }
+
+            ConnectionContext& m_context;
+            ssh_channel m_channel;
+        };
+
+        class ExecHandler final : public ChannelHandler
+        {
+        public:
+            ExecHandler(ConnectionContext& context, ssh_channel channel, std::string command)
+                : ChannelHandler(context, channel),
+                m_command(std::move(command))
+            {
+            }
+
+            bool Step() override
+            {
+                m_context.DelayRequest();
+                CommandResult result;
+                try
+                {
+                    result = m_context.Options().m_commandHandler(m_command);
+                }
+                catch (std::exception const& ex)
+                {
+                    result.m_err = ex.what();
+                    result.m_exitStatus = 127;
+                }
+                m_context.WriteThrottled(m_channel, result.m_out.data(), result.m_out.size());
+                m_context.WriteThrottled(m_channel, result.m_err.data(), result.m_err.size(), true);
+                Finish(result.m_exitStatus);
+                return false;
+            }
+
+            bool Busy() const noexcept override
+            {
+                return true;
+            }
+
+        private:
+            std::string m_command;
+        };
+
+        /**
+         * \brief runs a command via /bin/sh -c forwarding the standard input from and the output to the client
+         */
+        class ShellExecHandler final : public ChannelHandler
+        {
+        public:
+            ShellExecHandler(ConnectionContext& context, ssh_channel channel, std::string const& command)
+                : ChannelHandler(context, channel)
+            {
+                // a socket for the standard input, so writes after the command exited fail without SIGPIPE
+                int inSockets[2];
+                int outPipe[2];
+                int errPipe[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, inSockets) != 0)
+                {
+                    throw std::runtime_error("error creating socket pair");
+                }
+                if (pipe(outPipe) != 0)
+                {
+                    close(inSockets[0]);
+                    close(inSockets[1]);
+                    throw std::runtime_error("error creating pipe");
+                }
+                if (pipe(errPipe) != 0)
+                {
+                    close(inSockets[0]);
+                    close(inSockets[1]);
+                    close(outPipe[0]);
+                    close(outPipe[1]);
+                    throw std::runtime_error("error creating pipe");
+                }
+
+                m_child = fork();
+                if (m_child == 0)
+                {
+                    dup2(inSockets[1], STDIN_FILENO);
+                    dup2(outPipe[1], STDOUT_FILENO);
+                    dup2(errPipe[1], STDERR_FILENO);
+                    for (int fd : { inSockets[0], inSockets[1], outPipe[0], outPipe[1], errPipe[0], errPipe[1] })
+                    {
+                        close(fd);
+                    }
+                    execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+                    _exit(127);
+                }
+                close(inSockets[1]);
+                close(outPipe[1]);
+                close(errPipe[1]);
+                m_input = inSockets[0];
+                m_outputs[0] = outPipe[0];
+                m_outputs[1] = errPipe[0];
+                if (m_child < 0)
+                {
+                    CloseAll();
+                    throw std::runtime_error("error starting the command");
+                }
+                for (int fd : { m_input, m_outputs[0], m_outputs[1] })
+                {
+                    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+                }
+            }
+
+            ~ShellExecHandler() override
+            {
+                CloseAll();
+                if (m_child > 0)
+                {
+                    kill(m_child, SIGKILL);
+                    while (waitpid(m_child, nullptr, 0) < 0 && errno == EINTR)
+                    {
+                    }
+                }
+            }
+
+            bool Step() override
+            {
+                if (!m_started)
+                {
+                    m_context.DelayRequest();
+                    WatchOutputs();
+                    m_started = true;
+                }
+
+                ForwardInput();
+                for (int i = 0; i != 2; ++i)
+                {
+                    if (!ForwardOutput(i))
+                    {
+                        return false;
+                    }
+                }
+
+                if (m_outputs[0] >= 0 || m_outputs[1] >= 0)
+                {
+                    return true;
+                }
+                int status = 0;
+                auto const result = waitpid(m_child, &status, WNOHANG);
+                if (result == 0 || (result < 0 && errno == EINTR))
+                {
+                    return true;
+                }
+                m_child = -1;
+                Finish((result > 0 && WIFEXITED(status)) ? WEXITSTATUS(status) : 255);
+                return false;
+            }
+
+            bool Busy() const noexcept override
+            {
+                // the input waits for the child to read; the exit status for the child to terminate
+                return !m_pendingInput.empty() || (m_outputs[0] < 0 && m_outputs[1] < 0);
+            }
+
+        private:
+            static int OnOutputReady(socket_t, int, void*)
+            {
+                // only wakes up the event loop; the output is read by Step
+                return 0;
+            }
+
+            void WatchOutputs()
+            {
+                if (m_context.Event() == nullptr)
+                {
+                    return;
+                }
+                for (int fd : m_outputs)
+                {
+                    ssh_event_add_fd(m_context.Event(), fd, POLLIN, &ShellExecHandler::OnOutputReady, this);
+                }
+            }
+
+            void CloseOutput(int index) noexcept
+            {
+                if (m_outputs[index] < 0)
+                {
+                    return;
+                }
+                if (m_started && m_context.Event() != nullptr)
+                {
+                    ssh_event_remove_fd(m_context.Event(), m_outputs[index]);
+                }
+                close(m_outputs[index]);
+                m_outputs[index] = -1;
+            }
+
+            void CloseInput() noexcept
+            {
+                if (m_input >= 0)
+                {
+                    close(m_input);
+                    m_input = -1;
+                }
+                m_pendingInput.clear();
+            }
+
+            void CloseAll() noexcept
+            {
+                CloseInput();
+                CloseOutput(0);
+                CloseOutput(1);
+            }
+
+            /**
+             * \brief passes the data received from the client to the child; only reads more, once the child took the
+             *        previous data, so the channel window limits the buffered amount
+             */
+            void ForwardInput()
+            {
+                if (m_input < 0)
+                {
+                    // the child doesn't read anymore; drop the input
+                    char buffer[16384];
+                    while (ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), 0) > 0)
+                    {
+                    }
+                    return;
+                }
+                while (true)
+                {
+                    if (m_pendingInput.empty())
+                    {
+                        char buffer[16384];
+                        int const count = ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), 0);
+                        if (count > 0)
+                        {
+                            m_pendingInput.assign(buffer, static_cast<size_t>(count));
+                        }
+                        else
+                        {
+                            if (count < 0 || ssh_channel_is_eof(m_channel))
+                            {
+                                CloseInput();
+                            }
+                            return;
+                        }
+                    }
+                    auto const sent = send(m_input, m_pendingInput.data(), m_pendingInput.size(), MSG_NOSIGNAL);
+                    if (sent < 0)
+                    {
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                        {
+                            CloseInput();
+                        }
+                        return;
+                    }
+                    m_pendingInput.erase(0, static_cast<size_t>(sent));
+                }
+            }
+
+            /**
+             * \return false, if the channel failed
+             */
+            bool ForwardOutput(int index)
+            {
+                char buffer[32768];
+                while (m_outputs[index] >= 0)
+                {
+                    auto const count = read(m_outputs[index], buffer, sizeof(buffer));
+                    if (count > 0)
+                    {
+                        if (!m_context.WriteThrottled(m_channel, buffer, static_cast<size_t>(count), index == 1))
+                        {
+                            return false;
+                        }
+                    }
+                    else if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    {
+                        CloseOutput(index);
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                return true;
+            }
+
+            pid_t m_child{ -1 };
+            int m_input{ -1 };
+            int m_outputs[2]{ -1, -1 };
+            std::string m_pendingInput;
+            bool m_started{ false };
+        };
+
+        /**
+         * \brief scp -t: receives files from the client
+         */
+        class ScpSinkHandler final : public ChannelHandler
+        {
+        public:
+            ScpSinkHandler(ConnectionContext& context, ssh_channel channel, std::filesystem::path target)
+                : ChannelHandler(context, channel),
+                m_target(std::move(target))
+            {
+                m_directories.push_back(m_target);
+            }
+
+            ~ScpSinkHandler() override
+            {
+                CloseFile();
+            }
+
+            bool Step() override
+            {
+                if (!m_started)
+                {
+                    m_started = true;
+                    Respond();
+                }
+
+                char buffer[32768];
+                while (true)
+                {
+                    int const count = ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), 0);
+                    if (count == 0)
+                    {
+                        return true;
+                    }
+                    if (count < 0)
+                    {
+                        Finish(m_failed ? 1 : 0);
+                        return false;
+                    }
+                    if (!Consume(buffer, static_cast<size_t>(count)))
+                    {
+                        Finish(1);
+                        return false;
+                    }
+                }
+            }
+
+        private:
+
+            void Respond(char code = 0, std::string_view message = {})
+            {
+                ssh_channel_write(m_channel, &code, 1);
+                if (code != 0)
+                {
+                    std::string line(message);
+                    line += '\n';
+                    ssh_channel_write(m_channel, line.data(), static_cast<uint32_t>(line.size()));
+                    m_failed = true;
+                }
+            }
+
+            void CloseFile() noexcept
+            {
+                if (m_file >= 0)
+                {
+                    close(m_file);
+                    m_file = -1;
+                }
+            }
+
+            bool Consume(char const* data, size_t size)
+            {
+                while (size != 0)
+                {
+                    if (m_remaining != 0)
+                    {
+                        size_t const count = static_cast<size_t>((std::min<uint64_t>)(m_remaining, size));
+                        m_context.Throttle(count);
+                        if (m_file >= 0 && write(m_file, data, count) != static_cast<ssize_t>(count))
+                        {
+                            CloseFile();
+                        }
+                        m_remaining -= count;
+                        data += count;
+                        size -= count;
+                        if (m_remaining == 0)
+                        {
+                            m_awaitingEndOfFile = true;
+                        }
+                    }
+                    else if (m_awaitingEndOfFile)
+                    {
+                        // the status byte following the file contents
+                        m_awaitingEndOfFile = false;
+                        bool const success = (m_file >= 0);
+                        CloseFile();
+                        ++data;
+                        --size;
+                        m_context.DelayRequest();
+                        Respond(success ? 0 : 2, "scp: error writing file");
+                    }
+                    else
+                    {
+                        char const* const lineEnd = static_cast<char const*>(std::memchr(data, '\n', size));
+                        if (lineEnd == nullptr)
+                        {
+                            m_line.append(data, size);
+                            return true;
+                        }
+                        m_line.append(data, lineEnd);
+                        size -= static_cast<size_t>(lineEnd + 1 - data);
+                        data = lineEnd + 1;
+                        m_context.DelayRequest();
+                        if (!HandleControlLine(m_line))
+                        {
+                            return false;
+                        }
+                        m_line.clear();
+                    }
+                }
+                return true;
+            }
+
+            std::filesystem::path TargetFor(std::string const& name) const
+            {
+                if (m_directories.size() == 1 && !std::filesystem::is_directory(m_target))
+                {
+                    return m_target;
+                }
+                return m_directories.back() / name;
+            }
+
+            bool HandleControlLine(std::string const& line)
+            {
+                if (line.empty())
+                {
+                    Respond(2, "scp: empty control message");
+                    return false;
+                }
+
+                unsigned int mode = 0;
+                unsigned long long size = 0;
+                char name[1024] = {};
+                switch (line[0])
+                {
+                case 'C':
+                    if (std::sscanf(line.c_str() + 1, "%o %llu %1023[^\n]", &mode, &size, name) != 3)
+                    {
+                        Respond(2, "scp: invalid file message");
+                        return false;
+                    }
+                    m_file = open(TargetFor(name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode & 07777);
+                    if (m_file < 0)
+                    {
+                        Respond(1, "scp: cannot open file");
+                        return true;
+                    }
+                    m_remaining = size;
+                    m_awaitingEndOfFile = (size == 0);
+                    Respond();
+                    return true;
+                case 'D':
+                    if (std::sscanf(line.c_str() + 1, "%o %llu %1023[^\n]", &mode, &size, name) != 3)
+                    {
+                        Respond(2, "scp: invalid directory message");
+                        return false;
+                    }
+                    {
+                        auto path = TargetFor(name);
+                        if (mkdir(path.c_str(), mode & 07777) != 0 && errno != EEXIST)
+                        {
+                            Respond(1, "scp: cannot create directory");
+                            return true;
+                        }
+                        m_directories.push_back(std::move(path));
+                    }
+                    Respond();
+                    return true;
+                case 'E':
+                    if (m_directories.size() > 1)
+                    {
+                        m_directories.pop_back();
+                    }
+                    Respond();
+                    return true;
+                case 'T':
+                    Respond();
+                    return true;
+                default:
+                    Respond(2, "scp: unknown control message");
+                    return false;
+                }
+            }
+
+            std::filesystem::path m_target;
+            std::vector<std::filesystem::path> m_directories;
+            std::string m_line;
+            uint64_t m_remaining{ 0 };
+            int m_file{ -1 };
+            bool m_started{ false };
+            bool m_awaitingEndOfFile{ false };
+            bool m_failed{ false };
+        };
+
+        /**
+         * \brief scp -f: sends a single file to the client
+         */
+        class ScpSourceHandler final : public ChannelHandler
+        {
+        public:
+            ScpSourceHandler(ConnectionContext& context, ssh_channel channel, std::filesystem::path source, bool recursive)
+                : ChannelHandler(context, channel),
+                m_source(std::move(source)),
+                m_recursive(recursive)
+            {
+            }
+
+            ~ScpSourceHandler() override
+            {
+                if (m_file >= 0)
+                {
+                    close(m_file);
+                }
+            }
+
+            bool Step() override
+            {
+                switch (m_state)
+                {
+                case State::AwaitStart:
+                    if (!ReadAck())
+                    {
+                        return m_state != State::Done;
+                    }
+                    m_context.DelayRequest();
+                    SendHeader();
+                    return m_state != State::Done;
+                case State::AwaitHeaderAck:
+                    if (ReadAck())
+                    {
+                        m_state = State::SendData;
+                    }
+                    return m_state != State::Done;
+                case State::SendData:
+                    SendChunk();
+                    return m_state != State::Done;
+                case State::AwaitDataAck:
+                    if (ReadAck())
+                    {
+                        Finish(0);
+                        m_state = State::Done;
+                    }
+                    return m_state != State::Done;
+                case State::Done:
+                    break;
+                }
+                return false;
+            }
+
+            bool Busy() const noexcept override
+            {
+                return m_state == State::SendData;
+            }
+
+        private:
+            enum class State
+            {
+                AwaitStart,
+                AwaitHeaderAck,
+                SendData,
+                AwaitDataAck,
+                Done,
+            };
+
+            /**
+             * \return true, if a status byte was received
+             */
+            bool ReadAck()
+            {
+                char code;
+                int const count = ssh_channel_read_nonblocking(m_channel, &code, 1, 0);
+                if (count < 0)
+                {
+                    m_state = State::Done;
+                    return false;
+                }
+                if (count == 1 && code != 0)
+                {
+                    Finish(1);
+                    m_state = State::Done;
+                    return false;
+                }
+                return count == 1;
+            }
+
+            void Fail(std::string_view message)
+            {
+                std::string line("\x01");
+                line += message;
+                line += '\n';
+                ssh_channel_write(m_channel, line.data(), static_cast<uint32_t>(line.size()));
+                Finish(1);
+                m_state = State::Done;
+            }
+
+            void SendHeader()
+            {
+                struct stat info;
+                if (m_recursive || stat(m_source.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+                {
+                    Fail("scp: only single regular files are supported");
+                    return;
+                }
+                m_file = open(m_source.c_str(), O_RDONLY);
+                if (m_file < 0)
+                {
+                    Fail("scp: cannot open file");
+                    return;
+                }
+                m_remaining = static_cast<uint64_t>(info.st_size);
+                char header[1200];
+                int const length = std::snprintf(header, sizeof(header), "C%04o %llu %s\n",
+                    static_cast<unsigned int>(info.st_mode & 07777),
+                    static_cast<unsigned long long>(info.st_size),
+                    m_source.filename().c_str());
+                ssh_channel_write(m_channel, header, static_cast<uint32_t>(length));
+                m_state = State::AwaitHeaderAck;
+            }
+
+            void SendChunk()
+            {
+                char buffer[32768];
+                if (m_remaining != 0)
+                {
+                    auto const count = read(m_file, buffer, static_cast<size_t>((std::min<uint64_t>)(m_remaining, sizeof(buffer))));
+                    if (count <= 0 || !m_context.WriteThrottled(m_channel, buffer, static_cast<size_t>(count)))
+                    {
+                        Finish(1);
+                        m_state = State::Done;
+                        return;
+                    }
+                    m_remaining -= static_cast<uint64_t>(count);
+                }
+                if (m_remaining == 0)
+                {
+                    char const code = 0;
+                    ssh_channel_write(m_channel, &code, 1);
+                    m_state = State::AwaitDataAck;
+                }
+            }
+
+            std::filesystem::path m_source;
+            bool m_recursive;
+            State m_state{ State::AwaitStart };
+            int m_file{ -1 };
+            uint64_t m_remaining{ 0 };
+        };
+
+        class SftpHandler final : public ChannelHandler
+        {
+        public:
+            SftpHandler(ConnectionContext& context, ssh_channel channel)
+                : ChannelHandler(context, channel),
+                m_sftp(sftp_server_new(context.Session(), channel))
+            {
+                if (m_sftp == nullptr)
+                {
+                    throw std::runtime_error("error creating the sftp server session");
+                }
+                m_channel = nullptr; // owned by the sftp session now
+            }
+
+            ~SftpHandler() override
+            {
+                for (auto& handle : m_handles)
+                {
+                    CloseHandle(*handle);
+                }
+                sftp_free(m_sftp);
+            }
+
+            bool Step() override
+            {
+                ssh_channel const channel = m_sftp->channel;
+                if (!m_initialized)
+                {
+                    if (sftp_server_init(m_sftp) != SSH_OK)
+                    {
+                        return false;
+                    }
+                    m_initialized = true;
+                }
+
+                while (true)
+                {
+                    int const available = ssh_channel_poll(channel, 0);
+                    if (available == 0)
+                    {
+                        return true;
+                    }
+                    if (available < 0)
+                    {
+                        return false;
+                    }
+                    sftp_client_message message = sftp_get_client_message(m_sftp);
+                    if (message == nullptr)
+                    {
+                        return false;
+                    }
+                    m_context.DelayRequest();
+                    HandleMessage(message);
+                    sftp_client_message_free(message);
+                }
+            }
+
+        private:
+
+            struct Handle
+            {
+                int m_file{ -1 };
+                DIR* m_directory{ nullptr };
+                std::filesystem::path m_path;
+            };
+
+            static void CloseHandle(Handle& handle) noexcept
+            {
+                if (handle.m_file >= 0)
+                {
+                    close(handle.m_file);
+                    handle.m_file = -1;
+                }
+                if (handle.m_directory != nullptr)
+                {
+                    closedir(handle.m_directory);
+                    handle.m_directory = nullptr;
+                }
+            }
+
+            static void FillAttributes(sftp_attributes_struct& attributes, struct stat const& info) noexcept
+            {
+                attributes = {};
+                attributes.flags = SSH_FILEXFER_ATTR_SIZE | SSH_FILEXFER_ATTR_UIDGID | SSH_FILEXFER_ATTR_PERMISSIONS | SSH_FILEXFER_ATTR_ACCESSTIME;
+                attributes.size = static_cast<uint64_t>(info.st_size);
+                attributes.uid = info.st_uid;
+                attributes.gid = info.st_gid;
+                attributes.permissions = info.st_mode;
+                attributes.atime = static_cast<uint32_t>(info.st_atime);
+                attributes.mtime = static_cast<uint32_t>(info.st_mtime);
+                attributes.type = S_ISDIR(info.st_mode) ? SSH_FILEXFER_TYPE_DIRECTORY : SSH_FILEXFER_TYPE_REGULAR;
+            }
+
+            Handle* FindHandle(sftp_client_message message) const
+            {
+                return static_cast<Handle*>(sftp_handle(m_sftp, message->handle));
+            }
+
+            void ReplyErrno(sftp_client_message message, int error)
+            {
+                sftp_reply_status(message, ErrnoToSftpStatus(error), std::strerror(error));
+            }
+
+            void ReplyResult(sftp_client_message message, int result)
+            {
+                if (result == 0)
+                {
+                    sftp_reply_status(message, SSH_FX_OK, nullptr);
+                }
+                else
+                {
+                    ReplyErrno(message, errno);
+                }
+            }
+
+            void ReplyHandle(sftp_client_message message, std::unique_ptr<Handle> handle)
+            {
+                ssh_string handleString = sftp_handle_alloc(m_sftp, handle.get());
+                if (handleString == nullptr)
+                {
+                    CloseHandle(*handle);
+                    sftp_reply_status(message, SSH_FX_FAILURE, "too many open handles");
+                    return;
+                }
+                m_handles.push_back(std::move(handle));
+                sftp_reply_handle(message, handleString);
+                ssh_string_free(handleString);
+            }
+
+            void RemoveHandle(Handle* handle)
+            {
+                CloseHandle(*handle);
+                sftp_handle_remove(m_sftp, handle);
+                m_handles.erase(std::remove_if(m_handles.begin(), m_handles.end(), [handle](auto const& h) { return h.get() == handle; }), m_handles.end());
+            }
+
+            void HandleOpen(sftp_client_message message)
+            {
+                uint32_t const flags = sftp_client_message_get_flags(message);
+                int openFlags = 0;
+                if ((flags & SSH_FXF_READ) && (flags & SSH_FXF_WRITE))
+                {
+                    openFlags = O_RDWR;
+                }
+                else if (flags & SSH_FXF_WRITE)
+                {
+                    openFlags = O_WRONLY;
+                }
+                else
+                {
+                    openFlags = O_RDONLY;
+                }
+                openFlags |= (flags & SSH_FXF_CREAT) ? O_CREAT : 0;
+                openFlags |= (flags & SSH_FXF_TRUNC) ? O_TRUNC : 0;
+                openFlags |= (flags & SSH_FXF_EXCL) ? O_EXCL : 0;
+                openFlags |= (flags & SSH_FXF_APPEND) ? O_APPEND : 0;
+
+                mode_t const mode = (message->attr != nullptr && (message->attr->flags & SSH_FILEXFER_ATTR_PERMISSIONS))
+                    ? static_cast<mode_t>(message->attr->permissions & 07777)
+                    : 0644;
+
+                auto handle = std::make_unique<Handle>();
+                handle->m_path = m_context.ResolvePath(sftp_client_message_get_filename(message));
+                handle->m_file = open(handle->m_path.c_str(), openFlags, mode);
+                if (handle->m_file < 0)
+                {
+                    ReplyErrno(message, errno);
+                    return;
+                }
+                ReplyHandle(message, std::move(handle));
+            }
+
+            void HandleOpenDirectory(sftp_client_message message)
+            {
+                auto handle = std::make_unique<Handle>();
+                handle->m_path = m_context.ResolvePath(sftp_client_message_get_filename(message));
+                handle->m_directory = opendir(handle->m_path.c_str());
+                if (handle->m_directory == nullptr)
+                {
+                    ReplyErrno(message, errno);
+                    return;
+                }
+                ReplyHandle(message, std::move(handle));
+            }
+
+            void HandleReadDirectory(sftp_client_message message)
+            {
+                Handle* const handle = FindHandle(message);
+                if (handle == nullptr || handle->m_directory == nullptr)
+                {
+                    sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    return;
+                }
+                int count = 0;
+                for (; count != 64; ++count)
+                {
+                    dirent* entry = readdir(handle->m_directory);
+                    if (entry == nullptr)
+                    {
+                        break;
+                    }
+                    struct stat info;
+                    if (lstat((handle->m_path / entry->d_name).c_str(), &info) != 0)
+                    {
+                        continue;
+                    }
+                    sftp_attributes_struct attributes;
+                    FillAttributes(attributes, info);
+                    sftp_reply_names_add(message, entry->d_name, entry->d_name, &attributes);
+                }
+                if (count == 0)
+                {
+                    sftp_reply_status(message, SSH_FX_EOF, nullptr);
+                }
+                else
+                {
+                    sftp_reply_names(message);
+                }
+            }
+
+            void HandleRead(sftp_client_message message)
+            {
+                Handle* const handle = FindHandle(message);
+                if (handle == nullptr || handle->m_file < 0)
+                {
+                    sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    return;
+                }
+                constexpr uint32_t MaxReadSize = 1 << 20;
+                m_buffer.resize((std::min)(message->len, MaxReadSize));
+                auto const count = pread(handle->m_file, m_buffer.data(), m_buffer.size(), static_cast<off_t>(message->offset));
+                if (count < 0)
+                {
+                    ReplyErrno(message, errno);
+                }
+                else if (count == 0)
+                {
+                    sftp_reply_status(message, SSH_FX_EOF, nullptr);
+                }
+                else
+                {
+                    m_context.Throttle(static_cast<size_t>(count));
+                    sftp_reply_data(message, m_buffer.data(), static_cast<int>(count));
+                }
+            }
+
+            void HandleWrite(sftp_client_message message)
+            {
+                Handle* const handle = FindHandle(message);
+                if (handle == nullptr || handle->m_file < 0)
+                {
+                    sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    return;
+                }
+                auto const size = ssh_string_len(message->data);
+                m_context.Throttle(size);
+                auto const written = pwrite(handle->m_file, ssh_string_data(message->data), size, static_cast<off_t>(message->offset));
+                if (written != static_cast<ssize_t>(size))
+                {
+                    ReplyErrno(message, (written < 0) ? errno : ENOSPC);
+                    return;
+                }
+                sftp_reply_status(message, SSH_FX_OK, nullptr);
+            }
+
+            void HandleStat(sftp_client_message message, bool followLinks)
+            {
+                struct stat info;
+                auto const path = m_context.ResolvePath(sftp_client_message_get_filename(message));
+                if ((followLinks ? stat(path.c_str(), &info) : lstat(path.c_str(), &info)) != 0)
+                {
+                    ReplyErrno(message, errno);
+                    return;
+                }
+                sftp_attributes_struct attributes;
+                FillAttributes(attributes, info);
+                sftp_reply_attr(message, &attributes);
+            }
+
+            void HandleFileStat(sftp_client_message message)
+            {
+                Handle* const handle = FindHandle(message);
+                struct stat info;
+                if (handle == nullptr || handle->m_file < 0 || fstat(handle->m_file, &info) != 0)
+                {
+                    sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    return;
+                }
+                sftp_attributes_struct attributes;
+                FillAttributes(attributes, info);
+                sftp_reply_attr(message, &attributes);
+            }
+
+            void HandleSetStat(sftp_client_message message, std::filesystem::path const& path)
+            {
+                sftp_attributes const attributes = message->attr;
+                if (attributes != nullptr && (attributes->flags & SSH_FILEXFER_ATTR_PERMISSIONS)
+                    && chmod(path.c_str(), static_cast<mode_t>(attributes->permissions & 07777)) != 0)
+                {
+                    ReplyErrno(message, errno);
+                    return;
+                }
+                if (attributes != nullptr && (attributes->flags & SSH_FILEXFER_ATTR_SIZE)
+                    && truncate(path.c_str(), static_cast<off_t>(attributes->size)) != 0)
+                {
+                    ReplyErrno(message, errno);
+                    return;
+                }
+                sftp_reply_status(message, SSH_FX_OK, nullptr);
+            }
+
+            void HandleRealPath(sftp_client_message message)
+            {
+                std::filesystem::path path(sftp_client_message_get_filename(message));
+                if (path.empty() || path == ".")
+                {
+                    path = m_context.Options().m_root.empty() ? std::filesystem::current_path() : std::filesystem::path("/");
+                }
+                auto const normalized = path.lexically_normal().string();
+                sftp_attributes_struct attributes{};
+                sftp_reply_name(message, normalized.c_str(), &attributes);
+            }
+
+            void HandleMessage(sftp_client_message message)
+            {
+                switch (sftp_client_message_get_type(message))
+                {
+                case SSH_FXP_OPEN:
+                    HandleOpen(message);
+                    break;
+                case SSH_FXP_CLOSE:
+                    if (Handle* const handle = FindHandle(message))
+                    {
+                        RemoveHandle(handle);
+                        sftp_reply_status(message, SSH_FX_OK, nullptr);
+                    }
+                    else
+                    {
+                        sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    }
+                    break;
+                case SSH_FXP_READ:
+                    HandleRead(message);
+                    break;
+                case SSH_FXP_WRITE:
+                    HandleWrite(message);
+                    break;
+                case SSH_FXP_OPENDIR:
+                    HandleOpenDirectory(message);
+                    break;
+                case SSH_FXP_READDIR:
+                    HandleReadDirectory(message);
+                    break;
+                case SSH_FXP_STAT:
+                    HandleStat(message, true);
+                    break;
+                case SSH_FXP_LSTAT:
+                    HandleStat(message, false);
+                    break;
+                case SSH_FXP_FSTAT:
+                    HandleFileStat(message);
+                    break;
+                case SSH_FXP_SETSTAT:
+                    HandleSetStat(message, m_context.ResolvePath(sftp_client_message_get_filename(message)));
+                    break;
+                case SSH_FXP_FSETSTAT:
+                    if (Handle* const handle = FindHandle(message))
+                    {
+                        HandleSetStat(message, handle->m_path);
+                    }
+                    else
+                    {
+                        sftp_reply_status(message, SSH_FX_INVALID_HANDLE, "invalid handle");
+                    }
+                    break;
+                case SSH_FXP_MKDIR:
+                    {
+                        mode_t const mode = (message->attr != nullptr && (message->attr->flags & SSH_FILEXFER_ATTR_PERMISSIONS))
+                            ? static_cast<mode_t>(message->attr->permissions & 07777)
+                            : 0755;
+                        ReplyResult(message, mkdir(m_context.ResolvePath(sftp_client_message_get_filename(message)).c_str(), mode));
+                    }
+                    break;
+                case SSH_FXP_RMDIR:
+                    ReplyResult(message, rmdir(m_context.ResolvePath(sftp_client_message_get_filename(message)).c_str()));
+                    break;
+                case SSH_FXP_REMOVE:
+                    ReplyResult(message, unlink(m_context.ResolvePath(sftp_client_message_get_filename(message)).c_str()));
+                    break;
+                case SSH_FXP_RENAME:
+                    ReplyResult(message, std::rename(m_context.ResolvePath(sftp_client_message_get_filename(message)).c_str(),
+                        m_context.ResolvePath(sftp_client_message_get_data(message)).c_str()));
+                    break;
+                case SSH_FXP_REALPATH:
+                    HandleRealPath(message);
+                    break;
+                default:
+                    sftp_reply_status(message, SSH_FX_OP_UNSUPPORTED, "unsupported request");
+                    break;
+                }
+            }
+
+            sftp_session m_sftp;
+            bool m_initialized{ false };
+            std::vector<std::unique_ptr<Handle>> m_handles;
+            std::vector<char> m_buffer;
+        };
+
+        /**
+         * \return a socket connected to \p host at \p port; -1 on failure
+         */
+        inline int ConnectTcp(char const* host, int port) noexcept
+        {
+            addrinfo hints{};
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo* addresses = nullptr;
+            if (host == nullptr || getaddrinfo(host, std::to_string(port).c_str(), &hints, &addresses) != 0)
+            {
+                return -1;
+            }
+            int result = -1;
+            for (addrinfo* address = addresses; address != nullptr && result < 0; address = address->ai_next)
+            {
+                result = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+                if (result >= 0 && connect(result, address->ai_addr, address->ai_addrlen) != 0)
+                {
+                    close(result);
+                    result = -1;
+                }
+            }
+            freeaddrinfo(addresses);
+            return result;
+        }
+
+        /**
+         * \brief relays a direct-tcpip or forwarded-tcpip channel to a tcp connection of the server
+         */
+        class TcpRelayHandler final : public ChannelHandler
+        {
+        public:
+            TcpRelayHandler(ConnectionContext& context, ssh_channel channel, int socket) noexcept
+                : ChannelHandler(context, channel),
+                m_socket(socket)
+            {
+                fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL, 0) | O_NONBLOCK);
+            }
+
+            ~TcpRelayHandler() override
+            {
+                UnwatchSocket();
+                close(m_socket);
+            }
+
+            bool Step() override
+            {
+                if (!m_started)
+                {
+                    if (m_context.Event() != nullptr)
+                    {
+                        ssh_event_add_fd(m_context.Event(), m_socket, POLLIN, &TcpRelayHandler::OnSocketReady, this);
+                        m_watching = true;
+                    }
+                    m_started = true;
+                }
+
+                if (!ForwardToSocket() || !ForwardToChannel())
+                {
+                    return false;
+                }
+                return !(m_channelEof && m_socketEof) && !ssh_channel_is_closed(m_channel);
+            }
+
+            bool Busy() const noexcept override
+            {
+                return !m_pending.empty();
+            }
+
+        private:
+            static int OnSocketReady(socket_t, int, void*)
+            {
+                // only wakes up the event loop; the data is read by Step
+                return 0;
+            }
+
+            void UnwatchSocket() noexcept
+            {
+                if (m_watching && m_context.Event() != nullptr)
+                {
+                    ssh_event_remove_fd(m_context.Event(), m_socket);
+                }
+                m_watching = false;
+            }
+
+            /**
+             * \brief passes the data received from the client to the socket; only reads more, once the socket took the
+             *        previous data
+             *
+             * \return false, if the connection failed
+             */
+            bool ForwardToSocket()
+            {
+                while (!m_channelEof)
+                {
+                    if (m_pending.empty())
+                    {
+                        char buffer[16384];
+                        int const count = ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), 0);
+                        if (count < 0)
+                        {
+                            return false;
+                        }
+                        if (count == 0)
+                        {
+                            if (ssh_channel_is_eof(m_channel))
+                            {
+                                shutdown(m_socket, SHUT_WR);
+                                m_channelEof = true;
+                            }
+                            return true;
+                        }
+                        m_pending.assign(buffer, static_cast<size_t>(count));
+                    }
+                    auto const sent = send(m_socket, m_pending.data(), m_pending.size(), MSG_NOSIGNAL);
+                    if (sent < 0)
+                    {
+                        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                    }
+                    m_pending.erase(0, static_cast<size_t>(sent));
+                }
+                return true;
+            }
+
+            /**
+             * \return false, if the connection failed
+             */
+            bool ForwardToChannel()
+            {
+                char buffer[32768];
+                while (!m_socketEof)
+                {
+                    auto const count = recv(m_socket, buffer, sizeof(buffer), 0);
+                    if (count > 0)
+                    {
+                        if (!m_context.WriteThrottled(m_channel, buffer, static_cast<size_t>(count)))
+                        {
+                            return false;
+                        }
+                    }
+                    else if (count == 0)
+                    {
+                        // a socket at its end stays readable
+                        UnwatchSocket();
+                        ssh_channel_send_eof(m_channel);
+                        m_socketEof = true;
+                    }
+                    else
+                    {
+                        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+                    }
+                }
+                return true;
+            }
+
+            int m_socket;
+            std::string m_pending;
+            bool m_started{ false };
+            bool m_watching{ false };
+            bool m_channelEof{ false };
+            bool m_socketEof{ false };
+        };
+
+        /**
+         * \brief serves a single client connection until it's closed or the server is stopped
+         */
+        class ServerConnection
+        {
+        public:
+            ServerConnection(ssh_session session, TestServerOptions const& options, std::atomic<bool> const& stop)
+                : m_context(session, options),
+                m_stop(stop)
+            {
+            }
+
+            ~ServerConnection()
+            {
+                m_channels.clear();
+                ssh_disconnect(m_context.Session());
+                ssh_free(m_context.Session());
+            }
+
+            ServerConnection(ServerConnection const&) = delete;
+            ServerConnection& operator=(ServerConnection const&) = delete;
+
+            void Run()
+            {
+                ssh_session const session = m_context.Session();
+                if (ssh_handle_key_exchange(session) != SSH_OK)
+                {
+                    return;
+                }
+                ssh_set_auth_methods(session, SSH_AUTH_METHOD_PASSWORD);
+                ssh_set_message_callback(session, &ServerConnection::OnMessage, this);
+
+                std::unique_ptr<std::remove_pointer_t<ssh_event>, decltype(&ssh_event_free)> event(ssh_event_new(), &ssh_event_free);
+                if (!event || ssh_event_add_session(event.get(), session) != SSH_OK)
+                {
+                    return;
+                }
+                m_context.SetEvent(event.get());
+
+                while (!m_stop.load(std::memory_order_relaxed))
+                {
+                    bool const busy = std::any_of(m_channels.begin(), m_channels.end(),
+                        [](OpenChannel const& channel) { return channel.m_handler && channel.m_handler->Busy(); });
+                    if (ssh_event_dopoll(event.get(), busy ? 0 : 50) == SSH_ERROR
+                        || (ssh_get_status(session) & (SSH_CLOSED | SSH_CLOSED_ERROR)) != 0)
+                    {
+                        break;
+                    }
+                    StepChannels();
+                    AcceptForwardedConnections();
+                }
+                m_channels.clear(); // the handlers unregister their descriptors from the event
+                while (!m_forwardListeners.empty())
+                {
+                    CloseForwardListener(m_forwardListeners.front());
+                    m_forwardListeners.pop_front();
+                }
+                m_context.SetEvent(nullptr);
+                ssh_event_remove_session(event.get(), session);
+            }
+
+        private:
+
+            struct OpenChannel
+            {
+                ssh_channel m_channel;
+                std::unique_ptr<ChannelHandler> m_handler;
+            };
+
+            /**
+             * \brief a port listened on for a tcpip-forward request of the client
+             */
+            struct ForwardListener
+            {
+                int m_socket;
+                std::string m_address;
+                int m_port;
+            };
+
+            static bool IsExpected(char const* value, std::string const& expected) noexcept
+            {
+                return value != nullptr && expected == value;
+            }
+
+            static int OnMessage(ssh_session, ssh_message message, void* userData)
+            {
+                return static_cast<ServerConnection*>(userData)->HandleMessage(message);
+            }
+
+            /**
+             * \return 0, if the message was answered, 1 for the default reply
+             */
+            int HandleMessage(ssh_message message)
+            {
+                switch (ssh_message_type(message))
+                {
+                case SSH_REQUEST_AUTH:
+                    if (ssh_message_subtype(message) == SSH_AUTH_METHOD_PASSWORD
+                        && IsExpected(ssh_message_auth_user(message), m_context.Options().m_user)
+                        && IsExpected(ssh_message_auth_password(message), m_context.Options().m_password))
+                    {
+                        m_authenticated = true;
+                        ssh_message_auth_reply_success(message, 0);
+                        return 0;
+                    }
+                    ssh_message_auth_set_methods(message, SSH_AUTH_METHOD_PASSWORD);
+                    return 1;
+                case SSH_REQUEST_CHANNEL_OPEN:
+                    if (m_authenticated && ssh_message_subtype(message) == SSH_CHANNEL_SESSION)
+                    {
+                        if (ssh_channel channel = ssh_message_channel_request_open_reply_accept(message))
+                        {
+                            m_channels.push_back(OpenChannel{ channel, nullptr });
+                            return 0;
+                        }
+                    }
+                    else if (m_authenticated && ssh_message_subtype(message) == SSH_CHANNEL_DIRECT_TCPIP)
+                    {
+                        return OpenDirectTcpIp(message);
+                    }
+                    return 1;
+                case SSH_REQUEST_CHANNEL:
+                    return HandleChannelRequest(message);
+                case SSH_REQUEST_GLOBAL:
+                    return m_authenticated ? HandleGlobalRequest(message) : 1;
+                default:
+                    return 1;
+                }
+            }
+
+            int HandleChannelRequest(ssh_message message)
+            {
+                ssh_channel const channel = ssh_message_channel_request_channel(message);
+                auto pos = std::find_if(m_channels.begin(), m_channels.end(),
+                    [channel](OpenChannel const& c) { return c.m_channel == channel; });
+                if (pos == m_channels.end() || pos->m_handler)
+                {
+                    return 1;
+                }
+
+                try
+                {
+                    switch (ssh_message_subtype(message))
+                    {
+                    case SSH_CHANNEL_REQUEST_EXEC:
+                        pos->m_handler = CreateExecHandler(channel, ssh_message_channel_request_command(message));
+                        break;
+                    case SSH_CHANNEL_REQUEST_SUBSYSTEM:
+                        if (std::string_view(ssh_message_channel_request_subsystem(message)) != "sftp")
+                        {
+                            return 1;
+                        }
+                        pos->m_handler = std::make_unique<SftpHandler>(m_context, channel);
+                        break;
+                    case SSH_CHANNEL_REQUEST_ENV:
+                    case SSH_CHANNEL_REQUEST_PTY:
+                        ssh_message_channel_request_reply_success(message);
+                        return 0;
+                    default:
+                        return 1;
+                    }
+                }
+                catch (std::exception const&)
+                {
+                    return 1;
+                }
+                ssh_message_channel_request_reply_success(message);
+                return 0;
+            }
+
+            int OpenDirectTcpIp(ssh_message message)
+            {
+                int const socket = ConnectTcp(ssh_message_channel_request_open_destination(message),
+                                              ssh_message_channel_request_open_destination_port(message));
+                if (socket < 0)
+                {
+                    return 1;
+                }
+                ssh_channel const channel = ssh_message_channel_request_open_reply_accept(message);
+                if (channel == nullptr)
+                {
+                    close(socket);
+                    return 1;
+                }
+                m_channels.push_back(OpenChannel{ channel, std::make_unique<TcpRelayHandler>(m_context, channel, socket) });
+                return 0;
+            }
+
+            /**
+             * \brief handles tcpip-forward and cancel-tcpip-forward; the server always listens on 127.0.0.1
+             */
+            int HandleGlobalRequest(ssh_message message)
+            {
+                switch (ssh_message_subtype(message))
+                {
+                case SSH_GLOBAL_REQUEST_TCPIP_FORWARD:
+                {
+                    auto const address = ssh_message_global_request_address(message);
+                    int const port = ListenForward(address == nullptr ? "" : address, ssh_message_global_request_port(message));
+                    if (port < 0)
+                    {
+                        return 1;
+                    }
+                    ssh_message_global_request_reply_success(message, static_cast<uint16_t>(port));
+                    return 0;
+                }
+                case SSH_GLOBAL_REQUEST_CANCEL_TCPIP_FORWARD:
+                {
+                    int const port = ssh_message_global_request_port(message);
+                    auto pos = std::find_if(m_forwardListeners.begin(), m_forwardListeners.end(),
+                        [port](ForwardListener const& listener) { return listener.m_socket >= 0 && listener.m_port == port; });
+                    if (pos == m_forwardListeners.end())
+                    {
+                        return 1;
+                    }
+                    // removed by AcceptForwardedConnections, which may be iterating the listeners right now
+                    CloseForwardListener(*pos);
+                    ssh_message_global_request_reply_success(message, 0);
+                    return 0;
+                }
+                default:
+                    return 1;
+                }
+            }
+
+            /**
+             * \return the port listened on; -1 on failure
+             */
+            int ListenForward(std::string address, int port)
+            {
+                int const listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+                if (listenSocket < 0)
+                {
+                    return -1;
+                }
+                int const reuse = 1;
+                setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+                sockaddr_in bound{};
+                bound.sin_family = AF_INET;
+                bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                bound.sin_port = htons(static_cast<uint16_t>(port));
+                socklen_t boundLength = sizeof(bound);
+                if (bind(listenSocket, reinterpret_cast<sockaddr*>(&bound), sizeof(bound)) != 0
+                    || listen(listenSocket, SOMAXCONN) != 0
+                    || getsockname(listenSocket, reinterpret_cast<sockaddr*>(&bound), &boundLength) != 0)
+                {
+                    close(listenSocket);
+                    return -1;
+                }
+                fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK);
+                if (m_context.Event() != nullptr)
+                {
+                    ssh_event_add_fd(m_context.Event(), listenSocket, POLLIN, &ServerConnection::OnConnectionPending, this);
+                }
+
+                int const boundPort = ntohs(bound.sin_port);
+                m_forwardListeners.push_back(ForwardListener{ listenSocket, std::move(address), boundPort });
+                return boundPort;
+            }
+
+            static int OnConnectionPending(socket_t, int, void*)
+            {
+                // only wakes up the event loop; the connections are accepted by AcceptForwardedConnections
+                return 0;
+            }
+
+            void CloseForwardListener(ForwardListener& listener) noexcept
+            {
+                if (listener.m_socket < 0)
+                {
+                    return;
+                }
+                if (m_context.Event() != nullptr)
+                {
+                    ssh_event_remove_fd(m_context.Event(), listener.m_socket);
+                }
+                close(listener.m_socket);
+                listener.m_socket = -1;
+            }
+
+            /**
+             * \brief opens a forwarded-tcpip channel to the client for each connection to a forwarded port
+             */
+            void AcceptForwardedConnections()
+            {
+                for (auto& listener : m_forwardListeners)
+                {
+                    // opening the channel handles other messages, which may cancel the forward
+                    while (listener.m_socket >= 0)
+                    {
+                        sockaddr_in peer{};
+                        socklen_t peerLength = sizeof(peer);
+                        int const socket = accept(listener.m_socket, reinterpret_cast<sockaddr*>(&peer), &peerLength);
+                        if (socket < 0)
+                        {
+                            break;
+                        }
+                        ssh_channel const channel = ssh_channel_new(m_context.Session());
+                        if (channel == nullptr
+                            || ssh_channel_open_reverse_forward(channel, listener.m_address.c_str(), listener.m_port,
+                                                                "127.0.0.1", ntohs(peer.sin_port)) != SSH_OK)
+                        {
+                            if (channel != nullptr)
+                            {
+                                ssh_channel_free(channel);
+                            }
+                            close(socket);
+                            continue;
+                        }
+                        m_channels.push_back(OpenChannel{ channel, std::make_unique<TcpRelayHandler>(m_context, channel, socket) });
+                    }
+                }
+                m_forwardListeners.remove_if([](ForwardListener const& listener) { return listener.m_socket < 0; });
+            }
+
+            std::unique_ptr<ChannelHandler> CreateExecHandler(ssh_channel channel, char const* command)
+            {
+                auto const arguments = SplitCommandLine(command);
+                if (arguments.size() >= 2 && arguments[0] == "scp")
+                {
+                    bool sink = false;
+                    bool source = false;
+                    bool recursive = false;
+                    std::string location;
+                    for (size_t i = 1; i != arguments.size(); ++i)
+                    {
+                        auto const& argument = arguments[i];
+                        if (argument == "-t")
+                        {
+                            sink = true;
+                        }
+                        else if (argument == "-f")
+                        {
+                            source = true;
+                        }
+                        else if (argument == "-r")
+                        {
+                            recursive = true;
+                        }
+                        else if (argument.empty() || argument[0] != '-')
+                        {
+                            location = argument;
+                        }
+                    }
+                    if (sink)
+                    {
+                        return std::make_unique<ScpSinkHandler>(m_context, channel, m_context.ResolvePath(location));
+                    }
+                    if (source)
+                    {
+                        return std::make_unique<ScpSourceHandler>(m_context, channel, m_context.ResolvePath(location), recursive);
+                    }
+                }
+                if (!m_context.Options().m_commandHandler)
+                {
+                    return std::make_unique<ShellExecHandler>(m_context, channel, command);
+                }
+                return std::make_unique<ExecHandler>(m_context, channel, command);
+            }
+
+            void StepChannels()
+            {
+                for (auto pos = m_channels.begin(); pos != m_channels.end();)
+                {
+                    bool keep;
+                    if (pos->m_handler)
+                    {
+                        keep = pos->m_handler->Step();
+                    }
+                    else if (ssh_channel_is_closed(pos->m_channel) || ssh_channel_is_eof(pos->m_channel))
+                    {
+                        ssh_channel_close(pos->m_channel);
+                        ssh_channel_free(pos->m_channel);
+                        keep = false;
+                    }
+                    else
+                    {
+                        keep = true;
+                    }
+                    pos = keep ? std::next(pos) : m_channels.erase(pos);
+                }
+            }
+
+            ConnectionContext m_context;
+            std::atomic<bool> const& m_stop;
+            std::list<OpenChannel> m_channels; // std::list, since the message callback may add channels while they're stepped
+            std::list<ForwardListener> m_forwardListeners; // std::list for the same reason
+            bool m_authenticated{ false };
+        };
+    }
+
+    /**
+     * \brief An in-process ssh server listening on an ephemeral localhost port
+     *
+     * Accepts password authentication, executes commands via the configured handler, serves SFTP and
+     * single file SCP transfers and relays tcp connections for local and remote port forwarding. Every client connection
+     * is served by its own thread.
+     */
+    class TestServer
+    {
+    public:
+        explicit TestServer(TestServerOptions options = {})
+            : m_options(std::move(options))
+        {
+            m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+            if (m_listenSocket < 0)
+            {
+                throw std::runtime_error("error creating the listen socket");
+            }
+            int const reuse = 1;
+            setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = 0;
+            socklen_t addressLength = sizeof(address);
+            if (bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(m_listenSocket, SOMAXCONN) != 0
+                || getsockname(m_listenSocket, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0)
+            {
+                close(m_listenSocket);
+                throw std::runtime_error("error listening on localhost");
+            }
+            m_port = ntohs(address.sin_port);
+
+            m_bind = ssh_bind_new();
+            if (m_bind == nullptr)
+            {
+                close(m_listenSocket);
+                throw std::runtime_error("error creating the ssh bind");
+            }
+
+            ssh_key hostKey = nullptr;
+            if (ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &hostKey) != SSH_OK
+                || ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_IMPORT_KEY, hostKey) != SSH_OK)
+            {
+                ssh_key_free(hostKey);
+                ssh_bind_free(m_bind);
+                close(m_listenSocket);
+                throw std::runtime_error("error setting up the host key");
+            }
+
+            ssh_bind_set_fd(m_bind, m_listenSocket);
+            if (ssh_bind_listen(m_bind) != SSH_OK)
+            {
+                ssh_bind_free(m_bind);
+                throw std::runtime_error("error starting the ssh bind");
+            }
+
+            m_acceptThread = std::thread(&TestServer::AcceptLoop, this);
+        }
+
+        TestServer(TestServer const&) = delete;
+        TestServer& operator=(TestServer const&) = delete;
+
+        ~TestServer() noexcept
+        {
+            Stop();
+        }
+
+        [[nodiscard]] IpV4 Address() const noexcept
+        {
+            return IpV4(127, 0, 0, 1);
+        }
+
+        [[nodiscard]] int Port() const noexcept
+        {
+            return m_port;
+        }
+
+        [[nodiscard]] TestServerOptions const& Options() const noexcept
+        {
+            return m_options;
+        }
+
+        /**
+         * \brief stops accepting connections and closes all open connections
+         */
+        void Stop() noexcept
+        {
+            if (m_stop.exchange(true))
+            {
+                return;
+            }
+            if (m_acceptThread.joinable())
+            {
+                m_acceptThread.join();
+            }
+            for (auto& connection : m_connections)
+            {
+                connection.m_thread.join();
+            }
+            m_connections.clear();
+            ssh_bind_free(m_bind);
+        }
+
+    private:
+
+        struct ConnectionThread
+        {
+            std::thread m_thread;
+            std::shared_ptr<std::atomic<bool>> m_done;
+        };
+
+        void AcceptLoop()
+        {
+            while (!m_stop.load(std::memory_order_relaxed))
+            {
+                pollfd listenFd{ m_listenSocket, POLLIN, 0 };
+                if (poll(&listenFd, 1, 50) <= 0)
+                {
+                    continue;
+                }
+
+                ssh_session session = ssh_new();
+                if (session == nullptr)
+                {
+                    continue;
+                }
+                if (ssh_bind_accept(m_bind, session) != SSH_OK)
+                {
+                    ssh_free(session);
+                    continue;
+                }
+
+                // reap the threads of connections closed in the meantime
+                m_connections.erase(std::remove_if(m_connections.begin(), m_connections.end(),
+                    [](ConnectionThread& connection)
+                    {
+                        if (connection.m_done->load())
+                        {
+                            connection.m_thread.join();
+                            return true;
+                        }
+                        return false;
+                    }), m_connections.end());
+
+                auto done = std::make_shared<std::atomic<bool>>(false);
+                m_connections.push_back(ConnectionThread{
+                    std::thread([this, session, done]
+                        {
+                            {
+                                detail::ServerConnection connection(session, m_options, m_stop);
+                                connection.Run();
+                            }
+                            done->store(true);
+                        }),
+                    done });
+            }
+        }
+
+        TestServerOptions m_options;
+        int m_listenSocket{ -1 };
+        int m_port{ 0 };
+        ssh_bind m_bind{ nullptr };
+        std::atomic<bool> m_stop{ false };
+        std::thread m_acceptThread;
+        std::vector<ConnectionThread> m_connections; // only accessed by the accept thread while it's running
+    };
+
+}
+
+#endif
@@ -0,0 +1,493 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#ifndef LIBSSH_CPP_WRAP_TESTING_WAN_PROXY
+#define LIBSSH_CPP_WRAP_TESTING_WAN_PROXY
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "libssh_cpp_wrap/ip.hpp"
+
+namespace libssh_wrap::testing
+{
+
+    /**
+     * \brief the characteristics of an emulated network link
+     */
+    struct LinkProfile
+    {
+        std::string m_name{ "direct" };
+
+        std::chrono::microseconds m_roundTripTime{ 0 };
+
+        /**
+         * \brief maximum random deviation added to the one way delay of each segment
+         */
+        std::chrono::microseconds m_jitter{ 0 };
+
+        /**
+         * \brief bandwidth per direction; 0 for unlimited
+         */
+        size_t m_bytesPerSecond{ 0 };
+
+        /**
+         * \brief probability of a forwarded segment being held back by m_stallDuration, emulating a retransmission
+         */
+        double m_stallProbability{ 0.0 };
+        std::chrono::microseconds m_stallDuration{ 0 };
+    };
+
+    /**
+     * \brief profiles for typical links, ordered from fast to slow
+     */
+    inline std::vector<LinkProfile> const& StandardLinkProfiles()
+    {
+        using std::chrono::milliseconds;
+        static std::vector<LinkProfile> const profiles{
+            { "lan", milliseconds(1), milliseconds(0), 0, 0.0, milliseconds(0) },
+            { "metro", milliseconds(10), milliseconds(1), 100'000'000 / 8, 0.0, milliseconds(0) },
+            { "continental", milliseconds(40), milliseconds(4), 50'000'000 / 8, 0.0001, milliseconds(80) },
+            { "intercontinental", milliseconds(150), milliseconds(10), 20'000'000 / 8, 0.0005, milliseconds(300) },
+            { "lossy", milliseconds(80), milliseconds(30), 5'000'000 / 8, 0.01, milliseconds(200) },
+        };
+        return profiles;
+    }
+
+    namespace detail
+    {
+
+        /**
+         * \brief forwards the data of one direction of a proxied connection applying the link profile
+         */
+        class ShapedPipe
+        {
+        public:
+            ShapedPipe(int from, int to, LinkProfile const& profile, std::mutex& profileMutex)
+                : m_from(from),
+                m_to(to),
+                m_profile(profile),
+                m_profileMutex(profileMutex),
+                m_random(std::random_device{}())
+            {
+                m_reader = std::thread(&ShapedPipe::ReadLoop, this);
+                m_writer = std::thread(&ShapedPipe::WriteLoop, this);
+            }
+
+            ShapedPipe(ShapedPipe const&) = delete;
+            ShapedPipe& operator=(ShapedPipe const&) = delete;
+
+            ~ShapedPipe()
+            {
+                Close();
+                m_reader.join();
+                m_writer.join();
+            }
+
+            void Close() noexcept
+            {
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_closed = true;
+                }
+                m_condition.notify_all();
+                shutdown(m_from, SHUT_RD);
+            }
+
+            bool Finished() const noexcept
+            {
+                return m_finished.load();
+            }
+
+        private:
+            using Clock = std::chrono::steady_clock;
+
+            struct Segment
+            {
+                std::vector<char> m_data;
+                Clock::time_point m_departure;
+            };
+
+            /**
+             * \brief computes the time the last byte of \p size bytes read now leaves the emulated link
+             */
+            Clock::time_point ScheduleDeparture(size_t size)
+            {
+                LinkProfile profile;
+                {
+                    std::lock_guard lock(m_profileMutex);
+                    profile = m_profile;
+                }
+
+                auto const now = Clock::now();
+                auto delay = std::chrono::duration_cast<Clock::duration>(profile.m_roundTripTime / 2);
+                if (profile.m_jitter.count() > 0)
+                {
+                    std::uniform_int_distribution<long long> jitter(-profile.m_jitter.count(), profile.m_jitter.count());
+                    delay += std::chrono::duration_cast<Clock::duration>(std::chrono::microseconds(jitter(m_random)));
+                }
+                if (profile.m_stallProbability > 0.0 && std::bernoulli_distribution(profile.m_stallProbability)(m_random))
+                {
+                    delay += std::chrono::duration_cast<Clock::duration>(profile.m_stallDuration);
+                }
+                delay = (std::max)(delay, Clock::duration::zero());
+
+                // serialization delay of the link; segments never overtake each other
+                auto departure = (std::max)(now + delay, m_lastDeparture);
+                if (profile.m_bytesPerSecond != 0)
+                {
+                    departure = (std::max)(now, m_linkFree)
+                        + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(size) / static_cast<double>(profile.m_bytesPerSecond)));
+                    m_linkFree = departure;
+                    departure = (std::max)(departure + delay, m_lastDeparture);
+                }
+                m_lastDeparture = departure;
+                return departure;
+            }
+
+            void ReadLoop()
+            {
+                constexpr size_t SegmentSize = 16384;
+                while (true)
+                {
+                    std::vector<char> data(SegmentSize);
+                    auto const count = recv(m_from, data.data(), data.size(), 0);
+                    if (count <= 0)
+                    {
+                        break;
+                    }
+                    data.resize(static_cast<size_t>(count));
+                    auto const departure = ScheduleDeparture(data.size());
+                    {
+                        std::lock_guard lock(m_mutex);
+                        if (m_closed)
+                        {
+                            break;
+                        }
+                        m_queue.push_back(Segment{ std::move(data), departure });
+                    }
+                    m_condition.notify_all();
+                }
+                {
+                    std::lock_guard lock(m_mutex);
+                    m_readerDone = true;
+                }
+                m_condition.notify_all();
+            }
+
+            void WriteLoop()
+            {
+                std::unique_lock lock(m_mutex);
+                while (true)
+                {
+                    m_condition.wait(lock, [this] { return m_closed || m_readerDone || !m_queue.empty(); });
+                    if (m_closed)
+                    {
+                        break;
+                    }
+                    if (m_queue.empty())
+                    {
+                        // the reader finished and everything was forwarded
+                        break;
+                    }
+                    auto const departure = m_queue.front().m_departure;
+                    if (m_condition.wait_until(lock, departure, [this] { return m_closed; }))
+                    {
+                        break;
+                    }
+                    Segment segment = std::move(m_queue.front());
+                    m_queue.pop_front();
+                    lock.unlock();
+                    bool const success = SendAll(segment.m_data);
+                    lock.lock();
+                    if (!success)
+                    {
+                        break;
+                    }
+                }
+                lock.unlock();
+                shutdown(m_to, SHUT_WR);
+                m_finished.store(true);
+            }
+
+            bool SendAll(std::vector<char> const& data) const noexcept
+            {
+                size_t sent = 0;
+                while (sent != data.size())
+                {
+                    auto const count = send(m_to, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                    if (count <= 0)
+                    {
+                        return false;
+                    }
+                    sent += static_cast<size_t>(count);
+                }
+                return true;
+            }
+
+            int m_from;
+            int m_to;
+            LinkProfile const& m_profile;
+            std::mutex& m_profileMutex;
+            std::mt19937_64 m_random;
+            Clock::time_point m_lastDeparture{};
+            Clock::time_point m_linkFree{};
+
+            std::mutex m_mutex;
+            std::condition_variable m_condition;
+            std::deque<Segment> m_queue;
+            bool m_closed{ false };
+            bool m_readerDone{ false };
+            std::atomic<bool> m_finished{ false };
+
+            std::thread m_reader;
+            std::thread m_writer;
+        };
+
+        class ProxiedConnection
+        {
+        public:
+            ProxiedConnection(int client, int upstream, LinkProfile const& profile, std::mutex& profileMutex)
+                : m_client(client),
+                m_upstream(upstream),
+                m_toUpstream(client, upstream, profile, profileMutex),
+                m_toClient(upstream, client, profile, profileMutex)
+            {
+            }
+
+            ~ProxiedConnection()
+            {
+                m_toUpstream.Close();
+                m_toClient.Close();
+                shutdown(m_client, SHUT_RDWR);
+                shutdown(m_upstream, SHUT_RDWR);
+            }
+
+            ProxiedConnection(ProxiedConnection const&) = delete;
+            ProxiedConnection& operator=(ProxiedConnection const&) = delete;
+
+            bool Finished() const noexcept
+            {
+                return m_toUpstream.Finished() && m_toClient.Finished();
+            }
+
+        private:
+            struct Socket
+            {
+                int m_fd;
+
+                Socket(int fd) noexcept
+                    : m_fd(fd)
+                {
+                }
+
+                ~Socket()
+                {
+                    close(m_fd);
+                }
+
+                operator int() const noexcept
+                {
+                    return m_fd;
+                }
+            };
+
+            // declared before the pipes to be closed after their threads are joined
+            Socket m_client;
+            Socket m_upstream;
+            ShapedPipe m_toUpstream;
+            ShapedPipe m_toClient;
+        };
+    }
+
+    /**
+     * \brief A TCP proxy on localhost forwarding to a fixed upstream endpoint with the delay, bandwidth and
+     *        stalls of a LinkProfile applied to both directions
+     *
+     * Runs in user space without any special privileges.
+     */
+    class WanProxy
+    {
+    public:
+        WanProxy(IpV4 upstreamAddress, int upstreamPort, LinkProfile profile = {}, int listenPort = 0)
+            : m_upstreamAddress(upstreamAddress),
+            m_upstreamPort(upstreamPort),
+            m_profile(std::move(profile))
+        {
+            m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+            if (m_listenSocket < 0)
+            {
+                throw std::runtime_error("error creating the listen socket");
+            }
+            int const reuse = 1;
+            setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            address.sin_port = htons(static_cast<uint16_t>(listenPort));
+            socklen_t addressLength = sizeof(address);
+            if (bind(m_listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(m_listenSocket, SOMAXCONN) != 0
+                || getsockname(m_listenSocket, reinterpret_cast<sockaddr*>(&address), &addressLength) != 0)
+            {
+                close(m_listenSocket);
+                throw std::runtime_error("error listening on localhost");
+            }
+            m_port = ntohs(address.sin_port);
+
+            m_acceptThread = std::thread(&WanProxy::AcceptLoop, this);
+        }
+
+        WanProxy(WanProxy const&) = delete;
+        WanProxy& operator=(WanProxy const&) = delete;
+
+        ~WanProxy() noexcept
+        {
+            Stop();
+        }
+
+        [[nodiscard]] IpV4 Address() const noexcept
+        {
+            return IpV4(127, 0, 0, 1);
+        }
+
+        [[nodiscard]] int Port() const noexcept
+        {
+            return m_port;
+        }
+
+        [[nodiscard]] LinkProfile Profile() const
+        {
+            std::lock_guard lock(m_profileMutex);
+            return m_profile;
+        }
+
+        /**
+         * \brief changes the profile; applies to data read after the call, including existing connections
+         */
+        void SetProfile(LinkProfile profile)
+        {
+            std::lock_guard lock(m_profileMutex);
+            m_profile = std::move(profile);
+        }
+
+        /**
+         * \brief stops accepting connections and closes all proxied connections
+         */
+        void Stop() noexcept
+        {
+            if (m_stop.exchange(true))
+            {
+                return;
+            }
+            if (m_acceptThread.joinable())
+            {
+                m_acceptThread.join();
+            }
+            m_connections.clear();
+            close(m_listenSocket);
+        }
+
+    private:
+
+        int ConnectUpstream() const
+        {
+            int const upstream = socket(AF_INET, SOCK_STREAM, 0);
+            if (upstream < 0)
+            {
+                return -1;
+            }
+            char host[IpV4::MaxCStringLength];
+            m_upstreamAddress.FillToCString(host);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(m_upstreamPort));
+            if (inet_pton(AF_INET, host, &address.sin_addr) != 1
+                || connect(upstream, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+            {
+                close(upstream);
+                return -1;
+            }
+            return upstream;
+        }
+
+        void AcceptLoop()
+        {
+            while (!m_stop.load(std::memory_order_relaxed))
+            {
+                pollfd listenFd{ m_listenSocket, POLLIN, 0 };
+                if (poll(&listenFd, 1, 50) <= 0)
+                {
+                    continue;
+                }
+                int const client = accept(m_listenSocket, nullptr, nullptr);
+                if (client < 0)
+                {
+                    continue;
+                }
+                int const upstream = ConnectUpstream();
+                if (upstream < 0)
+                {
+                    close(client);
+                    continue;
+                }
+                int const noDelay = 1;
+                setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                setsockopt(upstream, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+                m_connections.remove_if([](auto const& connection) { return connection->Finished(); });
+                m_connections.push_back(std::make_unique<detail::ProxiedConnection>(client, upstream, m_profile, m_profileMutex));
+            }
+        }
+
+        IpV4 m_upstreamAddress;
+        int m_upstreamPort;
+        mutable std::mutex m_profileMutex;
+        LinkProfile m_profile;
+        int m_listenSocket{ -1 };
+        int m_port{ 0 };
+        std::atomic<bool> m_stop{ false };
+        std::thread m_acceptThread;
+        std::list<std::unique_ptr<detail::ProxiedConnection>> m_connections; // only accessed by the accept thread while it's running
+    };
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "libssh_cpp_wrap/ip.hpp"
+#include "libssh_cpp_wrap_testing/wan_proxy.hpp"
+
+namespace
+{
+
+void PrintUsage(std::ostream& out)
+{
+    out <<
+        (
+            "Incorrect usage, should be:\n"
+            "wan_proxy <listen port> <upstream ip> <upstream port> [options]\n"
+            "options:\n"
+            "  --profile <name>           start from a predefined profile (lan, metro, continental, intercontinental, lossy)\n"
+            "  --rtt <ms>                 round trip time\n"
+            "  --jitter <ms>              maximum deviation of the one way delay\n"
+            "  --rate <bytes per second>  bandwidth per direction, 0 for unlimited\n"
+            "  --stall-probability <p>    probability of a segment being held back\n"
+            "  --stall <ms>               duration a held back segment is delayed\n"
+        );
+}
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void OnSignal(int)
+{
+    g_stop = 1;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace libssh_wrap;
+    using namespace libssh_wrap::testing;
+
+    if (argc < 4 || (argc % 2) != 0)
+    {
+        PrintUsage(std::cerr);
+        return 1;
+    }
+
+    int const listenPort = std::atoi(argv[1]);
+    IpV4 const upstream(argv[2]);
+    int const upstreamPort = std::atoi(argv[3]);
+
+    if (upstream == IpV4("0.0.0.0"))
+    {
+        std::cerr << "Unexpected value passed as ip: " << argv[2] << '\n';
+        return 1;
+    }
+
+    LinkProfile profile;
+    for (int i = 4; i + 1 < argc; i += 2)
+    {
+        std::string_view const option = argv[i];
+        char const* const value = argv[i + 1];
+        if (option == "--profile")
+        {
+            bool found = false;
+            for (auto const& standardProfile : StandardLinkProfiles())
+            {
+                if (standardProfile.m_name == value)
+                {
+                    profile = standardProfile;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                std::cerr << "Unknown profile: " << value << '\n';
+                return 1;
+            }
+        }
+        else if (option == "--rtt")
+        {
+            profile.m_roundTripTime = std::chrono::milliseconds(std::atoll(value));
+        }
+        else if (option == "--jitter")
+        {
+            profile.m_jitter = std::chrono::milliseconds(std::atoll(value));
+        }
+        else if (option == "--rate")
+        {
+            profile.m_bytesPerSecond = static_cast<size_t>(std::atoll(value));
+        }
+        else if (option == "--stall-probability")
+        {
+            profile.m_stallProbability = std::atof(value);
+        }
+        else if (option == "--stall")
+        {
+            profile.m_stallDuration = std::chrono::milliseconds(std::atoll(value));
+        }
+        else
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+    }
+
+    try
+    {
+        WanProxy proxy(upstream, upstreamPort, profile, listenPort);
+        std::cout << "forwarding 127.0.0.1:" << proxy.Port() << " to " << upstream << ':' << upstreamPort << '\n';
+
+        std::signal(SIGINT, &OnSignal);
+        std::signal(SIGTERM, &OnSignal);
+        while (g_stop == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    catch (std::runtime_error const& ex)
+    {
+        std::cerr << ex.what() << '\n';
+        return 1;
+    }
+}
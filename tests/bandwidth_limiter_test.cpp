@@ -0,0 +1,175 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/bandwidth_limiter.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    /**
+     * \return the time it took to acquire \p total bytes for \p host in grants of at most \p wanted bytes
+     */
+    std::chrono::duration<double> AcquireAll(BandwidthLimiter& limiter, std::string const& host, size_t total, size_t wanted)
+    {
+        auto const start = BandwidthLimiter::Clock::now();
+        while (total != 0)
+        {
+            auto const grant = limiter.Acquire(host, (std::min)(total, wanted));
+            total -= grant.m_bytes;
+        }
+        return BandwidthLimiter::Clock::now() - start;
+    }
+
+}
+
+TEST(BandwidthLimiter, DoesNotThrottleWithoutLimits)
+{
+    BandwidthLimiter limiter(1000);
+    auto const grant = limiter.Acquire("host", 1000000);
+    EXPECT_EQ(grant.m_bytes, 1000000u);
+    EXPECT_EQ(grant.m_throttled, BandwidthLimiter::Clock::duration::zero());
+    EXPECT_EQ(limiter.Acquire("host", 0).m_bytes, 0u);
+}
+
+TEST(BandwidthLimiter, GrantsAtMostAQuantum)
+{
+    BandwidthLimiter limiter(1000);
+    limiter.SetGlobalLimit(1000000);
+    EXPECT_EQ(limiter.Acquire("host", 1000000).m_bytes, 1000u);
+    EXPECT_EQ(limiter.Acquire("host", 10).m_bytes, 10u);
+}
+
+TEST(BandwidthLimiter, LimitsTheRate)
+{
+    BandwidthLimiter limiter(10000);
+    limiter.SetGlobalLimit(2000000);
+
+    // one quantum of burst, the remaining 390000 bytes take 195 ms
+    auto const elapsed = AcquireAll(limiter, "host", 400000, 100000);
+    EXPECT_GE(elapsed, 150ms);
+    EXPECT_LT(elapsed, 1s);
+}
+
+TEST(BandwidthLimiter, AppliesHostAndSiteLimitsToTheirHostsOnly)
+{
+    BandwidthLimiter limiter(10000);
+    limiter.SetHostLimit("limited", 1000000);
+    limiter.SetSiteLimit("site", 1000000);
+    limiter.AssignSite("member", "site");
+
+    EXPECT_GE(AcquireAll(limiter, "limited", 200000, 10000), 150ms);
+    EXPECT_GE(AcquireAll(limiter, "member", 200000, 10000), 150ms);
+    EXPECT_LT(AcquireAll(limiter, "other", 200000, 10000), 50ms);
+
+    limiter.AssignSite("member", "");
+    EXPECT_LT(AcquireAll(limiter, "member", 200000, 10000), 50ms);
+
+    limiter.SetHostLimit("limited", BandwidthLimiter::Unlimited);
+    EXPECT_LT(AcquireAll(limiter, "limited", 200000, 10000), 50ms);
+}
+
+TEST(BandwidthLimiter, SharesALimitEvenlyRegardlessOfTheRequestSize)
+{
+    BandwidthLimiter limiter(4000);
+    limiter.SetGlobalLimit(2000000);
+
+    std::atomic<bool> stop{ false };
+    uint64_t small = 0;
+    uint64_t large = 0;
+    auto transfer = [&limiter, &stop](uint64_t& total, size_t wanted)
+        {
+            while (!stop)
+            {
+                total += limiter.Acquire("host", wanted).m_bytes;
+            }
+        };
+    std::thread smallTransfer(transfer, std::ref(small), size_t(4000));
+    std::thread largeTransfer(transfer, std::ref(large), size_t(1000000));
+    std::this_thread::sleep_for(300ms);
+    stop = true;
+    smallTransfer.join();
+    largeTransfer.join();
+
+    ASSERT_GT(small, 0u);
+    ASSERT_GT(large, 0u);
+    double const ratio = static_cast<double>(small) / static_cast<double>(large);
+    EXPECT_GT(ratio, 0.7);
+    EXPECT_LT(ratio, 1.0 / 0.7);
+}
+
+TEST(BandwidthLimiter, ReleasedBytesAreAvailableAgain)
+{
+    BandwidthLimiter limiter(100000);
+    limiter.SetGlobalLimit(1000000);
+
+    // the burst covers two grants; the released one makes room for a third, the fourth waits
+    limiter.Acquire("host", 100000);
+    limiter.Acquire("host", 100000);
+    limiter.Release("host", 100000);
+    EXPECT_LT(limiter.Acquire("host", 100000).m_throttled, 50ms);
+    EXPECT_GE(limiter.Acquire("host", 100000).m_throttled, 50ms);
+}
+
+TEST(BandwidthLimiter, CancelledWaitsReturnTheirBytes)
+{
+    BandwidthLimiter limiter(100000);
+    limiter.SetGlobalLimit(1000000);
+
+    limiter.Acquire("host", 100000);
+    limiter.Acquire("host", 100000);
+    auto const start = BandwidthLimiter::Clock::now();
+    EXPECT_THROW(limiter.Acquire("host", 100000, start + 10ms), OperationCancelled);
+    EXPECT_LT(BandwidthLimiter::Clock::now() - start, 50ms);
+
+    // without the refund, the cancelled grant would delay this one by another 100 ms
+    EXPECT_LT(limiter.Acquire("host", 100000).m_throttled, 150ms);
+}
+
+TEST(BandwidthLimiter, DoesNotGrantAfterAStopRequest)
+{
+    BandwidthLimiter limiter(100000);
+    limiter.SetGlobalLimit(1000000);
+
+    std::stop_source stop;
+    stop.request_stop();
+    EXPECT_THROW(limiter.Acquire("host", 100000, NoDeadline, stop.get_token()), OperationCancelled);
+
+    // nothing was charged, so the burst still covers two grants
+    EXPECT_LT(limiter.Acquire("host", 100000).m_throttled, 50ms);
+    EXPECT_LT(limiter.Acquire("host", 100000).m_throttled, 50ms);
+}
+
+}
@@ -0,0 +1,180 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/cancellation.hpp"
+#include "libssh_cpp_wrap/command_execution_channel.hpp"
+#include "libssh_cpp_wrap/sftp_channel.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    using namespace std::chrono_literals;
+
+    /**
+     * \brief a localhost port completing tcp handshakes without ever answering
+     */
+    class SilentPort
+    {
+    public:
+        SilentPort()
+        {
+            m_socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (m_socket < 0
+                || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(m_socket, SOMAXCONN) != 0
+                || getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+            {
+                throw std::runtime_error("error listening on localhost");
+            }
+            m_port = ntohs(address.sin_port);
+        }
+
+        SilentPort(SilentPort const&) = delete;
+        SilentPort& operator=(SilentPort const&) = delete;
+
+        ~SilentPort()
+        {
+            close(m_socket);
+        }
+
+        [[nodiscard]] int Port() const noexcept
+        {
+            return m_port;
+        }
+
+    private:
+        int m_socket{ -1 };
+        int m_port{ 0 };
+    };
+
+}
+
+TEST(Cancellation, AbortsTheHandshakeAtTheDeadline)
+{
+    SilentPort port;
+    Session session = Session::Create();
+    session.SetOption(IpV4(127, 0, 0, 1));
+    session.SetOption(Port{ port.Port() });
+    session.SetOption(ProcessConfig{ false });
+
+    auto const start = std::chrono::steady_clock::now();
+    EXPECT_THROW(Connection(std::move(session), start + 200ms), OperationCancelled);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+}
+
+TEST(Cancellation, AbortsCommandsAtTheDeadline)
+{
+    testing::TestServer server;
+    ExecutionChannel channel(Connect(server));
+
+    TransferOptions options;
+    auto const start = std::chrono::steady_clock::now();
+    options.m_deadline = start + 200ms;
+    std::ostringstream out;
+    EXPECT_THROW(channel.Execute("sleep 10", out, out, options), OperationCancelled);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+}
+
+TEST(Cancellation, AbortsTransfersOnStopRequests)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << std::string(2000000, 'x');
+    }
+
+    testing::TestServerOptions serverOptions;
+    serverOptions.m_bytesPerSecond = 200000;
+    testing::TestServer server(serverOptions);
+    SftpChannel sftp(Connect(server));
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+
+    std::stop_source stop;
+    TransferOptions options;
+    options.m_stopToken = stop.get_token();
+    std::thread stopper([&stop]
+        {
+            std::this_thread::sleep_for(100ms);
+            stop.request_stop();
+        });
+
+    std::ostringstream out;
+    EXPECT_THROW(file.Read(out, options), OperationCancelled);
+    stopper.join();
+    EXPECT_LT(out.str().size(), 2000000u);
+}
+
+TEST(Cancellation, LeavesOperationsFinishingInTimeAlone)
+{
+    testing::TestServer server;
+    auto connection = Connect(server);
+
+    TransferOptions options;
+    options.m_deadline = std::chrono::steady_clock::now() + 10s;
+    std::ostringstream out;
+    ExecutionChannel(connection).Execute("echo first", out, out, options);
+
+    // the connection stays usable after the guarded operation
+    ExecutionChannel(connection).Execute("echo second", out, out);
+    EXPECT_EQ(out.str(), "first\nsecond\n");
+}
+
+TEST(Cancellation, ScopeAbortsOperationsWithoutDeadlineParameter)
+{
+    testing::TestServerOptions serverOptions;
+    serverOptions.m_requestDelay = 2s;
+    testing::TestServer server(serverOptions);
+    auto connection = Connect(server);
+
+    CancellationScope scope(connection, 200ms);
+    auto const start = std::chrono::steady_clock::now();
+    EXPECT_THROW(SftpChannel{ connection }, std::runtime_error);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1500ms);
+    EXPECT_TRUE(scope.Cancelled());
+    EXPECT_THROW(scope.ThrowIfCancelled(), OperationCancelled);
+}
+
+}
@@ -0,0 +1,61 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/cipher_autotuner.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+TEST(CipherAutotuner, FailingProbeSkipsTheSuite)
+{
+    testing::TestServerOptions options;
+    options.m_commandHandler = [](std::string const&)
+        {
+            return testing::CommandResult{ "", "sh: head: not found", 127 };
+        };
+    testing::TestServer server(options);
+
+    CipherAutotuner tuner({ { "aes128-ctr", "hmac-sha2-256" }, { "aes256-ctr", "hmac-sha2-256" } }, 1024);
+    std::optional<CipherSuite> result;
+    EXPECT_NO_THROW(result = tuner.Tune("test", [&server] { return CreateSession(server); },
+                                        [&server](Connection&& connection) { return Authenticate(server, std::move(connection)); }));
+    EXPECT_FALSE(result.has_value());
+    EXPECT_FALSE(tuner.Lookup("test").has_value());
+}
+
+TEST(CipherAutotuner, PicksAnAcceptedSuite)
+{
+    testing::TestServer server;
+
+    CipherAutotuner tuner({ { "aes128-ctr", "hmac-sha2-256" } }, 65536);
+    auto const result = tuner.Tune("test", [&server] { return CreateSession(server); },
+                                   [&server](Connection&& connection) { return Authenticate(server, std::move(connection)); });
+    ASSERT_TRUE(result.has_value());
+    EXPECT_EQ(result->m_cipher, "aes128-ctr");
+}
+
+}
@@ -0,0 +1,169 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/connection_actor.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    std::string Content(size_t size)
+    {
+        std::string content;
+        for (size_t i = 0; content.size() < size; ++i)
+        {
+            content += std::to_string(i) + '\n';
+        }
+        return content;
+    }
+
+    std::string ReadFile(std::filesystem::path const& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+}
+
+TEST(ConnectionActor, ExecutesCommands)
+{
+    testing::TestServer server;
+    ConnectionActor actor(Connect(server));
+
+    std::ostringstream out;
+    std::ostringstream err;
+    EXPECT_EQ(actor.Execute("echo out; echo err >&2; exit 3", out, err).get(), 3);
+    EXPECT_EQ(out.str(), "out\n");
+    EXPECT_EQ(err.str(), "err\n");
+}
+
+TEST(ConnectionActor, UploadsAndDownloads)
+{
+    TemporaryDirectory directory;
+    auto const remotePath = (directory.Path() / "file").string();
+    auto const content = Content(300000);
+
+    testing::TestServer server;
+    // small chunks and few outstanding requests, so the transfers take many steps
+    ConnectionActor actor(Connect(server), 1000, 3);
+
+    std::istringstream in(content);
+    EXPECT_EQ(actor.Upload(in, remotePath, 0644).get(), content.size());
+    EXPECT_EQ(ReadFile(remotePath), content);
+
+    std::ostringstream out;
+    EXPECT_EQ(actor.Download(remotePath, out).get(), content.size());
+    EXPECT_EQ(out.str(), content);
+}
+
+TEST(ConnectionActor, FailsTransfersOfMissingFiles)
+{
+    TemporaryDirectory directory;
+
+    testing::TestServer server;
+    ConnectionActor actor(Connect(server));
+
+    std::ostringstream out;
+    auto download = actor.Download((directory.Path() / "missing").string(), out);
+    EXPECT_THROW(download.get(), std::runtime_error);
+
+    // the actor stays usable
+    std::ostringstream err;
+    EXPECT_EQ(actor.Execute("echo still alive", out, err).get(), 0);
+    EXPECT_EQ(out.str(), "still alive\n");
+}
+
+TEST(ConnectionActor, InterleavesConcurrentJobs)
+{
+    TemporaryDirectory directory;
+    auto const content = Content(200000);
+
+    testing::TestServer server;
+    ConnectionActor actor(Connect(server), 4096, 4);
+
+    std::vector<std::istringstream> inputs;
+    std::vector<std::future<uint64_t>> uploads;
+    inputs.reserve(3);
+    for (size_t i = 0; i != 3; ++i)
+    {
+        auto& in = inputs.emplace_back(content);
+        uploads.push_back(actor.Upload(in, (directory.Path() / std::to_string(i)).string(), 0644));
+    }
+
+    std::vector<std::ostringstream> outputs(5);
+    std::ostringstream err;
+    std::vector<std::future<int>> commands;
+    for (size_t i = 0; i != outputs.size(); ++i)
+    {
+        commands.push_back(actor.Execute("echo " + std::to_string(i), outputs[i], err));
+    }
+
+    for (size_t i = 0; i != commands.size(); ++i)
+    {
+        EXPECT_EQ(commands[i].get(), 0);
+        EXPECT_EQ(outputs[i].str(), std::to_string(i) + '\n');
+    }
+    for (size_t i = 0; i != uploads.size(); ++i)
+    {
+        EXPECT_EQ(uploads[i].get(), content.size());
+        EXPECT_EQ(ReadFile(directory.Path() / std::to_string(i)), content);
+    }
+}
+
+TEST(ConnectionActor, ServicesCommandsAheadOfTransfers)
+{
+    TemporaryDirectory directory;
+    auto const content = Content(4000000);
+
+    testing::TestServerOptions options;
+    options.m_bytesPerSecond = 2000000;
+    testing::TestServer server(options);
+    ConnectionActor actor(Connect(server));
+
+    std::istringstream in(content);
+    auto upload = actor.Upload(in, (directory.Path() / "file").string(), 0644);
+
+    std::ostringstream out;
+    std::ostringstream err;
+    EXPECT_EQ(actor.Execute("echo interactive", out, err, PriorityClass::Interactive).get(), 0);
+    EXPECT_EQ(out.str(), "interactive\n");
+    EXPECT_EQ(upload.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+    EXPECT_EQ(upload.get(), content.size());
+}
+
+}
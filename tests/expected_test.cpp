@@ -0,0 +1,57 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/expected.hpp"
+
+namespace libssh_wrap::tests
+{
+
+TEST(Expected, ValueThrowsTheErrorOfTheOperation)
+{
+    Expected<int> failed = Unexpected(SshError("error opening file", SSH_FATAL, SshError::NoSftpStatus, "no such file"));
+    try
+    {
+        (void) failed.value();
+        FAIL() << "value() returned despite the error";
+    }
+    catch (std::runtime_error const& e)
+    {
+        EXPECT_EQ(std::string(e.what()), "error opening file: no such file");
+    }
+    EXPECT_THROW(ValueOrThrow(std::move(failed)), std::runtime_error);
+
+    Expected<int> succeeded = 42;
+    EXPECT_EQ(succeeded.value(), 42);
+}
+
+TEST(Expected, ValueThrowsOperationCancelledForCancelledOperations)
+{
+    Expected<void> cancelled = Unexpected(SshError::Cancelled(detail::CancelReason::Deadline));
+    EXPECT_THROW(cancelled.value(), OperationCancelled);
+    EXPECT_THROW(ValueOrThrow(cancelled), OperationCancelled);
+    EXPECT_NO_THROW(Expected<void>().value());
+}
+
+}
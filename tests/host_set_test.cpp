@@ -0,0 +1,134 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/host_set.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    IpV4Range Range(IpV4 first, IpV4 last)
+    {
+        return { first.ToUInt32(), last.ToUInt32() };
+    }
+
+}
+
+TEST(HostSet, ParsesAllEntryForms)
+{
+    auto const set = HostSet::Parse("10.0.0.1, 10.0.1.0/30\n10.0.2.1-10.0.2.3 # comment, 10.9.9.9\n\t10.0.3.5-7\r\n");
+    std::vector<IpV4Range> const expected{
+        Range(IpV4(10, 0, 0, 1), IpV4(10, 0, 0, 1)),
+        Range(IpV4(10, 0, 1, 0), IpV4(10, 0, 1, 3)),
+        Range(IpV4(10, 0, 2, 1), IpV4(10, 0, 2, 3)),
+        Range(IpV4(10, 0, 3, 5), IpV4(10, 0, 3, 7)),
+    };
+    EXPECT_EQ(set.Ranges(), expected);
+    EXPECT_EQ(set.Size(), 11u);
+    EXPECT_FALSE(set.Contains(IpV4(10, 9, 9, 9)));
+}
+
+TEST(HostSet, MergesOverlappingAndAdjacentRanges)
+{
+    auto const set = HostSet::Parse("10.0.0.5-10 10.0.0.0-4 10.0.0.8-20 10.0.0.22");
+    std::vector<IpV4Range> const expected{
+        Range(IpV4(10, 0, 0, 0), IpV4(10, 0, 0, 20)),
+        Range(IpV4(10, 0, 0, 22), IpV4(10, 0, 0, 22)),
+    };
+    EXPECT_EQ(set.Ranges(), expected);
+}
+
+TEST(HostSet, RejectsInvalidEntries)
+{
+    for (char const* entry : { "10.0.0", "10.0.0.256", "10.0.0.5-3", "10.0.0.0/33", "10.0.0.0/", "10.0.0.1-", "host.example.com", "10.0.0.1/24x" })
+    {
+        EXPECT_THROW((void) HostSet::Parse(entry), std::runtime_error) << entry;
+    }
+
+    try
+    {
+        (void) HostSet::Parse("10.0.0.1\n# comment\n10.0.0.1-0\n");
+        FAIL() << "no exception thrown";
+    }
+    catch (std::runtime_error const& e)
+    {
+        EXPECT_NE(std::string(e.what()).find("line 3"), std::string::npos) << e.what();
+    }
+}
+
+TEST(HostSet, CombinesSets)
+{
+    auto const a = HostSet::Parse("10.0.0.0-10 10.0.0.20-30");
+    auto const b = HostSet::Parse("10.0.0.5-25");
+
+    EXPECT_EQ(a | b, HostSet::Parse("10.0.0.0-30"));
+    EXPECT_EQ(a & b, HostSet::Parse("10.0.0.5-10 10.0.0.20-25"));
+    EXPECT_EQ(a - b, HostSet::Parse("10.0.0.0-4 10.0.0.26-30"));
+    EXPECT_EQ(b - a, HostSet::Parse("10.0.0.11-19"));
+    EXPECT_TRUE((a - a).Empty());
+}
+
+TEST(HostSet, HandlesTheEdgesOfTheAddressSpace)
+{
+    auto const all = HostSet::Parse("0.0.0.0/0");
+    EXPECT_EQ(all.Size(), uint64_t(1) << 32);
+
+    auto const rest = all - HostSet::Parse("0.0.0.0 255.255.255.255");
+    EXPECT_EQ(rest.Size(), (uint64_t(1) << 32) - 2);
+    EXPECT_FALSE(rest.Contains(IpV4(255, 255, 255, 255)));
+    EXPECT_TRUE(rest.Contains(IpV4(255, 255, 255, 254)));
+}
+
+TEST(HostSet, IteratesAcrossRanges)
+{
+    auto const set = HostSet::Parse("10.0.0.255 10.0.1.0-1 10.0.2.7");
+    std::vector<IpV4> addresses(set.begin(), set.end());
+    std::vector<IpV4> const expected{ IpV4(10, 0, 0, 255), IpV4(10, 0, 1, 0), IpV4(10, 0, 1, 1), IpV4(10, 0, 2, 7) };
+    EXPECT_EQ(addresses, expected);
+}
+
+TEST(HostSet, ShardsPartitionTheSet)
+{
+    auto const set = HostSet::Parse("10.0.0.0/28 10.0.1.3 10.0.2.0-10.0.2.6");
+    for (size_t count = 1; count != 8; ++count)
+    {
+        HostSet covered;
+        for (size_t index = 0; index != count; ++index)
+        {
+            auto const shard = set.Shard(index, count);
+            EXPECT_TRUE((covered & shard).Empty());
+            EXPECT_LE(shard.Size(), set.Size() / count + 1);
+            EXPECT_GE(shard.Size(), set.Size() / count);
+            covered = covered | shard;
+        }
+        EXPECT_EQ(covered, set);
+    }
+    EXPECT_THROW((void) set.Shard(2, 2), std::out_of_range);
+}
+
+}
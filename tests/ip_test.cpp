@@ -0,0 +1,58 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/ip.hpp"
+
+namespace libssh_wrap::tests
+{
+
+TEST(IpV6, ParsesCompressedAddresses)
+{
+    EXPECT_EQ(std::string(IpV6("2001:db8::1")), "2001:db8::1");
+    EXPECT_EQ(std::string(IpV6("::1")), "::1");
+    EXPECT_EQ(std::string(IpV6("1:2:3:4:5:6:7::")), "1:2:3:4:5:6:7:0");
+    EXPECT_EQ(std::string(IpV6("::2:3:4:5:6:7:8")), "0:2:3:4:5:6:7:8");
+    EXPECT_EQ(std::string(IpV6("1:2:3:4:5:6:7:8")), "1:2:3:4:5:6:7:8");
+    EXPECT_EQ(IpV6("::ffff:192.0.2.1"), IpV6::MappedIpV4(IpV4(192, 0, 2, 1)));
+}
+
+TEST(IpV6, RejectsGapWithoutMissingGroups)
+{
+    EXPECT_EQ(IpV6("1:2:3:4:5:6:7:8::"), IpV6());
+    EXPECT_EQ(IpV6("::1:2:3:4:5:6:7:8"), IpV6());
+    EXPECT_EQ(IpV6("1:2:3:4::5:6:7:8"), IpV6());
+}
+
+TEST(IpV6, RejectsMalformedAddresses)
+{
+    EXPECT_EQ(IpV6("1::2::3"), IpV6());
+    EXPECT_EQ(IpV6("1:2:3:4:5:6:7"), IpV6());
+    EXPECT_EQ(IpV6("1:2:3:4:5:6:7:8:9"), IpV6());
+    EXPECT_EQ(IpV6(":1::"), IpV6());
+    EXPECT_EQ(IpV6("1:"), IpV6());
+    EXPECT_EQ(IpV6("12345::"), IpV6());
+    EXPECT_EQ(IpV6("1:2:3:4:5:6:7:1.2.3.4"), IpV6());
+}
+
+}
@@ -0,0 +1,184 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "libssh_cpp_wrap/known_hosts.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    constexpr char const* Key1 = "AAAAC3NzaC1lZDI1NTE5AAAAIKey1";
+    constexpr char const* Key2 = "AAAAC3NzaC1lZDI1NTE5AAAAIKey2";
+
+    std::string EncodeBase64(std::string const& data)
+    {
+        std::string result(4 * ((data.size() + 2) / 3), '\0');
+        EVP_EncodeBlock(reinterpret_cast<unsigned char*>(result.data()), reinterpret_cast<unsigned char const*>(data.data()),
+                        static_cast<int>(data.size()));
+        return result;
+    }
+
+    /**
+     * \return the host field ssh-keygen -H writes for \p name
+     */
+    std::string HashHost(std::string const& name, std::string const& salt)
+    {
+        std::array<unsigned char, EVP_MAX_MD_SIZE> digest;
+        unsigned int digestLength = 0;
+        HMAC(EVP_sha1(), salt.data(), static_cast<int>(salt.size()), reinterpret_cast<unsigned char const*>(name.data()),
+             name.size(), digest.data(), &digestLength);
+        return "|1|" + EncodeBase64(salt) + '|' + EncodeBase64(std::string(reinterpret_cast<char const*>(digest.data()), digestLength));
+    }
+
+    std::vector<std::string> KeysOf(detail::KnownHostsData const& data, std::string const& name)
+    {
+        std::vector<std::string> result;
+        for (auto const& key : *data.Find(name))
+        {
+            result.push_back(key.m_key);
+        }
+        return result;
+    }
+
+    class KnownHostsFile
+    {
+    public:
+        explicit KnownHostsFile(std::string const& content)
+            : m_index(m_directory.Path() / "known_hosts")
+        {
+            Write(content);
+        }
+
+        void Write(std::string const& content)
+        {
+            std::ofstream(m_index.Path(), std::ios::binary | std::ios::trunc) << content;
+            // the index only reparses the file after its modification time changed
+            std::filesystem::last_write_time(m_index.Path(), std::filesystem::file_time_type::clock::now() + std::chrono::seconds(++m_writes));
+        }
+
+        KnownHostsIndex const& Index() const noexcept
+        {
+            return m_index;
+        }
+
+    private:
+        TemporaryDirectory m_directory;
+        KnownHostsIndex m_index;
+        int m_writes{ 0 };
+    };
+
+}
+
+TEST(KnownHostsData, FindsPlainEntries)
+{
+    std::istringstream input(std::string("# comment\n\nhost1,host2 ssh-ed25519 ") + Key1 + " user@host\n[host1]:2222 ssh-ed25519 " + Key2 + '\n');
+    detail::KnownHostsData const data(input);
+
+    EXPECT_EQ(KeysOf(data, "host1"), std::vector<std::string>{ Key1 });
+    EXPECT_EQ(KeysOf(data, "host2"), std::vector<std::string>{ Key1 });
+    EXPECT_EQ(KeysOf(data, "[host1]:2222"), std::vector<std::string>{ Key2 });
+    EXPECT_TRUE(KeysOf(data, "host3").empty());
+}
+
+TEST(KnownHostsData, FindsHashedEntries)
+{
+    std::istringstream input(HashHost("secret.example.com", "0123456789abcdefghij") + " ssh-ed25519 " + Key1 + '\n'
+        + HashHost("[secret.example.com]:2222", "jihgfedcba9876543210") + " ssh-ed25519 " + Key2 + '\n');
+    detail::KnownHostsData const data(input);
+
+    EXPECT_EQ(KeysOf(data, "secret.example.com"), std::vector<std::string>{ Key1 });
+    EXPECT_EQ(KeysOf(data, "[secret.example.com]:2222"), std::vector<std::string>{ Key2 });
+    EXPECT_TRUE(KeysOf(data, "other.example.com").empty());
+}
+
+TEST(KnownHostsData, MatchesWildcardsAndNegations)
+{
+    std::istringstream input(std::string("*.example.com,!bad.example.com ssh-ed25519 ") + Key1 + "\nweb?? ssh-ed25519 " + Key2 + '\n');
+    detail::KnownHostsData const data(input);
+
+    EXPECT_EQ(KeysOf(data, "good.example.com"), std::vector<std::string>{ Key1 });
+    EXPECT_TRUE(KeysOf(data, "bad.example.com").empty());
+    EXPECT_TRUE(KeysOf(data, "example.com").empty());
+    EXPECT_EQ(KeysOf(data, "web01"), std::vector<std::string>{ Key2 });
+    EXPECT_TRUE(KeysOf(data, "web1").empty());
+}
+
+TEST(KnownHostsData, IgnoresMalformedAndCertAuthorityLines)
+{
+    std::istringstream input(std::string("@cert-authority *.example.com ssh-ed25519 ") + Key1 + "\nhost1 ssh-ed25519\n|1|broken ssh-ed25519 " + Key2 + '\n');
+    detail::KnownHostsData const data(input);
+
+    EXPECT_TRUE(KeysOf(data, "a.example.com").empty());
+    EXPECT_TRUE(KeysOf(data, "host1").empty());
+}
+
+TEST(KnownHostsIndex, ChecksKeys)
+{
+    KnownHostsFile file(std::string("host1 ssh-ed25519 ") + Key1 + "\n[host1]:2222 ssh-ed25519 " + Key2 + '\n');
+
+    EXPECT_EQ(file.Index().Check("host1", 22, Key1), HostKeyStatus::Known);
+    EXPECT_EQ(file.Index().Check("host1", 22, Key2), HostKeyStatus::Changed);
+    EXPECT_EQ(file.Index().Check("host1", 2222, Key2), HostKeyStatus::Known);
+    EXPECT_EQ(file.Index().Check("host2", 22, Key1), HostKeyStatus::Unknown);
+}
+
+TEST(KnownHostsIndex, ReportsRevokedKeys)
+{
+    KnownHostsFile file(std::string("@revoked * ssh-ed25519 ") + Key1 + "\nhost1 ssh-ed25519 " + Key1 + "\nhost2 ssh-ed25519 " + Key2 + '\n');
+
+    EXPECT_EQ(file.Index().Check("host1", 22, Key1), HostKeyStatus::Revoked);
+    EXPECT_EQ(file.Index().Check("host2", 22, Key1), HostKeyStatus::Revoked);
+    EXPECT_EQ(file.Index().Check("host2", 22, Key2), HostKeyStatus::Known);
+}
+
+TEST(KnownHostsIndex, ReparsesModifiedFiles)
+{
+    KnownHostsFile file(std::string("host1 ssh-ed25519 ") + Key1 + '\n');
+    EXPECT_EQ(file.Index().Check("host1", 22, Key2), HostKeyStatus::Changed);
+
+    file.Write(std::string("host1 ssh-ed25519 ") + Key2 + '\n');
+    EXPECT_EQ(file.Index().Check("host1", 22, Key2), HostKeyStatus::Known);
+}
+
+TEST(KnownHostsIndex, TreatsMissingFilesAsEmpty)
+{
+    TemporaryDirectory directory;
+    KnownHostsIndex const index(directory.Path() / "missing");
+    EXPECT_EQ(index.Check("host1", 22, Key1), HostKeyStatus::Unknown);
+}
+
+}
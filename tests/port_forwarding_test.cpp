@@ -0,0 +1,369 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/port_forwarding.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    /**
+     * \brief a tcp server on localhost sending back everything it receives
+     */
+    class EchoServer
+    {
+    public:
+        EchoServer()
+        {
+            m_socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (m_socket < 0
+                || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(m_socket, SOMAXCONN) != 0
+                || getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+            {
+                throw std::runtime_error("error starting the echo server");
+            }
+            m_port = ntohs(address.sin_port);
+            m_thread = std::thread(&EchoServer::Run, this);
+        }
+
+        EchoServer(EchoServer const&) = delete;
+        EchoServer& operator=(EchoServer const&) = delete;
+
+        ~EchoServer()
+        {
+            m_stop = true;
+            m_thread.join();
+            for (auto& connection : m_connections)
+            {
+                connection.join();
+            }
+            close(m_socket);
+        }
+
+        [[nodiscard]] int Port() const noexcept
+        {
+            return m_port;
+        }
+
+    private:
+        void Run()
+        {
+            while (!m_stop)
+            {
+                pollfd listenFd{ m_socket, POLLIN, 0 };
+                if (poll(&listenFd, 1, 50) <= 0)
+                {
+                    continue;
+                }
+                int const connection = accept(m_socket, nullptr, nullptr);
+                if (connection >= 0)
+                {
+                    m_connections.emplace_back([connection]
+                        {
+                            char buffer[16384];
+                            ssize_t count;
+                            while ((count = recv(connection, buffer, sizeof(buffer), 0)) > 0)
+                            {
+                                for (ssize_t sent = 0; sent < count;)
+                                {
+                                    auto const written = send(connection, buffer + sent, static_cast<size_t>(count - sent), MSG_NOSIGNAL);
+                                    if (written <= 0)
+                                    {
+                                        close(connection);
+                                        return;
+                                    }
+                                    sent += written;
+                                }
+                            }
+                            close(connection);
+                        });
+                }
+            }
+        }
+
+        int m_socket{ -1 };
+        int m_port{ 0 };
+        std::atomic<bool> m_stop{ false };
+        std::thread m_thread;
+        std::vector<std::thread> m_connections;
+    };
+
+    /**
+     * \brief a localhost port whose accept queue is full, so further connection attempts hang
+     */
+    class FullListener
+    {
+    public:
+        FullListener()
+        {
+            m_socket = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            socklen_t length = sizeof(address);
+            if (m_socket < 0
+                || bind(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+                || listen(m_socket, 0) != 0
+                || getsockname(m_socket, reinterpret_cast<sockaddr*>(&address), &length) != 0)
+            {
+                throw std::runtime_error("error listening on localhost");
+            }
+            m_port = ntohs(address.sin_port);
+
+            // connections never accepted fill the queue
+            for (int i = 0; i != 4; ++i)
+            {
+                int const client = socket(AF_INET, SOCK_STREAM, 0);
+                fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+                m_clients.push_back(client);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        FullListener(FullListener const&) = delete;
+        FullListener& operator=(FullListener const&) = delete;
+
+        ~FullListener()
+        {
+            for (int client : m_clients)
+            {
+                close(client);
+            }
+            close(m_socket);
+        }
+
+        [[nodiscard]] int Port() const noexcept
+        {
+            return m_port;
+        }
+
+    private:
+        int m_socket{ -1 };
+        int m_port{ 0 };
+        std::vector<int> m_clients;
+    };
+
+    int ConnectLocalhost(int port)
+    {
+        int const result = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (result < 0 || connect(result, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            throw std::runtime_error("error connecting to localhost");
+        }
+        return result;
+    }
+
+    /**
+     * \brief sends \p data through \p socket and returns everything received until the peer closes the connection
+     */
+    std::string RoundTrip(int socket, std::string const& data)
+    {
+        std::thread sender([socket, &data]
+            {
+                size_t sent = 0;
+                while (sent < data.size())
+                {
+                    auto const count = send(socket, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                    if (count <= 0)
+                    {
+                        break;
+                    }
+                    sent += static_cast<size_t>(count);
+                }
+                shutdown(socket, SHUT_WR);
+            });
+
+        std::string received;
+        char buffer[16384];
+        ssize_t count;
+        while ((count = recv(socket, buffer, sizeof(buffer), 0)) > 0)
+        {
+            received.append(buffer, static_cast<size_t>(count));
+        }
+        sender.join();
+        close(socket);
+        return received;
+    }
+
+    std::string Content(size_t size)
+    {
+        std::string content;
+        for (size_t i = 0; content.size() < size; ++i)
+        {
+            content += std::to_string(i) + '\n';
+        }
+        return content;
+    }
+
+    bool WaitForNoConnections(PortForwarder const& forwarder)
+    {
+        auto const end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (forwarder.ActiveConnections() != 0)
+        {
+            if (std::chrono::steady_clock::now() > end)
+            {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+}
+
+TEST(PortForwarder, RelaysLocalForwards)
+{
+    testing::TestServer server;
+    EchoServer echo;
+    PortForwarder forwarder(Connect(server));
+
+    LocalForward forward;
+    forward.m_remoteHost = "127.0.0.1";
+    forward.m_remotePort = echo.Port();
+    int const port = forwarder.AddLocalForward(forward);
+
+    auto const content = Content(1000000);
+    EXPECT_EQ(RoundTrip(ConnectLocalhost(port), content), content);
+    EXPECT_TRUE(WaitForNoConnections(forwarder));
+    EXPECT_TRUE(forwarder.IsRunning());
+}
+
+TEST(PortForwarder, RelaysConcurrentConnections)
+{
+    testing::TestServer server;
+    EchoServer echo;
+    // a small buffer, so the relays take turns many times
+    PortForwarder forwarder(Connect(server), 4096);
+
+    LocalForward forward;
+    forward.m_remoteHost = "127.0.0.1";
+    forward.m_remotePort = echo.Port();
+    int const port = forwarder.AddLocalForward(forward);
+
+    std::vector<std::string> results(4);
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i != results.size(); ++i)
+    {
+        clients.emplace_back([&results, i, port] { results[i] = RoundTrip(ConnectLocalhost(port), Content(100000 * (i + 1))); });
+    }
+    for (size_t i = 0; i != clients.size(); ++i)
+    {
+        clients[i].join();
+        EXPECT_EQ(results[i], Content(100000 * (i + 1)));
+    }
+    EXPECT_TRUE(WaitForNoConnections(forwarder));
+}
+
+TEST(PortForwarder, RelaysRemoteForwards)
+{
+    testing::TestServer server;
+    EchoServer echo;
+    PortForwarder forwarder(Connect(server));
+
+    RemoteForward forward;
+    forward.m_bindAddress = "127.0.0.1";
+    forward.m_targetHost = "127.0.0.1";
+    forward.m_targetPort = echo.Port();
+    int const port = forwarder.AddRemoteForward(forward).get();
+    ASSERT_GT(port, 0);
+
+    auto const content = Content(1000000);
+    EXPECT_EQ(RoundTrip(ConnectLocalhost(port), content), content);
+    EXPECT_TRUE(WaitForNoConnections(forwarder));
+    EXPECT_TRUE(forwarder.IsRunning());
+}
+
+TEST(PortForwarder, RejectsLocalForwardsWithoutRemoteHost)
+{
+    testing::TestServer server;
+    PortForwarder forwarder(Connect(server));
+
+    LocalForward forward;
+    forward.m_remotePort = 22;
+    EXPECT_THROW(forwarder.AddLocalForward(forward), std::runtime_error);
+}
+
+TEST(PortForwarder, KeepsRelayingWhileARemoteForwardTargetConnects)
+{
+    testing::TestServer server;
+    EchoServer echo;
+    FullListener unresponsive;
+    PortForwarder forwarder(Connect(server), 65536,
+                            HappyEyeballsOptions{ std::chrono::milliseconds(250), std::chrono::seconds(10), {} });
+
+    RemoteForward remoteForward;
+    remoteForward.m_bindAddress = "127.0.0.1";
+    remoteForward.m_targetHost = "127.0.0.1";
+    remoteForward.m_targetPort = unresponsive.Port();
+    int const remotePort = forwarder.AddRemoteForward(remoteForward).get();
+
+    LocalForward localForward;
+    localForward.m_remoteHost = "127.0.0.1";
+    localForward.m_remotePort = echo.Port();
+    int const localPort = forwarder.AddLocalForward(localForward);
+
+    // the relay of this connection waits for the target to accept
+    int const pending = ConnectLocalhost(remotePort);
+    auto const end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (forwarder.ActiveConnections() == 0 && std::chrono::steady_clock::now() < end)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(forwarder.ActiveConnections(), 1u);
+
+    auto const start = std::chrono::steady_clock::now();
+    auto const content = Content(100000);
+    EXPECT_EQ(RoundTrip(ConnectLocalhost(localPort), content), content);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    close(pending);
+}
+
+}
@@ -0,0 +1,187 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/resilient_connection.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+#include "libssh_cpp_wrap_testing/wan_proxy.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    /**
+     * \brief a test server reached through a proxy, which can be restarted to drop the client connections
+     */
+    class DroppableServer
+    {
+    public:
+        DroppableServer()
+            : m_proxy(std::make_unique<testing::WanProxy>(m_server.Address(), m_server.Port())),
+            m_port(m_proxy->Port())
+        {
+        }
+
+        /**
+         * \brief closes all connections; new connections are accepted again, if \p restart is true
+         */
+        void Drop(bool restart = true)
+        {
+            m_proxy.reset();
+            if (restart)
+            {
+                m_proxy = std::make_unique<testing::WanProxy>(m_server.Address(), m_server.Port(), testing::LinkProfile{}, m_port);
+            }
+        }
+
+        ResilientConnection::Factory Factory()
+        {
+            return [this]
+                {
+                    ++m_connects;
+                    return Connect(m_server, m_port);
+                };
+        }
+
+        [[nodiscard]] int Connects() const noexcept
+        {
+            return m_connects;
+        }
+
+    private:
+        testing::TestServer m_server;
+        std::unique_ptr<testing::WanProxy> m_proxy;
+        int m_port;
+        std::atomic<int> m_connects{ 0 };
+    };
+
+    ReconnectPolicy FastPolicy()
+    {
+        ReconnectPolicy policy;
+        policy.m_initialDelay = std::chrono::milliseconds(10);
+        policy.m_maxDelay = std::chrono::milliseconds(50);
+        policy.m_maxAttempts = 3;
+        return policy;
+    }
+
+}
+
+TEST(ResilientConnection, ReplaysIdempotentCommandsAfterADrop)
+{
+    DroppableServer server;
+    ResilientConnection connection(server.Factory(), FastPolicy());
+
+    std::ostringstream out;
+    std::ostringstream err;
+    connection.ExecuteIdempotent("echo before", out, err);
+    EXPECT_EQ(out.str(), "before\n");
+
+    server.Drop();
+    connection.ExecuteIdempotent("echo after", out, err);
+    EXPECT_EQ(out.str(), "before\nafter\n");
+    EXPECT_EQ(server.Connects(), 2);
+}
+
+TEST(ResilientConnection, PassesOnErrorsOfLiveConnections)
+{
+    DroppableServer server;
+    ResilientConnection connection(server.Factory(), FastPolicy());
+
+    int runs = 0;
+    EXPECT_THROW(connection.Run([&runs](std::shared_ptr<AuthenticatedConnection> const&)
+        {
+            ++runs;
+            throw std::runtime_error("operation failed");
+        }), std::runtime_error);
+    EXPECT_EQ(runs, 1);
+    EXPECT_EQ(server.Connects(), 1);
+}
+
+TEST(ResilientConnection, DoesNotReplayForbiddenOperations)
+{
+    DroppableServer server;
+    ResilientConnection connection(server.Factory(), FastPolicy());
+    server.Drop();
+
+    int runs = 0;
+    EXPECT_THROW(connection.Run([&runs](std::shared_ptr<AuthenticatedConnection> const& current)
+        {
+            ++runs;
+            std::ostringstream out;
+            ExecutionChannel(current).Execute("true", out, out);
+        }, Replay::Forbidden), std::runtime_error);
+    EXPECT_EQ(runs, 1);
+
+    // the reconnect happens nonetheless
+    EXPECT_TRUE(connection.Get()->IsConnected());
+    EXPECT_EQ(server.Connects(), 2);
+}
+
+TEST(ResilientConnection, GivesUpAfterMaxAttempts)
+{
+    DroppableServer server;
+    ResilientConnection connection(server.Factory(), FastPolicy());
+    server.Drop(false);
+
+    std::ostringstream out;
+    EXPECT_THROW(connection.ExecuteIdempotent("true", out, out), std::runtime_error);
+    EXPECT_THROW((void) connection.Get(), std::runtime_error);
+    EXPECT_EQ(server.Connects(), 1 + static_cast<int>(FastPolicy().m_maxAttempts));
+}
+
+TEST(ResilientConnection, TransfersFiles)
+{
+    TemporaryDirectory directory;
+    auto const remotePath = (directory.Path() / "file").string();
+    std::string content;
+    for (size_t i = 0; content.size() < 200000; ++i)
+    {
+        content += std::to_string(i) + '\n';
+    }
+
+    DroppableServer server;
+    ResilientConnection connection(server.Factory(), FastPolicy());
+
+    std::istringstream in(content);
+    connection.UploadResumable(in, remotePath.c_str(), 0644);
+    std::ifstream written(remotePath, std::ios::binary);
+    EXPECT_EQ(std::string(std::istreambuf_iterator<char>(written), {}), content);
+
+    std::ostringstream out;
+    connection.DownloadResumable(remotePath.c_str(), out);
+    EXPECT_EQ(out.str(), content);
+}
+
+}
@@ -0,0 +1,81 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <filesystem>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/sftp_batch.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+TEST(SftpBatch, DefaultPredicateReportsErrors)
+{
+    TemporaryDirectory directory;
+    std::filesystem::create_directories(directory.Path() / "existing");
+    auto const existing = (directory.Path() / "existing").string();
+    auto const created = (directory.Path() / "created").string();
+    auto const missing = (directory.Path() / "missing").string();
+
+    testing::TestServer server;
+    SftpChannel channel(Connect(server));
+    SftpBatch batch(channel);
+    batch.MakeDirectory(existing.c_str(), 0755)
+        .MakeDirectory(created.c_str(), 0755)
+        .DeleteFile(missing.c_str())
+        .MakeDirectory(existing.c_str(), 0755, &IgnoreAlreadyExists);
+
+    auto const results = batch.Run();
+    ASSERT_EQ(results.size(), 4u);
+    EXPECT_EQ(results[0].m_status, SSH_FX_FILE_ALREADY_EXISTS);
+    EXPECT_TRUE(results[0].m_failed);
+    EXPECT_EQ(results[1].m_status, SSH_OK);
+    EXPECT_FALSE(results[1].m_failed);
+    EXPECT_NE(results[2].m_status, SSH_OK);
+    EXPECT_TRUE(results[2].m_failed);
+    EXPECT_FALSE(results[3].m_failed);
+    EXPECT_TRUE(std::filesystem::is_directory(created));
+
+    // the channel is still in sync after the batch
+    EXPECT_NO_THROW(channel.MakeDirectory((directory.Path() / "after").string().c_str(), 0755));
+}
+
+TEST(SftpBatch, NullPredicateFallsBackToDefault)
+{
+    TemporaryDirectory directory;
+    auto const missing = (directory.Path() / "missing").string();
+
+    testing::TestServer server;
+    SftpChannel channel(Connect(server));
+    SftpBatch batch(channel);
+    batch.DeleteFile(missing.c_str(), static_cast<bool(*)(int)>(nullptr));
+
+    std::vector<SftpBatchResult> results;
+    EXPECT_NO_THROW(results = batch.Run());
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_TRUE(results[0].m_failed);
+}
+
+}
@@ -0,0 +1,201 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/sftp_pipeline.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+#include "libssh_cpp_wrap_testing/wan_proxy.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    std::string Content(size_t size)
+    {
+        std::string content;
+        for (size_t i = 0; content.size() < size; ++i)
+        {
+            content += std::to_string(i) + '\n';
+        }
+        content.resize(size);
+        return content;
+    }
+
+    std::string ReadFile(std::filesystem::path const& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+    void WriteFile(std::filesystem::path const& path, std::string const& content)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+    }
+
+}
+
+TEST(SftpPipeline, WritesAndReadsFiles)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    // not a multiple of the request size
+    auto const content = Content(1000001);
+
+    testing::TestServer server;
+    SftpChannel sftp(Connect(server));
+    {
+        auto file = sftp.OpenFile(path.c_str(), 0644, FileAccessMode::WriteOnly);
+        SftpPipeline pipeline(file);
+        std::istringstream in(content);
+        EXPECT_EQ(pipeline.Write(in), content.size());
+    }
+    EXPECT_EQ(ReadFile(path), content);
+
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+    SftpPipeline pipeline(file);
+    std::ostringstream out;
+    EXPECT_EQ(pipeline.Read(out), content.size());
+    EXPECT_EQ(out.str(), content);
+}
+
+TEST(SftpPipeline, ContinuesAtTheFilePosition)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    auto const content = Content(200000);
+    WriteFile(path, content);
+
+    testing::TestServer server;
+    SftpChannel sftp(Connect(server));
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+    file.Seek(1000);
+
+    SftpPipelineOptions options;
+    options.m_requestSize = 4096;
+    SftpPipeline pipeline(file, options);
+    std::ostringstream out;
+    EXPECT_EQ(pipeline.Read(out), content.size() - 1000);
+    EXPECT_EQ(out.str(), content.substr(1000));
+    EXPECT_EQ(file.Tell(), content.size());
+}
+
+TEST(SftpPipeline, UsesTheConfiguredDepthWithoutAutoTuning)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    auto const content = Content(300000);
+    WriteFile(path, content);
+
+    testing::TestServer server;
+    SftpChannel sftp(Connect(server));
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+
+    SftpPipelineOptions options;
+    options.m_requestSize = 8192;
+    options.m_maxOutstanding = 8;
+    options.m_autoTune = false;
+    SftpPipeline pipeline(file, options);
+    EXPECT_EQ(pipeline.Outstanding(), 8u);
+
+    std::ostringstream out;
+    EXPECT_EQ(pipeline.Read(out), content.size());
+    EXPECT_EQ(out.str(), content);
+    EXPECT_EQ(pipeline.Outstanding(), 8u);
+}
+
+TEST(SftpPipeline, AutoTuningGrowsTheDepthOnSlowLinks)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    auto const content = Content(2000000);
+    WriteFile(path, content);
+
+    testing::TestServer server;
+    testing::LinkProfile profile;
+    profile.m_roundTripTime = std::chrono::milliseconds(20);
+    testing::WanProxy proxy(server.Address(), server.Port(), profile);
+    SftpChannel sftp(Connect(server, proxy.Port()));
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+
+    SftpPipelineOptions options;
+    options.m_requestSize = 16384;
+    SftpPipeline pipeline(file, options);
+    EXPECT_EQ(pipeline.Outstanding(), SftpPipeline::InitialOutstanding);
+
+    std::ostringstream out;
+    EXPECT_EQ(pipeline.Read(out), content.size());
+    EXPECT_EQ(out.str(), content);
+    EXPECT_GT(pipeline.Outstanding(), SftpPipeline::InitialOutstanding);
+    EXPECT_LE(pipeline.Outstanding(), options.m_maxOutstanding);
+    EXPECT_GE(pipeline.MinRoundTrip(), std::chrono::milliseconds(15));
+}
+
+TEST(SftpPipeline, ReportsFailedRequestsAndKeepsTheSessionUsable)
+{
+    TemporaryDirectory directory;
+    auto const path = (directory.Path() / "file").string();
+    auto const content = Content(100000);
+    WriteFile(path, content);
+
+    testing::TestServer server;
+    SftpChannel sftp(Connect(server));
+    {
+        // the writes to a read only handle fail, while many more are outstanding
+        auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+        SftpPipelineOptions options;
+        options.m_requestSize = 4096;
+        options.m_maxOutstanding = 16;
+        options.m_autoTune = false;
+        SftpPipeline pipeline(file, options);
+        std::istringstream in(Content(1000000));
+        try
+        {
+            (void) pipeline.Write(in);
+            FAIL() << "no exception thrown";
+        }
+        catch (std::runtime_error const& e)
+        {
+            EXPECT_NE(std::string(e.what()).find("sftp status"), std::string::npos) << e.what();
+        }
+    }
+
+    // no reply of the failed transfer is left for the next requests
+    auto file = sftp.OpenFile(path.c_str(), 0, FileAccessMode::ReadOnly);
+    SftpPipeline pipeline(file);
+    std::ostringstream out;
+    EXPECT_EQ(pipeline.Read(out), content.size());
+    EXPECT_EQ(out.str(), content);
+}
+
+}
@@ -0,0 +1,239 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh_cpp_wrap/tar.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+namespace
+{
+
+    /**
+     * \brief collects the archive written by a TarWriter
+     */
+    struct Archive
+    {
+        std::string m_data;
+        detail::TarWriter m_writer{ [this](char const* data, size_t size) { m_data.append(data, size); } };
+
+        void AddFile(std::string const& name, std::string const& contents)
+        {
+            std::istringstream in(contents);
+            char buffer[512];
+            m_writer.AddFile(name, 0644, contents.size(), 0, in, buffer, sizeof(buffer));
+        }
+
+        /**
+         * \brief extracts the archive to \p directory feeding it in small pieces
+         */
+        void ExtractTo(std::filesystem::path const& directory)
+        {
+            m_writer.Finish();
+            detail::TarReader reader(directory);
+            for (size_t pos = 0; pos < m_data.size(); pos += 100)
+            {
+                reader.Feed(m_data.data() + pos, (std::min)(size_t(100), m_data.size() - pos));
+            }
+            reader.Finish();
+        }
+    };
+
+    /**
+     * \return a ustar header of \p type announcing \p size bytes followed by \p contents padded to whole blocks
+     */
+    std::string RawEntry(char type, std::string const& contents, uint64_t size)
+    {
+        std::string header(detail::TarBlockSize, '\0');
+        std::memcpy(header.data(), "entry", 5);
+        std::snprintf(header.data() + 100, 8, "%07o", 0644);
+        std::snprintf(header.data() + 124, 12, "%011llo", static_cast<unsigned long long>(size));
+        std::snprintf(header.data() + 136, 12, "%011o", 0);
+        header[156] = type;
+        std::memcpy(header.data() + 257, "ustar", 6);
+        std::memcpy(header.data() + 263, "00", 2);
+        std::memset(header.data() + 148, ' ', 8);
+        unsigned checksum = 0;
+        for (char c : header)
+        {
+            checksum += static_cast<unsigned char>(c);
+        }
+        std::snprintf(header.data() + 148, 8, "%06o", checksum);
+
+        auto const padding = (detail::TarBlockSize - contents.size() % detail::TarBlockSize) % detail::TarBlockSize;
+        return header + contents + std::string(padding, '\0');
+    }
+
+    /**
+     * \return the pax record "<length> <key>=<value>\n"
+     */
+    std::string PaxRecord(std::string const& key, std::string const& value)
+    {
+        auto const body = ' ' + key + '=' + value + '\n';
+        auto length = body.size() + 1;
+        while (std::to_string(length).size() + body.size() != length)
+        {
+            ++length;
+        }
+        return std::to_string(length) + body;
+    }
+
+    /**
+     * \brief extracts \p data followed by the end of archive marker to \p directory
+     */
+    void Extract(std::string const& data, std::filesystem::path const& directory)
+    {
+        detail::TarReader reader(directory);
+        reader.Feed(data.data(), data.size());
+        std::string const end(2 * detail::TarBlockSize, '\0');
+        reader.Feed(end.data(), end.size());
+        reader.Finish();
+    }
+
+    std::string ReadFile(std::filesystem::path const& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+}
+
+TEST(TarReader, ExtractsFilesDirectoriesAndLinks)
+{
+    TemporaryDirectory directory;
+    Archive archive;
+    archive.m_writer.AddDirectory("sub", 0755, 0);
+    archive.AddFile("sub/file", "contents");
+    archive.m_writer.AddSymlink("link", "sub/file", 0);
+    archive.AddFile(std::string(150, 'n'), "long name");
+    archive.ExtractTo(directory.Path());
+
+    EXPECT_EQ(ReadFile(directory.Path() / "sub" / "file"), "contents");
+    EXPECT_EQ(std::filesystem::read_symlink(directory.Path() / "link"), "sub/file");
+    EXPECT_EQ(ReadFile(directory.Path() / std::string(150, 'n')), "long name");
+}
+
+TEST(TarReader, RejectsPathsLeavingTheDirectory)
+{
+    TemporaryDirectory directory;
+    Archive archive;
+    archive.AddFile("../escape", "x");
+    EXPECT_THROW(archive.ExtractTo(directory.Path() / "target"), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(directory.Path() / "escape"));
+}
+
+TEST(TarReader, DoesNotWriteThroughExtractedSymlinks)
+{
+    TemporaryDirectory directory;
+    auto const outside = directory.Path() / "outside";
+    std::filesystem::create_directories(outside);
+
+    Archive archive;
+    archive.m_writer.AddSymlink("evil", outside.string(), 0);
+    archive.AddFile("evil/pwn", "x");
+    EXPECT_THROW(archive.ExtractTo(directory.Path() / "target"), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(outside / "pwn"));
+}
+
+TEST(TarReader, DoesNotCreateDirectoriesThroughExtractedSymlinks)
+{
+    TemporaryDirectory directory;
+    auto const outside = directory.Path() / "outside";
+    std::filesystem::create_directories(outside);
+
+    Archive archive;
+    archive.m_writer.AddSymlink("evil", outside.string(), 0);
+    archive.m_writer.AddDirectory("evil/sub", 0755, 0);
+    EXPECT_THROW(archive.ExtractTo(directory.Path() / "target"), std::runtime_error);
+    EXPECT_FALSE(std::filesystem::exists(outside / "sub"));
+}
+
+TEST(TarReader, ReplacesSymlinkByDirectoryEntry)
+{
+    TemporaryDirectory directory;
+    auto const outside = directory.Path() / "outside";
+    std::filesystem::create_directories(outside);
+    std::filesystem::permissions(outside, std::filesystem::perms::owner_all);
+
+    Archive archive;
+    archive.m_writer.AddSymlink("evil", outside.string(), 0);
+    archive.m_writer.AddDirectory("evil", 0777, 0);
+    archive.ExtractTo(directory.Path() / "target");
+
+    EXPECT_FALSE(std::filesystem::is_symlink(directory.Path() / "target" / "evil"));
+    EXPECT_TRUE(std::filesystem::is_directory(directory.Path() / "target" / "evil"));
+    EXPECT_EQ(std::filesystem::status(outside).permissions(), std::filesystem::perms::owner_all);
+}
+
+TEST(TarReader, AppliesPaxRecords)
+{
+    TemporaryDirectory directory;
+    std::string const name(200, 'p');
+    auto const records = PaxRecord("comment", "ignored") + PaxRecord("path", name);
+    Extract(RawEntry('x', records, records.size()) + RawEntry('0', "contents", 8), directory.Path());
+
+    EXPECT_EQ(ReadFile(directory.Path() / name), "contents");
+}
+
+TEST(TarReader, RejectsMalformedPaxRecords)
+{
+    std::string const malformed[] = {
+        "abc path=x\n",
+        "1 path=x\n",
+        "99999999999999999999999 path=x\n",
+        "5 path=x\n",
+        "12 path=x\n",
+        "path=x\n",
+        PaxRecord("size", "12x"),
+        PaxRecord("size", "-1"),
+        PaxRecord("size", "99999999999999999999999"),
+    };
+    for (auto const& records : malformed)
+    {
+        TemporaryDirectory directory;
+        EXPECT_THROW(Extract(RawEntry('x', records, records.size()) + RawEntry('0', "", 0), directory.Path()), std::runtime_error)
+            << records;
+    }
+}
+
+TEST(TarReader, RejectsOversizedMetadataEntries)
+{
+    for (char const type : { 'L', 'K', 'x' })
+    {
+        TemporaryDirectory directory;
+        detail::TarReader reader(directory.Path());
+        auto const header = RawEntry(type, "", detail::TarReader::MaxMetadataSize + 1);
+        EXPECT_THROW(reader.Feed(header.data(), header.size()), std::runtime_error) << type;
+    }
+}
+
+}
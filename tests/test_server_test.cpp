@@ -0,0 +1,114 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "libssh/libssh.h"
+
+#include "libssh_cpp_wrap/command_execution_channel.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+#include "test_utilities.hpp"
+
+namespace libssh_wrap::tests
+{
+
+TEST(TestServer, ExecutesCommands)
+{
+    testing::TestServer server;
+    auto connection = Connect(server);
+
+    std::ostringstream out;
+    std::ostringstream err;
+    ExecutionChannel channel(connection);
+    channel.Execute("echo out; echo err >&2; exit 3", out, err);
+    EXPECT_EQ(out.str(), "out\n");
+    EXPECT_EQ(err.str(), "err\n");
+}
+
+TEST(TestServer, ForwardsStandardInput)
+{
+    testing::TestServer server;
+
+    // the wrapper has no api for the standard input of commands yet
+    ssh_session session = ssh_new();
+    ASSERT_NE(session, nullptr);
+    char address[IpV4::MaxCStringLength];
+    server.Address().FillToCString(address);
+    int const port = server.Port();
+    ssh_options_set(session, SSH_OPTIONS_HOST, address);
+    ssh_options_set(session, SSH_OPTIONS_PORT, &port);
+    ssh_options_set(session, SSH_OPTIONS_USER, server.Options().m_user.c_str());
+    ASSERT_EQ(ssh_connect(session), SSH_OK);
+    ASSERT_EQ(ssh_userauth_password(session, nullptr, server.Options().m_password.c_str()), SSH_AUTH_SUCCESS);
+
+    ssh_channel channel = ssh_channel_new(session);
+    ASSERT_EQ(ssh_channel_open_session(channel), SSH_OK);
+    ASSERT_EQ(ssh_channel_request_exec(channel, "wc -c"), SSH_OK);
+
+    // more than the channel window, so the forwarding needs to keep up with the client
+    std::string input;
+    for (size_t i = 0; input.size() < 4 * 1024 * 1024; ++i)
+    {
+        input += std::to_string(i) + '\n';
+    }
+    for (size_t written = 0; written != input.size();)
+    {
+        int const count = ssh_channel_write(channel, input.data() + written, static_cast<uint32_t>(input.size() - written));
+        ASSERT_GT(count, 0);
+        written += static_cast<size_t>(count);
+    }
+    ssh_channel_send_eof(channel);
+
+    std::string out;
+    char buffer[256];
+    int count;
+    while ((count = ssh_channel_read(channel, buffer, sizeof(buffer), 0)) > 0)
+    {
+        out.append(buffer, static_cast<size_t>(count));
+    }
+    EXPECT_EQ(std::stoull(out), input.size());
+
+    ssh_channel_close(channel);
+    ssh_channel_free(channel);
+    ssh_disconnect(session);
+    ssh_free(session);
+}
+
+TEST(TestServer, CommandHandlerReplacesTheShell)
+{
+    testing::TestServerOptions options;
+    options.m_commandHandler = [](std::string const& command)
+        {
+            return testing::CommandResult{ "handled " + command, "", 0 };
+        };
+    testing::TestServer server(options);
+    auto connection = Connect(server);
+
+    std::ostringstream out;
+    std::ostringstream err;
+    ExecutionChannel(connection).Execute("anything", out, err);
+    EXPECT_EQ(out.str(), "handled anything");
+}
+
+}
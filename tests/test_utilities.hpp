@@ -0,0 +1,108 @@
+// libssh_cpp_wrap (A C++ wrapper for libssh)
+//
+// Copyright(C) 2022 Fabian Klein
+//
+// This library is free software; you can redistribute itand /or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110 - 1301
+// USA
+
+
+#ifndef LIBSSH_CPP_WRAP_TESTS_TEST_UTILITIES
+#define LIBSSH_CPP_WRAP_TESTS_TEST_UTILITIES
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <unistd.h>
+
+#include "libssh_cpp_wrap/connection.hpp"
+#include "libssh_cpp_wrap/session.hpp"
+#include "libssh_cpp_wrap/session_options.hpp"
+#include "libssh_cpp_wrap_testing/test_server.hpp"
+
+namespace libssh_wrap::tests
+{
+
+    /**
+     * \return a session targeting \p server via \p port, e.g. the port of a WanProxy forwarding to the server,
+     *         which doesn't read the ssh config of the user
+     */
+    inline Session CreateSession(testing::TestServer const& server, int port)
+    {
+        Session session = Session::Create();
+        session.SetOption(server.Address());
+        session.SetOption(Port{ port });
+        session.SetOption(UserName(server.Options().m_user.c_str()));
+        session.SetOption(ProcessConfig{ false });
+        return session;
+    }
+
+    inline Session CreateSession(testing::TestServer const& server)
+    {
+        return CreateSession(server, server.Port());
+    }
+
+    inline std::shared_ptr<AuthenticatedConnection> Authenticate(testing::TestServer const& server, Connection&& connection)
+    {
+        return std::move(connection).Authenticate(server.Options().m_password.c_str());
+    }
+
+    inline std::shared_ptr<AuthenticatedConnection> Connect(testing::TestServer const& server, int port)
+    {
+        return Authenticate(server, Connection(CreateSession(server, port)));
+    }
+
+    inline std::shared_ptr<AuthenticatedConnection> Connect(testing::TestServer const& server)
+    {
+        return Connect(server, server.Port());
+    }
+
+    /**
+     * \brief a directory below the temp directory, which is removed with its contents on destruction
+     */
+    class TemporaryDirectory
+    {
+    public:
+        TemporaryDirectory()
+        {
+            static std::atomic<unsigned> counter{ 0 };
+            m_path = std::filesystem::temp_directory_path()
+                / ("libssh_cpp_wrap_test_" + std::to_string(getpid()) + '_' + std::to_string(counter++));
+            std::filesystem::remove_all(m_path);
+            std::filesystem::create_directories(m_path);
+        }
+
+        TemporaryDirectory(TemporaryDirectory const&) = delete;
+        TemporaryDirectory& operator=(TemporaryDirectory const&) = delete;
+
+        ~TemporaryDirectory()
+        {
+            std::error_code error;
+            std::filesystem::remove_all(m_path, error);
+        }
+
+        [[nodiscard]] std::filesystem::path const& Path() const noexcept
+        {
+            return m_path;
+        }
+
+    private:
+        std::filesystem::path m_path;
+    };
+
+}
+
+#endif